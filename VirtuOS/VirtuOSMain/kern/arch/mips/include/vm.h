@@ -129,10 +129,7 @@ paddr_t ram_getfirstfree(void);
  */
 
 struct tlbshootdown {
-	/*
-	 * Change this to what you need for your VM design.
-	 */
-	int ts_placeholder;
+	vaddr_t ts_vaddr;	/* page whose mapping changed */
 };
 
 #define TLBSHOOTDOWN_MAX 16
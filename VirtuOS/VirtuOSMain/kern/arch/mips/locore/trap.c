@@ -203,7 +203,17 @@ mips_trap(struct trapframe *tf)
 		}
 
 		curthread->t_in_interrupt = old_in;
-		goto done2;
+		if (iskern) {
+			goto done2;
+		}
+
+		/*
+		 * Back to user mode; sync up the interrupt state as
+		 * below so we can check for exit on the way.
+		 */
+		spl = splhigh();
+		splx(spl);
+		goto done;
 	}
 
 	/*
@@ -323,6 +333,14 @@ mips_trap(struct trapframe *tf)
 	panic("I can't handle this... I think I'll just die now...\n");
 
  done:
+	/*
+	 * If another thread of the process called _exit, don't go
+	 * back to user mode.
+	 */
+	if (!iskern) {
+		proc_checkexit();
+	}
+
 	/*
 	 * Turn interrupts off on the processor, without affecting the
 	 * stored interrupt state.
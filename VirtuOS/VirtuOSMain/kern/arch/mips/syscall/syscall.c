@@ -37,6 +37,7 @@
 #include <current.h>
 #include <copyinout.h>
 #include <syscall.h>
+#include <syscallstat.h>
 
 
 /*
@@ -83,12 +84,14 @@ syscall(struct trapframe *tf)
 	int callno;
 	int32_t retval;
 	int err;
+	SYSCALLSTAT_STARTVAR(start);
 
 	KASSERT(curthread != NULL);
 	KASSERT(curthread->t_curspl == 0);
 	KASSERT(curthread->t_iplhigh_count == 0);
 
 	callno = tf->tf_v0;
+	SYSCALLSTAT_ENTER(callno, start);
 
 	/*
 	 * Initialize retval to 0. Many of the system calls don't
@@ -113,6 +116,11 @@ syscall(struct trapframe *tf)
 				 (userptr_t)tf->tf_a1);
 		break;
 
+	    case SYS_nanosleep:
+		err = sys_nanosleep((const_userptr_t)tf->tf_a0,
+				    (userptr_t)tf->tf_a1);
+		break;
+
 
 	    /* process calls */
 
@@ -120,6 +128,20 @@ syscall(struct trapframe *tf)
 		err = sys_fork(tf, &retval);
 		break;
 
+	    case SYS___thread_create:
+		err = sys___thread_create(tf, (userptr_t)tf->tf_a0,
+					  (userptr_t)tf->tf_a1,
+					  (userptr_t)tf->tf_a2, &retval);
+		break;
+
+	    case SYS___thread_join:
+		err = sys___thread_join(tf->tf_a0, (userptr_t)tf->tf_a1);
+		break;
+
+	    case SYS___thread_exit:
+		sys___thread_exit((userptr_t)tf->tf_a0);
+		panic("Returning from __thread_exit\n");
+
 	    case SYS_execv:
 		err = sys_execv(
 			(userptr_t)tf->tf_a0,
@@ -138,10 +160,91 @@ syscall(struct trapframe *tf)
 			&retval);
 		break;
 
+	    case SYS_waitmany:
+		err = sys_waitmany(
+			(userptr_t)tf->tf_a0,
+			(userptr_t)tf->tf_a1,
+			tf->tf_a2,
+			tf->tf_a3,
+			&retval);
+		break;
+
 	    case SYS_getpid:
 		err = sys_getpid(&retval);
 		break;
 
+	    case SYS_getpriority:
+		err = sys_getpriority(tf->tf_a0, tf->tf_a1, &retval);
+		break;
+
+	    case SYS_setpriority:
+		err = sys_setpriority(tf->tf_a0, tf->tf_a1, tf->tf_a2);
+		break;
+
+	    case SYS_sched_setaffinity:
+		err = sys_sched_setaffinity(tf->tf_a0, tf->tf_a1);
+		break;
+
+	    case SYS_sched_getaffinity:
+		err = sys_sched_getaffinity(tf->tf_a0, (userptr_t)tf->tf_a1);
+		break;
+
+	    case SYS_futex_wait:
+		err = sys_futex_wait((userptr_t)tf->tf_a0, tf->tf_a1,
+				     (const_userptr_t)tf->tf_a2);
+		break;
+
+	    case SYS_futex_wake:
+		err = sys_futex_wake((userptr_t)tf->tf_a0, tf->tf_a1, &retval);
+		break;
+
+	    case SYS_shm_map:
+		err = sys_shm_map((const_userptr_t)tf->tf_a0, tf->tf_a1,
+				  tf->tf_a2, &retval);
+		break;
+
+	    case SYS_shm_unmap:
+		err = sys_shm_unmap((userptr_t)tf->tf_a0);
+		break;
+
+	    case SYS_shm_unlink:
+		err = sys_shm_unlink((const_userptr_t)tf->tf_a0);
+		break;
+
+	    case SYS_ioring_setup:
+		err = sys_ioring_setup(tf->tf_a0, &retval);
+		break;
+
+	    case SYS_ioring_enter:
+		err = sys_ioring_enter(tf->tf_a0, &retval);
+		break;
+
+#if OPT_SYSCALLSTAT
+	    case SYS_sysstat:
+		err = sys_sysstat((userptr_t)tf->tf_a0, tf->tf_a1, &retval);
+		break;
+
+	    case SYS_sysstat_reset:
+		err = sys_sysstat_reset();
+		break;
+
+	    case SYS_systrace:
+		err = sys_systrace(tf->tf_a0, &retval);
+		break;
+
+	    case SYS_systrace_read:
+		err = sys_systrace_read((userptr_t)tf->tf_a0, tf->tf_a1,
+					&retval);
+		break;
+#else
+	    case SYS_sysstat:
+	    case SYS_sysstat_reset:
+	    case SYS_systrace:
+	    case SYS_systrace_read:
+		err = ENOSYS;
+		break;
+#endif
+
 
 	    /* file calls */
 
@@ -178,6 +281,52 @@ syscall(struct trapframe *tf)
 			tf->tf_a2,
 			&retval);
 		break;
+	    case SYS_pread:
+	    case SYS_pwrite:
+		{
+			/*
+			 * The 64-bit position has to go in an aligned
+			 * register pair, so it skips a3 and lands on
+			 * the stack.
+			 */
+			off_t pos;
+
+			err = copyin((userptr_t)tf->tf_sp + 16,
+				     &pos, sizeof(pos));
+			if (err) {
+				break;
+			}
+			if (callno == SYS_pread) {
+				err = sys_pread(tf->tf_a0,
+						(userptr_t)tf->tf_a1,
+						tf->tf_a2, pos, &retval);
+			}
+			else {
+				err = sys_pwrite(tf->tf_a0,
+						 (userptr_t)tf->tf_a1,
+						 tf->tf_a2, pos, &retval);
+			}
+		}
+		break;
+
+	    case SYS_readv:
+		err = sys_readv(tf->tf_a0, (const_userptr_t)tf->tf_a1,
+				tf->tf_a2, &retval);
+		break;
+
+	    case SYS_writev:
+		err = sys_writev(tf->tf_a0, (const_userptr_t)tf->tf_a1,
+				 tf->tf_a2, &retval);
+		break;
+
+	    case SYS_pipe:
+		err = sys_pipe((userptr_t)tf->tf_a0, 0, 0);
+		break;
+
+	    case SYS_pipe2:
+		err = sys_pipe((userptr_t)tf->tf_a0, tf->tf_a1, tf->tf_a2);
+		break;
+
 	    case SYS_lseek:
 		{
 			/*
@@ -245,9 +394,17 @@ syscall(struct trapframe *tf)
 		err = sys_getdirentry(tf->tf_a0, (userptr_t)tf->tf_a1,
 				      tf->tf_a2, &retval);
 		break;
+	    case SYS_getdirentries:
+		err = sys_getdirentries(tf->tf_a0, (userptr_t)tf->tf_a1,
+					tf->tf_a2, &retval);
+		break;
 	    case SYS_fstat:
 		err = sys_fstat(tf->tf_a0, (userptr_t)tf->tf_a1);
 		break;
+	    case SYS_fstatat:
+		err = sys_fstatat(tf->tf_a0, (const_userptr_t)tf->tf_a1,
+				  (userptr_t)tf->tf_a2, tf->tf_a3);
+		break;
 	    case SYS_fsync:
 		err = sys_fsync(tf->tf_a0);
 		break;
@@ -270,6 +427,25 @@ syscall(struct trapframe *tf)
 		}
 		break;
 
+		case SYS_fallocate:
+		{
+			/*
+			 * Two 64-bit arguments: the position goes in
+			 * a2/a3 and the length on the stack.
+			 */
+			uint64_t pos;
+			off_t len;
+
+			join32to64(tf->tf_a2, tf->tf_a3, &pos);
+			err = copyin((userptr_t)tf->tf_sp + 16,
+				     &len, sizeof(len));
+			if (err) {
+				break;
+			}
+			err = sys_fallocate(tf->tf_a0, pos, len);
+		}
+		break;
+
 
 
 	    default:
@@ -278,6 +454,7 @@ syscall(struct trapframe *tf)
 		break;
 	}
 
+	SYSCALLSTAT_EXIT(tf, callno, start, err, retval);
 
 	if (err) {
 		/*
@@ -325,3 +502,22 @@ enter_forked_process(struct trapframe *tf)
 
 	mips_usermode(tf);
 }
+
+/*
+ * Enter user mode in a new thread of the current process. TF is a
+ * copy of the creating thread's trapframe, so registers like gp
+ * carry over; start at ENTRY with ARG as the first argument and the
+ * stack pointer at STACKTOP.
+ */
+void
+enter_new_thread(struct trapframe *tf, vaddr_t entry, vaddr_t arg,
+		 vaddr_t stacktop)
+{
+	tf->tf_epc = entry;
+	tf->tf_t9 = entry;	/* PIC code finds its gp through t9 */
+	tf->tf_a0 = arg;
+	tf->tf_sp = stacktop;
+	tf->tf_ra = 0;
+
+	mips_usermode(tf);
+}
@@ -72,6 +72,8 @@ ram_bootstrap(void)
 	size_t ramsize, frametable_size;
         uint32_t npages, i;
 
+	SPINLOCK_SETNAME(&frame_table_spinlock, "frame_table");
+
 	/* Get size of RAM. */
 	ramsize = mainbus_ramsize();
 
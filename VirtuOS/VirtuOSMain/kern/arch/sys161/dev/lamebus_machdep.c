@@ -76,6 +76,27 @@ mips_timer_set(uint32_t count)
 		:: "r" (count));
 }
 
+/*
+ * The on-chip timer counts cycles in 32 bits; don't ask for more than
+ * this. (It's about 2.5 minutes at 25 MHz.)
+ */
+#define TIMER_MAXNSECS 100000000000ULL
+
+void
+mainbus_settimer(uint64_t nsecs)
+{
+	uint64_t cycles;
+
+	if (nsecs > TIMER_MAXNSECS) {
+		nsecs = TIMER_MAXNSECS;
+	}
+	cycles = nsecs * (CPU_FREQUENCY / 1000000) / 1000;
+	if (cycles == 0) {
+		cycles = 1;
+	}
+	mips_timer_set((uint32_t)cycles);
+}
+
 /*
  * LAMEbus data for the system. (We have only one LAMEbus per system.)
  * This does not need to be locked, because it's constant once
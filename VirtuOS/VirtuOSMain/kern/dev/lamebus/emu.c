@@ -1087,6 +1087,7 @@ static const struct vnode_ops emufs_fileops = {
 	.vop_read = emufs_read,
 	.vop_readlink = emufs_readlink_notlink,
 	.vop_getdirentry = emufs_uio_op_notdir,
+	.vop_getdirentries = emufs_uio_op_notdir,
 	.vop_write = emufs_write,
 	.vop_ioctl = emufs_ioctl,
 	.vop_stat = emufs_stat,
@@ -1095,6 +1096,7 @@ static const struct vnode_ops emufs_fileops = {
 	.vop_fsync = emufs_fsync,
 	.vop_mmap = emufs_mmap,
 	.vop_truncate = emufs_truncate,
+	.vop_fallocate = vopfail_fallocate_nosys,
 	.vop_namefile = emufs_uio_op_notdir,
 
 	.vop_creat = emufs_creat_notdir,
@@ -1121,6 +1123,7 @@ static const struct vnode_ops emufs_dirops = {
 	.vop_read = emufs_uio_op_isdir,
 	.vop_readlink = emufs_uio_op_isdir,
 	.vop_getdirentry = emufs_getdirentry,
+	.vop_getdirentries = vnode_getdirentries,
 	.vop_write = emufs_uio_op_isdir,
 	.vop_ioctl = emufs_ioctl,
 	.vop_stat = emufs_stat,
@@ -1129,6 +1132,7 @@ static const struct vnode_ops emufs_dirops = {
 	.vop_fsync = emufs_void_op_isdir,
 	.vop_mmap = emufs_void_op_isdir,
 	.vop_truncate = emufs_truncate_isdir,
+	.vop_fallocate = vopfail_fallocate_isdir,
 	.vop_namefile = emufs_namefile,
 
 	.vop_creat = emufs_creat,
@@ -36,9 +36,10 @@
 #include <lib.h>
 #include <uio.h>
 #include <membar.h>
-#include <synch.h>
+#include <spinlock.h>
 #include <platform/bus.h>
 #include <vfs.h>
+#include <bio.h>
 #include <lamebus/lhd.h>
 #include "autoconf.h"
 
@@ -96,28 +97,311 @@ int lhd_code_to_errno(struct lhd_softc *lh, int code)
 }
 
 /*
- * Record that an I/O has completed: save the result and poke the
- * completion semaphore.
+ * Seek model, for the statistics. The disk doesn't tell us its
+ * geometry, so assume a fixed number of sectors per track: moving
+ * the head costs a settle time plus a little per track crossed, and
+ * any access that isn't sequential then waits on average half a
+ * rotation for its sector to come around. The rotation speed comes
+ * from the RPM register.
+ */
+#define LHD_SECTPERTRACK	64
+#define LHD_SETTLE_NS		1000000		/* 1 ms */
+#define LHD_TRACK_NS		10000		/* 10 us per track crossed */
+#define LHD_DEFAULT_RPM		3600
+
+/* Largest run of sectors we'll build by merging requests */
+#define LHD_MAXMERGE		128
+
+/* Size of the bounce buffer used by lhd_io, in sectors */
+#define LHD_BOUNCESECT		8
+
+/* Table of attached disks, for lhd_getunit */
+#define LHD_MAXUNITS		8
+static struct lhd_softc *lhd_units[LHD_MAXUNITS];
+
+/*
+ * Modeled time to get from sector FROM to sector TO.
+ */
+static
+uint64_t
+lhd_seekcost(struct lhd_softc *lh, uint32_t from, uint32_t to)
+{
+	uint32_t dist, tracks;
+	uint64_t ns;
+
+	dist = from > to ? from - to : to - from;
+	tracks = dist / LHD_SECTPERTRACK;
+
+	ns = 0;
+	if (tracks > 0) {
+		ns += LHD_SETTLE_NS + (uint64_t)tracks * LHD_TRACK_NS;
+	}
+	/* half a revolution is 30 seconds divided by the rpm */
+	ns += 30000000000ULL / lh->lh_rpm;
+	return ns;
+}
+
+////////////////////////////////////////////////////////////
+// Request queue
+
+/*
+ * Try to merge REQ with a queued request that is adjacent to it on
+ * disk and going the same way. Merged requests are chained together
+ * in sector order and go to the disk as one queue entry. The request
+ * in service (lh_active) is never merged into, since it's partly done.
+ */
+static
+bool
+lhd_merge(struct lhd_softc *lh, struct bio *req)
+{
+	struct bio **pp, *q, *t;
+
+	for (pp = &lh->lh_queue; (q = *pp) != NULL; pp = &q->b_next) {
+		if (q->b_write != req->b_write) {
+			continue;
+		}
+		if (q->b_end - q->b_blkno + req->b_nblocks > LHD_MAXMERGE) {
+			continue;
+		}
+		if (q->b_end == req->b_blkno) {
+			/* REQ goes on the end of Q's chain */
+			for (t = q; t->b_chain != NULL; t = t->b_chain) {
+				/* nothing */
+			}
+			t->b_chain = req;
+			q->b_end = req->b_end;
+			return true;
+		}
+		if (req->b_end == q->b_blkno) {
+			/* REQ goes in front of Q and takes its place */
+			req->b_chain = q;
+			req->b_end = q->b_end;
+			req->b_next = q->b_next;
+			q->b_next = NULL;
+			*pp = req;
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Add REQ to the queue. For the elevator the queue is kept sorted by
+ * sector; in FIFO mode new requests go on the end and aren't merged,
+ * so that it behaves like the old one-at-a-time driver.
+ */
+static
+void
+lhd_enqueue(struct lhd_softc *lh, struct bio *req)
+{
+	struct bio **pp;
+
+	KASSERT(spinlock_do_i_hold(&lh->lh_lock));
+
+	if (!lh->lh_fifo && lhd_merge(lh, req)) {
+		lh->lh_stats.ls_merges++;
+		return;
+	}
+
+	pp = &lh->lh_queue;
+	if (lh->lh_fifo) {
+		while (*pp != NULL) {
+			pp = &(*pp)->b_next;
+		}
+	}
+	else {
+		while (*pp != NULL && (*pp)->b_blkno <= req->b_blkno) {
+			pp = &(*pp)->b_next;
+		}
+	}
+	req->b_next = *pp;
+	*pp = req;
+}
+
+/*
+ * Choose the next queue entry to service and take it off the queue.
+ *
+ * C-LOOK: take the lowest-numbered request past the head position;
+ * if there isn't one, go back to the lowest-numbered request overall.
+ * The head only sweeps in one direction, which keeps the wait for any
+ * one request bounded by a single pass over the disk. Don't rely on
+ * the queue being sorted; it isn't if lhd_setfifo was used recently.
+ */
+static
+struct bio *
+lhd_dequeue(struct lhd_softc *lh)
+{
+	struct bio **pp, **best, **lowest, *req;
+	uint32_t sector;
+
+	KASSERT(spinlock_do_i_hold(&lh->lh_lock));
+
+	if (lh->lh_queue == NULL) {
+		return NULL;
+	}
+
+	if (lh->lh_fifo) {
+		best = &lh->lh_queue;
+	}
+	else {
+		best = lowest = NULL;
+		for (pp = &lh->lh_queue; *pp != NULL; pp = &(*pp)->b_next) {
+			sector = (*pp)->b_blkno;
+			if (sector > lh->lh_headpos &&
+			    (best == NULL || sector < (*best)->b_blkno)) {
+				best = pp;
+			}
+			if (lowest == NULL || sector < (*lowest)->b_blkno) {
+				lowest = pp;
+			}
+		}
+		if (best == NULL) {
+			best = lowest;
+		}
+	}
+
+	req = *best;
+	*best = req->b_next;
+	req->b_next = NULL;
+	return req;
+}
+
+/*
+ * Start the transfer of sector lh_cursect of request lh_cur.
+ */
+static
+void
+lhd_startsector(struct lhd_softc *lh)
+{
+	struct bio *req = lh->lh_cur;
+	uint32_t statval = LHD_WORKING;
+	char *data;
+
+	KASSERT(spinlock_do_i_hold(&lh->lh_lock));
+
+	/* If writing, transfer the data to the on-card buffer. */
+	if (req->b_write) {
+		data = req->b_data;
+		data += (lh->lh_cursect - req->b_blkno) * LHD_SECTSIZE;
+		memcpy(lh->lh_buf, data, LHD_SECTSIZE);
+		membar_store_store();
+		statval |= LHD_ISWRITE;
+	}
+
+	/* Tell it what sector we want... */
+	lhd_wreg(lh, LHD_REG_SECT, lh->lh_cursect);
+
+	/* and start the operation. */
+	lhd_wreg(lh, LHD_REG_STAT, statval);
+}
+
+/*
+ * If the disk is idle, start on the next queue entry.
  */
 static
 void
-lhd_iodone(struct lhd_softc *lh, int err)
+lhd_dispatch(struct lhd_softc *lh)
+{
+	struct bio *req;
+
+	KASSERT(spinlock_do_i_hold(&lh->lh_lock));
+
+	if (lh->lh_active != NULL) {
+		return;
+	}
+	req = lhd_dequeue(lh);
+	if (req == NULL) {
+		return;
+	}
+
+	lh->lh_stats.ls_dispatches++;
+	if (req->b_blkno != lh->lh_headpos + 1) {
+		lh->lh_stats.ls_seeks++;
+		lh->lh_stats.ls_seekdist += req->b_blkno > lh->lh_headpos ?
+			req->b_blkno - lh->lh_headpos :
+			lh->lh_headpos - req->b_blkno;
+		lh->lh_stats.ls_seekns +=
+			lhd_seekcost(lh, lh->lh_headpos, req->b_blkno);
+	}
+
+	lh->lh_active = req;
+	lh->lh_cur = req;
+	lh->lh_cursect = req->b_blkno;
+	lhd_startsector(lh);
+}
+
+/*
+ * The disk finished the sector in flight with result RESULT. Save the
+ * data and start the next sector. Returns the request in flight if it
+ * is now complete, or NULL.
+ */
+static
+struct bio *
+lhd_sectordone(struct lhd_softc *lh, int result)
 {
-	lh->lh_result = err;
-	V(lh->lh_done);
+	struct bio *req = lh->lh_cur;
+	char *data;
+
+	KASSERT(spinlock_do_i_hold(&lh->lh_lock));
+
+	if (req == NULL) {
+		/* Nothing was in flight. */
+		return NULL;
+	}
+
+	lh->lh_headpos = lh->lh_cursect;
+
+	if (result == 0) {
+		/* If reading, transfer the data out of the on-card buffer. */
+		if (!req->b_write) {
+			membar_load_load();
+			data = req->b_data;
+			data += (lh->lh_cursect - req->b_blkno) *
+				LHD_SECTSIZE;
+			memcpy(data, lh->lh_buf, LHD_SECTSIZE);
+		}
+		lh->lh_stats.ls_sectors++;
+		lh->lh_cursect++;
+		if (lh->lh_cursect < req->b_blkno + req->b_nblocks) {
+			lhd_startsector(lh);
+			return NULL;
+		}
+	}
+	else {
+		req->b_error = result;
+	}
+
+	/* This request is done; go on to the next one in its chain. */
+	lh->lh_cur = req->b_chain;
+	req->b_chain = NULL;
+	lh->lh_depth--;
+
+	if (lh->lh_cur != NULL) {
+		lh->lh_cursect = lh->lh_cur->b_blkno;
+		lhd_startsector(lh);
+	}
+	else {
+		lh->lh_active = NULL;
+		lhd_dispatch(lh);
+	}
+	return req;
 }
 
 /*
  * Interrupt handler for lhd.
  * Read the status register; if an operation finished, clear the status
- * register and report completion.
+ * register, start the next one, and report completion. The completion
+ * callback is made without the lock held.
  */
 void
 lhd_irq(void *vlh)
 {
 	struct lhd_softc *lh = vlh;
+	struct bio *done = NULL;
 	uint32_t val;
 
+	spinlock_acquire(&lh->lh_lock);
+
 	val = lhd_rdreg(lh, LHD_REG_STAT);
 
 	switch (val & LHD_STATEMASK) {
@@ -128,9 +412,149 @@ lhd_irq(void *vlh)
 	    case LHD_INVSECT:
 	    case LHD_MEDIA:
 		lhd_wreg(lh, LHD_REG_STAT, 0);
-		lhd_iodone(lh, lhd_code_to_errno(lh, val));
+		done = lhd_sectordone(lh, lhd_code_to_errno(lh, val));
 		break;
 	}
+
+	spinlock_release(&lh->lh_lock);
+
+	if (done != NULL) {
+		bio_done(done, done->b_error);
+	}
+}
+
+/*
+ * Strategy function: queue a list of transfers. Bad ones are failed
+ * with EINVAL without going on the queue. The whole list goes in
+ * before the disk is started, so the first dispatch already sees
+ * all of it.
+ */
+static
+void
+lhd_strategy(struct device *d, struct bio *list)
+{
+	struct lhd_softc *lh = d->d_data;
+	uint32_t nblocks = lh->lh_dev.d_blocks;
+	struct bio *b, *next, *bad = NULL;
+
+	spinlock_acquire(&lh->lh_lock);
+
+	for (b = list; b != NULL; b = next) {
+		next = b->b_next;
+		b->b_next = NULL;
+		b->b_chain = NULL;
+		b->b_end = b->b_blkno + b->b_nblocks;
+		b->b_error = 0;
+
+		if (b->b_nblocks == 0 || b->b_blkno >= nblocks ||
+		    b->b_nblocks > nblocks - b->b_blkno) {
+			b->b_next = bad;
+			bad = b;
+			continue;
+		}
+
+		lh->lh_depth++;
+		lh->lh_stats.ls_requests++;
+		lh->lh_stats.ls_depthsum += lh->lh_depth;
+		if (lh->lh_depth > lh->lh_stats.ls_maxdepth) {
+			lh->lh_stats.ls_maxdepth = lh->lh_depth;
+		}
+
+		lhd_enqueue(lh, b);
+	}
+	lhd_dispatch(lh);
+
+	spinlock_release(&lh->lh_lock);
+
+	for (b = bad; b != NULL; b = next) {
+		next = b->b_next;
+		b->b_next = NULL;
+		bio_done(b, EINVAL);
+	}
+}
+
+/*
+ * Queue a transfer and wait for it.
+ */
+static
+int
+lhd_syncio(struct lhd_softc *lh, uint32_t sector, uint32_t nsect,
+	   bool write, void *data)
+{
+	struct bio b;
+
+	bio_init(&b, &lh->lh_dev, sector, nsect, data, write);
+	bio_submit(&b);
+	return bio_wait(&b);
+}
+
+////////////////////////////////////////////////////////////
+// Queue control and statistics
+
+struct lhd_softc *
+lhd_getunit(int unit)
+{
+	if (unit < 0 || unit >= LHD_MAXUNITS) {
+		return NULL;
+	}
+	return lhd_units[unit];
+}
+
+bool
+lhd_setfifo(struct lhd_softc *lh, bool fifo)
+{
+	bool ret;
+
+	spinlock_acquire(&lh->lh_lock);
+	ret = lh->lh_fifo;
+	lh->lh_fifo = fifo;
+	spinlock_release(&lh->lh_lock);
+	return ret;
+}
+
+void
+lhd_getstats(struct lhd_softc *lh, struct lhd_stats *ret)
+{
+	spinlock_acquire(&lh->lh_lock);
+	*ret = lh->lh_stats;
+	spinlock_release(&lh->lh_lock);
+}
+
+void
+lhd_printstats(void)
+{
+	struct lhd_softc *lh;
+	struct lhd_stats st;
+	unsigned depth, avg100;
+	bool fifo;
+	int i;
+
+	for (i=0; i<LHD_MAXUNITS; i++) {
+		lh = lhd_units[i];
+		if (lh == NULL) {
+			continue;
+		}
+
+		spinlock_acquire(&lh->lh_lock);
+		st = lh->lh_stats;
+		depth = lh->lh_depth;
+		fifo = lh->lh_fifo;
+		spinlock_release(&lh->lh_lock);
+
+		avg100 = st.ls_requests == 0 ? 0 :
+			st.ls_depthsum * 100 / st.ls_requests;
+
+		kprintf("lhd%d: %s, %u rpm\n", i,
+			fifo ? "fifo" : "c-look", lh->lh_rpm);
+		kprintf("lhd%d: %llu requests, %llu merged, %llu dispatched, "
+			"%llu sectors\n", i, st.ls_requests, st.ls_merges,
+			st.ls_dispatches, st.ls_sectors);
+		kprintf("lhd%d: queue depth %u now, %u max, %u.%02u average\n",
+			i, depth, st.ls_maxdepth, avg100 / 100, avg100 % 100);
+		kprintf("lhd%d: %llu seeks, %llu sectors of travel, "
+			"%llu ms modeled seek time\n", i, st.ls_seeks,
+			st.ls_seekdist, st.ls_seekns / 1000000);
+	}
 }
 
 /*
@@ -181,6 +605,11 @@ lhd_reset(struct lhd_softc *lh)
 
 /*
  * I/O function (for both reads and writes)
+ *
+ * Kernel buffers that are all in one piece are handed to the queue
+ * as they are; anything else goes through a bounce buffer, since the
+ * transfer happens in the interrupt handler where we can't touch
+ * user memory.
  */
 static
 int
@@ -192,9 +621,12 @@ lhd_io(struct device *d, struct uio *uio)
 	uint32_t sectoff = uio->uio_offset % LHD_SECTSIZE;
 	uint32_t len = uio->uio_resid / LHD_SECTSIZE;
 	uint32_t lenoff = uio->uio_resid % LHD_SECTSIZE;
-	uint32_t i;
-	uint32_t statval = LHD_WORKING;
-	int result;
+	bool write = uio->uio_rw == UIO_WRITE;
+	struct iovec *iov;
+	void *bounce = NULL;
+	uint32_t n;
+	size_t bytes;
+	int result = 0;
 
 	/* Don't allow I/O that isn't sector-aligned. */
 	if (sectoff != 0 || lenoff != 0) {
@@ -207,67 +639,65 @@ lhd_io(struct device *d, struct uio *uio)
 		return EINVAL;
 	}
 
-	/* Set up the value to write into the status register. */
-	if (uio->uio_rw==UIO_WRITE) {
-		statval |= LHD_ISWRITE;
+	iov = uio->uio_iov;
+	if (uio->uio_segflg == UIO_SYSSPACE && uio->uio_iovcnt == 1 &&
+	    iov->iov_len >= uio->uio_resid) {
+		if (len == 0) {
+			return 0;
+		}
+		result = lhd_syncio(lh, sector, len, write, iov->iov_kbase);
+		if (result) {
+			return result;
+		}
+		bytes = len * LHD_SECTSIZE;
+		iov->iov_kbase = (char *)iov->iov_kbase + bytes;
+		iov->iov_len -= bytes;
+		uio->uio_offset += bytes;
+		uio->uio_resid -= bytes;
+		return 0;
 	}
 
-	/* Loop over all the sectors we were asked to do. */
-	for (i=0; i<len; i++) {
+	if (len > 0) {
+		bounce = kmalloc(LHD_BOUNCESECT * LHD_SECTSIZE);
+		if (bounce == NULL) {
+			return ENOMEM;
+		}
+	}
 
-		/* Wait until nobody else is using the device. */
-		P(lh->lh_clear);
+	while (len > 0) {
+		n = len < LHD_BOUNCESECT ? len : LHD_BOUNCESECT;
+		bytes = n * LHD_SECTSIZE;
 
-		/*
-		 * Are we writing? If so, transfer the data to the
-		 * on-card buffer.
-		 */
-		if (uio->uio_rw == UIO_WRITE) {
-			result = uiomove(lh->lh_buf, LHD_SECTSIZE, uio);
-			membar_store_store();
+		if (write) {
+			result = uiomove(bounce, bytes, uio);
 			if (result) {
-				V(lh->lh_clear);
-				return result;
+				break;
 			}
 		}
-
-		/* Tell it what sector we want... */
-		lhd_wreg(lh, LHD_REG_SECT, sector+i);
-
-		/* and start the operation. */
-		lhd_wreg(lh, LHD_REG_STAT, statval);
-
-		/* Now wait until the interrupt handler tells us we're done. */
-		P(lh->lh_done);
-
-		/* Get the result value saved by the interrupt handler. */
-		result = lh->lh_result;
-
-		/*
-		 * Are we reading? If so, and if we succeeded,
-		 * transfer the data out of the on-card buffer.
-		 */
-		if (result==0 && uio->uio_rw==UIO_READ) {
-			membar_load_load();
-			result = uiomove(lh->lh_buf, LHD_SECTSIZE, uio);
-		}
-
-		/* Tell another thread it's cleared to go ahead. */
-		V(lh->lh_clear);
-
-		/* If we failed, return the error. */
+		result = lhd_syncio(lh, sector, n, write, bounce);
 		if (result) {
-			return result;
+			break;
 		}
+		if (!write) {
+			result = uiomove(bounce, bytes, uio);
+			if (result) {
+				break;
+			}
+		}
+
+		sector += n;
+		len -= n;
 	}
 
-	return 0;
+	kfree(bounce);
+	return result;
 }
 
 static const struct device_ops lhd_devops = {
 	.devop_eachopen = lhd_eachopen,
 	.devop_io = lhd_io,
 	.devop_ioctl = lhd_ioctl,
+	.devop_strategy = lhd_strategy,
 };
 
 /*
@@ -284,16 +714,25 @@ config_lhd(struct lhd_softc *lh, int lhdno)
 	/* Get a pointer to the on-chip buffer. */
 	lh->lh_buf = bus_map_area(lh->lh_busdata, lh->lh_buspos, LHD_BUFFER);
 
-	/* Create the semaphores. */
-	lh->lh_clear = sem_create("lhd-clear", 1);
-	if (lh->lh_clear == NULL) {
-		return ENOMEM;
+	/* Set up the request queue. */
+	spinlock_init(&lh->lh_lock);
+	lh->lh_queue = NULL;
+	lh->lh_active = NULL;
+	lh->lh_cur = NULL;
+	lh->lh_cursect = 0;
+	lh->lh_headpos = 0;
+	lh->lh_depth = 0;
+	lh->lh_fifo = false;
+	bzero(&lh->lh_stats, sizeof(lh->lh_stats));
+
+	/* Get the rotation speed for the seek model. */
+	lh->lh_rpm = lhd_rdreg(lh, LHD_REG_RPM);
+	if (lh->lh_rpm == 0) {
+		lh->lh_rpm = LHD_DEFAULT_RPM;
 	}
-	lh->lh_done = sem_create("lhd-done", 0);
-	if (lh->lh_done == NULL) {
-		sem_destroy(lh->lh_clear);
-		lh->lh_clear = NULL;
-		return ENOMEM;
+
+	if (lhdno < LHD_MAXUNITS) {
+		lhd_units[lhdno] = lh;
 	}
 
 	/* Set up the VFS device structure. */
@@ -31,12 +31,31 @@
 #define _LAMEBUS_LHD_H_
 
 #include <device.h>
+#include <spinlock.h>
+
+struct bio;	/* in <bio.h> */
 
 /*
  * Our sector size
  */
 #define LHD_SECTSIZE  512
 
+/*
+ * Per-disk statistics. The queue depth counts requests submitted
+ * and not yet completed, including the one in service.
+ */
+struct lhd_stats {
+	uint64_t ls_requests;		/* Requests submitted */
+	uint64_t ls_merges;		/* ...that were merged into another */
+	uint64_t ls_dispatches;		/* Queue entries sent to the disk */
+	uint64_t ls_sectors;		/* Sectors transferred */
+	uint64_t ls_seeks;		/* Dispatches that moved the head */
+	uint64_t ls_seekdist;		/* Total head travel, in sectors */
+	uint64_t ls_seekns;		/* Modeled positioning time */
+	uint64_t ls_depthsum;		/* Sum of queue depth at each submit */
+	unsigned ls_maxdepth;		/* Highest queue depth seen */
+};
+
 /*
  * Hardware device data associated with lhd (LAMEbus hard disk)
  */
@@ -51,9 +70,17 @@ struct lhd_softc {
 	 */
 
 	void *lh_buf;			/* Pointer to on-card I/O buffer */
-	int lh_result;			/* Result from I/O operation */
-	struct semaphore *lh_clear;	/* Synchronization */
-	struct semaphore *lh_done;
+	uint32_t lh_rpm;		/* Rotation speed, for the seek model */
+
+	struct spinlock lh_lock;	/* Protects everything below */
+	struct bio *lh_queue;		/* Pending requests */
+	struct bio *lh_active;		/* Request chain in service */
+	struct bio *lh_cur;		/* Member of lh_active in flight */
+	uint32_t lh_cursect;		/* Sector in flight */
+	uint32_t lh_headpos;		/* Last sector transferred */
+	unsigned lh_depth;		/* Requests not yet completed */
+	bool lh_fifo;			/* Serve in arrival order */
+	struct lhd_stats lh_stats;
 
 	struct device lh_dev;		/* VFS device structure */
 };
@@ -61,4 +88,19 @@ struct lhd_softc {
 /* Functions called by lower-level drivers */
 void lhd_irq(/*struct lhd_softc*/ void *);	/* Interrupt handler */
 
+/*
+ * Request queue control. Requests themselves come in through
+ * devop_strategy (see bio.h).
+ *
+ *    lhd_getunit    - Return lhd number UNIT, or NULL if there isn't one.
+ *    lhd_setfifo    - Turn elevator ordering off (true) or on (false).
+ *                     Returns the previous setting.
+ *    lhd_getstats   - Copy out the statistics for a disk.
+ *    lhd_printstats - Print statistics for all disks.
+ */
+struct lhd_softc *lhd_getunit(int unit);
+bool lhd_setfifo(struct lhd_softc *lh, bool fifo);
+void lhd_getstats(struct lhd_softc *lh, struct lhd_stats *ret);
+void lhd_printstats(void);
+
 #endif /* _LAMEBUS_LHD_H_ */
@@ -115,7 +115,7 @@ semfs_destroy(struct semfs *semfs)
 	lock_destroy(semfs->semfs_dirlock);
 	semfs_semarray_destroy(semfs->semfs_sems);
 	vnodearray_destroy(semfs->semfs_vnodes);
-	lock_destroy(semfs->semfs_tablelock);
+	rwlock_destroy(semfs->semfs_tablelock);
 	kfree(semfs);
 }
 
@@ -129,13 +129,13 @@ semfs_unmount(struct fs *fs)
 {
 	struct semfs *semfs = fs->fs_data;
 
-	lock_acquire(semfs->semfs_tablelock);
+	rwlock_acquire_write(semfs->semfs_tablelock);
 	if (vnodearray_num(semfs->semfs_vnodes) > 0) {
-		lock_release(semfs->semfs_tablelock);
+		rwlock_release_write(semfs->semfs_tablelock);
 		return EBUSY;
 	}
 
-	lock_release(semfs->semfs_tablelock);
+	rwlock_release_write(semfs->semfs_tablelock);
 	semfs_destroy(semfs);
 
 	return 0;
@@ -165,7 +165,7 @@ semfs_create(void)
 		goto fail_total;
 	}
 
-	semfs->semfs_tablelock = lock_create("semfs_table");
+	semfs->semfs_tablelock = rwlock_create("semfs_table");
 	if (semfs->semfs_tablelock == NULL) {
 		goto fail_semfs;
 	}
@@ -198,7 +198,7 @@ semfs_create(void)
  fail_vnodes:
 	vnodearray_destroy(semfs->semfs_vnodes);
  fail_tablelock:
-	lock_destroy(semfs->semfs_tablelock);
+	rwlock_destroy(semfs->semfs_tablelock);
  fail_semfs:
 	kfree(semfs);
  fail_total:
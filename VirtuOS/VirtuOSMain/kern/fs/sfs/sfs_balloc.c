@@ -33,8 +33,10 @@
  * Block allocation.
  */
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
 #include <bitmap.h>
+#include <vfs.h>
 #include <sfs.h>
 #include "sfsprivate.h"
 
@@ -52,32 +54,295 @@ sfs_clearblock(struct sfs_fs *sfs, daddr_t block)
 }
 
 /*
- * Allocate a block.
+ * Number of blocks reserved ahead of a file that is growing
+ * sequentially. The reservation lives only in memory (in
+ * sfs_reservemap); it keeps other files' allocations from landing
+ * in the middle of this one, so files written in parallel don't
+ * interleave on disk.
  */
+#define SFS_PREALLOC_BLOCKS 16
+
+/*
+ * Check if a block is available: neither in use nor reserved.
+ */
+static
+bool
+sfs_bavail(struct sfs_fs *sfs, daddr_t block)
+{
+	return !bitmap_isset(sfs->sfs_freemap, block) &&
+		!bitmap_isset(sfs->sfs_reservemap, block);
+}
+
+/*
+ * Find an available block, searching forward from GOAL and wrapping
+ * around at the end of the volume.
+ */
+static
 int
-sfs_balloc(struct sfs_fs *sfs, daddr_t *diskblock)
+sfs_findfree(struct sfs_fs *sfs, daddr_t goal, daddr_t *ret)
 {
-	int result;
+	uint32_t nblocks = sfs->sfs_sb.sb_nblocks;
+	uint32_t i;
+	daddr_t block;
 
-	result = bitmap_alloc(sfs->sfs_freemap, diskblock);
-	if (result) {
-		return result;
+	if (goal >= nblocks) {
+		goal = 0;
+	}
+	for (i=0; i<nblocks; i++) {
+		block = goal + i;
+		if (block >= nblocks) {
+			block -= nblocks;
+		}
+		if (sfs_bavail(sfs, block)) {
+			*ret = block;
+			return 0;
+		}
+	}
+	return ENOSPC;
+}
+
+/*
+ * Find a run of NUM available blocks, searching forward from GOAL.
+ * If there isn't one that long, hand back the longest one seen.
+ */
+static
+int
+sfs_findrun(struct sfs_fs *sfs, daddr_t goal, uint32_t num,
+	    daddr_t *ret, uint32_t *retnum)
+{
+	uint32_t nblocks = sfs->sfs_sb.sb_nblocks;
+	daddr_t block, runstart = 0, beststart = 0;
+	uint32_t runlen = 0, bestlen = 0;
+
+	if (goal >= nblocks) {
+		goal = 0;
+	}
+	/* runs don't wrap, so scan from goal to the end, then the start */
+	for (block = goal; block < nblocks; block++) {
+		if (!sfs_bavail(sfs, block)) {
+			runlen = 0;
+			continue;
+		}
+		if (runlen == 0) {
+			runstart = block;
+		}
+		runlen++;
+		if (runlen > bestlen) {
+			beststart = runstart;
+			bestlen = runlen;
+			if (bestlen == num) {
+				goto found;
+			}
+		}
+	}
+	runlen = 0;
+	for (block = 0; block < goal; block++) {
+		if (!sfs_bavail(sfs, block)) {
+			runlen = 0;
+			continue;
+		}
+		if (runlen == 0) {
+			runstart = block;
+		}
+		runlen++;
+		if (runlen > bestlen) {
+			beststart = runstart;
+			bestlen = runlen;
+			if (bestlen == num) {
+				goto found;
+			}
+		}
+	}
+	if (bestlen == 0) {
+		return ENOSPC;
+	}
+ found:
+	*ret = beststart;
+	*retnum = bestlen;
+	return 0;
+}
+
+/*
+ * Drop every file's preallocation window. Used when the disk is
+ * otherwise full, so reservations never cause ENOSPC.
+ */
+static
+void
+sfs_prealloc_releaseall(struct sfs_fs *sfs)
+{
+	unsigned i, num;
+
+	num = vnodearray_num(sfs->sfs_vnodes);
+	for (i=0; i<num; i++) {
+		struct vnode *v = vnodearray_get(sfs->sfs_vnodes, i);
+		sfs_prealloc_release(v->vn_data);
+	}
+}
+
+/*
+ * Note that the freemap block holding the bit for BLOCK has changed,
+ * so sfs_sync writes that block and no others.
+ */
+static
+void
+sfs_freemap_touch(struct sfs_fs *sfs, daddr_t block)
+{
+	unsigned fmblock = block / SFS_BITSPERBLOCK;
+
+	if (!bitmap_isset(sfs->sfs_freemapdirtymap, fmblock)) {
+		bitmap_mark(sfs->sfs_freemapdirtymap, fmblock);
 	}
 	sfs->sfs_freemapdirty = true;
+}
 
-	if (*diskblock >= sfs->sfs_sb.sb_nblocks) {
+/*
+ * Mark BLOCK in use and zero it.
+ */
+static
+int
+sfs_btake(struct sfs_fs *sfs, daddr_t block)
+{
+	int result;
+
+	if (block >= sfs->sfs_sb.sb_nblocks) {
 		panic("sfs: %s: balloc: invalid block %u\n",
-		      sfs->sfs_sb.sb_volname, *diskblock);
+		      sfs->sfs_sb.sb_volname, block);
 	}
 
+	bitmap_mark(sfs->sfs_freemap, block);
+	sfs_freemap_touch(sfs, block);
+
 	/* Clear block before returning it */
-	result = sfs_clearblock(sfs, *diskblock);
+	result = sfs_clearblock(sfs, block);
 	if (result) {
-		bitmap_unmark(sfs->sfs_freemap, *diskblock);
+		bitmap_unmark(sfs->sfs_freemap, block);
 	}
 	return result;
 }
 
+/*
+ * Allocate a block, preferring GOAL or the first available block
+ * after it. Pass 0 for no preference.
+ */
+int
+sfs_balloc(struct sfs_fs *sfs, daddr_t goal, daddr_t *diskblock)
+{
+	int result;
+
+	result = sfs_findfree(sfs, goal, diskblock);
+	if (result == ENOSPC) {
+		/* Out of unreserved space; reservations are only hints */
+		sfs_prealloc_releaseall(sfs);
+		result = sfs_findfree(sfs, goal, diskblock);
+	}
+	if (result) {
+		return result;
+	}
+
+	return sfs_btake(sfs, *diskblock);
+}
+
+/*
+ * Allocate a data block for file SV. GOAL is the block after the
+ * file's previous block (0 if none).
+ *
+ * If the file has a preallocation window, allocate from it; the
+ * window is where the file has been growing (or where fallocate put
+ * it). Otherwise allocate near the goal and open a new window right
+ * after the block we got.
+ */
+int
+sfs_balloc_file(struct sfs_vnode *sv, daddr_t goal, daddr_t *diskblock)
+{
+	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	daddr_t block;
+	uint32_t num;
+	int result;
+
+	if (sv->sv_pa_count > 0) {
+		block = sv->sv_pa_next;
+		KASSERT(bitmap_isset(sfs->sfs_reservemap, block));
+		bitmap_unmark(sfs->sfs_reservemap, block);
+		sv->sv_pa_next++;
+		sv->sv_pa_count--;
+
+		result = sfs_btake(sfs, block);
+		if (result) {
+			return result;
+		}
+		*diskblock = block;
+		return 0;
+	}
+
+	if (goal == 0) {
+		/* start new files near their inode */
+		goal = sv->sv_ino + 1;
+	}
+
+	result = sfs_balloc(sfs, goal, diskblock);
+	if (result) {
+		return result;
+	}
+
+	/* Reserve what's available right after it, up to the limit */
+	for (num = 0; num < SFS_PREALLOC_BLOCKS; num++) {
+		block = *diskblock + 1 + num;
+		if (block >= sfs->sfs_sb.sb_nblocks ||
+		    !sfs_bavail(sfs, block)) {
+			break;
+		}
+		bitmap_mark(sfs->sfs_reservemap, block);
+	}
+	sv->sv_pa_next = *diskblock + 1;
+	sv->sv_pa_count = num;
+
+	return 0;
+}
+
+/*
+ * Replace SV's preallocation window with one of up to NUM contiguous
+ * blocks, searching forward from GOAL. Used by fallocate. Returns
+ * the number of blocks actually reserved in RETNUM; this may be less
+ * than NUM if there's no run that long.
+ */
+int
+sfs_prealloc(struct sfs_vnode *sv, daddr_t goal, uint32_t num,
+	     uint32_t *retnum)
+{
+	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	daddr_t start;
+	uint32_t i;
+	int result;
+
+	sfs_prealloc_release(sv);
+
+	result = sfs_findrun(sfs, goal, num, &start, retnum);
+	if (result) {
+		return result;
+	}
+	for (i=0; i<*retnum; i++) {
+		bitmap_mark(sfs->sfs_reservemap, start + i);
+	}
+	sv->sv_pa_next = start;
+	sv->sv_pa_count = *retnum;
+	return 0;
+}
+
+/*
+ * Give back whatever is left of SV's preallocation window.
+ */
+void
+sfs_prealloc_release(struct sfs_vnode *sv)
+{
+	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+
+	while (sv->sv_pa_count > 0) {
+		bitmap_unmark(sfs->sfs_reservemap, sv->sv_pa_next);
+		sv->sv_pa_next++;
+		sv->sv_pa_count--;
+	}
+}
+
 /*
  * Free a block.
  */
@@ -85,7 +350,7 @@ void
 sfs_bfree(struct sfs_fs *sfs, daddr_t diskblock)
 {
 	bitmap_unmark(sfs->sfs_freemap, diskblock);
-	sfs->sfs_freemapdirty = true;
+	sfs_freemap_touch(sfs, diskblock);
 }
 
 /*
@@ -39,11 +39,18 @@
 #include <sfs.h>
 #include "sfsprivate.h"
 
+/*
+ * Allocation goal for a new block following PREV in a file: the next
+ * disk block, or no preference (0) if PREV isn't allocated.
+ */
+#define SFS_GOAL(prev) ((prev) == 0 ? 0 : (prev) + 1)
+
 /*
  * Look up the disk block number (from 0 up to the number of blocks on
  * the disk) given a file and the logical block number within that
  * file. If DOALLOC is set, and no such block exists, one will be
- * allocated.
+ * allocated, trying to place it right after the previous block of
+ * the file.
  */
 int
 sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
@@ -82,14 +89,18 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 		 * Do we need to allocate?
 		 */
 		if (block==0 && doalloc) {
-			result = sfs_balloc(sfs, &block);
+			daddr_t goal;
+
+			goal = fileblock == 0 ? 0 :
+				SFS_GOAL(sv->sv_i.sfi_direct[fileblock-1]);
+			result = sfs_balloc_file(sv, goal, &block);
 			if (result) {
 				return result;
 			}
 
 			/* Remember what we allocated; mark inode dirty */
 			sv->sv_i.sfi_direct[fileblock] = block;
-			sv->sv_dirty = true;
+			sfs_markdirty(sv);
 		}
 
 		/*
@@ -143,7 +154,8 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 		 * the indirect block. Thus, we need to allocate an
 		 * indirect block.
 		 */
-		result = sfs_balloc(sfs, &idblock);
+		result = sfs_balloc(sfs,
+			SFS_GOAL(sv->sv_i.sfi_direct[SFS_NDIRECT-1]), &idblock);
 		if (result) {
 			return result;
 		}
@@ -152,7 +164,7 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 		sv->sv_i.sfi_indirect = idblock;
 
 		/* Mark the inode dirty */
-		sv->sv_dirty = true;
+		sfs_markdirty(sv);
 
 		/* Clear the indirect block buffer */
 		bzero(idbuf, sizeof(idbuf));
@@ -172,7 +184,11 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 
 	/* If there's no block there, allocate one */
 	if (block==0 && doalloc) {
-		result = sfs_balloc(sfs, &block);
+		daddr_t goal;
+
+		goal = idoff == 0 ? SFS_GOAL(sv->sv_i.sfi_direct[SFS_NDIRECT-1]) :
+			SFS_GOAL(idbuf[idoff-1]);
+		result = sfs_balloc_file(sv, goal, &block);
 		if (result) {
 			return result;
 		}
@@ -227,6 +243,9 @@ sfs_itrunc(struct sfs_vnode *sv, off_t len)
 
 	vfs_biglock_acquire();
 
+	/* The window was placed for the old size; let it go. */
+	sfs_prealloc_release(sv);
+
 	/*
 	 * Go through the direct blocks. Discard any that are
 	 * past the limit we're truncating to.
@@ -236,7 +255,7 @@ sfs_itrunc(struct sfs_vnode *sv, off_t len)
 		if (i >= blocklen && block != 0) {
 			sfs_bfree(sfs, block);
 			sv->sv_i.sfi_direct[i] = 0;
-			sv->sv_dirty = true;
+			sfs_markdirty(sv);
 		}
 	}
 
@@ -278,7 +297,7 @@ sfs_itrunc(struct sfs_vnode *sv, off_t len)
 			/* The whole indirect block is empty now; free it */
 			sfs_bfree(sfs, idblock);
 			sv->sv_i.sfi_indirect = 0;
-			sv->sv_dirty = true;
+			sfs_markdirty(sv);
 		}
 		else if (iddirty) {
 			/* The indirect block is dirty; write it back */
@@ -295,7 +314,7 @@ sfs_itrunc(struct sfs_vnode *sv, off_t len)
 	sv->sv_i.sfi_size = len;
 
 	/* Mark the inode dirty */
-	sv->sv_dirty = true;
+	sfs_markdirty(sv);
 
 	vfs_biglock_release();
 	return 0;
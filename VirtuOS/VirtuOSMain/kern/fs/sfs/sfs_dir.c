@@ -34,11 +34,15 @@
  */
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/dirent.h>
 #include <lib.h>
 #include <vfs.h>
 #include <sfs.h>
 #include "sfsprivate.h"
 
+/* Number of directory entries in one block. */
+#define SFS_DIRPERBLOCK (SFS_BLOCKSIZE / sizeof(struct sfs_direntry))
+
 /*
  * Read the directory entry out of slot SLOT of a directory vnode.
  * The "slot" is the index of the directory entry, starting at 0.
@@ -146,6 +150,109 @@ sfs_dir_findname(struct sfs_vnode *sv, const char *name,
 	return found ? 0 : ENOENT;
 }
 
+/*
+ * Get the d_type for inode INO by loading its vnode. Most of the
+ * time the inode is already in memory, or in the buffer cache from
+ * a recent neighbor.
+ */
+static
+int
+sfs_dir_enttype(struct sfs_vnode *sv, uint32_t ino, uint8_t *ret)
+{
+	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	struct sfs_vnode *child;
+	int result;
+
+	result = sfs_loadvnode(sfs, ino, SFS_TYPE_INVAL, &child);
+	if (result) {
+		return result;
+	}
+	switch (child->sv_i.sfi_type) {
+	    case SFS_TYPE_FILE: *ret = DT_REG; break;
+	    case SFS_TYPE_DIR: *ret = DT_DIR; break;
+	    default: *ret = DT_UNKNOWN; break;
+	}
+	VOP_DECREF(&child->sv_absvn);
+	return 0;
+}
+
+/*
+ * Read as many entries as fit into UIO as struct dirent records,
+ * starting at slot uio_offset, and leave uio_offset at the first
+ * slot not read. Reads up to a block's worth of slots at a time
+ * rather than one per sfs_metaio, never crossing a block boundary.
+ */
+int
+sfs_dir_getentries(struct sfs_vnode *sv, struct uio *uio)
+{
+	struct sfs_direntry sds[SFS_DIRPERBLOCK];
+	struct dirent de;
+	int nentries, slot, n, i, result = 0;
+	size_t namelen, reclen;
+	bool any = false;
+
+	if (uio->uio_offset < 0) {
+		return EINVAL;
+	}
+	nentries = sfs_dir_nentries(sv);
+	if (uio->uio_offset >= nentries) {
+		return 0;
+	}
+	slot = uio->uio_offset;
+
+	while (slot < nentries) {
+		/* sfs_metaio does one block, so stop at the block's end */
+		n = SFS_DIRPERBLOCK - slot % SFS_DIRPERBLOCK;
+		if (n > nentries - slot) {
+			n = nentries - slot;
+		}
+		result = sfs_metaio(sv, slot * sizeof(struct sfs_direntry),
+				    sds, n * sizeof(struct sfs_direntry),
+				    UIO_READ);
+		if (result) {
+			break;
+		}
+
+		for (i=0; i<n; i++, slot++) {
+			if (sds[i].sfd_ino == SFS_NOINO) {
+				continue;
+			}
+			/* Ensure null termination, just in case */
+			sds[i].sfd_name[sizeof(sds[i].sfd_name)-1] = 0;
+			namelen = strlen(sds[i].sfd_name);
+			reclen = _DIRENT_RECLEN(namelen);
+			if (reclen > uio->uio_resid) {
+				uio->uio_offset = slot;
+				return any ? 0 : EINVAL;
+			}
+
+			result = sfs_dir_enttype(sv, sds[i].sfd_ino,
+						 &de.d_type);
+			if (result) {
+				break;
+			}
+			de.d_ino = sds[i].sfd_ino;
+			de.d_reclen = reclen;
+			de.d_namlen = namelen;
+			bzero(de.d_name, reclen - 8);
+			memcpy(de.d_name, sds[i].sfd_name, namelen);
+
+			result = uiomove(&de, reclen, uio);
+			if (result) {
+				break;
+			}
+			any = true;
+		}
+		if (result) {
+			break;
+		}
+	}
+
+	uio->uio_offset = slot;
+	/* As with a short read, report an error only if we got nothing. */
+	return any ? 0 : result;
+}
+
 /*
  * Create a link in a directory to the specified inode by number, with
  * the specified name, and optionally hand back the slot.
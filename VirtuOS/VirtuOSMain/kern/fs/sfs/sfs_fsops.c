@@ -71,8 +71,10 @@ static
 int
 sfs_freemapio(struct sfs_fs *sfs, enum uio_rw rw)
 {
-	uint32_t j, freemapblocks;
+	uint32_t j, k, n, freemapblocks;
+	daddr_t blocks[SFS_IOBATCH];
 	char *freemapdata;
+	bool any;
 	int result;
 
 	/* Number of blocks in the free block bitmap. */
@@ -81,44 +83,67 @@ sfs_freemapio(struct sfs_fs *sfs, enum uio_rw rw)
 	/* Pointer to our freemap data in memory. */
 	freemapdata = bitmap_getdata(sfs->sfs_freemap);
 
-	/* For each block in the free block bitmap... */
-	for (j=0; j<freemapblocks; j++) {
-
-		/* Get a pointer to its data */
-		void *ptr = freemapdata + j*SFS_BLOCKSIZE;
-
-		/* and read or write it. The freemap starts at sector 2. */
-		if (rw == UIO_READ) {
-			result = sfs_readblock(sfs, SFS_FREEMAP_START+j, ptr,
-					       SFS_BLOCKSIZE);
+	/*
+	 * Read or write the blocks of the free block bitmap, a batch
+	 * at a time. The freemap starts at sector 2. When writing,
+	 * only the blocks that have changed are written; the others
+	 * are left as holes in the batch.
+	 */
+	for (j=0; j<freemapblocks; j+=n) {
+		n = freemapblocks - j;
+		if (n > SFS_IOBATCH) {
+			n = SFS_IOBATCH;
 		}
-		else {
-			result = sfs_writeblock(sfs, SFS_FREEMAP_START+j, ptr,
-						SFS_BLOCKSIZE);
+		any = false;
+		for (k=0; k<n; k++) {
+			if (rw == UIO_WRITE &&
+			    !bitmap_isset(sfs->sfs_freemapdirtymap, j+k)) {
+				blocks[k] = 0;
+				continue;
+			}
+			blocks[k] = SFS_FREEMAP_START+j+k;
+			any = true;
 		}
+		if (!any) {
+			continue;
+		}
+
+		result = sfs_rwblocks(sfs, blocks, n,
+				      freemapdata + j*SFS_BLOCKSIZE, rw);
 
 		/* If we failed, stop. */
 		if (result) {
 			return result;
 		}
+
+		/* If writing, those blocks are clean now. */
+		for (k=0; rw == UIO_WRITE && k<n; k++) {
+			if (blocks[k] != 0) {
+				bitmap_unmark(sfs->sfs_freemapdirtymap, j+k);
+				sfs->sfs_syncstats.ss_freemapbytes +=
+					SFS_BLOCKSIZE;
+			}
+		}
 	}
 	return 0;
 }
 
 /*
- * Sync routine for the vnode table.
+ * Sync routine for the vnode table. Only the vnodes on the dirty
+ * list need anything done; sfs_sync_inode takes each one off.
  */
 static
 int
 sfs_sync_vnodes(struct sfs_fs *sfs)
 {
-	unsigned i, num;
+	int result;
 
-	/* Go over the array of loaded vnodes, syncing as we go. */
-	num = vnodearray_num(sfs->sfs_vnodes);
-	for (i=0; i<num; i++) {
-		struct vnode *v = vnodearray_get(sfs->sfs_vnodes, i);
-		VOP_FSYNC(v);
+	while (sfs->sfs_dirtyvnodes != NULL) {
+		result = sfs_sync_inode(sfs->sfs_dirtyvnodes);
+		if (result) {
+			return result;
+		}
+		sfs->sfs_syncstats.ss_inodebytes += SFS_BLOCKSIZE;
 	}
 	return 0;
 }
@@ -159,10 +184,21 @@ sfs_sync_superblock(struct sfs_fs *sfs)
 			return result;
 		}
 		sfs->sfs_superdirty = false;
+		sfs->sfs_syncstats.ss_superbytes += SFS_BLOCKSIZE;
 	}
 	return 0;
 }
 
+/*
+ * Total metadata bytes written so far.
+ */
+static
+uint64_t
+sfs_syncstats_total(const struct sfs_syncstats *ss)
+{
+	return ss->ss_inodebytes + ss->ss_freemapbytes + ss->ss_superbytes;
+}
+
 /*
  * Sync routine. This is what gets invoked if you do FS_SYNC on the
  * sfs filesystem structure.
@@ -172,6 +208,7 @@ int
 sfs_sync(struct fs *fs)
 {
 	struct sfs_fs *sfs;
+	uint64_t before;
 	int result;
 
 	vfs_biglock_acquire();
@@ -207,30 +244,35 @@ sfs_sync(struct fs *fs)
 	 */
 
 	sfs = fs->fs_data;
+	before = sfs_syncstats_total(&sfs->sfs_syncstats);
 
 	/* If any vnodes need to be written, write them. */
 	result = sfs_sync_vnodes(sfs);
 	if (result) {
-		vfs_biglock_release();
-		return result;
+		goto out;
 	}
 
 	/* If the free block map needs to be written, write it. */
 	result = sfs_sync_freemap(sfs);
 	if (result) {
-		vfs_biglock_release();
-		return result;
+		goto out;
 	}
 
 	/* If the superblock needs to be written, write it. */
 	result = sfs_sync_superblock(sfs);
 	if (result) {
-		vfs_biglock_release();
-		return result;
+		goto out;
 	}
 
+ out:
+	sfs->sfs_syncstats.ss_syncs++;
+	sfs->sfs_syncstats.ss_lastbytes =
+		sfs_syncstats_total(&sfs->sfs_syncstats) - before;
+	DEBUG(DB_SFS, "sfs: %s: sync wrote %u bytes of metadata\n",
+	      sfs->sfs_sb.sb_volname, sfs->sfs_syncstats.ss_lastbytes);
+
 	vfs_biglock_release();
-	return 0;
+	return result;
 }
 
 /*
@@ -262,6 +304,13 @@ sfs_fs_destroy(struct sfs_fs *sfs)
 	if (sfs->sfs_freemap != NULL) {
 		bitmap_destroy(sfs->sfs_freemap);
 	}
+	if (sfs->sfs_freemapdirtymap != NULL) {
+		bitmap_destroy(sfs->sfs_freemapdirtymap);
+	}
+	if (sfs->sfs_reservemap != NULL) {
+		bitmap_destroy(sfs->sfs_reservemap);
+	}
+	KASSERT(sfs->sfs_dirtyvnodes == NULL);
 	vnodearray_destroy(sfs->sfs_vnodes);
 	KASSERT(sfs->sfs_device == NULL);
 	kfree(sfs);
@@ -359,6 +408,12 @@ sfs_fs_create(void)
 	/* freemap */
 	sfs->sfs_freemap = NULL;
 	sfs->sfs_freemapdirty = false;
+	sfs->sfs_freemapdirtymap = NULL;
+	sfs->sfs_reservemap = NULL;
+
+	/* nothing to sync yet */
+	sfs->sfs_dirtyvnodes = NULL;
+	bzero(&sfs->sfs_syncstats, sizeof(sfs->sfs_syncstats));
 
 	return sfs;
 
@@ -464,6 +519,24 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 		return result;
 	}
 
+	/* Nothing in the freemap has changed yet */
+	sfs->sfs_freemapdirtymap = bitmap_create(SFS_FS_FREEMAPBLOCKS(sfs));
+	if (sfs->sfs_freemapdirtymap == NULL) {
+		sfs->sfs_device = NULL;
+		sfs_fs_destroy(sfs);
+		vfs_biglock_release();
+		return ENOMEM;
+	}
+
+	/* Preallocation reservations start out empty */
+	sfs->sfs_reservemap = bitmap_create(SFS_FS_FREEMAPBITS(sfs));
+	if (sfs->sfs_reservemap == NULL) {
+		sfs->sfs_device = NULL;
+		sfs_fs_destroy(sfs);
+		vfs_biglock_release();
+		return ENOMEM;
+	}
+
 	/* Hand back the abstract fs */
 	*ret = &sfs->sfs_absfs;
 
@@ -471,6 +544,42 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 	return 0;
 }
 
+/*
+ * Print the sync statistics for an sfs volume.
+ */
+int
+sfs_printstats(struct fs *fs)
+{
+	struct sfs_fs *sfs;
+	struct sfs_syncstats ss;
+	unsigned ndirty;
+	struct sfs_vnode *sv;
+
+	if (fs->fs_ops != &sfs_fsops) {
+		return EINVAL;
+	}
+	sfs = fs->fs_data;
+
+	vfs_biglock_acquire();
+	ss = sfs->sfs_syncstats;
+	ndirty = 0;
+	for (sv = sfs->sfs_dirtyvnodes; sv != NULL; sv = sv->sv_dirtynext) {
+		ndirty++;
+	}
+	kprintf("sfs: %s: %u syncs, last wrote %u bytes of metadata\n",
+		sfs->sfs_sb.sb_volname, ss.ss_syncs, ss.ss_lastbytes);
+	kprintf("sfs: %s: %llu bytes inodes, %llu bytes freemap, "
+		"%llu bytes superblock\n", sfs->sfs_sb.sb_volname,
+		ss.ss_inodebytes, ss.ss_freemapbytes, ss.ss_superbytes);
+	kprintf("sfs: %s: %u of %u loaded vnodes dirty, freemap %s\n",
+		sfs->sfs_sb.sb_volname, ndirty,
+		vnodearray_num(sfs->sfs_vnodes),
+		sfs->sfs_freemapdirty ? "dirty" : "clean");
+	vfs_biglock_release();
+
+	return 0;
+}
+
 /*
  * Actual function called from high-level code to mount an sfs.
  */
@@ -55,11 +55,49 @@ sfs_sync_inode(struct sfs_vnode *sv)
 		if (result) {
 			return result;
 		}
+
+		/* Clean now; take it off the dirty list. */
+		if (sv->sv_dirtyprev != NULL) {
+			sv->sv_dirtyprev->sv_dirtynext = sv->sv_dirtynext;
+		}
+		else {
+			KASSERT(sfs->sfs_dirtyvnodes == sv);
+			sfs->sfs_dirtyvnodes = sv->sv_dirtynext;
+		}
+		if (sv->sv_dirtynext != NULL) {
+			sv->sv_dirtynext->sv_dirtyprev = sv->sv_dirtyprev;
+		}
+		sv->sv_dirtynext = sv->sv_dirtyprev = NULL;
 		sv->sv_dirty = false;
 	}
 	return 0;
 }
 
+/*
+ * Note that an in-memory inode has been modified. Besides setting
+ * sv_dirty, this puts it on the volume's list of dirty vnodes, so
+ * sfs_sync can find the ones it needs to write without looking at
+ * every loaded vnode.
+ */
+void
+sfs_markdirty(struct sfs_vnode *sv)
+{
+	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	if (sv->sv_dirty) {
+		return;
+	}
+	sv->sv_dirty = true;
+	sv->sv_dirtyprev = NULL;
+	sv->sv_dirtynext = sfs->sfs_dirtyvnodes;
+	if (sfs->sfs_dirtyvnodes != NULL) {
+		sfs->sfs_dirtyvnodes->sv_dirtyprev = sv;
+	}
+	sfs->sfs_dirtyvnodes = sv;
+}
+
 /*
  * Called when the vnode refcount (in-memory usage count) hits zero.
  *
@@ -93,6 +131,9 @@ sfs_reclaim(struct vnode *v)
 	}
 	spinlock_release(&v->vn_countlock);
 
+	/* Give back any blocks reserved for the file to grow into. */
+	sfs_prealloc_release(sv);
+
 	/* If there are no on-disk references to the file either, erase it. */
 	if (sv->sv_i.sfi_linkcount == 0) {
 		result = sfs_itrunc(sv, 0);
@@ -204,6 +245,12 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 
 	/* Not dirty yet */
 	sv->sv_dirty = false;
+	sv->sv_dirtynext = NULL;
+	sv->sv_dirtyprev = NULL;
+
+	/* No preallocation window yet */
+	sv->sv_pa_next = 0;
+	sv->sv_pa_count = 0;
 
 	/*
 	 * FORCETYPE is set if we're creating a new file, because the
@@ -213,7 +260,6 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 	if (forcetype != SFS_TYPE_INVAL) {
 		KASSERT(sv->sv_i.sfi_type == SFS_TYPE_INVAL);
 		sv->sv_i.sfi_type = forcetype;
-		sv->sv_dirty = true;
 	}
 
 	/*
@@ -250,6 +296,11 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 		return result;
 	}
 
+	/* A new object needs its type written out */
+	if (forcetype != SFS_TYPE_INVAL) {
+		sfs_markdirty(sv);
+	}
+
 	/* Hand it back */
 	*ret = sv;
 	return 0;
@@ -269,7 +320,7 @@ sfs_makeobj(struct sfs_fs *sfs, int type, struct sfs_vnode **ret)
 	 * number is the block number, so just get a block.)
 	 */
 
-	result = sfs_balloc(sfs, &ino);
+	result = sfs_balloc(sfs, 0, &ino);
 	if (result) {
 		return result;
 	}
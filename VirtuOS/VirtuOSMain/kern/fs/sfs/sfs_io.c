@@ -38,6 +38,7 @@
 #include <uio.h>
 #include <vfs.h>
 #include <device.h>
+#include <bio.h>
 #include <sfs.h>
 #include "sfsprivate.h"
 
@@ -131,6 +132,81 @@ sfs_writeblock(struct sfs_fs *sfs, daddr_t block, void *data, size_t len)
 	return sfs_rwblock(sfs, &ku);
 }
 
+/*
+ * Read or write N blocks at once: block I of DATA goes to or from
+ * disk block BLOCKS[I]. A zero entry is a hole; reads fill it with
+ * zeros and writes skip it. The transfers are submitted as one batch
+ * so the disk can sort and merge them, and we wait for them all
+ * together. Any that fail are redone one at a time with sfs_rwblock,
+ * which knows how to retry.
+ */
+int
+sfs_rwblocks(struct sfs_fs *sfs, const daddr_t *blocks, unsigned n,
+	     void *data, enum uio_rw rw)
+{
+	struct bio *bios, *list = NULL;
+	char *ptr;
+	unsigned i;
+	int result = 0;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	bios = kmalloc(n * sizeof(*bios));
+
+	for (i=n; i-- > 0; ) {
+		ptr = (char *)data + i * SFS_BLOCKSIZE;
+		if (blocks[i] == 0) {
+			if (rw == UIO_READ) {
+				bzero(ptr, SFS_BLOCKSIZE);
+			}
+			continue;
+		}
+		if (bios == NULL) {
+			/* Out of memory; just do it the slow way. */
+			continue;
+		}
+		bio_init(&bios[i], sfs->sfs_device, blocks[i], 1, ptr,
+			 rw == UIO_WRITE);
+		bios[i].b_next = list;
+		list = &bios[i];
+	}
+
+	bio_submitlist(list);
+
+	for (i=0; i<n; i++) {
+		if (blocks[i] == 0) {
+			continue;
+		}
+		if (bios != NULL && bio_wait(&bios[i]) == 0) {
+			continue;
+		}
+		ptr = (char *)data + i * SFS_BLOCKSIZE;
+		if (rw == UIO_READ) {
+			result = sfs_readblock(sfs, blocks[i], ptr,
+					       SFS_BLOCKSIZE);
+		}
+		else {
+			result = sfs_writeblock(sfs, blocks[i], ptr,
+						SFS_BLOCKSIZE);
+		}
+		if (result) {
+			break;
+		}
+	}
+
+	if (result && bios != NULL) {
+		/* Don't free the bios while some are still in flight. */
+		for (i++; i<n; i++) {
+			if (blocks[i] != 0) {
+				bio_wait(&bios[i]);
+			}
+		}
+	}
+
+	kfree(bios);
+	return result;
+}
+
 ////////////////////////////////////////////////////////////
 //
 // File-level I/O
@@ -285,6 +361,56 @@ sfs_blockio(struct sfs_vnode *sv, struct uio *uio)
 	return result;
 }
 
+/*
+ * Do I/O of N whole blocks as one batch through sfs_rwblocks, so the
+ * device sees them all at once and can merge the ones that are next
+ * to each other on disk. For reads this amounts to reading ahead
+ * within the request.
+ */
+static
+int
+sfs_blockrun(struct sfs_vnode *sv, struct uio *uio, unsigned n)
+{
+	/*
+	 * Staging buffer. As with sfs_partialio's, this would come from
+	 * the buffer cache if there were one.
+	 */
+	static char runbuf[SFS_IOBATCH * SFS_BLOCKSIZE];
+
+	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	daddr_t blocks[SFS_IOBATCH];
+	uint32_t fileblock;
+	bool doalloc = (uio->uio_rw==UIO_WRITE);
+	unsigned i;
+	int result;
+
+	/* We're using a global static buffer; it had better be locked */
+	KASSERT(vfs_biglock_do_i_hold());
+	KASSERT(n <= SFS_IOBATCH);
+
+	fileblock = uio->uio_offset / SFS_BLOCKSIZE;
+	for (i=0; i<n; i++) {
+		result = sfs_bmap(sv, fileblock + i, doalloc, &blocks[i]);
+		if (result) {
+			return result;
+		}
+	}
+
+	if (uio->uio_rw == UIO_READ) {
+		result = sfs_rwblocks(sfs, blocks, n, runbuf, UIO_READ);
+		if (result) {
+			return result;
+		}
+		return uiomove(runbuf, n * SFS_BLOCKSIZE, uio);
+	}
+
+	result = uiomove(runbuf, n * SFS_BLOCKSIZE, uio);
+	if (result) {
+		return result;
+	}
+	return sfs_rwblocks(sfs, blocks, n, runbuf, UIO_WRITE);
+}
+
 /*
  * Do I/O of a whole region of data, whether or not it's block-aligned.
  */
@@ -292,7 +418,7 @@ int
 sfs_io(struct sfs_vnode *sv, struct uio *uio)
 {
 	uint32_t blkoff;
-	uint32_t nblocks, i;
+	uint32_t nblocks, n;
 	int result = 0;
 	uint32_t origresid, extraresid = 0;
 
@@ -352,12 +478,23 @@ sfs_io(struct sfs_vnode *sv, struct uio *uio)
 	 */
 	KASSERT(uio->uio_offset % SFS_BLOCKSIZE == 0);
 	nblocks = uio->uio_resid / SFS_BLOCKSIZE;
-	for (i=0; i<nblocks; i++) {
+	if (nblocks == 1) {
+		/* Just one; go straight to the uio. */
 		result = sfs_blockio(sv, uio);
 		if (result) {
 			goto out;
 		}
 	}
+	else {
+		while (nblocks > 0) {
+			n = nblocks < SFS_IOBATCH ? nblocks : SFS_IOBATCH;
+			result = sfs_blockrun(sv, uio, n);
+			if (result) {
+				goto out;
+			}
+			nblocks -= n;
+		}
+	}
 
 	/*
 	 * Now do any remaining partial block at the end.
@@ -378,7 +515,7 @@ sfs_io(struct sfs_vnode *sv, struct uio *uio)
 	    uio->uio_rw == UIO_WRITE &&
 	    uio->uio_offset > (off_t)sv->sv_i.sfi_size) {
 		sv->sv_i.sfi_size = uio->uio_offset;
-		sv->sv_dirty = true;
+		sfs_markdirty(sv);
 	}
 
 	/* Add in any extra amount we couldn't read because of EOF */
@@ -471,7 +608,7 @@ sfs_metaio(struct sfs_vnode *sv, off_t actualpos, void *data, size_t len,
 		endpos = actualpos + len;
 		if (endpos > (off_t)sv->sv_i.sfi_size) {
 			sv->sv_i.sfi_size = endpos;
-			sv->sv_dirty = true;
+			sfs_markdirty(sv);
 		}
 	}
 
@@ -109,6 +109,25 @@ sfs_read(struct vnode *v, struct uio *uio)
 	return result;
 }
 
+/*
+ * Called for getdirentries(). sfs_dir_getentries() does the work.
+ */
+static
+int
+sfs_getdirentries(struct vnode *v, struct uio *uio)
+{
+	struct sfs_vnode *sv = v->vn_data;
+	int result;
+
+	KASSERT(uio->uio_rw==UIO_READ);
+
+	vfs_biglock_acquire();
+	result = sfs_dir_getentries(sv, uio);
+	vfs_biglock_release();
+
+	return result;
+}
+
 /*
  * Called for write(). sfs_io() does the work.
  */
@@ -254,6 +273,80 @@ sfs_truncate(struct vnode *v, off_t len)
 	return sfs_itrunc(sv, len);
 }
 
+/*
+ * Allocate disk space for a range of a file.
+ *
+ * We reserve a contiguous run for the whole range first, so the
+ * blocks sfs_bmap allocates come out of it in order, then extend the
+ * file to cover the range. Blocks in the range that already exist
+ * are left alone.
+ */
+static
+int
+sfs_fallocate(struct vnode *v, off_t pos, off_t len)
+{
+	struct sfs_vnode *sv = v->vn_data;
+	uint32_t first, last, fileblock, num;
+	daddr_t block, goal;
+	int result;
+
+	if (pos < 0 || len <= 0) {
+		return EINVAL;
+	}
+
+	/*
+	 * The largest file we can represent. Compare without adding
+	 * so that a huge pos + len can't overflow and pass the check.
+	 */
+	if (len >
+	    (off_t)(SFS_NDIRECT + SFS_NINDIRECT*SFS_DBPERIDB)*SFS_BLOCKSIZE
+	    - pos) {
+		return EFBIG;
+	}
+
+	first = pos / SFS_BLOCKSIZE;
+	last = DIVROUNDUP(pos + len, SFS_BLOCKSIZE);
+
+	vfs_biglock_acquire();
+
+	/* Try to continue from the block before the range */
+	goal = sv->sv_ino + 1;
+	if (first > 0) {
+		result = sfs_bmap(sv, first - 1, false, &block);
+		if (result) {
+			vfs_biglock_release();
+			return result;
+		}
+		if (block != 0) {
+			goal = block + 1;
+		}
+	}
+
+	result = sfs_prealloc(sv, goal, last - first, &num);
+	if (result) {
+		vfs_biglock_release();
+		return result;
+	}
+
+	for (fileblock = first; fileblock < last; fileblock++) {
+		result = sfs_bmap(sv, fileblock, true, &block);
+		if (result) {
+			break;
+		}
+	}
+
+	if (result == 0 && pos + len > sv->sv_i.sfi_size) {
+		sv->sv_i.sfi_size = pos + len;
+		sfs_markdirty(sv);
+	}
+
+	/* Return whatever we didn't use (blocks that already existed) */
+	sfs_prealloc_release(sv);
+
+	vfs_biglock_release();
+	return result;
+}
+
 /*
  * Get the full pathname for a file. This only needs to work on directories.
  * Since we don't support subdirectories, assume it's the root directory
@@ -338,7 +431,7 @@ sfs_creat(struct vnode *v, const char *name, bool excl, mode_t mode,
 	newguy->sv_i.sfi_linkcount++;
 
 	/* and consequently mark it dirty. */
-	newguy->sv_dirty = true;
+	sfs_markdirty(newguy);
 
 	*ret = &newguy->sv_absvn;
 
@@ -378,7 +471,7 @@ sfs_link(struct vnode *dir, const char *name, struct vnode *file)
 
 	/* and update the link count, marking the inode dirty */
 	f->sv_i.sfi_linkcount++;
-	f->sv_dirty = true;
+	sfs_markdirty(f);
 
 	vfs_biglock_release();
 	return 0;
@@ -411,7 +504,7 @@ sfs_remove(struct vnode *dir, const char *name)
 		/* If we succeeded, decrement the link count. */
 		KASSERT(victim->sv_i.sfi_linkcount > 0);
 		victim->sv_i.sfi_linkcount--;
-		victim->sv_dirty = true;
+		sfs_markdirty(victim);
 	}
 
 	/* Discard the reference that sfs_lookonce got us */
@@ -468,7 +561,7 @@ sfs_rename(struct vnode *d1, const char *n1,
 
 	/* Increment the link count, and mark inode dirty */
 	g1->sv_i.sfi_linkcount++;
-	g1->sv_dirty = true;
+	sfs_markdirty(g1);
 
 	/* Unlink the old slot */
 	result = sfs_dir_unlink(sv, slot1);
@@ -482,7 +575,7 @@ sfs_rename(struct vnode *d1, const char *n1,
 	 */
 	KASSERT(g1->sv_i.sfi_linkcount>0);
 	g1->sv_i.sfi_linkcount--;
-	g1->sv_dirty = true;
+	sfs_markdirty(g1);
 
 	/* Let go of the reference to g1 */
 	VOP_DECREF(&g1->sv_absvn);
@@ -593,6 +686,7 @@ const struct vnode_ops sfs_fileops = {
 	.vop_read = sfs_read,
 	.vop_readlink = vopfail_uio_notdir,
 	.vop_getdirentry = vopfail_uio_notdir,
+	.vop_getdirentries = vopfail_uio_notdir,
 	.vop_write = sfs_write,
 	.vop_ioctl = sfs_ioctl,
 	.vop_stat = sfs_stat,
@@ -601,6 +695,7 @@ const struct vnode_ops sfs_fileops = {
 	.vop_fsync = sfs_fsync,
 	.vop_mmap = sfs_mmap,
 	.vop_truncate = sfs_truncate,
+	.vop_fallocate = sfs_fallocate,
 	.vop_namefile = vopfail_uio_notdir,
 
 	.vop_creat = vopfail_creat_notdir,
@@ -627,6 +722,7 @@ const struct vnode_ops sfs_dirops = {
 	.vop_read = vopfail_uio_isdir,
 	.vop_readlink = vopfail_uio_inval,
 	.vop_getdirentry = vopfail_uio_nosys,
+	.vop_getdirentries = sfs_getdirentries,
 	.vop_write = vopfail_uio_isdir,
 	.vop_ioctl = sfs_ioctl,
 	.vop_stat = sfs_stat,
@@ -635,6 +731,7 @@ const struct vnode_ops sfs_dirops = {
 	.vop_fsync = sfs_fsync,
 	.vop_mmap = vopfail_mmap_isdir,
 	.vop_truncate = vopfail_truncate_isdir,
+	.vop_fallocate = vopfail_fallocate_isdir,
 	.vop_namefile = sfs_namefile,
 
 	.vop_creat = sfs_creat,
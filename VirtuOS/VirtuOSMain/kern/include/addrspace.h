@@ -41,6 +41,7 @@
 #define SUCCESS 0
 
 struct vnode;
+struct shmobj;
 
 
 /*
@@ -93,9 +94,22 @@ struct Mmap_Region {
 	struct Mmap_Region* next;
 }
 
+// Shared memory mapping; see shm.h. The pages belong to the object,
+// not the address space, so fork shares them instead of copying.
+// Unlike the other regions end_addr is one past the last byte.
+struct Shm_Region {
+
+	vaddr_t			base_addr;
+	vaddr_t			end_addr;
+	int				writeable;
+	struct shmobj  *obj;
+	struct Shm_Region* next;
+};
+
 typedef struct addrspace_region* Region_t;
 typedef struct Heap_region* HeapRegion_t;
 typedef struct Mmap_Region* Mmap_Region_t;
+typedef struct Shm_Region* Shm_Region_t;
 
 struct addrspace {
 
@@ -115,8 +129,10 @@ struct addrspace {
 	HeapRegion_t    Proc_heap;
 	Mmap_Region_t   File_region_base;
 	Mmap_Region_t   File_region_end;
+	Shm_Region_t    Shm_region_base;	/* sorted, highest first */
 	Page_table_t 	PageTable;
-	
+	struct lock    *as_lock;	/* for vm_fault from multiple threads */
+
 
 #endif
 };
@@ -159,6 +175,10 @@ typedef struct addrspace* addrspace_t;
  *                (Normally called *after* as_complete_load().) Hands
  *                back the initial stack pointer for the new process.
  *
+ *    as_stackpage - get the kernel address of a page of the stack,
+ *                allocating it if needed. Used by exec to fill in the
+ *                new stack without switching to it.
+ *
  * Note that when using dumbvm, addrspace.c is not used and these
  * functions are found in dumbvm.c.
  */
@@ -177,10 +197,22 @@ int               as_define_region(struct addrspace *as,
 int               as_prepare_load(struct addrspace *as);
 int               as_complete_load(struct addrspace *as);
 int               as_define_stack(struct addrspace *as, vaddr_t *initstackptr);
+int               as_stackpage(struct addrspace *as, vaddr_t vaddr,
+                               vaddr_t *kvaddr);
 vaddr_t as_set_process_break(struct addrspace* as, intptr_t amount, int* err_sbrk);
 vaddr_t Find_Free_File_Region(struct addrspace* as, vaddr_t base_addr, vaddr_t end_addr);
 vaddr_t as_mmap_file(struct addrspace* as, size_t length, int prot, int fd, off_t offset, &err_mmap);
 
+/*
+ * Shared memory mappings. as_map_shared maps the first LENGTH bytes
+ * (page aligned) of the object below the stack and hands back the
+ * address; the mapping takes over the caller's reference to the
+ * object. as_unmap_shared removes the mapping starting at VADDR.
+ */
+int as_map_shared(struct addrspace *as, struct shmobj *so, size_t length,
+		  bool writeable, vaddr_t *ret);
+int as_unmap_shared(struct addrspace *as, vaddr_t vaddr);
+
 /*
  * Functions in loadelf.c
  *    load_elf - load an ELF user program executable into the current
@@ -217,6 +249,7 @@ int Page_table_copy(Page_table_t oldPT, Page_table_t newPT);
 int Page_table_Add (vaddr_t faultaddress, paddr_t frame_no, Region_t as_reg, HeapRegion_t as_hreg, struct addrspace* as);
 int Page_table_Insert(struct addrspace *as, uint32_t FLI, uint32_t SLI, uint32_t TLI, uint32_t entry_lo);
 void Page_table_readonly (struct addrspace *as, vaddr_t base_addr);
+void Page_table_unmap(struct addrspace *as, vaddr_t base_addr, vaddr_t end_addr);
 int init_level_three (struct addrspace *as, uint32_t FLI, uint32_t SLI);
 int init_level_two (struct addrspace *as, uint32_t FLI);
 int Level_three_copy (Page_table_t oldPT, Page_table_t newPT, int i, int j);
@@ -227,6 +260,8 @@ int Level_two_copy (Page_table_t oldPT, Page_table_t newPT, int i);
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
 int Region_copy (struct addrspace* old, struct addrspace* newas);
+int Shm_region_copy (struct addrspace* old, struct addrspace* newas);
+vaddr_t Shm_region_floor (struct addrspace* as);
 void Create_Region (struct addrspace *as, Region_t new_region, 
 		vaddr_t vaddr, size_t memsize, int readable, 
 		int writeable, int executable);
@@ -241,6 +276,8 @@ int tlb_miss_handler(vaddr_t faultaddress, struct addrspace* as, Region_t Valid_
 void Load_TLB(uint32_t entry_hi, uint32_t entry_lo);
 Region_t Lookup_Region(struct addrspace* as, vaddr_t faultaddress);
 HeapRegion_t Lookup_Heap(struct addrspace* as, vaddr_t faultaddress);
+Shm_Region_t Lookup_Shm(struct addrspace* as, vaddr_t faultaddress);
+int Shm_fault(int faulttype, vaddr_t faultaddress, struct addrspace* as, Shm_Region_t Valid_Shm);
 int Alloc_Frame_Insert_PTE(vaddr_t faultaddress, struct addrspace* as, Region_t as_req, HeapRegion_t as_hreq);
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
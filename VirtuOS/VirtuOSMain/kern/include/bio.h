@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _BIO_H_
+#define _BIO_H_
+
+/*
+ * Asynchronous block I/O.
+ *
+ * A struct bio describes a transfer of whole device blocks between
+ * a kernel buffer and a device. Fill one in with bio_init, hand it
+ * to bio_submit (or a list of them, linked through b_next, to
+ * bio_submitlist), and find out it's finished in one of three ways:
+ *
+ *    - If b_done is set, it is called when the transfer is finished.
+ *      It is called from the device's interrupt handler and must not
+ *      sleep.
+ *    - Otherwise, if b_sem is set, V is done on it. Point a batch of
+ *      bios at the same semaphore and P it once per bio to wait for
+ *      them all.
+ *    - Otherwise, wait with bio_wait or bio_waitall.
+ *
+ * Either way b_error holds the result (0 or an errno value) when
+ * the transfer is finished. The bio and its buffer belong to the
+ * device from submission until then.
+ *
+ * Devices that can queue I/O provide devop_strategy; for the others
+ * bio_submit does the transfer synchronously with DEVOP_IO before it
+ * returns.
+ */
+
+struct device;
+struct semaphore;
+struct thread;
+
+struct bio {
+	/* Set up by bio_init */
+	struct device *b_dev;		/* Device to transfer to/from */
+	daddr_t b_blkno;		/* First block (of d_blocksize) */
+	uint32_t b_nblocks;		/* Number of blocks */
+	bool b_write;			/* Direction */
+	void *b_data;			/* Kernel buffer */
+
+	/* Completion; set by the caller after bio_init if wanted */
+	void (*b_done)(struct bio *);	/* Completion callback */
+	struct semaphore *b_sem;	/* Completion semaphore */
+	void *b_arg;			/* For use by the caller */
+
+	/* Result */
+	int b_error;			/* 0 or errno */
+	unsigned b_flags;		/* B_* below; protected by bio lock */
+	struct thread *b_waiter;	/* In bio_wait; protected by bio lock */
+
+	/* Submission list, then owned by the driver */
+	struct bio *b_next;
+
+	/* Private to the driver */
+	struct bio *b_chain;		/* Bios merged behind this one */
+	daddr_t b_end;			/* Block past the end of the chain */
+};
+
+#define B_DONE		0x1		/* Finished (bio_wait mode only) */
+
+/*
+ * Functions.
+ *
+ *    bio_bootstrap  - Call once during system startup.
+ *    bio_init       - Set up a bio for NBLOCKS blocks at BLKNO on DEV.
+ *    bio_submit     - Start a transfer.
+ *    bio_submitlist - Start a list of transfers, linked by b_next, all
+ *                     to the same device. The device sees them all at
+ *                     once, so it can sort and merge them.
+ *    bio_wait       - Wait for a transfer with no b_done or b_sem.
+ *                     Returns b_error.
+ *    bio_waitall    - Likewise for an array of N bios; returns the
+ *                     first error found.
+ *    bio_done       - Called by device drivers when a transfer is
+ *                     finished, with the result.
+ */
+void bio_bootstrap(void);
+void bio_init(struct bio *b, struct device *dev, daddr_t blkno,
+	      uint32_t nblocks, void *data, bool write);
+void bio_submit(struct bio *b);
+void bio_submitlist(struct bio *list);
+int bio_wait(struct bio *b);
+int bio_waitall(struct bio *bios, unsigned n);
+void bio_done(struct bio *b, int error);
+
+
+#endif /* _BIO_H_ */
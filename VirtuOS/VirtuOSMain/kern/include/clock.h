@@ -40,6 +40,15 @@
 /*
  * hardclock() is called on every CPU HZ times a second, possibly only
  * when the CPU is not idle, for scheduling.
+ *
+ * Once timer_bootstrap has run, idle CPUs stop taking scheduler
+ * ticks: thread_switch calls hardclock_rearm on the way into and out
+ * of the idle loop, and an idle CPU only wakes up for the next timer
+ * (see below), an interrupt, or CLOCK_IDLE_NSECS, whichever is
+ * first. An idle CPU that saw work on other run queues it couldn't
+ * steal yet keeps ticking so it can try again. Ticks skipped while
+ * idle are added to c_hardclocks when the CPU wakes up, so it still
+ * counts time.
  */
 
 /* hardclocks per second */
@@ -47,6 +56,7 @@
 
 void hardclock_bootstrap(void);
 void hardclock(void);
+void hardclock_rearm(void);
 
 /*
  * timerclock() is called on one CPU once a second to allow simple
@@ -76,8 +86,53 @@ void timespec_sub(const struct timespec *t1,
 /*
  * clocksleep() suspends execution for the requested number of seconds,
  * like userlevel sleep(3). (Don't confuse it with wchan_sleep.)
+ *
+ * clocknanosleep() suspends execution for the requested time, with
+ * the resolution of the timer interrupt rather than whole seconds.
  */
 void clocksleep(int seconds);
+void clocknanosleep(const struct timespec *duration);
+
+/*
+ * Timers.
+ *
+ * A timer calls FUNC(DATA) once, after a delay. Timers are kept on a
+ * hierarchical timing wheel and run from the timer interrupt on CPU
+ * 0, which programs its on-chip timer for the next one due, so they
+ * fire close to their deadline and not just on the next hardclock.
+ * FUNC runs in interrupt context and must not sleep.
+ *
+ * The struct timer belongs to the caller and may live on its stack.
+ *
+ *    timer_init      - Set up TM to call FUNC(DATA).
+ *    timer_start     - Arm TM to go off after DELAY. It must not
+ *                      already be armed.
+ *    timer_stop      - Disarm TM. Returns true if it hadn't gone off.
+ *                      If FUNC is running on another CPU, waits for
+ *                      it to finish, so TM can be freed afterwards.
+ *
+ * timer_bootstrap must be called after the time-of-day clock is
+ * attached and before any timer is started.
+ */
+struct timer {
+	struct timer *tm_next;		/* next in wheel slot */
+	struct timer **tm_prevp;	/* pointer to us in wheel slot */
+	uint64_t tm_expires;		/* deadline, in nanoseconds */
+	unsigned tm_slot;		/* where on the wheel (private) */
+	bool tm_pending;		/* on the wheel */
+	void (*tm_func)(void *);	/* what to call */
+	void *tm_data;			/* argument for tm_func */
+};
+
+void timer_bootstrap(void);
+void timer_init(struct timer *tm, void (*func)(void *), void *data);
+void timer_start(struct timer *tm, const struct timespec *delay);
+bool timer_stop(struct timer *tm);
+
+/*
+ * Print timer statistics (for the "sched" menu command).
+ */
+void clock_printstats(void);
 
 
 #endif /* _CLOCK_H_ */
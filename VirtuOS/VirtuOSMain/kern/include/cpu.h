@@ -59,7 +59,15 @@ struct cpu {
 	 */
 	struct thread *c_curthread;	/* Current thread on cpu */
 	struct threadlist c_zombies;	/* List of exited threads */
+	struct threadlist c_threadcache; /* Exited threads kept for reuse */
+	unsigned c_cachehits;		/* thread_forks served from cache */
+	unsigned c_cachemisses;		/* thread_forks that had to kmalloc */
+	struct thread *c_moving;	/* Thread leaving for another cpu */
 	unsigned c_hardclocks;		/* Counter of hardclock() calls */
+	uint64_t c_nextclock;		/* When the next hardclock is due */
+	unsigned c_idlewakeups;		/* Times cpu_idle returned */
+	unsigned c_skippedclocks;	/* Hardclocks skipped while idle */
+	bool c_stealretry;		/* Keep ticking while idle to steal */
 	unsigned c_spinlocks;		/* Counter of spinlocks held */
 
 	/*
@@ -69,6 +77,8 @@ struct cpu {
 	bool c_isidle;			/* True if this cpu is idle */
 	struct threadlist c_runqueue;	/* Run queue for this cpu */
 	struct spinlock c_runqueue_lock;
+	unsigned c_steals;		/* Threads this cpu stole */
+	unsigned c_stolen;		/* Threads stolen from this cpu */
 
 	/*
 	 * Accessed by other cpus.
@@ -82,10 +92,16 @@ struct cpu {
 	 * The contents of struct tlbshootdown are also machine-
 	 * dependent and might reasonably be either an address space
 	 * and vaddr pair, or a paddr, or something else.
+	 *
+	 * c_shootdown_posted counts the requests made to this CPU and
+	 * c_shootdown_done is set to it each time the queue has been
+	 * processed, so a sender can tell when its request is done.
 	 */
 	uint32_t c_ipi_pending;		/* One bit for each IPI number */
 	struct tlbshootdown c_shootdown[TLBSHOOTDOWN_MAX];
 	unsigned c_numshootdown;
+	unsigned c_shootdown_posted;
+	unsigned c_shootdown_done;
 	struct spinlock c_ipi_lock;
 
 	/*
@@ -155,6 +171,9 @@ void cpu_halt(void);
  * ipi_send sends an IPI to one CPU.
  * ipi_broadcast sends an IPI to all CPUs except the current one.
  * ipi_tlbshootdown is like ipi_send but carries TLB shootdown data.
+ * ipi_tlbshootdown_sync sends TLB shootdown data to all CPUs except
+ * the current one and waits until all of them have acted on it. It
+ * must be called with interrupts enabled and no spinlocks held.
  *
  * interprocessor_interrupt is called on the target CPU when an IPI is
  * received.
@@ -165,10 +184,13 @@ void cpu_halt(void);
 #define IPI_OFFLINE		1	/* CPU is requested to go offline */
 #define IPI_UNIDLE		2	/* Runnable threads are available */
 #define IPI_TLBSHOOTDOWN	3	/* MMU mapping(s) need invalidation */
+#define IPI_CLOCK		4	/* Timer interrupt needs reprogramming */
 
 void ipi_send(struct cpu *target, int code);
 void ipi_broadcast(int code);
 void ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping);
+void ipi_tlbshootdown_broadcast(const struct tlbshootdown *mapping);
+void ipi_tlbshootdown_sync(const struct tlbshootdown *mapping);
 
 void interprocessor_interrupt(void);
 
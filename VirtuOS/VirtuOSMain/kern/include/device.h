@@ -36,6 +36,7 @@
 
 
 struct uio;  /* in <uio.h> */
+struct bio;  /* in <bio.h> */
 
 /*
  * Filesystem-namespace-accessible device.
@@ -56,11 +57,14 @@ struct device {
  *      devop_eachopen - called on each open call to allow denying the open
  *      devop_io - for both reads and writes (the uio indicates the direction)
  *      devop_ioctl - miscellaneous control operations
+ *      devop_strategy - queue a list of block transfers (see bio.h);
+ *                       optional, may be NULL
  */
 struct device_ops {
 	int (*devop_eachopen)(struct device *, int flags_from_open);
 	int (*devop_io)(struct device *, struct uio *);
 	int (*devop_ioctl)(struct device *, int op, userptr_t data);
+	void (*devop_strategy)(struct device *, struct bio *list);
 };
 
 /*
@@ -69,6 +73,7 @@ struct device_ops {
 #define DEVOP_EACHOPEN(d, f)	((d)->d_ops->devop_eachopen(d, f))
 #define DEVOP_IO(d, u)		((d)->d_ops->devop_io(d, u))
 #define DEVOP_IOCTL(d, op, p)	((d)->d_ops->devop_ioctl(d, op, p))
+#define DEVOP_STRATEGY(d, l)	((d)->d_ops->devop_strategy(d, l))
 
 
 /* Create vnode for a vfs-level device. */
@@ -35,28 +35,48 @@
 #define _FILETABLE_H_
 
 #include <limits.h> /* for OPEN_MAX */
+#include <spinlock.h>
 
+struct lock;
 
 /*
  * The file table is an array of open files.
  *
- * There is no particular reason to use a fixed size array (of size
- * OPEN_MAX) instead of a dynamically sized array (using array.h) --
- * the code was just written this way years ago and there's no
- * compelling reason to change it that outweighs this benefit: you can
- * look through the code to see what it would take to make it dynamic,
- * or even to make it dynamic with the limit being user-settable. (See
- * setrlimit(2) on a Unix machine.)
+ * The array grows as needed, doubling from FT_MINSLOTS, up to OPEN_MAX
+ * slots. A bitmap of the slots in use, with a second level marking
+ * the full words of the first, finds the lowest free descriptor
+ * without looking at every slot.
  *
- * Because we only have single-threaded processes, the file table is
- * never shared and so it doesn't require synchronization. On fork,
- * the table is copied. Another exercise: what would you need to do to
- * make this code safe for multithreaded processes? What happens if
- * one thread calls close() while another one is in the middle of e.g.
- * read() using the same file handle?
+ * The slots live in a separate, reference-counted struct ftslots so
+ * that fork can share them copy-on-write: filetable_copy just makes a
+ * new filetable pointing at the same slots. Shared slots are never
+ * changed; a process that wants to change its table while it's shared
+ * first gets its own copy, and only then takes references to the
+ * open files. A fork followed by exec thus never copies the table.
+ *
+ * Because processes can be multithreaded, the table is locked:
+ * ft_lock is held briefly to look at or change ft_slots and the slots
+ * in it, and ft_wlock serializes anything that changes the table,
+ * which may need to allocate memory. filetable_get takes a reference
+ * to the open file, so another thread closing the descriptor can't
+ * pull it out from under us; filetable_put drops it.
  */
+#define FT_MINSLOTS	32
+#define FT_FULLWORDS	((OPEN_MAX + 1023) / 1024)
+
+struct ftslots {
+	struct spinlock fs_reflock;	/* protects fs_refcount */
+	unsigned fs_refcount;		/* number of filetables using this */
+	unsigned fs_num;		/* number of slots (multiple of 32) */
+	struct openfile **fs_files;	/* the slots */
+	uint32_t *fs_inuse;		/* bit set for each slot in use */
+	uint32_t fs_full[FT_FULLWORDS];	/* bit set for each full fs_inuse word */
+};
+
 struct filetable {
-	struct openfile *ft_openfiles[OPEN_MAX];
+	struct spinlock ft_lock;	/* for ft_slots and its contents */
+	struct lock *ft_wlock;		/* held while changing the table */
+	struct ftslots *ft_slots;
 };
 
 /*
@@ -64,7 +84,7 @@ struct filetable {
  *
  * create -  Construct an empty file table.
  * destroy - Wipe out a file table, closing anything open in it.
- * copy -    Clone a file table.
+ * copy -    Clone a file table (copy-on-write).
  * okfd -    Check if a file handle is in range.
  * get/put - Retrieve a fd for use and put it back when done. (Checks
  *           okfd and also fails on files not open; returned openfile
@@ -83,8 +103,8 @@ int filetable_get(struct filetable *ft, int fd, struct openfile **ret);
 void filetable_put(struct filetable *ft, int fd, struct openfile *file);
 
 int filetable_place(struct filetable *ft, struct openfile *file, int *fd);
-void filetable_placeat(struct filetable *ft, struct openfile *newfile, int fd,
-		       struct openfile **oldfile_ret);
+int filetable_placeat(struct filetable *ft, struct openfile *newfile, int fd,
+		      struct openfile **oldfile_ret);
 
 
 #endif /* _FILETABLE_H_ */
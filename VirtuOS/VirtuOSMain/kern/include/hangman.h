@@ -52,6 +52,7 @@ struct hangman_lockable {
 void hangman_wait(struct hangman_actor *a, struct hangman_lockable *l);
 void hangman_acquire(struct hangman_actor *a, struct hangman_lockable *l);
 void hangman_release(struct hangman_actor *a, struct hangman_lockable *l);
+void hangman_unwait(struct hangman_actor *a, struct hangman_lockable *l);
 
 #define HANGMAN_ACTOR(sym)	struct hangman_actor sym
 #define HANGMAN_LOCKABLE(sym)	struct hangman_lockable sym
@@ -64,6 +65,7 @@ void hangman_release(struct hangman_actor *a, struct hangman_lockable *l);
 #define HANGMAN_WAIT(a, l)	hangman_wait(a, l)
 #define HANGMAN_ACQUIRE(a, l)	hangman_acquire(a, l)
 #define HANGMAN_RELEASE(a, l)	hangman_release(a, l)
+#define HANGMAN_UNWAIT(a, l)	hangman_unwait(a, l)
 
 #else
 
@@ -78,6 +80,7 @@ void hangman_release(struct hangman_actor *a, struct hangman_lockable *l);
 #define HANGMAN_WAIT(a, l)
 #define HANGMAN_ACQUIRE(a, l)
 #define HANGMAN_RELEASE(a, l)
+#define HANGMAN_UNWAIT(a, l)
 
 #endif
 
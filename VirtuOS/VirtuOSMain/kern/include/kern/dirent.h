@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _KERN_DIRENT_H_
+#define _KERN_DIRENT_H_
+
+#include <kern/limits.h>
+#include <kern/stattypes.h>
+
+/*
+ * Directory entries as returned by getdirentries().
+ *
+ * getdirentries() packs as many of these as fit into the caller's
+ * buffer, one after another. Each record is d_reclen bytes long,
+ * which is the name plus its terminating null, rounded up so the
+ * next record starts on a 4-byte boundary; walk the buffer by adding
+ * d_reclen, not sizeof(struct dirent).
+ *
+ * d_type is the file type from st_mode shifted down 12 bits, so a
+ * caller that only needs to know what kind of file each name is
+ * doesn't have to stat it. Filesystems that can't tell cheaply
+ * report DT_UNKNOWN, and d_ino is 0 if they have no inode numbers.
+ */
+struct dirent {
+	__u32 d_ino;			/* inode number, or 0 */
+	__u16 d_reclen;			/* length of this record */
+	__u8 d_type;			/* DT_* file type */
+	__u8 d_namlen;			/* length of d_name, less the null */
+	char d_name[__NAME_MAX + 1];	/* name (really d_namlen+1 bytes) */
+};
+
+/* Record length for a name of NAMLEN characters (8 is the header). */
+#define _DIRENT_RECLEN(namlen)	(((8 + (namlen) + 1) + 3) & ~3)
+
+/* Values for d_type. */
+#define DT_UNKNOWN	0
+#define DT_REG		(_S_IFREG >> 12)
+#define DT_DIR		(_S_IFDIR >> 12)
+#define DT_LNK		(_S_IFLNK >> 12)
+#define DT_FIFO		(_S_IFIFO >> 12)
+#define DT_SOCK		(_S_IFSOCK >> 12)
+#define DT_CHR		(_S_IFCHR >> 12)
+#define DT_BLK		(_S_IFBLK >> 12)
+
+#endif /* _KERN_DIRENT_H_ */
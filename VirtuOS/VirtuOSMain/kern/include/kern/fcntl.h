@@ -49,6 +49,7 @@
 #define O_TRUNC      16      /* Truncate file upon open */
 #define O_APPEND     32      /* All writes happen at EOF (optional feature) */
 #define O_NOCTTY     64      /* Required by POSIX, != 0, but does nothing */
+#define O_NONBLOCK  128      /* Don't block in read/write (pipes only) */
 
 /* Additional related definition */
 #define O_ACCMODE     3      /* mask for O_RDONLY/O_WRONLY/O_RDWR */
@@ -63,6 +64,10 @@
 #define LOCK_UN         3       /* release the lock */
 #define LOCK_NB         4       /* flag: don't block */
 
+/* directory fd and flags for fstatat() */
+#define AT_FDCWD        (-100)  /* names are relative to the current dir */
+#define AT_SYMLINK_NOFOLLOW 1   /* don't follow a final symlink */
+
 /*
  * Mostly pretty useless
  */
@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _KERN_IORING_H_
+#define _KERN_IORING_H_
+
+/*
+ * Submission/completion ring for batching I/O system calls.
+ *
+ * ioring_setup() maps a ring into the process and returns its
+ * address. The ring starts with a struct ioring; the submission
+ * entries start ir_sqoff bytes in and the completion entries
+ * ir_cqoff bytes in, ir_entries of each.
+ *
+ * The four counters run freely and wrap; entry N of a ring is at
+ * index N & (ir_entries - 1). To submit, fill in the entry at
+ * ir_sqtail and then advance ir_sqtail. ioring_enter() runs the
+ * submitted entries in order, one after another, and posts one
+ * completion each, advancing ir_sqhead and ir_cqtail as it goes; it
+ * stops early rather than overrun the completion ring. To reap,
+ * read the completions from ir_cqhead up to ir_cqtail and then
+ * advance ir_cqhead.
+ *
+ * Only the counters are looked at after setup; the kernel keeps its
+ * own copies of the rest.
+ */
+
+struct ioring {
+	volatile __u32 ir_sqhead;	/* next entry the kernel takes */
+	volatile __u32 ir_sqtail;	/* next entry to fill in */
+	volatile __u32 ir_cqhead;	/* next completion to reap */
+	volatile __u32 ir_cqtail;	/* next completion the kernel posts */
+	__u32 ir_entries;		/* size of each ring (power of 2) */
+	__u32 ir_sqoff;			/* offset of the submission entries */
+	__u32 ir_cqoff;			/* offset of the completion entries */
+};
+
+/* Submission entry */
+struct ioring_sqe {
+	__u32 sqe_op;			/* IORING_OP_* */
+	__i32 sqe_fd;			/* file handle */
+	__i64 sqe_off;			/* file position; -1 for the seek pos */
+#ifdef _KERNEL
+	userptr_t sqe_buf;		/* buffer, or pathname for open */
+#else
+	void *sqe_buf;			/* buffer, or pathname for open */
+#endif
+	__u32 sqe_len;			/* buffer length */
+	__i32 sqe_flags;		/* open flags, or lseek whence */
+	__u32 sqe_mode;			/* open mode */
+	__u64 sqe_data;			/* handed back in the completion */
+};
+
+/* Completion entry */
+struct ioring_cqe {
+	__u64 cqe_data;			/* sqe_data of the request */
+	__i64 cqe_res;			/* what the call returns, or -errno */
+};
+
+/* Operations; each does what the system call of the same name does */
+#define IORING_OP_NOP		0
+#define IORING_OP_READ		1	/* pread, or read if sqe_off is -1 */
+#define IORING_OP_WRITE		2	/* pwrite, or write if sqe_off is -1 */
+#define IORING_OP_OPEN		3
+#define IORING_OP_CLOSE		4
+#define IORING_OP_FSYNC		5
+#define IORING_OP_LSEEK		6
+
+/* Largest ring */
+#define IORING_MAXENTRIES	4096
+
+
+#endif /* _KERN_IORING_H_ */
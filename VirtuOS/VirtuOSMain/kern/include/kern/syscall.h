@@ -91,8 +91,8 @@
 //#define SYS_getrlimit  36
 //#define SYS_setrlimit  37
 //                              (process priority control)
-//#define SYS_getpriority 38
-//#define SYS_setpriority 39
+#define SYS_getpriority  38
+#define SYS_setpriority  39
 //                              (process groups, sessions, and job control)
 //#define SYS_getpgid    40
 //#define SYS_setpgid    41
@@ -109,12 +109,12 @@
 #define SYS_close        49
 #define SYS_read         50
 #define SYS_pread        51
-//#define SYS_readv      52
+#define SYS_readv        52
 //#define SYS_preadv     53
 #define SYS_getdirentry  54
 #define SYS_write        55
 #define SYS_pwrite       56
-//#define SYS_writev     57
+#define SYS_writev       57
 //#define SYS_pwritev    58
 #define SYS_lseek        59
 #define SYS_flock        60
@@ -197,6 +197,29 @@
 #define SYS_reboot       119
 //#define SYS___sysctl   120
 
+//                              -- Local additions --
+#define SYS_fallocate    121
+#define SYS_sched_setaffinity 122
+#define SYS_sched_getaffinity 123
+#define SYS_futex_wait   124
+#define SYS_futex_wake   125
+#define SYS___thread_create 126
+#define SYS___thread_join 127
+#define SYS___thread_exit 128
+#define SYS_waitmany     129
+#define SYS_pipe2        130
+#define SYS_shm_map      131
+#define SYS_shm_unmap    132
+#define SYS_shm_unlink   133
+#define SYS_ioring_setup 134
+#define SYS_ioring_enter 135
+#define SYS_sysstat      136
+#define SYS_sysstat_reset 137
+#define SYS_systrace     138
+#define SYS_systrace_read 139
+#define SYS_getdirentries 140
+#define SYS_fstatat      141
+
 /*CALLEND*/
 
 
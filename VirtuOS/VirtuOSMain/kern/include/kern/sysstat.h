@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _KERN_SYSSTAT_H_
+#define _KERN_SYSSTAT_H_
+
+/*
+ * System call statistics and tracing, for kernels built with
+ * "options syscallstat". Without it the calls fail with ENOSYS.
+ *
+ * sysstat() fills in one struct sysstat_call per system call number,
+ * starting from 0, and returns how many it filled in. Latencies are
+ * in nanoseconds of wall-clock time from entry to exit, and the
+ * histogram counts calls by latency: bucket B holds the calls that
+ * took from 2^B up to 2^(B+1) microseconds, except that bucket 0
+ * also has everything under a microsecond and the last bucket
+ * everything too long for the others. _exit and a successful execv
+ * never return, so they are counted but not timed.
+ *
+ * systrace(1) turns tracing on for the calling process, and
+ * systrace(0) turns it off; either way the old setting is returned.
+ * The setting is kept across execv and inherited by fork. Every call
+ * a traced process makes is logged to a single kernel ring that
+ * systrace_read() drains, oldest first, without waiting. The ring
+ * doesn't hold up traced processes when it fills; the oldest records
+ * are overwritten instead, which shows up as a gap in st_seq.
+ */
+
+#define SYSSTAT_NCALLS		256
+#define SYSSTAT_NBUCKETS	20
+
+struct sysstat_call {
+	__u64 sc_calls;				/* times called */
+	__u64 sc_errors;			/* ...that failed */
+	__u64 sc_totalns;			/* total latency (ns) */
+	__u32 sc_hist[SYSSTAT_NBUCKETS];	/* latency histogram */
+};
+
+struct sysstat_trace {
+	__u64 st_start;			/* time of day at entry (ns) */
+	__u64 st_duration;		/* latency (ns) */
+	__u32 st_seq;			/* record number */
+	__i32 st_pid;			/* calling process */
+	__i32 st_callno;		/* SYS_* */
+	__u32 st_args[4];		/* a0-a3, as passed */
+	__i32 st_retval;		/* return value if st_err is 0 */
+	__i32 st_err;			/* error code, or 0 */
+};
+
+#endif /* _KERN_SYSSTAT_H_ */
@@ -194,5 +194,8 @@ void kprintf_bootstrap(void);
 #define DIVROUNDUP(a,b) (((a)+(b)-1)/(b))
 #define ROUNDUP(a,b)    (DIVROUNDUP(a,b)*(b))
 
+/* Index of the lowest set bit of a nonzero word. */
+unsigned lowbit32(uint32_t word);
+
 
 #endif /* _LIB_H_ */
@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2015
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef LOCKSTAT_H
+#define LOCKSTAT_H
+
+/*
+ * Lock contention profiler. Enable with "options lockstat" in the
+ * kernel config.
+ *
+ * Each spinlock, lock, and CV carries a hook that points at a
+ * statistics class. Sleep locks and CVs are put in the class for
+ * their name when they're created; spinlocks have no name, so only
+ * the ones given one with SPINLOCK_SETNAME are tracked. All locks
+ * with the same name (e.g. every "openfile" lock) share one class.
+ *
+ * A lock acquisition is contended if the lock was held when we got
+ * there; only then is the wait timed. Every cv_wait counts as a
+ * contended wait. Hold times run from acquire to release.
+ *
+ * Nothing is counted until lockstat_bootstrap has been called, since
+ * the timestamps come from the real-time clock device.
+ */
+
+#include "opt-lockstat.h"
+
+#if OPT_LOCKSTAT
+
+/* Kinds of lock, for lockstat_register. */
+#define LOCKSTAT_SPIN	's'
+#define LOCKSTAT_LOCK	'l'
+#define LOCKSTAT_CV	'c'
+
+struct lockstat_class;
+
+struct lockstat_hook {
+	struct lockstat_class *lh_class;	/* NULL if not tracked */
+	uint64_t lh_since;			/* when the holder got it (ns) */
+};
+
+void lockstat_bootstrap(void);
+void lockstat_register(struct lockstat_hook *h, char kind, const char *name);
+uint64_t lockstat_now(struct lockstat_hook *h);
+void lockstat_acquired(struct lockstat_hook *h, uint64_t waitstart);
+void lockstat_released(struct lockstat_hook *h);
+void lockstat_waited(struct lockstat_hook *h, uint64_t waitstart);
+
+/* Print the N most contended classes; reset all counters. */
+void lockstat_print(unsigned n);
+void lockstat_reset(void);
+
+#define LOCKSTAT_HOOK(sym)		struct lockstat_hook sym
+/* This brings its own comma, because it may expand to nothing. */
+#define LOCKSTAT_HOOK_INITIALIZER	{ NULL, 0 },
+
+#define LOCKSTAT_HOOKINIT(h)	((h)->lh_class = NULL, (h)->lh_since = 0)
+#define LOCKSTAT_REGISTER(h, kind, name) lockstat_register(h, kind, name)
+
+#define LOCKSTAT_BOOTSTRAP()	lockstat_bootstrap()
+
+/*
+ * Declare a wait start time; set it the first time the lock turns out
+ * to be held; pass it along once the lock is acquired.
+ */
+#define LOCKSTAT_WAITVAR(v)	uint64_t v = 0
+#define LOCKSTAT_CONTENDED(h, v) \
+	((v) == 0 ? (void)((v) = lockstat_now(h)) : (void)0)
+#define LOCKSTAT_ACQUIRED(h, v)	lockstat_acquired(h, v)
+#define LOCKSTAT_RELEASED(h)	lockstat_released(h)
+
+/* For CVs: the whole sleep is the wait. */
+#define LOCKSTAT_WAITSTART(h, v) ((v) = lockstat_now(h))
+#define LOCKSTAT_WAITED(h, v)	lockstat_waited(h, v)
+
+#else
+
+#define LOCKSTAT_HOOK(sym)
+#define LOCKSTAT_HOOK_INITIALIZER
+
+#define LOCKSTAT_HOOKINIT(h)
+#define LOCKSTAT_REGISTER(h, kind, name)
+
+#define LOCKSTAT_BOOTSTRAP()
+
+#define LOCKSTAT_WAITVAR(v)
+#define LOCKSTAT_CONTENDED(h, v)
+#define LOCKSTAT_ACQUIRED(h, v)
+#define LOCKSTAT_RELEASED(h)
+
+#define LOCKSTAT_WAITSTART(h, v)
+#define LOCKSTAT_WAITED(h, v)
+
+#endif
+
+#endif /* LOCKSTAT_H */
@@ -52,6 +52,12 @@ void mainbus_interrupt(struct trapframe *);
 /* XXX this interface is not adequately MI */
 size_t mainbus_ramsize(void);
 
+/*
+ * Make the current CPU's next timer interrupt (hardclock) happen in
+ * NSECS nanoseconds instead of the usual 1/HZ second. (Low-level.)
+ */
+void mainbus_settimer(uint64_t nsecs);
+
 /* Switch on an inter-processor interrupt. (Low-level.) */
 void mainbus_send_ipi(struct cpu *target);
 
@@ -70,5 +70,12 @@ void pid_setexitstatus(int status);
  */
 int pid_wait(pid_t targetpid, int *status, int flags, pid_t *retpid);
 
+/*
+ * Collects up to N exited children of the current thread at once,
+ * waiting for the first one unless WNOHANG is given.
+ */
+int pid_waitmany(pid_t *pids, int *statuses, unsigned n, int flags,
+		 unsigned *count);
+
 
 #endif /* _PID_H_ */
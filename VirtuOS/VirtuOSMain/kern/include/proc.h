@@ -41,20 +41,35 @@
 
 struct addrspace;
 struct vnode;
+struct uthread;
+struct ioring_ctx;
 
 /*
  * Process structure.
  *
- * Note that unless you implement multithreaded processes, p_threads
- * will only contain one thread for all processes other than kproc.
+ * p_threads holds every thread in the process. Threads other than
+ * the first are made by the thread_create syscall and get a nonzero
+ * thread id; p_uthreads keeps a record for each of those until it
+ * is joined, so thread_join can collect its return value. The
+ * process exits when its last thread does.
+ *
+ * p_exiting is set when a thread calls _exit (or dies of a fatal
+ * trap). From then on the other threads leave the process instead
+ * of returning to user mode, and futex_wait and thread_join give up
+ * with EINTR so blocked threads get there too.
  *
  * Note: you can't protect p_threads with a spinlock because it needs
  * to be able to call kmalloc.
  */
 struct proc {
 	char *p_name;			/* Name of this process */
-	struct lock *p_threadslock;	/* Lock for p_threads */
+	struct lock *p_threadslock;	/* Lock for p_threads and join data */
 	struct threadarray p_threads;	/* Threads in this process */
+	struct cv *p_threadcv;		/* Signaled when a thread exits */
+	struct uthread *p_uthreads;	/* Join records */
+	int p_nexttid;			/* Next thread id to hand out */
+	int p_exitstatus;		/* Status when the last thread exits */
+	bool p_exiting;			/* _exit called; threads must leave */
 	struct spinlock p_lock;		/* Lock for rest of this structure */
 	pid_t p_pid;			/* Process ID */
 
@@ -64,6 +79,10 @@ struct proc {
 	/* VFS */
 	struct vnode *p_cwd;		/* current working directory */
 	struct filetable *p_filetable;	/* table of open files */
+	struct ioring_ctx *p_ioring;	/* I/O submission ring, if any */
+
+	/* Debugging */
+	bool p_systrace;		/* log syscalls (see syscallstat.h) */
 
 	/* add more material here as needed */
 };
@@ -87,14 +106,50 @@ void proc_unfork(struct proc *proc);
 void proc_destroy(struct proc *proc);
 
 /*
- * Cause the current process to exit. The current thread switches
- * itself into the kernel process.
+ * Cause the current process to exit. Any other threads in it are
+ * made to leave first; then the current thread switches itself into
+ * the kernel process and the process is destroyed. If another thread
+ * is already exiting the process, its status wins and the current
+ * thread just leaves.
+ *
+ * Threads asleep in the kernel other than in futex_wait or
+ * thread_join (for example on a pipe) leave when they wake up, and
+ * the exit waits for them.
  *
  * The status code should be prepared with one of the _MKWAIT macros
  * defined in <kern/wait.h>.
  */
 void proc_exit(int status);
 
+/*
+ * Called on the way back to user mode: if the process is exiting,
+ * leave it instead.
+ */
+void proc_checkexit(void);
+
+/*
+ * Thread-level exit: leave the process, handing RETVAL to whoever
+ * joins us. The process exits too if we were the last thread.
+ */
+__DEAD void proc_thread_exit(userptr_t retval);
+
+/* Allocate a thread id and join record for a new thread. */
+int proc_newtid(int *ret);
+
+/* Undo proc_newtid if the thread never got going. */
+void proc_droptid(int tid);
+
+/* Wait for the thread with id TID to exit and collect its RETVAL. */
+int proc_jointid(int tid, userptr_t *retval);
+
+/*
+ * Set the nice value or the affinity mask of every thread of the
+ * current process. proc_setaffinity fails with EINVAL, changing
+ * nothing, if the mask allows no cpu that exists.
+ */
+void proc_setnice(int nice);
+int proc_setaffinity(uint32_t mask);
+
 /* Attach a thread to a process. Must not already have a process. */
 int proc_addthread(struct proc *proc, struct thread *t);
 
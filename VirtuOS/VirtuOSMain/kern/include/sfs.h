@@ -56,6 +56,21 @@ struct sfs_vnode {
 	struct sfs_dinode sv_i;		/* copy of on-disk inode */
 	uint32_t sv_ino;                /* inode number */
 	bool sv_dirty;                  /* true if sv_i modified */
+	struct sfs_vnode *sv_dirtynext; /* links for sfs_dirtyvnodes */
+	struct sfs_vnode *sv_dirtyprev;
+	daddr_t sv_pa_next;             /* next block of prealloc window */
+	uint32_t sv_pa_count;           /* blocks left in prealloc window */
+};
+
+/*
+ * Counts of metadata written back by sfs_sync.
+ */
+struct sfs_syncstats {
+	uint32_t ss_syncs;              /* number of syncs */
+	uint64_t ss_inodebytes;         /* bytes of inodes written */
+	uint64_t ss_freemapbytes;       /* bytes of freemap written */
+	uint64_t ss_superbytes;         /* bytes of superblock written */
+	uint32_t ss_lastbytes;          /* total written by the last sync */
 };
 
 /*
@@ -69,6 +84,10 @@ struct sfs_fs {
 	struct vnodearray *sfs_vnodes;  /* vnodes loaded into memory */
 	struct bitmap *sfs_freemap;     /* blocks in use are marked 1 */
 	bool sfs_freemapdirty;          /* true if freemap modified */
+	struct bitmap *sfs_freemapdirtymap; /* ...and which of its blocks */
+	struct sfs_vnode *sfs_dirtyvnodes; /* vnodes with sv_dirty set */
+	struct sfs_syncstats sfs_syncstats;
+	struct bitmap *sfs_reservemap;  /* blocks in prealloc windows */
 };
 
 /*
@@ -76,5 +95,10 @@ struct sfs_fs {
  */
 int sfs_mount(const char *device);
 
+/*
+ * Print the sync statistics for FS, if it is an sfs volume.
+ */
+int sfs_printstats(struct fs *fs);
+
 
 #endif /* _SFS_H_ */
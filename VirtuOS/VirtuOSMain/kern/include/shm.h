@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _SHM_H_
+#define _SHM_H_
+
+/*
+ * Shared memory objects: a run of pages that can be mapped into any
+ * number of address spaces at once, so that processes see each
+ * other's stores with no copying. An object either has a name, and
+ * lives until it is unlinked and unmapped everywhere, or is
+ * anonymous, and is shared only by processes that inherit a mapping
+ * of it through fork. Pages are allocated and zeroed on first touch.
+ *
+ * The system calls are in syscall.h; the address space side is
+ * as_map_shared/as_unmap_shared in addrspace.h.
+ */
+
+/* Largest object, in bytes. */
+#define SHM_MAXSIZE	(4*1024*1024)
+
+struct shmobj;
+
+/* Set up the namespace. */
+void shm_bootstrap(void);
+
+/*
+ * Find or create an object. NAME may be NULL for a new anonymous
+ * object. FLAGS are O_CREAT and O_EXCL, as for open. SIZE is the
+ * size to create with; for an existing object it may be 0, and
+ * otherwise must not exceed the object's size. The object comes back
+ * with a reference held for the caller.
+ */
+int shmobj_open(const char *name, int flags, size_t size,
+		struct shmobj **ret);
+
+/* Remove NAME from the namespace. */
+int shmobj_unlink(const char *name);
+
+/* Reference counting; one reference per mapping. */
+void shmobj_incref(struct shmobj *so);
+void shmobj_decref(struct shmobj *so);
+
+/* Size of the object in bytes (a multiple of PAGE_SIZE). */
+size_t shmobj_size(struct shmobj *so);
+
+/*
+ * Get the frame for page INDEX, allocating it if needed. The frame
+ * belongs to the object; a page table entry for it must take its
+ * own reference with frame_ref_increase.
+ */
+int shmobj_getpage(struct shmobj *so, unsigned index, paddr_t *ret);
+
+
+#endif /* _SHM_H_ */
@@ -37,6 +37,7 @@
 
 #include <cdefs.h>
 #include <hangman.h>
+#include <lockstat.h>
 
 /* Inlining support - for making sure an out-of-line copy gets built */
 #ifndef SPINLOCK_INLINE
@@ -58,6 +59,7 @@
 struct spinlock {
 	volatile spinlock_data_t splk_lock; /* Memory word where we spin. */
 	struct cpu *splk_holder;	    /* CPU holding this lock. */
+	LOCKSTAT_HOOK(splk_lockstat);	    /* Contention profiler hook. */
 	HANGMAN_LOCKABLE(splk_hangman);     /* Deadlock detector hook. */
 };
 
@@ -66,9 +68,11 @@ struct spinlock {
  */
 #ifdef OPT_HANGMAN
 #define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL, \
+				  LOCKSTAT_HOOK_INITIALIZER \
 				  HANGMAN_LOCKABLE_INITIALIZER }
 #else
-#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL }
+#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL, \
+				  LOCKSTAT_HOOK_INITIALIZER }
 #endif
 
 /*
@@ -91,5 +95,13 @@ void spinlock_release(struct spinlock *lk);
 
 bool spinlock_do_i_hold(struct spinlock *lk);
 
+/*
+ * Spinlocks have no names, so lockstat only tracks the ones that are
+ * given one with this. It goes after spinlock_init (or the static
+ * initializer), before the lock is used.
+ */
+#define SPINLOCK_SETNAME(lk, name) \
+	LOCKSTAT_REGISTER(&(lk)->splk_lockstat, LOCKSTAT_SPIN, name)
+
 
 #endif /* _SPINLOCK_H_ */
@@ -37,6 +37,8 @@
 
 #include <spinlock.h>
 
+struct timespec; /* in kern/time.h */
+
 /*
  * Dijkstra-style semaphore.
  *
@@ -75,6 +77,7 @@ void V(struct semaphore *);
 struct lock {
         char *lk_name;
         HANGMAN_LOCKABLE(lk_hangman);   /* Deadlock detector hook. */
+        LOCKSTAT_HOOK(lk_lockstat);     /* Contention profiler hook. */
         struct wchan *lk_wchan;
         struct spinlock lk_lock;
         struct thread *volatile lk_holder;
@@ -93,10 +96,15 @@ void lock_destroy(struct lock *);
  *                   false otherwise.
  *
  * These operations must be atomic. You get to write them.
+ *
+ * lock_acquire spins for a while, rather than sleeping, if the holder
+ * is running on another cpu, since it will probably release the lock
+ * soon. lock_setspin turns this off (for comparison in tests).
  */
 void lock_acquire(struct lock *);
 void lock_release(struct lock *);
 bool lock_do_i_hold(struct lock *);
+void lock_setspin(bool enabled);
 
 
 /*
@@ -117,6 +125,7 @@ struct cv {
         char *cv_name;
         struct wchan *cv_wchan;
         struct spinlock cv_wchanlock;
+        LOCKSTAT_HOOK(cv_lockstat);     /* Contention profiler hook. */
 };
 
 struct cv *cv_create(const char *name);
@@ -128,16 +137,73 @@ void cv_destroy(struct cv *);
  *                   waking up again, re-acquire the lock.
  *    cv_signal    - Wake up one thread that's sleeping on this CV.
  *    cv_broadcast - Wake up all threads sleeping on this CV.
+ *    cv_timedwait - Like cv_wait, but give up after TIMEOUT. Returns
+ *                   ETIMEDOUT if that happened and 0 if woken up.
+ *                   The lock is re-acquired either way.
  *
- * For all three operations, the current thread must hold the lock passed
- * in. Note that under normal circumstances the same lock should be used
- * on all operations with any particular CV.
+ * For all of these operations, the current thread must hold the lock
+ * passed in. Note that under normal circumstances the same lock should
+ * be used on all operations with any particular CV.
  *
  * These operations must be atomic. You get to write them.
  */
 void cv_wait(struct cv *cv, struct lock *lock);
+int cv_timedwait(struct cv *cv, struct lock *lock,
+		 const struct timespec *timeout);
 void cv_signal(struct cv *cv, struct lock *lock);
 void cv_broadcast(struct cv *cv, struct lock *lock);
 
 
+/*
+ * Reader-writer lock.
+ *
+ * Any number of readers may hold the lock at once, or one writer.
+ * Writers have preference: once a writer is waiting, new readers
+ * wait too, so a stream of readers can't starve writers. To keep
+ * writers from starving readers in turn, when a writer releases the
+ * lock every reader that was waiting at that point is let in before
+ * the next writer.
+ *
+ * Only writers are visible to the deadlock detector, as holders;
+ * readers are checked when they wait but never recorded as holding.
+ *
+ * The name field is for easier debugging. A copy of the name is
+ * made internally.
+ */
+
+struct rwlock {
+        char *rwl_name;
+        HANGMAN_LOCKABLE(rwl_hangman);  /* Deadlock detector hook. */
+        struct spinlock rwl_lock;       /* Protects the fields below */
+        struct wchan *rwl_readwchan;    /* Readers wait here */
+        struct wchan *rwl_writewchan;   /* Writers wait here */
+        unsigned rwl_readers;           /* Readers holding the lock */
+        unsigned rwl_readwaiting;       /* Readers waiting */
+        unsigned rwl_writewaiting;      /* Writers waiting */
+        unsigned rwl_readpass;          /* Readers let past writers */
+        struct thread *rwl_writer;      /* Writer holding the lock */
+};
+
+struct rwlock *rwlock_create(const char *name);
+void rwlock_destroy(struct rwlock *);
+
+/*
+ * Operations:
+ *    rwlock_acquire_read  - Get the lock for reading.
+ *    rwlock_release_read  - Give up a read hold.
+ *    rwlock_acquire_write - Get the lock for writing (exclusively).
+ *    rwlock_release_write - Give up the write hold.
+ *    rwlock_do_i_hold_write - Return true if the current thread holds
+ *                   the lock for writing. (There is no equivalent for
+ *                   reading, because readers aren't tracked.)
+ *
+ * A thread must not acquire a lock it already holds, in either mode.
+ */
+void rwlock_acquire_read(struct rwlock *);
+void rwlock_release_read(struct rwlock *);
+void rwlock_acquire_write(struct rwlock *);
+void rwlock_release_write(struct rwlock *);
+bool rwlock_do_i_hold_write(struct rwlock *);
+
+
 #endif /* _SYNCH_H_ */
@@ -48,13 +48,14 @@ void syscall(struct trapframe *tf);
 /* Helper for fork(). You write this. */
 void enter_forked_process(struct trapframe *tf);
 
+/* Helper for thread_create(). */
+__DEAD void enter_new_thread(struct trapframe *tf, vaddr_t entry,
+			     vaddr_t arg, vaddr_t stacktop);
+
 /* Enter user mode. Does not return. */
 __DEAD void enter_new_process(int argc, userptr_t argv, userptr_t env,
 		       vaddr_t stackptr, vaddr_t entrypoint);
 
-/* Setup function for exec. */
-void exec_bootstrap(void);
-
 
 /*
  * Prototypes for IN-KERNEL entry points for system call implementations.
@@ -65,18 +66,45 @@ void exec_bootstrap(void);
 
 int sys_reboot(int code);
 int sys___time(userptr_t user_seconds, userptr_t user_nanoseconds);
+int sys_nanosleep(const_userptr_t req, userptr_t rem);
 
 int sys_fork(struct trapframe *tf, pid_t *retval);
+int sys___thread_create(struct trapframe *tf, userptr_t entry, userptr_t arg,
+			userptr_t stacktop, int *retval);
+int sys___thread_join(int tid, userptr_t retval);
+__DEAD void sys___thread_exit(userptr_t retval);
 int sys_execv(userptr_t prog, userptr_t args);
 __DEAD void sys__exit(int code);
 int sys_waitpid(pid_t pid, userptr_t returncode, int flags, pid_t *retval);
+int sys_waitmany(userptr_t pids, userptr_t statuses, int n, int flags,
+		 int *retval);
 int sys_getpid(pid_t *retval);
+int sys_getpriority(int which, pid_t who, int *retval);
+int sys_setpriority(int which, pid_t who, int prio);
+int sys_sched_setaffinity(pid_t pid, uint32_t mask);
+int sys_sched_getaffinity(pid_t pid, userptr_t mask);
+int sys_futex_wait(userptr_t uaddr, int val, const_userptr_t timeout);
+int sys_futex_wake(userptr_t uaddr, int count, int *retval);
+int sys_shm_map(const_userptr_t name, int flags, size_t size, int32_t *retval);
+int sys_shm_unmap(userptr_t addr);
+int sys_shm_unlink(const_userptr_t name);
+int sys_ioring_setup(unsigned entries, int32_t *retval);
+int sys_ioring_enter(unsigned tosubmit, int *retval);
+int sys_sysstat(userptr_t buf, unsigned ncalls, int *retval);
+int sys_sysstat_reset(void);
+int sys_systrace(int on, int *retval);
+int sys_systrace_read(userptr_t buf, unsigned n, int *retval);
 
 int sys_open(const_userptr_t filename, int flags, mode_t mode, int *retval);
 int sys_dup2(int oldfd, int newfd, int *retval);
+int sys_pipe(userptr_t fds, int flags, size_t size);
 int sys_close(int fd);
 int sys_read(int fd, userptr_t buf, size_t size, int *retval);
 int sys_write(int fd, userptr_t buf, size_t size, int *retval);
+int sys_pread(int fd, userptr_t buf, size_t size, off_t pos, int *retval);
+int sys_pwrite(int fd, userptr_t buf, size_t size, off_t pos, int *retval);
+int sys_readv(int fd, const_userptr_t iov, int iovcnt, int *retval);
+int sys_writev(int fd, const_userptr_t iov, int iovcnt, int *retval);
 int sys_lseek(int fd, off_t offset, int code, off_t *retval);
 
 int sys_chdir(const_userptr_t path);
@@ -89,9 +117,12 @@ int sys_remove(userptr_t path);
 int sys_link(userptr_t oldpath, userptr_t newpath);
 int sys_rename(userptr_t oldpath, userptr_t newpath);
 int sys_getdirentry(int fd, userptr_t buf, size_t buflen, int *retval);
+int sys_getdirentries(int fd, userptr_t buf, size_t buflen, int *retval);
 int sys_fstat(int fd, userptr_t statptr);
+int sys_fstatat(int dirfd, const_userptr_t path, userptr_t statptr, int flags);
 int sys_fsync(int fd);
 int sys_ftruncate(int fd, off_t len);
+int sys_fallocate(int fd, off_t pos, off_t len);
 int sys_sbrk(intptr_t amount, int32_t* retval);
 int sys_mmap(size_t length, int prot, int fd, off_t offset, int32_t* retval);
 
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef SYSCALLSTAT_H
+#define SYSCALLSTAT_H
+
+/*
+ * Per-system-call counters, latency histograms, and tracing. Enable
+ * with "options syscallstat" in the kernel config. The system call
+ * dispatcher uses the macros below, which go away without it; the
+ * calls that read the results are described in <kern/sysstat.h>.
+ */
+
+#include "opt-syscallstat.h"
+
+#if OPT_SYSCALLSTAT
+
+struct trapframe;
+
+uint64_t syscallstat_enter(int callno);
+void syscallstat_exit(struct trapframe *tf, int callno, uint64_t start,
+		      int err, int32_t retval);
+
+#define SYSCALLSTAT_STARTVAR(v)		uint64_t v
+#define SYSCALLSTAT_ENTER(callno, v)	((v) = syscallstat_enter(callno))
+#define SYSCALLSTAT_EXIT(tf, callno, v, err, retval) \
+	syscallstat_exit(tf, callno, v, err, retval)
+
+#else
+
+#define SYSCALLSTAT_STARTVAR(v)
+#define SYSCALLSTAT_ENTER(callno, v)
+#define SYSCALLSTAT_EXIT(tf, callno, v, err, retval)
+
+#endif
+
+#endif /* SYSCALLSTAT_H */
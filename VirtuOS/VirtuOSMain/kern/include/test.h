@@ -53,10 +53,16 @@ int threadlisttest(int, char **);
 int threadtest(int, char **);
 int threadtest2(int, char **);
 int threadtest3(int, char **);
+int threadtest4(int, char **);
+int timertest(int, char **);
+int timertest2(int, char **);
 int semtest(int, char **);
 int locktest(int, char **);
 int cvtest(int, char **);
 int cvtest2(int, char **);
+int locktest2(int, char **);
+int rwtest(int, char **);
+int rwtest2(int, char **);
 
 /* semaphore unit tests */
 int semu1(int, char **);
@@ -91,6 +97,11 @@ int longstress(int, char **);
 int createstress(int, char **);
 int printfile(int, char **);
 
+/* disk queue tests (lhdtest.c) */
+int lhdtest(int, char **);
+int lhdtest2(int, char **);
+int lhdstats(int, char **);
+
 /* other tests */
 int kmalloctest(int, char **);
 int kmallocstress(int, char **);
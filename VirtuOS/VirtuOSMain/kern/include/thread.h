@@ -64,6 +64,9 @@ typedef enum {
 	S_ZOMBIE,	/* zombie; exited but not yet deleted */
 } threadstate_t;
 
+/* Affinity mask allowing every cpu. */
+#define THREAD_ALLCPUS	0xffffffff
+
 /* Thread structure. */
 struct thread {
 	/*
@@ -101,12 +104,34 @@ struct thread {
 	bool t_in_interrupt;		/* Are we in an interrupt? */
 	int t_curspl;			/* Current spl*() state */
 	int t_iplhigh_count;		/* # of times IPL has been raised */
+	volatile bool t_oncpu;		/* Running right now (for lock spinning) */
+
+	/*
+	 * Scheduler fields. See the MLFQ notes in thread.c.
+	 *
+	 * t_priority is the thread's queue level; 0 is the highest.
+	 * It never goes above (numerically below) the level its nice
+	 * value allows. t_quantum counts the hardclocks left before
+	 * the thread is demoted. t_age counts schedule() passes spent
+	 * waiting on a run queue and drives anti-starvation aging.
+	 * t_lastrun is the t_cpu hardclock count when the thread last
+	 * stopped running, used to avoid stealing cache-hot threads.
+	 * t_affinity has bit N set if the thread may run on cpu N.
+	 * All of these are protected by the run queue lock of t_cpu
+	 * while the thread is on a run queue.
+	 */
+	unsigned t_priority;		/* Current MLFQ level */
+	unsigned t_quantum;		/* Hardclocks left at this level */
+	unsigned t_age;			/* schedule() passes spent waiting */
+	unsigned t_lastrun;		/* c_hardclocks when last switched out */
+	uint32_t t_affinity;		/* Mask of cpus we may run on */
+	int t_nice;			/* PRIO_MIN..PRIO_MAX, as for setpriority */
 
 	/*
 	 * Public fields
 	 */
 
-	/* add more here as needed */
+	int t_tid;			/* User thread id in t_proc (0: first) */
 };
 
 /*
@@ -163,11 +188,47 @@ void thread_yield(void);
  */
 void schedule(void);
 
+/*
+ * Charge the current thread for one hardclock, and preempt it if its
+ * quantum has run out or a higher-priority thread is waiting. Called
+ * from the timer interrupt.
+ */
+void thread_timeslice(void);
+
+/*
+ * Get the nice value of the current thread, and set that of any
+ * thread. The value is clamped to PRIO_MIN..PRIO_MAX.
+ */
+int thread_getnice(void);
+void thread_setnice(struct thread *t, int nice);
+
+/*
+ * Get the affinity mask of the current thread, and set that of any
+ * thread. Bit N allows the thread to run on cpu N. Setting fails
+ * with EINVAL if the mask allows no cpu that exists. If the thread's
+ * cpu is no longer allowed, it moves at its next context switch; see
+ * thread_switch for why it can't always move right away.
+ */
+uint32_t thread_getaffinity(void);
+int thread_setaffinity(struct thread *t, uint32_t mask);
+
 /*
  * Potentially migrate ready threads to other CPUs. Called from the
  * timer interrupt.
  */
 void thread_consider_migration(void);
 
+/*
+ * Turn idle-time work stealing on or off (it is on by default), and
+ * print per-cpu scheduler statistics.
+ */
+void thread_setsteal(bool enabled);
+void thread_printschedstats(void);
+
+/*
+ * Total number of times any cpu has woken up from cpu_idle.
+ */
+unsigned thread_idlewakeups(void);
+
 
 #endif /* _THREAD_H_ */
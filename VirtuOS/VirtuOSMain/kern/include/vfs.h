@@ -200,5 +200,29 @@ void vfs_biglock_acquire(void);
 void vfs_biglock_release(void);
 bool vfs_biglock_do_i_hold(void);
 
+/*
+ * Name cache (vfsncache.c), used by vfs_lookup and vfs_lookparent.
+ *
+ *    vfs_ncache_lookup   - Look up NAME in DIR. Returns true on a hit,
+ *                          with *RESULT a new reference or NULL if NAME
+ *                          is known not to exist. Returns false on a miss.
+ *    vfs_ncache_enter    - Record that NAME in DIR is VN (NULL: absent).
+ *    vfs_ncache_purge    - Forget NAME in DIR. Must be called whenever a
+ *                          name is created, removed, or renamed.
+ *    vfs_ncache_purgedir - Forget every name cached under DIR.
+ *    vfs_ncache_purgefs  - Forget everything on FS (NULL: everything).
+ *
+ * The caller must hold the vfs_biglock for lookup and enter.
+ */
+void vfs_ncache_bootstrap(void);
+bool vfs_ncache_lookup(struct vnode *dir, const char *name,
+		       struct vnode **result);
+void vfs_ncache_enter(struct vnode *dir, const char *name, struct vnode *vn);
+void vfs_ncache_purge(struct vnode *dir, const char *name);
+void vfs_ncache_purgedir(struct vnode *dir);
+void vfs_ncache_purgefs(struct fs *fs);
+void vfs_ncache_setenabled(bool enabled);
+void vfs_ncache_printstats(void);
+
 
 #endif /* _VFS_H_ */
@@ -72,6 +72,9 @@ int frame_ref_count_check(paddr_t frame_no);
 /* TLB shootdown handling called from interprocessor_interrupt */
 void vm_tlbshootdown(const struct tlbshootdown *);
 
+/* Flush VADDR from the TLBs of cpus running curproc's other threads */
+void vm_shootdown_others(vaddr_t vaddr);
+
 // EXTRA HELPER FUNCTIONS FOR THE VM MANAGEMENT AND THE PAGE TABLE HANDLING
 
 
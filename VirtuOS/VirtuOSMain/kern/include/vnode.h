@@ -98,6 +98,19 @@ struct vnode {
  *                      handled in the normal fashion.
  *                      On non-directory objects, return ENOTDIR.
  *
+ *    vop_getdirentries - Read as many directory entries as fit into
+ *                      a uio, packed as struct dirent records (see
+ *                      <kern/dirent.h>), starting at the offset in the
+ *                      uio and leaving it at the first entry not read.
+ *                      The offset means the same as for
+ *                      vop_getdirentry. Stops at the first entry that
+ *                      doesn't fit; if not even one does, returns
+ *                      EINVAL. Reads nothing at end of directory.
+ *                      Filesystems without anything better can use
+ *                      vnode_getdirentries, which loops over
+ *                      vop_getdirentry.
+ *                      On non-directory objects, return ENOTDIR.
+ *
  *    vop_write       - Write data from uio to file at offset specified
  *                      in the uio, updating uio_resid to reflect the
  *                      amount written, and updating uio_offset to match.
@@ -127,6 +140,11 @@ struct vnode {
  *    vop_truncate    - Forcibly set size of file to the length passed
  *                      in, discarding any excess blocks.
  *
+ *    vop_fallocate   - Allocate storage for LEN bytes of file starting
+ *                      at offset POS, contiguously if the filesystem
+ *                      can, extending the file if the range runs past
+ *                      its end.
+ *
  *    vop_namefile    - Compute pathname relative to filesystem root
  *                      of the file and copy to the specified
  *                      uio. Need not work on objects that are not
@@ -187,6 +205,7 @@ struct vnode_ops {
 	int (*vop_read)(struct vnode *file, struct uio *uio);
 	int (*vop_readlink)(struct vnode *link, struct uio *uio);
 	int (*vop_getdirentry)(struct vnode *dir, struct uio *uio);
+	int (*vop_getdirentries)(struct vnode *dir, struct uio *uio);
 	int (*vop_write)(struct vnode *file, struct uio *uio);
 	int (*vop_ioctl)(struct vnode *object, int op, userptr_t data);
 	int (*vop_stat)(struct vnode *object, struct stat *statbuf);
@@ -195,6 +214,7 @@ struct vnode_ops {
 	int (*vop_fsync)(struct vnode *object);
 	int (*vop_mmap)(struct vnode *file /* add stuff */);
 	int (*vop_truncate)(struct vnode *file, off_t len);
+	int (*vop_fallocate)(struct vnode *file, off_t pos, off_t len);
 	int (*vop_namefile)(struct vnode *file, struct uio *uio);
 
 
@@ -231,6 +251,7 @@ struct vnode_ops {
 #define VOP_READ(vn, uio)               (__VOP(vn, read)(vn, uio))
 #define VOP_READLINK(vn, uio)           (__VOP(vn, readlink)(vn, uio))
 #define VOP_GETDIRENTRY(vn, uio)        (__VOP(vn,getdirentry)(vn, uio))
+#define VOP_GETDIRENTRIES(vn, uio)      (__VOP(vn,getdirentries)(vn, uio))
 #define VOP_WRITE(vn, uio)              (__VOP(vn, write)(vn, uio))
 #define VOP_IOCTL(vn, code, buf)        (__VOP(vn, ioctl)(vn,code,buf))
 #define VOP_STAT(vn, ptr) 	        (__VOP(vn, stat)(vn, ptr))
@@ -239,6 +260,7 @@ struct vnode_ops {
 #define VOP_FSYNC(vn)                   (__VOP(vn, fsync)(vn))
 #define VOP_MMAP(vn /*add stuff */)     (__VOP(vn, mmap)(vn /*add stuff */))
 #define VOP_TRUNCATE(vn, pos)           (__VOP(vn, truncate)(vn, pos))
+#define VOP_FALLOCATE(vn, pos, len)     (__VOP(vn, fallocate)(vn, pos, len))
 #define VOP_NAMEFILE(vn, uio)           (__VOP(vn, namefile)(vn, uio))
 
 #define VOP_CREAT(vn,nm,excl,mode,res)  (__VOP(vn, creat)(vn,nm,excl,mode,res))
@@ -279,6 +301,12 @@ int vnode_init(struct vnode *, const struct vnode_ops *ops,
  */
 void vnode_cleanup(struct vnode *);
 
+/*
+ * Generic vop_getdirentries for filesystems that only have
+ * vop_getdirentry. Reports every entry with d_ino 0 and DT_UNKNOWN.
+ */
+int vnode_getdirentries(struct vnode *dir, struct uio *uio);
+
 /*
  * Common stubs for vnode functions that just fail, in various ways.
  */
@@ -290,6 +318,8 @@ int vopfail_mmap_isdir(struct vnode *vn /* add stuff */);
 int vopfail_mmap_perm(struct vnode *vn /* add stuff */);
 int vopfail_mmap_nosys(struct vnode *vn /* add stuff */);
 int vopfail_truncate_isdir(struct vnode *vn, off_t pos);
+int vopfail_fallocate_isdir(struct vnode *vn, off_t pos, off_t len);
+int vopfail_fallocate_nosys(struct vnode *vn, off_t pos, off_t len);
 int vopfail_creat_notdir(struct vnode *vn, const char *name, bool excl,
 			 mode_t mode, struct vnode **result);
 int vopfail_symlink_notdir(struct vnode *vn, const char *contents,
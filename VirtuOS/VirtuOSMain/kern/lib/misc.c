@@ -47,6 +47,38 @@ kstrdup(const char *s)
 	return z;
 }
 
+/*
+ * Index of the lowest set bit of a nonzero word. (Done by hand
+ * because there's no find-first-set instruction to use.)
+ */
+unsigned
+lowbit32(uint32_t word)
+{
+	unsigned bit = 0;
+
+	KASSERT(word != 0);
+	if ((word & 0xffff) == 0) {
+		word >>= 16;
+		bit += 16;
+	}
+	if ((word & 0xff) == 0) {
+		word >>= 8;
+		bit += 8;
+	}
+	if ((word & 0xf) == 0) {
+		word >>= 4;
+		bit += 4;
+	}
+	if ((word & 0x3) == 0) {
+		word >>= 2;
+		bit += 2;
+	}
+	if ((word & 0x1) == 0) {
+		bit += 1;
+	}
+	return bit;
+}
+
 /*
  * Standard C function to return a string for a given errno.
  * Kernel version; panics if it hits an unknown error.
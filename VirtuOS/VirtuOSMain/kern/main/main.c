@@ -47,6 +47,9 @@
 #include <vfs.h>
 #include <device.h>
 #include <pid.h>
+#include <lockstat.h>
+#include <futex.h>
+#include <shm.h>
 #include <syscall.h>
 #include <test.h>
 #include <version.h>
@@ -113,6 +116,8 @@ boot(void)
 	thread_bootstrap();
 	pid_bootstrap();
 	hardclock_bootstrap();
+	futex_bootstrap();
+	shm_bootstrap();
 	vfs_bootstrap();
 	kheap_nextgeneration();
 
@@ -127,9 +132,10 @@ boot(void)
 	kheap_nextgeneration();
 
 	/* Late phase of initialization. */
+	timer_bootstrap();
+	LOCKSTAT_BOOTSTRAP();
 	vm_bootstrap();
 	kprintf_bootstrap();
-	exec_bootstrap();
 	thread_start_cpus();
 
 	/* Default bootfs - but ignore failure, in case emu0 doesn't exist */
@@ -47,6 +47,7 @@
 #include <test.h>
 #include "opt-sfs.h"
 #include "opt-net.h"
+#include "opt-lockstat.h"
 
 /*
  * In-kernel menu and command dispatcher.
@@ -500,6 +501,117 @@ cmd_kheapdump(int nargs, char **args)
 	return 0;
 }
 
+static
+int
+cmd_ncache(int nargs, char **args)
+{
+	if (nargs == 1) {
+		vfs_ncache_printstats();
+	}
+	else if (nargs == 2 && !strcmp(args[1], "on")) {
+		vfs_ncache_setenabled(true);
+	}
+	else if (nargs == 2 && !strcmp(args[1], "off")) {
+		vfs_ncache_setenabled(false);
+	}
+	else if (nargs == 2 && !strcmp(args[1], "flush")) {
+		vfs_ncache_purgefs(NULL);
+	}
+	else {
+		kprintf("Usage: ncache [on|off|flush]\n");
+	}
+
+	return 0;
+}
+
+/*
+ * Command for printing scheduler statistics and turning idle-time
+ * work stealing on and off.
+ */
+static
+int
+cmd_sched(int nargs, char **args)
+{
+	if (nargs == 1) {
+		thread_printschedstats();
+		clock_printstats();
+	}
+	else if (nargs == 2 && !strcmp(args[1], "steal")) {
+		thread_setsteal(true);
+	}
+	else if (nargs == 2 && !strcmp(args[1], "nosteal")) {
+		thread_setsteal(false);
+	}
+	else {
+		kprintf("Usage: sched [steal|nosteal]\n");
+	}
+
+	return 0;
+}
+
+#if OPT_LOCKSTAT
+/*
+ * Command for printing the most contended locks, or resetting the
+ * counters.
+ */
+static
+int
+cmd_lockstat(int nargs, char **args)
+{
+	if (nargs == 1) {
+		lockstat_print(10);
+	}
+	else if (nargs == 2 && !strcmp(args[1], "reset")) {
+		lockstat_reset();
+	}
+	else if (nargs == 2 && atoi(args[1]) > 0) {
+		lockstat_print(atoi(args[1]));
+	}
+	else {
+		kprintf("Usage: lockstat [count|reset]\n");
+	}
+
+	return 0;
+}
+#endif
+
+#if OPT_SFS
+/*
+ * Command for printing the metadata sync statistics of an sfs volume.
+ */
+static
+int
+cmd_sfsstat(int nargs, char **args)
+{
+	struct vnode *root;
+	char *device;
+	int result;
+
+	if (nargs != 2) {
+		kprintf("Usage: sfsstat device:\n");
+		return EINVAL;
+	}
+
+	device = args[1];
+
+	/* Allow (but do not require) colon after device name */
+	if (device[strlen(device)-1]==':') {
+		device[strlen(device)-1] = 0;
+	}
+
+	result = vfs_getroot(device, &root);
+	if (result) {
+		return result;
+	}
+	result = sfs_printstats(root->vn_fs);
+	VOP_DECREF(root);
+	if (result) {
+		kprintf("sfsstat: %s is not an sfs volume\n", device);
+	}
+	return result;
+}
+#endif
+
 ////////////////////////////////////////
 //
 // Menus.
@@ -569,6 +681,9 @@ static const char *testmenu[] = {
 	"[tt1] Thread test 1                 ",
 	"[tt2] Thread test 2                 ",
 	"[tt3] Thread test 3                 ",
+	"[tt4] Thread fork benchmark         ",
+	"[tm1] Timer accuracy and idle test  ",
+	"[tm2] CV timed wait test            ",
 #if OPT_NET
 	"[net] Network test                  ",
 #endif
@@ -576,6 +691,9 @@ static const char *testmenu[] = {
 	"[sy2] Lock test                     ",
 	"[sy3] CV test                       ",
 	"[sy4] CV test #2                    ",
+	"[sy5] Lock handoff latency          ",
+	"[rw1] RW lock test                  ",
+	"[rw2] RW lock writer starvation     ",
 	"[semu1-22] Semaphore unit tests     ",
 	"[wt]  waitpid test                  ",
 	"[fs1] Filesystem test               ",
@@ -584,6 +702,8 @@ static const char *testmenu[] = {
 	"[fs4] FS write stress 2             ",
 	"[fs5] FS long stress                ",
 	"[fs6] FS create stress              ",
+	"[lhd1] Disk queue benchmark         ",
+	"[lhd2] Async I/O depth 1 vs 8       ",
 	NULL
 };
 
@@ -606,6 +726,13 @@ static const char *mainmenu[] = {
 	"[kh] Kernel heap stats              ",
 	"[khgen] Next kernel heap generation ",
 	"[khdump] Dump kernel heap           ",
+	"[ncache] VFS name cache stats       ",
+	"[lhd] Disk queue stats              ",
+	"[sfsstat] SFS metadata sync stats   ",
+	"[sched] Scheduler stats             ",
+#if OPT_LOCKSTAT
+	"[lockstat] Lock contention stats    ",
+#endif
 	"[q] Quit and shut down              ",
 	NULL
 };
@@ -657,6 +784,15 @@ static struct {
 	{ "kh",         cmd_kheapstats },
 	{ "khgen",      cmd_kheapgeneration },
 	{ "khdump",     cmd_kheapdump },
+	{ "ncache",     cmd_ncache },
+	{ "lhd",        lhdstats },
+#if OPT_SFS
+	{ "sfsstat",    cmd_sfsstat },
+#endif
+	{ "sched",      cmd_sched },
+#if OPT_LOCKSTAT
+	{ "lockstat",   cmd_lockstat },
+#endif
 
 	/* base system tests */
 	{ "at",		arraytest },
@@ -673,12 +809,18 @@ static struct {
 	{ "tt1",	threadtest },
 	{ "tt2",	threadtest2 },
 	{ "tt3",	threadtest3 },
+	{ "tt4",	threadtest4 },
+	{ "tm1",	timertest },
+	{ "tm2",	timertest2 },
 	{ "sy1",	semtest },
 
 	/* synchronization assignment tests */
 	{ "sy2",	locktest },
 	{ "sy3",	cvtest },
 	{ "sy4",	cvtest2 },
+	{ "sy5",	locktest2 },
+	{ "rw1",	rwtest },
+	{ "rw2",	rwtest2 },
 
 	/* semaphore unit tests */
 	{ "semu1",	semu1 },
@@ -715,6 +857,8 @@ static struct {
 	{ "fs4",	writestress2 },
 	{ "fs5",	longstress },
 	{ "fs6",	createstress },
+	{ "lhd1",	lhdtest },
+	{ "lhd2",	lhdtest2 },
 
 	{ NULL, NULL }
 };
@@ -50,27 +50,71 @@
  * If pi_ppid is INVALID_PID, the parent has gone away and will not be
  * waiting. If pi_ppid is INVALID_PID and pi_exited is true, the
  * structure can be freed.
+ *
+ * Each process keeps its children on one of two lists: pi_children
+ * while they run and pi_zombies once they've exited, linked through
+ * pi_sibnext/pi_sibprev. So waiting for any child, and disowning all
+ * of them, only looks at our own children. pi_cv is what a process
+ * waits on for its children to exit.
  */
 struct pidinfo {
 	pid_t pi_pid;			// process id of this thread
 	pid_t pi_ppid;			// process id of parent thread
 	volatile bool pi_exited;	// true if thread has exited
 	int pi_exitstatus;		// status (only valid if exited)
-	struct cv *pi_cv;		// use to wait for thread exit
+	struct cv *pi_cv;		// use to wait for children to exit
+	struct pidinfo *pi_next;	// next in hash chain
+	struct pidinfo *pi_children;	// running children
+	struct pidinfo *pi_zombies;	// exited, unwaited-for children
+	struct pidinfo *pi_sibnext;	// next on parent's list
+	struct pidinfo *pi_sibprev;	// previous on parent's list
 };
 
 
 /*
  * Global pid and exit data.
  *
- * The process table is an el-cheapo hash table. It's indexed by
- * (pid % PROCS_MAX), and only allows one process per slot. If a
- * new pid allocation would cause a hash collision, we just don't
- * use that pid.
+ * The process table is a hash table with chaining, indexed by
+ * (pid % PID_NBUCKETS). Each bucket has its own lock, which protects
+ * the chain and every pidinfo on it, including the child lists, and
+ * which is the lock used with their pi_cv. Since pids are handed out
+ * in sequence, processes created around the same time land in
+ * different buckets, so waiting for or reaping one process only
+ * contends with the few others that share its bucket.
+ *
+ * Parent and child are usually in different buckets. The rules are:
+ *
+ *   - A child's pi_ppid is changed only with both buckets locked, so
+ *     either lock is enough to read it.
+ *   - While a child has a parent, its place on the parent's lists and
+ *     its pi_exited and pi_exitstatus are protected by the parent's
+ *     bucket lock.
+ *   - When both locks are needed, they're taken in address order
+ *     (pb_lock2), since the parent/child relation says nothing about
+ *     the order of the buckets.
+ *
+ * Which pids are in use is kept in a separate two-level bitmap,
+ * protected by a spinlock, so finding a free pid never looks at the
+ * table. pidmap has a bit set for each pid in use; pidmap_full has a
+ * bit set for each word of pidmap that has no free pids left. The
+ * search starts at nextpid and goes around, so pids aren't reused
+ * sooner than they have to be.
  */
-static struct lock *pidlock;		// lock for global exit data
-static struct pidinfo *pidinfo[PROCS_MAX]; // actual pid info
-static pid_t nextpid;			// next candidate pid
+#define PID_NBUCKETS	256
+#define PIDMAP_WORDS	((PID_MAX + 32) / 32)
+#define PIDFULL_WORDS	((PIDMAP_WORDS + 31) / 32)
+
+struct pidbucket {
+	struct lock *pb_lock;		// protects pb_chain and its pidinfos
+	struct pidinfo *pb_chain;	// pidinfos that hash here
+};
+
+static struct pidbucket pidtable[PID_NBUCKETS];
+
+static struct spinlock pidmap_lock = SPINLOCK_INITIALIZER;
+static uint32_t pidmap[PIDMAP_WORDS];	// bit set: pid in use
+static uint32_t pidmap_full[PIDFULL_WORDS]; // bit set: pidmap word full
+static pid_t nextpid;			// where to start looking
 static int nprocs;			// number of allocated pids
 
 
@@ -101,6 +145,11 @@ pidinfo_create(pid_t pid, pid_t ppid)
 	pi->pi_ppid = ppid;
 	pi->pi_exited = false;
 	pi->pi_exitstatus = 0xbeef;  /* Recognizably invalid value */
+	pi->pi_next = NULL;
+	pi->pi_children = NULL;
+	pi->pi_zombies = NULL;
+	pi->pi_sibnext = NULL;
+	pi->pi_sibprev = NULL;
 
 	return pi;
 }
@@ -114,166 +163,367 @@ pidinfo_destroy(struct pidinfo *pi)
 {
 	KASSERT(pi->pi_exited == true);
 	KASSERT(pi->pi_ppid == INVALID_PID);
+	KASSERT(pi->pi_children == NULL);
+	KASSERT(pi->pi_zombies == NULL);
 	cv_destroy(pi->pi_cv);
 	kfree(pi);
 }
 
 ////////////////////////////////////////////////////////////
 
+/*
+ * Mark PID in use or free.
+ */
+static
+void
+pidmap_set(pid_t pid)
+{
+	unsigned w = pid / 32;
+
+	KASSERT(spinlock_do_i_hold(&pidmap_lock));
+	KASSERT((pidmap[w] & (1U << (pid % 32))) == 0);
+
+	pidmap[w] |= 1U << (pid % 32);
+	if (pidmap[w] == 0xffffffff) {
+		pidmap_full[w / 32] |= 1U << (w % 32);
+	}
+}
+
+static
+void
+pidmap_clear(pid_t pid)
+{
+	unsigned w = pid / 32;
+
+	KASSERT(spinlock_do_i_hold(&pidmap_lock));
+	KASSERT((pidmap[w] & (1U << (pid % 32))) != 0);
+
+	pidmap[w] &= ~(1U << (pid % 32));
+	pidmap_full[w / 32] &= ~(1U << (w % 32));
+}
+
+/*
+ * Find the first free pid at or after START, wrapping around at
+ * PID_MAX. Looks at most at two pidmap words and each pidmap_full
+ * word once, so the cost doesn't depend on how many pids are in use.
+ * There must be a free pid.
+ */
+static
+pid_t
+pidmap_findfree(pid_t start)
+{
+	unsigned w, fw, i;
+	uint32_t bits;
+
+	KASSERT(spinlock_do_i_hold(&pidmap_lock));
+	KASSERT(start >= PID_MIN && start <= PID_MAX);
+
+	/* The rest of the word START is in. */
+	w = start / 32;
+	bits = ~pidmap[w] & (0xffffffff << (start % 32));
+	if (bits != 0) {
+		return w * 32 + lowbit32(bits);
+	}
+
+	/*
+	 * The first word after that that isn't full. Going all the
+	 * way around brings us back to the start of word W, which
+	 * might have a free pid below START.
+	 */
+	w++;
+	for (i=0; i<=PIDFULL_WORDS; i++) {
+		if (w >= PIDMAP_WORDS) {
+			w = 0;
+		}
+		fw = w / 32;
+		bits = ~pidmap_full[fw] & (0xffffffff << (w % 32));
+		if (fw == PIDFULL_WORDS - 1 && PIDMAP_WORDS % 32 != 0) {
+			/* ignore bits past the end of pidmap */
+			bits &= (1U << (PIDMAP_WORDS % 32)) - 1;
+		}
+		if (bits != 0) {
+			w = fw * 32 + lowbit32(bits);
+			return w * 32 + lowbit32(~pidmap[w]);
+		}
+		w = (fw + 1) * 32;
+	}
+	panic("pidmap_findfree: no free pid\n");
+}
+
+/*
+ * Allocate a pid number; fails with EAGAIN if there are too many
+ * processes.
+ */
+static
+int
+pidmap_alloc(pid_t *ret)
+{
+	pid_t pid;
+
+	spinlock_acquire(&pidmap_lock);
+	if (nprocs >= PROCS_MAX) {
+		spinlock_release(&pidmap_lock);
+		return EAGAIN;
+	}
+	pid = pidmap_findfree(nextpid);
+	pidmap_set(pid);
+	nprocs++;
+
+	nextpid = pid + 1;
+	if (nextpid > PID_MAX) {
+		nextpid = PID_MIN;
+	}
+	spinlock_release(&pidmap_lock);
+
+	*ret = pid;
+	return 0;
+}
+
+/*
+ * Give back a pid number.
+ */
+static
+void
+pidmap_free(pid_t pid)
+{
+	spinlock_acquire(&pidmap_lock);
+	pidmap_clear(pid);
+	KASSERT(nprocs > 0);
+	nprocs--;
+	spinlock_release(&pidmap_lock);
+}
+
+////////////////////////////////////////////////////////////
+
 /*
  * pid_bootstrap: initialize.
  */
 void
 pid_bootstrap(void)
 {
+	struct pidinfo *pi;
 	int i;
 
-	pidlock = lock_create("pidlock");
-	if (pidlock == NULL) {
-		panic("Out of memory creating pid lock\n");
+	for (i=0; i<PID_NBUCKETS; i++) {
+		pidtable[i].pb_lock = lock_create("pidlock");
+		if (pidtable[i].pb_lock == NULL) {
+			panic("Out of memory creating pid lock\n");
+		}
+		pidtable[i].pb_chain = NULL;
 	}
 
-	/* not really necessary - should start zeroed */
-	for (i=0; i<PROCS_MAX; i++) {
-		pidinfo[i] = NULL;
+	/*
+	 * Pids below PID_MIN are never handed out; the kernel has one
+	 * of them. Neither are any past PID_MAX that fit in the last
+	 * word of pidmap.
+	 */
+	spinlock_acquire(&pidmap_lock);
+	for (i=0; i<PID_MIN; i++) {
+		pidmap_set(i);
 	}
+	for (i=PID_MAX+1; i<PIDMAP_WORDS*32; i++) {
+		pidmap_set(i);
+	}
+	nextpid = PID_MIN;
+	nprocs = 1;
+	spinlock_release(&pidmap_lock);
 
-	pidinfo[KERNEL_PID] = pidinfo_create(KERNEL_PID, INVALID_PID);
-	if (pidinfo[KERNEL_PID]==NULL) {
+	pi = pidinfo_create(KERNEL_PID, INVALID_PID);
+	if (pi==NULL) {
 		panic("Out of memory creating kernel pid data\n");
 	}
+	pidtable[KERNEL_PID % PID_NBUCKETS].pb_chain = pi;
+}
 
-	nextpid = PID_MIN;
-	nprocs = 1;
+/*
+ * pid_bucket: get the table bucket a pid belongs in.
+ */
+static
+struct pidbucket *
+pid_bucket(pid_t pid)
+{
+	KASSERT(pid>=0);
+	KASSERT(pid != INVALID_PID);
+
+	return &pidtable[pid % PID_NBUCKETS];
 }
 
 /*
- * pi_get: look up a pidinfo in the process table.
+ * pi_get: look up a pidinfo in the process table. The bucket must be
+ * locked.
  */
 static
 struct pidinfo *
 pi_get(pid_t pid)
 {
+	struct pidbucket *pb;
 	struct pidinfo *pi;
 
-	KASSERT(pid>=0);
-	KASSERT(pid != INVALID_PID);
-	KASSERT(lock_do_i_hold(pidlock));
+	pb = pid_bucket(pid);
+	KASSERT(lock_do_i_hold(pb->pb_lock));
 
-	pi = pidinfo[pid % PROCS_MAX];
-	if (pi==NULL) {
-		return NULL;
-	}
-	if (pi->pi_pid != pid) {
-		return NULL;
+	for (pi = pb->pb_chain; pi != NULL; pi = pi->pi_next) {
+		if (pi->pi_pid == pid) {
+			return pi;
+		}
 	}
-	return pi;
+	return NULL;
 }
 
 /*
- * pi_put: insert a new pidinfo in the process table. The right slot
- * must be empty.
+ * pi_put: insert a new pidinfo in the process table. The bucket must
+ * be locked, and the pid must not be there already.
  */
 static
 void
-pi_put(pid_t pid, struct pidinfo *pi)
+pi_put(struct pidinfo *pi)
 {
-	KASSERT(lock_do_i_hold(pidlock));
+	struct pidbucket *pb;
 
-	KASSERT(pid != INVALID_PID);
+	pb = pid_bucket(pi->pi_pid);
+	KASSERT(lock_do_i_hold(pb->pb_lock));
+	DEBUGASSERT(pi_get(pi->pi_pid) == NULL);
 
-	KASSERT(pidinfo[pid % PROCS_MAX] == NULL);
-	pidinfo[pid % PROCS_MAX] = pi;
-	nprocs++;
+	pi->pi_next = pb->pb_chain;
+	pb->pb_chain = pi;
 }
 
 /*
- * pi_drop: remove a pidinfo structure from the process table and free
- * it. It should reflect a process that has already exited and been
- * waited for.
+ * pi_drop: remove a pidinfo structure from the process table, free
+ * it, and release its pid. It should reflect a process that has
+ * already exited and been waited for. The bucket must be locked.
  */
 static
 void
 pi_drop(pid_t pid)
 {
-	struct pidinfo *pi;
+	struct pidbucket *pb;
+	struct pidinfo **pp, *pi;
 
-	KASSERT(lock_do_i_hold(pidlock));
+	pb = pid_bucket(pid);
+	KASSERT(lock_do_i_hold(pb->pb_lock));
 
-	pi = pidinfo[pid % PROCS_MAX];
+	for (pp = &pb->pb_chain; *pp != NULL; pp = &(*pp)->pi_next) {
+		if ((*pp)->pi_pid == pid) {
+			break;
+		}
+	}
+	pi = *pp;
 	KASSERT(pi != NULL);
-	KASSERT(pi->pi_pid == pid);
+	*pp = pi->pi_next;
 
 	pidinfo_destroy(pi);
-	pidinfo[pid % PROCS_MAX] = NULL;
-	nprocs--;
+	pidmap_free(pid);
 }
 
 ////////////////////////////////////////////////////////////
 
+
 /*
- * Helper function for pid_alloc.
+ * Lock two buckets, which may be the same one, in a fixed order.
  */
 static
 void
-inc_nextpid(void)
+pb_lock2(struct pidbucket *a, struct pidbucket *b)
 {
-	KASSERT(lock_do_i_hold(pidlock));
+	struct pidbucket *tmp;
 
-	nextpid++;
-	if (nextpid > PID_MAX) {
-		nextpid = PID_MIN;
+	if (a == b) {
+		lock_acquire(a->pb_lock);
+		return;
+	}
+	if (a > b) {
+		tmp = a;
+		a = b;
+		b = tmp;
+	}
+	lock_acquire(a->pb_lock);
+	lock_acquire(b->pb_lock);
+}
+
+static
+void
+pb_unlock2(struct pidbucket *a, struct pidbucket *b)
+{
+	lock_release(a->pb_lock);
+	if (a != b) {
+		lock_release(b->pb_lock);
 	}
 }
 
 /*
- * pid_alloc: allocate a process id.
+ * pi_link: put a child on the right one of its parent's lists.
+ * pi_unlink: take it off again. The parent's bucket must be locked.
  */
-int
-pid_alloc(pid_t *retval)
+static
+void
+pi_link(struct pidinfo *parent, struct pidinfo *pi)
 {
-	struct pidinfo *pi;
-	pid_t pid;
-	int count;
+	struct pidinfo **head;
 
-	KASSERT(curproc->p_pid != INVALID_PID);
+	head = pi->pi_exited ? &parent->pi_zombies : &parent->pi_children;
+	pi->pi_sibprev = NULL;
+	pi->pi_sibnext = *head;
+	if (*head != NULL) {
+		(*head)->pi_sibprev = pi;
+	}
+	*head = pi;
+}
 
-	/* lock the table */
-	lock_acquire(pidlock);
+static
+void
+pi_unlink(struct pidinfo *parent, struct pidinfo *pi)
+{
+	struct pidinfo **head;
 
-	if (nprocs == PROCS_MAX) {
-		lock_release(pidlock);
-		return EAGAIN;
+	head = pi->pi_exited ? &parent->pi_zombies : &parent->pi_children;
+	if (pi->pi_sibprev != NULL) {
+		pi->pi_sibprev->pi_sibnext = pi->pi_sibnext;
+	}
+	else {
+		KASSERT(*head == pi);
+		*head = pi->pi_sibnext;
 	}
+	if (pi->pi_sibnext != NULL) {
+		pi->pi_sibnext->pi_sibprev = pi->pi_sibprev;
+	}
+	pi->pi_sibnext = pi->pi_sibprev = NULL;
+}
 
-	/*
-	 * The above test guarantees that this loop terminates, unless
-	 * our nprocs count is off. Even so, assert we aren't looping
-	 * forever.
-	 */
-	count = 0;
-	while (pidinfo[nextpid % PROCS_MAX] != NULL) {
+/*
+ * pid_alloc: allocate a process id.
+ */
+int
+pid_alloc(pid_t *retval)
+{
+	struct pidbucket *ourpb, *pb;
+	struct pidinfo *us, *pi;
+	pid_t pid;
+	int result;
 
-		/* avoid various boundary cases by allowing extra loops */
-		KASSERT(count < PROCS_MAX*2+5);
-		count++;
+	KASSERT(curproc->p_pid != INVALID_PID);
 
-		inc_nextpid();
+	result = pidmap_alloc(&pid);
+	if (result) {
+		return result;
 	}
 
-	pid = nextpid;
-
 	pi = pidinfo_create(pid, curproc->p_pid);
 	if (pi==NULL) {
-		lock_release(pidlock);
+		pidmap_free(pid);
 		return ENOMEM;
 	}
 
-	pi_put(pid, pi);
+	ourpb = pid_bucket(curproc->p_pid);
+	pb = pid_bucket(pid);
+	pb_lock2(ourpb, pb);
 
-	inc_nextpid();
+	us = pi_get(curproc->p_pid);
+	KASSERT(us != NULL);
+	pi_put(pi);
+	pi_link(us, pi);
 
-	lock_release(pidlock);
+	pb_unlock2(ourpb, pb);
 
 	*retval = pid;
 	return 0;
@@ -286,17 +536,24 @@ pid_alloc(pid_t *retval)
 void
 pid_unalloc(pid_t theirpid)
 {
-	struct pidinfo *them;
+	struct pidbucket *ourpb, *pb;
+	struct pidinfo *us, *them;
 
 	KASSERT(theirpid >= PID_MIN && theirpid <= PID_MAX);
 
-	lock_acquire(pidlock);
+	ourpb = pid_bucket(curproc->p_pid);
+	pb = pid_bucket(theirpid);
+	pb_lock2(ourpb, pb);
 
+	us = pi_get(curproc->p_pid);
 	them = pi_get(theirpid);
+	KASSERT(us != NULL);
 	KASSERT(them != NULL);
 	KASSERT(them->pi_exited == false);
 	KASSERT(them->pi_ppid == curproc->p_pid);
 
+	pi_unlink(us, them);
+
 	/* keep pidinfo_destroy from complaining */
 	them->pi_exitstatus = 0xdead;
 	them->pi_exited = true;
@@ -304,7 +561,7 @@ pid_unalloc(pid_t theirpid)
 
 	pi_drop(theirpid);
 
-	lock_release(pidlock);
+	pb_unlock2(ourpb, pb);
 }
 
 /*
@@ -314,22 +571,28 @@ pid_unalloc(pid_t theirpid)
 void
 pid_disown(pid_t theirpid)
 {
-	struct pidinfo *them;
+	struct pidbucket *ourpb, *pb;
+	struct pidinfo *us, *them;
 
 	KASSERT(theirpid >= PID_MIN && theirpid <= PID_MAX);
 
-	lock_acquire(pidlock);
+	ourpb = pid_bucket(curproc->p_pid);
+	pb = pid_bucket(theirpid);
+	pb_lock2(ourpb, pb);
 
+	us = pi_get(curproc->p_pid);
 	them = pi_get(theirpid);
+	KASSERT(us != NULL);
 	KASSERT(them != NULL);
 	KASSERT(them->pi_ppid==curproc->p_pid);
 
+	pi_unlink(us, them);
 	them->pi_ppid = INVALID_PID;
 	if (them->pi_exited) {
 		pi_drop(them->pi_pid);
 	}
 
-	lock_release(pidlock);
+	pb_unlock2(ourpb, pb);
 }
 
 /*
@@ -343,42 +606,156 @@ pid_disown(pid_t theirpid)
 void
 pid_setexitstatus(int status)
 {
-	struct pidinfo *us;
-	int i;
+	struct pidbucket *ourpb, *ppb, *pb;
+	struct pidinfo *us, *parent, *pi;
+	pid_t ourpid, ppid;
 
-	lock_acquire(pidlock);
-	KASSERT(curproc->p_pid != INVALID_PID);
+	ourpid = curproc->p_pid;
+	KASSERT(ourpid != INVALID_PID);
+
+	ourpb = pid_bucket(ourpid);
+	lock_acquire(ourpb->pb_lock);
+	us = pi_get(ourpid);
+	KASSERT(us != NULL);
+	lock_release(ourpb->pb_lock);
 
-	/* First, disown all children */
-	for (i=0; i<PROCS_MAX; i++) {
-		if (pidinfo[i]==NULL) {
-			continue;
+	/*
+	 * First, disown all children. We're the last thread in the
+	 * process, so no new ones can appear, and only we can make
+	 * one go away; so PI stays valid after we peek at the list,
+	 * although it may move from pi_children to pi_zombies before
+	 * we get both locks.
+	 */
+	while (1) {
+		lock_acquire(ourpb->pb_lock);
+		pi = us->pi_children != NULL ? us->pi_children :
+			us->pi_zombies;
+		lock_release(ourpb->pb_lock);
+		if (pi == NULL) {
+			break;
 		}
-		if (pidinfo[i]->pi_ppid == curproc->p_pid) {
-			pidinfo[i]->pi_ppid = INVALID_PID;
-			if (pidinfo[i]->pi_exited) {
-				pi_drop(pidinfo[i]->pi_pid);
-			}
+
+		pb = pid_bucket(pi->pi_pid);
+		pb_lock2(ourpb, pb);
+		pi_unlink(us, pi);
+		pi->pi_ppid = INVALID_PID;
+		if (pi->pi_exited) {
+			pi_drop(pi->pi_pid);
 		}
+		pb_unlock2(ourpb, pb);
 	}
 
-	/* Now, wake up our parent */
-	us = pi_get(curproc->p_pid);
-	KASSERT(us != NULL);
+	/*
+	 * Now, wake up our parent. It may disown us while we aren't
+	 * holding our lock, but it can't go away before doing that.
+	 */
+	lock_acquire(ourpb->pb_lock);
+	ppid = us->pi_ppid;
+	lock_release(ourpb->pb_lock);
+
+	ppb = (ppid == INVALID_PID) ? ourpb : pid_bucket(ppid);
+	pb_lock2(ppb, ourpb);
 
 	us->pi_exitstatus = status;
-	us->pi_exited = true;
 
 	if (us->pi_ppid == INVALID_PID) {
 		/* no parent */
-		pi_drop(curproc->p_pid);
+		us->pi_exited = true;
+		pi_drop(ourpid);
 	}
 	else {
-		cv_broadcast(us->pi_cv, pidlock);
+		KASSERT(us->pi_ppid == ppid);
+		parent = pi_get(ppid);
+		KASSERT(parent != NULL);
+
+		/* move to the zombie list */
+		pi_unlink(parent, us);
+		us->pi_exited = true;
+		pi_link(parent, us);
+
+		cv_broadcast(parent->pi_cv, ppb->pb_lock);
 	}
 
 	curproc->p_pid = INVALID_PID;
-	lock_release(pidlock);
+	pb_unlock2(ppb, ourpb);
+}
+
+/*
+ * Reap up to N exited children of the current process, in no
+ * particular order, storing their pids in PIDS and (if STATUSES is
+ * not null) their exit statuses in STATUSES. If none have exited yet,
+ * waits for one, unless WNOHANG is set. The number reaped is returned
+ * in COUNT; it's 0 only with WNOHANG. Fails with ECHILD if there are
+ * no children to wait for.
+ */
+int
+pid_waitmany(pid_t *pids, int *statuses, unsigned n, int flags,
+	     unsigned *count)
+{
+	struct pidbucket *ourpb, *pb;
+	struct pidinfo *us, *pi, *reaped;
+	unsigned num;
+
+	KASSERT(curproc->p_pid != INVALID_PID);
+	KASSERT(n > 0);
+
+	/* Only valid options */
+	if (flags != 0 && flags != WNOHANG) {
+		return EINVAL;
+	}
+
+	ourpb = pid_bucket(curproc->p_pid);
+	lock_acquire(ourpb->pb_lock);
+	us = pi_get(curproc->p_pid);
+	KASSERT(us != NULL);
+
+	while (us->pi_zombies == NULL) {
+		if (us->pi_children == NULL) {
+			lock_release(ourpb->pb_lock);
+			return ECHILD;
+		}
+		if (flags == WNOHANG) {
+			lock_release(ourpb->pb_lock);
+			*count = 0;
+			return 0;
+		}
+		cv_wait(us->pi_cv, ourpb->pb_lock);
+	}
+
+	/*
+	 * Take them off the zombie list. Exited children don't look
+	 * at their pi_ppid any more, so our lock is enough to clear
+	 * it; once it's clear, nobody else will touch them.
+	 */
+	reaped = NULL;
+	for (num = 0; num < n && us->pi_zombies != NULL; num++) {
+		pi = us->pi_zombies;
+		pi_unlink(us, pi);
+		pi->pi_ppid = INVALID_PID;
+
+		pids[num] = pi->pi_pid;
+		if (statuses != NULL) {
+			statuses[num] = pi->pi_exitstatus;
+		}
+		pi->pi_sibnext = reaped;
+		reaped = pi;
+	}
+	lock_release(ourpb->pb_lock);
+
+	/* Now free them. */
+	while (reaped != NULL) {
+		pi = reaped;
+		reaped = pi->pi_sibnext;
+		pi->pi_sibnext = NULL;
+
+		pb = pid_bucket(pi->pi_pid);
+		lock_acquire(pb->pb_lock);
+		pi_drop(pi->pi_pid);
+		lock_release(pb->pb_lock);
+	}
+
+	*count = num;
+	return 0;
 }
 
 /*
@@ -386,25 +763,44 @@ pid_setexitstatus(int status)
  * status and ret are a kernel pointers, but pid/flags may come from
  * userland and may thus be maliciously invalid.
  *
+ * PID may be WAIT_ANY to wait for whichever child exits first.
+ *
  * status may be null, in which case the status is thrown away. ret
  * may only be null if WNOHANG is not set.
  */
 int
 pid_wait(pid_t theirpid, int *status, int flags, pid_t *ret)
 {
-	struct pidinfo *them;
+	struct pidbucket *ourpb, *pb;
+	struct pidinfo *us, *them;
+	pid_t ourpid, anypid;
+	unsigned count;
+	bool waited;
+	int result;
 
-	KASSERT(curproc->p_pid != INVALID_PID);
+	ourpid = curproc->p_pid;
+	KASSERT(ourpid != INVALID_PID);
 
 	/* Don't let a process wait for itself. */
-	if (theirpid == curproc->p_pid) {
+	if (theirpid == ourpid) {
 		return EINVAL;
 	}
 
+	if (theirpid == WAIT_ANY) {
+		result = pid_waitmany(&anypid, status, 1, flags, &count);
+		if (result) {
+			return result;
+		}
+		if (ret != NULL) {
+			*ret = (count == 0) ? 0 : anypid;
+		}
+		return 0;
+	}
+
 	/*
-	 * We don't support the Unix meanings of negative pids or 0
-	 * (0 is INVALID_PID) and other code may break on them, so
-	 * check now.
+	 * We don't support the other Unix meanings of negative pids
+	 * or 0 (0 is INVALID_PID) and other code may break on them,
+	 * so check now.
 	 */
 	if (theirpid == INVALID_PID || theirpid<0) {
 		return ENOSYS;
@@ -415,51 +811,73 @@ pid_wait(pid_t theirpid, int *status, int flags, pid_t *ret)
 		return EINVAL;
 	}
 
-	lock_acquire(pidlock);
-
-	them = pi_get(theirpid);
-	if (them==NULL) {
-		lock_release(pidlock);
+	if (theirpid > PID_MAX) {
 		return ESRCH;
 	}
 
-	KASSERT(them->pi_pid==theirpid);
+	ourpb = pid_bucket(ourpid);
+	pb = pid_bucket(theirpid);
+	waited = false;
 
-	/* Only allow waiting for own children. */
-	if (them->pi_ppid != curproc->p_pid) {
-		lock_release(pidlock);
-		return EPERM;
-	}
+	while (1) {
+		pb_lock2(ourpb, pb);
+
+		them = pi_get(theirpid);
+		if (them==NULL) {
+			pb_unlock2(ourpb, pb);
+			return ESRCH;
+		}
+
+		KASSERT(them->pi_pid==theirpid);
+
+		/*
+		 * Only allow waiting for own children. If we've
+		 * already waited, another thread of ours collected it
+		 * first.
+		 */
+		if (them->pi_ppid != ourpid) {
+			pb_unlock2(ourpb, pb);
+			return waited ? ESRCH : EPERM;
+		}
+
+		us = pi_get(ourpid);
+		KASSERT(us != NULL);
+
+		if (them->pi_exited) {
+			break;
+		}
 
-	if (them->pi_exited == false) {
 		if (flags == WNOHANG) {
-			lock_release(pidlock);
+			pb_unlock2(ourpb, pb);
 			KASSERT(ret != NULL);
 			*ret = 0;
 			return 0;
 		}
-		/* don't need to loop on this */
-		cv_wait(them->pi_cv, pidlock);
-		KASSERT(them->pi_exited == true);
+
+		/*
+		 * Wait for any child to exit, then look again. While
+		 * THEM is our child, our lock is the one that covers
+		 * its exit.
+		 */
+		if (pb != ourpb) {
+			lock_release(pb->pb_lock);
+		}
+		cv_wait(us->pi_cv, ourpb->pb_lock);
+		lock_release(ourpb->pb_lock);
+		waited = true;
 	}
 
 	if (status != NULL) {
 		*status = them->pi_exitstatus;
 	}
 	if (ret != NULL) {
-		/*
-		 * In Unix you can wait for any of several possible
-		 * processes by passing particular magic values of
-		 * pid. wait then returns the pid you actually
-		 * found. We don't support this, so always return the
-		 * pid we looked for.
-		 */
 		*ret = theirpid;
 	}
 
-	them->pi_ppid = 0;
-	pi_drop(them->pi_pid);
+	pi_unlink(us, them);
+	them->pi_ppid = INVALID_PID;
+	pi_drop(theirpid);
 
-	lock_release(pidlock);
+	pb_unlock2(ourpb, pb);
 	return 0;
 }
@@ -44,6 +44,7 @@
 
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/wait.h>
 #include <spl.h>
 #include <synch.h>
 #include <proc.h>
@@ -52,12 +53,26 @@
 #include <vnode.h>
 #include <pid.h>
 #include <filetable.h>
+#include <ioring.h>
+#include <futex.h>
 
 /*
  * The process for the kernel; this holds all the kernel-only threads.
  */
 struct proc *kproc;
 
+/*
+ * Join record for a thread made by thread_create. Lives on the
+ * process's p_uthreads list from creation until it's joined.
+ */
+struct uthread {
+	int ut_tid;			/* thread id */
+	bool ut_exited;			/* true once the thread is gone */
+	bool ut_joining;		/* someone is in thread_join for it */
+	userptr_t ut_retval;		/* value passed to __thread_exit */
+	struct uthread *ut_next;	/* next on p_uthreads */
+};
+
 /*
  * Create a proc structure.
  */
@@ -84,6 +99,18 @@ proc_create(const char *name)
 		return NULL;
 	}
 	threadarray_init(&proc->p_threads);
+	proc->p_threadcv = cv_create("p_threads");
+	if (proc->p_threadcv == NULL) {
+		threadarray_cleanup(&proc->p_threads);
+		lock_destroy(proc->p_threadslock);
+		kfree(proc->p_name);
+		kfree(proc);
+		return NULL;
+	}
+	proc->p_uthreads = NULL;
+	proc->p_nexttid = 1;
+	proc->p_exitstatus = _MKWAIT_EXIT(0);
+	proc->p_exiting = false;
 
 	spinlock_init(&proc->p_lock);
 	proc->p_pid = INVALID_PID;
@@ -94,6 +121,9 @@ proc_create(const char *name)
 	/* VFS fields */
 	proc->p_cwd = NULL;
 	proc->p_filetable = NULL;
+	proc->p_ioring = NULL;
+
+	proc->p_systrace = false;
 
 	return proc;
 }
@@ -133,6 +163,10 @@ proc_destroy(struct proc *proc)
 		filetable_destroy(proc->p_filetable);
 		proc->p_filetable = NULL;
 	}
+	if (proc->p_ioring) {
+		ioring_destroy(proc->p_ioring);
+		proc->p_ioring = NULL;
+	}
 
 	/* VM fields */
 	if (proc->p_addrspace) {
@@ -184,6 +218,15 @@ proc_destroy(struct proc *proc)
 
 	KASSERT(proc->p_pid == INVALID_PID);
 	spinlock_cleanup(&proc->p_lock);
+	while (proc->p_uthreads != NULL) {
+		struct uthread *ut = proc->p_uthreads;
+
+		/* threads nobody joined */
+		KASSERT(ut->ut_exited);
+		proc->p_uthreads = ut->ut_next;
+		kfree(ut);
+	}
+	cv_destroy(proc->p_threadcv);
 	threadarray_cleanup(&proc->p_threads);
 	lock_destroy(proc->p_threadslock);
 
@@ -318,7 +361,8 @@ proc_fork(struct proc **ret)
 	}
 
 	/*
-	 * Lock the current process to copy its current directory.
+	 * Lock the current process to copy its current directory and
+	 * trace setting.
 	 * (We don't need to lock the new process, though, as we have
 	 * the only reference to it.)
 	 */
@@ -327,6 +371,7 @@ proc_fork(struct proc **ret)
 		VOP_INCREF(curproc->p_cwd);
 		newproc->p_cwd = curproc->p_cwd;
 	}
+	newproc->p_systrace = curproc->p_systrace;
 	spinlock_release(&curproc->p_lock);
 
 	*ret = newproc;
@@ -347,16 +392,67 @@ proc_unfork(struct proc *newproc)
 /*
  * Make the current process exit.
  */
+/*
+ * Common code for proc_exit and proc_thread_exit: the current thread
+ * leaves its process, and if it's the last one the process exits
+ * with p_exitstatus.
+ */
+__DEAD
+static
 void
-proc_exit(int status)
+proc_leave(userptr_t retval)
 {
 	struct proc *proc = curproc;
+	struct uthread *ut;
+	unsigned num, i;
+	bool last;
+	int spl;
 
 	/* The kernel isn't supposed to exit. */
 	KASSERT(proc != kproc);
 
+	lock_acquire(proc->p_threadslock);
+
+	/* Post our return value for thread_join. */
+	for (ut = proc->p_uthreads; ut != NULL; ut = ut->ut_next) {
+		if (ut->ut_tid == curthread->t_tid) {
+			ut->ut_exited = true;
+			ut->ut_retval = retval;
+			break;
+		}
+	}
+	/* Wake joiners, and proc_exit waiting for us to go. */
+	cv_broadcast(proc->p_threadcv, proc->p_threadslock);
+
+	/*
+	 * If we're the only thread, nobody else can come or go and
+	 * we tear the process down below. Otherwise take ourselves
+	 * out while still holding the lock, so the last thread can't
+	 * destroy the process while we're still in it.
+	 */
+	num = threadarray_num(&proc->p_threads);
+	last = (num == 1);
+	if (!last) {
+		for (i=0; i<num; i++) {
+			if (threadarray_get(&proc->p_threads, i) == curthread) {
+				threadarray_remove(&proc->p_threads, i);
+				break;
+			}
+		}
+		KASSERT(i < num);
+		spl = splhigh();
+		curthread->t_proc = NULL;
+		splx(spl);
+	}
+	lock_release(proc->p_threadslock);
+
+	if (!last) {
+		proc_addthread(kproc, curthread);
+		thread_exit();
+	}
+
 	/* Set exit status and wake up anyone waiting for us. */
-	pid_setexitstatus(status);
+	pid_setexitstatus(proc->p_exitstatus);
 
 	/* Detach from the process and attach to the kernel process. */
 	KASSERT(curthread->t_proc == proc);
@@ -372,6 +468,211 @@ proc_exit(int status)
 	thread_exit();
 }
 
+void
+proc_exit(int status)
+{
+	struct proc *proc = curproc;
+
+	lock_acquire(proc->p_threadslock);
+	if (proc->p_exiting) {
+		/* Another thread got here first. */
+		lock_release(proc->p_threadslock);
+		proc_leave(NULL);
+	}
+	proc->p_exiting = true;
+	proc->p_exitstatus = status;
+
+	/* Kick anyone in thread_join... */
+	cv_broadcast(proc->p_threadcv, proc->p_threadslock);
+	lock_release(proc->p_threadslock);
+
+	/* ...and futex_wait. */
+	futex_wakeproc(proc);
+
+	/*
+	 * Wait for the others to leave. Those running in user mode do
+	 * at their next trap (the timer will provide one), and those
+	 * we just woke on their way out of the kernel.
+	 */
+	lock_acquire(proc->p_threadslock);
+	while (threadarray_num(&proc->p_threads) > 1) {
+		cv_wait(proc->p_threadcv, proc->p_threadslock);
+	}
+	lock_release(proc->p_threadslock);
+
+	proc_leave(NULL);
+}
+
+/*
+ * Unlocked look at p_exiting: it only ever goes from false to true,
+ * and if we miss it this time we'll see it on the next trap.
+ */
+void
+proc_checkexit(void)
+{
+	if (curproc->p_exiting) {
+		proc_leave(NULL);
+	}
+}
+
+void
+proc_thread_exit(userptr_t retval)
+{
+	proc_leave(retval);
+}
+
+int
+proc_newtid(int *ret)
+{
+	struct proc *proc = curproc;
+	struct uthread *ut;
+
+	ut = kmalloc(sizeof(*ut));
+	if (ut == NULL) {
+		return ENOMEM;
+	}
+	ut->ut_exited = false;
+	ut->ut_joining = false;
+	ut->ut_retval = NULL;
+
+	lock_acquire(proc->p_threadslock);
+	if (proc->p_exiting) {
+		lock_release(proc->p_threadslock);
+		kfree(ut);
+		return EINTR;
+	}
+	ut->ut_tid = proc->p_nexttid++;
+	ut->ut_next = proc->p_uthreads;
+	proc->p_uthreads = ut;
+	*ret = ut->ut_tid;
+	lock_release(proc->p_threadslock);
+
+	return 0;
+}
+
+void
+proc_droptid(int tid)
+{
+	struct proc *proc = curproc;
+	struct uthread **utp, *ut;
+
+	lock_acquire(proc->p_threadslock);
+	for (utp = &proc->p_uthreads; *utp != NULL; utp = &(*utp)->ut_next) {
+		if ((*utp)->ut_tid == tid) {
+			break;
+		}
+	}
+	ut = *utp;
+	KASSERT(ut != NULL);
+	*utp = ut->ut_next;
+	lock_release(proc->p_threadslock);
+
+	kfree(ut);
+}
+
+int
+proc_jointid(int tid, userptr_t *retval)
+{
+	struct proc *proc = curproc;
+	struct uthread **utp, *ut;
+
+	if (tid == curthread->t_tid) {
+		return EINVAL;
+	}
+
+	lock_acquire(proc->p_threadslock);
+	for (ut = proc->p_uthreads; ut != NULL; ut = ut->ut_next) {
+		if (ut->ut_tid == tid) {
+			break;
+		}
+	}
+	if (ut == NULL) {
+		lock_release(proc->p_threadslock);
+		return ESRCH;
+	}
+	if (ut->ut_joining) {
+		/* only one joiner per thread */
+		lock_release(proc->p_threadslock);
+		return EINVAL;
+	}
+	ut->ut_joining = true;
+	while (!ut->ut_exited) {
+		if (proc->p_exiting) {
+			ut->ut_joining = false;
+			lock_release(proc->p_threadslock);
+			return EINTR;
+		}
+		cv_wait(proc->p_threadcv, proc->p_threadslock);
+	}
+	*retval = ut->ut_retval;
+
+	/* the list may have changed while we slept */
+	for (utp = &proc->p_uthreads; *utp != ut; utp = &(*utp)->ut_next) {
+		KASSERT(*utp != NULL);
+	}
+	*utp = ut->ut_next;
+	lock_release(proc->p_threadslock);
+
+	kfree(ut);
+	return 0;
+}
+
+/*
+ * The nice value and the affinity mask are per-thread, but
+ * setpriority and sched_setaffinity work on whole processes, so
+ * apply them to each of our threads.
+ *
+ * A thread being forked right now copies its creator's values; if it
+ * was copied before this and added to p_threads after, it keeps the
+ * old ones.
+ */
+void
+proc_setnice(int nice)
+{
+	struct proc *proc = curproc;
+	struct thread *t;
+	unsigned i, num;
+
+	lock_acquire(proc->p_threadslock);
+	num = threadarray_num(&proc->p_threads);
+	for (i=0; i<num; i++) {
+		t = threadarray_get(&proc->p_threads, i);
+		thread_setnice(t, nice);
+	}
+	lock_release(proc->p_threadslock);
+}
+
+/*
+ * The current thread goes first, outside p_threadslock, because
+ * setting its mask can yield; once the mask has been accepted the
+ * others can't fail.
+ */
+int
+proc_setaffinity(uint32_t mask)
+{
+	struct proc *proc = curproc;
+	struct thread *t;
+	unsigned i, num;
+	int result;
+
+	result = thread_setaffinity(curthread, mask);
+	if (result) {
+		return result;
+	}
+
+	lock_acquire(proc->p_threadslock);
+	num = threadarray_num(&proc->p_threads);
+	for (i=0; i<num; i++) {
+		t = threadarray_get(&proc->p_threads, i);
+		if (t != curthread) {
+			result = thread_setaffinity(t, mask);
+			KASSERT(result == 0);
+		}
+	}
+	lock_release(proc->p_threadslock);
+	return 0;
+}
+
 /*
  * Add a thread to a process. Either the thread or the process might
  * or might not be current.
@@ -34,6 +34,7 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <kern/fcntl.h>
+#include <kern/iovec.h>
 #include <kern/limits.h>
 #include <kern/seek.h>
 #include <kern/stat.h>
@@ -47,8 +48,15 @@
 #include <vnode.h>
 #include <openfile.h>
 #include <filetable.h>
+#include <pipe.h>
 #include <syscall.h>
 
+/* readv/writev iovecs kept on the stack instead of kmalloc'd */
+#define RWV_STACKIOVS	8
+
+/* readv/writev totals must fit in ssize_t */
+#define RWV_MAXTOTAL	((size_t)-1 >> 1)
+
 /*
  * open() - get the path with copyinstr, then use openfile_open and
  * filetable_place to do the real work.
@@ -107,18 +115,20 @@ sys_open(const_userptr_t upath, int flags, mode_t mode, int *retval)
 /*
  * Common logic for read and write.
  *
- * Look up the fd, then use VOP_READ or VOP_WRITE.
+ * Look up the fd, then use VOP_READ or VOP_WRITE. The caller sets up
+ * the uio with the user's buffer(s). If POSITIONAL is set (pread and
+ * pwrite) the caller also sets the offset and the file's own seek
+ * position is left alone, so we don't need its lock; otherwise the
+ * seek position is used and updated, under the lock.
  */
 static
 int
-sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
+sys_readwrite(int fd, struct uio *useruio, bool positional,
 	      int badaccmode, ssize_t *retval)
 {
 	struct openfile *file;
 	bool locked;
-	off_t pos;
-	struct iovec iov;
-	struct uio useruio;
+	size_t size;
 	int result;
 
 	/* better be a valid file descriptor */
@@ -127,35 +137,40 @@ sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
 		return result;
 	}
 
+	if (file->of_accmode == badaccmode) {
+		filetable_put(curproc->p_filetable, fd, file);
+		return EBADF;
+	}
+
 	/* Only lock the seek position if we're really using it. */
-	locked = VOP_ISSEEKABLE(file->of_vnode);
-	if (locked) {
+	locked = false;
+	if (positional) {
+		if (!VOP_ISSEEKABLE(file->of_vnode)) {
+			filetable_put(curproc->p_filetable, fd, file);
+			return ESPIPE;
+		}
+	}
+	else if (VOP_ISSEEKABLE(file->of_vnode)) {
+		locked = true;
 		lock_acquire(file->of_offsetlock);
-		pos = file->of_offset;
+		useruio->uio_offset = file->of_offset;
 	}
 	else {
-		pos = 0;
+		useruio->uio_offset = 0;
 	}
 
-	if (file->of_accmode == badaccmode) {
-		result = EBADF;
-		goto fail;
-	}
-
-	/* set up a uio with the buffer, its size, and the current offset */
-	uio_uinit(&iov, &useruio, buf, size, pos, rw);
-
 	/* do the read or write */
-	result = (rw == UIO_READ) ?
-		VOP_READ(file->of_vnode, &useruio) :
-		VOP_WRITE(file->of_vnode, &useruio);
+	size = useruio->uio_resid;
+	result = (useruio->uio_rw == UIO_READ) ?
+		VOP_READ(file->of_vnode, useruio) :
+		VOP_WRITE(file->of_vnode, useruio);
 	if (result) {
 		goto fail;
 	}
 
 	if (locked) {
 		/* set the offset to the updated offset in the uio */
-		file->of_offset = useruio.uio_offset;
+		file->of_offset = useruio->uio_offset;
 		lock_release(file->of_offsetlock);
 	}
 
@@ -165,7 +180,7 @@ sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
 	 * The amount read (or written) is the original buffer size,
 	 * minus how much is left in it.
 	 */
-	*retval = size - useruio.uio_resid;
+	*retval = size - useruio->uio_resid;
 
 	return 0;
 
@@ -177,13 +192,78 @@ fail:
 	return result;
 }
 
+/*
+ * Common logic for readv and writev: copy in the iovecs and set up a
+ * uio that covers all of them.
+ */
+static
+int
+sys_readwritev(int fd, const_userptr_t uiov, int iovcnt, enum uio_rw rw,
+	       int badaccmode, ssize_t *retval)
+{
+	struct iovec stackiov[RWV_STACKIOVS];
+	struct iovec *iov;
+	struct uio useruio;
+	size_t total;
+	int i, result;
+
+	if (iovcnt <= 0 || iovcnt > IOV_MAX) {
+		return EINVAL;
+	}
+
+	/* small vectors are the common case; don't kmalloc for them */
+	if (iovcnt <= RWV_STACKIOVS) {
+		iov = stackiov;
+	}
+	else {
+		iov = kmalloc(iovcnt * sizeof(struct iovec));
+		if (iov == NULL) {
+			return ENOMEM;
+		}
+	}
+
+	result = copyin(uiov, iov, iovcnt * sizeof(struct iovec));
+	if (result) {
+		goto done;
+	}
+
+	total = 0;
+	for (i=0; i<iovcnt; i++) {
+		if (iov[i].iov_len > RWV_MAXTOTAL - total) {
+			result = EINVAL;
+			goto done;
+		}
+		total += iov[i].iov_len;
+	}
+
+	useruio.uio_iov = iov;
+	useruio.uio_iovcnt = iovcnt;
+	useruio.uio_offset = 0;
+	useruio.uio_resid = total;
+	useruio.uio_segflg = UIO_USERSPACE;
+	useruio.uio_rw = rw;
+	useruio.uio_space = proc_getas();
+
+	result = sys_readwrite(fd, &useruio, false, badaccmode, retval);
+
+done:
+	if (iov != stackiov) {
+		kfree(iov);
+	}
+	return result;
+}
+
 /*
  * read() - use sys_readwrite
  */
 int
 sys_read(int fd, userptr_t buf, size_t size, int *retval)
 {
-	return sys_readwrite(fd, buf, size, UIO_READ, O_WRONLY, retval);
+	struct iovec iov;
+	struct uio useruio;
+
+	uio_uinit(&iov, &useruio, buf, size, 0, UIO_READ);
+	return sys_readwrite(fd, &useruio, false, O_WRONLY, retval);
 }
 
 /*
@@ -192,7 +272,61 @@ sys_read(int fd, userptr_t buf, size_t size, int *retval)
 int
 sys_write(int fd, userptr_t buf, size_t size, int *retval)
 {
-	return sys_readwrite(fd, buf, size, UIO_WRITE, O_RDONLY, retval);
+	struct iovec iov;
+	struct uio useruio;
+
+	uio_uinit(&iov, &useruio, buf, size, 0, UIO_WRITE);
+	return sys_readwrite(fd, &useruio, false, O_RDONLY, retval);
+}
+
+/*
+ * pread() - read at an explicit position; use sys_readwrite
+ */
+int
+sys_pread(int fd, userptr_t buf, size_t size, off_t pos, int *retval)
+{
+	struct iovec iov;
+	struct uio useruio;
+
+	if (pos < 0) {
+		return EINVAL;
+	}
+	uio_uinit(&iov, &useruio, buf, size, pos, UIO_READ);
+	return sys_readwrite(fd, &useruio, true, O_WRONLY, retval);
+}
+
+/*
+ * pwrite() - write at an explicit position; use sys_readwrite
+ */
+int
+sys_pwrite(int fd, userptr_t buf, size_t size, off_t pos, int *retval)
+{
+	struct iovec iov;
+	struct uio useruio;
+
+	if (pos < 0) {
+		return EINVAL;
+	}
+	uio_uinit(&iov, &useruio, buf, size, pos, UIO_WRITE);
+	return sys_readwrite(fd, &useruio, true, O_RDONLY, retval);
+}
+
+/*
+ * readv() - use sys_readwritev
+ */
+int
+sys_readv(int fd, const_userptr_t iov, int iovcnt, int *retval)
+{
+	return sys_readwritev(fd, iov, iovcnt, UIO_READ, O_WRONLY, retval);
+}
+
+/*
+ * writev() - use sys_readwritev
+ */
+int
+sys_writev(int fd, const_userptr_t iov, int iovcnt, int *retval)
+{
+	return sys_readwritev(fd, iov, iovcnt, UIO_WRITE, O_RDONLY, retval);
 }
 
 /*
@@ -203,6 +337,7 @@ sys_close(int fd)
 {
 	struct filetable *ft;
 	struct openfile *file;
+	int result;
 
 	ft = curproc->p_filetable;
 
@@ -211,8 +346,14 @@ sys_close(int fd)
 		return EBADF;
 	}
 
-	/* place null in the filetable and get the file previously there */
-	filetable_placeat(ft, NULL, fd, &file);
+	/*
+	 * place null in the filetable and get the file previously
+	 * there (this can fail if the table needs to be unshared)
+	 */
+	result = filetable_placeat(ft, NULL, fd, &file);
+	if (result) {
+		return result;
+	}
 
 	if (file == NULL) {
 		/* oops, it wasn't open, that's an error */
@@ -321,7 +462,11 @@ sys_dup2(int oldfd, int newfd, int *retval)
 	filetable_put(ft, oldfd, oldfdfile);
 
 	/* place it */
-	filetable_placeat(ft, oldfdfile, newfd, &newfdfile);
+	result = filetable_placeat(ft, oldfdfile, newfd, &newfdfile);
+	if (result) {
+		openfile_decref(oldfdfile);
+		return result;
+	}
 
 	/* if there was a file already there, drop that reference */
 	if (newfdfile != NULL) {
@@ -333,6 +478,84 @@ sys_dup2(int oldfd, int newfd, int *retval)
 	return 0;
 }
 
+/*
+ * Take a file that sys_pipe just placed back out of the file table
+ * after a later failure. If another thread already closed or replaced
+ * it, or the table can't be unshared, leave things be.
+ */
+static
+void
+sys_pipe_unplace(struct filetable *ft, int fd)
+{
+	struct openfile *file;
+
+	if (filetable_placeat(ft, NULL, fd, &file) == 0 && file != NULL) {
+		openfile_decref(file);
+	}
+}
+
+/*
+ * pipe() and pipe2() - make a pipe and put its two ends in the file
+ * table. SIZE is the buffer size (0 for the default) and FLAGS may
+ * contain O_NONBLOCK.
+ */
+int
+sys_pipe(userptr_t fdsptr, int flags, size_t size)
+{
+	struct filetable *ft;
+	struct vnode *readvn, *writevn;
+	struct openfile *readfile, *writefile;
+	int fds[2];
+	int result;
+
+	ft = curproc->p_filetable;
+
+	if ((flags & ~O_NONBLOCK) != 0 || size > PIPE_MAXSIZE) {
+		return EINVAL;
+	}
+
+	result = pipe_create(size, flags, &readvn, &writevn);
+	if (result) {
+		return result;
+	}
+
+	result = openfile_fromvnode(readvn, O_RDONLY, &readfile);
+	if (result) {
+		vfs_close(readvn);
+		vfs_close(writevn);
+		return result;
+	}
+	result = openfile_fromvnode(writevn, O_WRONLY, &writefile);
+	if (result) {
+		openfile_decref(readfile);
+		vfs_close(writevn);
+		return result;
+	}
+
+	/* placing the files hands our references to the table */
+	result = filetable_place(ft, readfile, &fds[0]);
+	if (result) {
+		openfile_decref(readfile);
+		openfile_decref(writefile);
+		return result;
+	}
+	result = filetable_place(ft, writefile, &fds[1]);
+	if (result) {
+		openfile_decref(writefile);
+		sys_pipe_unplace(ft, fds[0]);
+		return result;
+	}
+
+	result = copyout(fds, fdsptr, sizeof(fds));
+	if (result) {
+		sys_pipe_unplace(ft, fds[1]);
+		sys_pipe_unplace(ft, fds[0]);
+		return result;
+	}
+
+	return 0;
+}
+
 /*
  * chdir() - change directory. Send the path off to the vfs layer.
  */
@@ -34,10 +34,259 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <lib.h>
+#include <synch.h>
 #include <openfile.h>
 #include <filetable.h>
 
 
+////////////////////////////////////////////////////////////
+//
+// Slot arrays
+//
+
+/*
+ * Create a slot array with NUM empty slots and one reference.
+ */
+static
+struct ftslots *
+ftslots_create(unsigned num)
+{
+	struct ftslots *fs;
+	unsigned i;
+
+	KASSERT(num % 32 == 0 && num <= OPEN_MAX);
+
+	fs = kmalloc(sizeof(*fs));
+	if (fs == NULL) {
+		return NULL;
+	}
+	fs->fs_files = kmalloc(num * sizeof(fs->fs_files[0]));
+	if (fs->fs_files == NULL) {
+		kfree(fs);
+		return NULL;
+	}
+	fs->fs_inuse = kmalloc((num / 32) * sizeof(fs->fs_inuse[0]));
+	if (fs->fs_inuse == NULL) {
+		kfree(fs->fs_files);
+		kfree(fs);
+		return NULL;
+	}
+
+	for (i=0; i<num; i++) {
+		fs->fs_files[i] = NULL;
+	}
+	for (i=0; i<num / 32; i++) {
+		fs->fs_inuse[i] = 0;
+	}
+	for (i=0; i<FT_FULLWORDS; i++) {
+		fs->fs_full[i] = 0;
+	}
+	spinlock_init(&fs->fs_reflock);
+	fs->fs_refcount = 1;
+	fs->fs_num = num;
+	return fs;
+}
+
+/*
+ * Free a slot array without touching the files in it.
+ */
+static
+void
+ftslots_free(struct ftslots *fs)
+{
+	spinlock_cleanup(&fs->fs_reflock);
+	kfree(fs->fs_inuse);
+	kfree(fs->fs_files);
+	kfree(fs);
+}
+
+/*
+ * Drop a reference to a slot array. The last reference closes the
+ * files in it.
+ */
+static
+void
+ftslots_decref(struct ftslots *fs)
+{
+	unsigned fd;
+
+	spinlock_acquire(&fs->fs_reflock);
+	KASSERT(fs->fs_refcount > 0);
+	fs->fs_refcount--;
+	if (fs->fs_refcount > 0) {
+		spinlock_release(&fs->fs_reflock);
+		return;
+	}
+	spinlock_release(&fs->fs_reflock);
+
+	for (fd = 0; fd < fs->fs_num; fd++) {
+		if (fs->fs_files[fd] != NULL) {
+			openfile_decref(fs->fs_files[fd]);
+		}
+	}
+	ftslots_free(fs);
+}
+
+/*
+ * Check if a slot array is in use by more than one filetable.
+ */
+static
+bool
+ftslots_shared(struct ftslots *fs)
+{
+	bool ret;
+
+	spinlock_acquire(&fs->fs_reflock);
+	ret = fs->fs_refcount > 1;
+	spinlock_release(&fs->fs_reflock);
+	return ret;
+}
+
+/*
+ * Set a slot, keeping the bitmaps up to date.
+ */
+static
+void
+ftslots_set(struct ftslots *fs, int fd, struct openfile *file)
+{
+	unsigned w = fd / 32;
+	uint32_t bit = (uint32_t)1 << (fd % 32);
+
+	KASSERT(fd >= 0 && (unsigned)fd < fs->fs_num);
+
+	fs->fs_files[fd] = file;
+	if (file != NULL) {
+		fs->fs_inuse[w] |= bit;
+		if (fs->fs_inuse[w] == 0xffffffff) {
+			fs->fs_full[w / 32] |= (uint32_t)1 << (w % 32);
+		}
+	}
+	else {
+		fs->fs_inuse[w] &= ~bit;
+		fs->fs_full[w / 32] &= ~((uint32_t)1 << (w % 32));
+	}
+}
+
+/*
+ * Find the lowest free slot. Returns fs_num if there isn't one.
+ */
+static
+unsigned
+ftslots_lowfree(struct ftslots *fs)
+{
+	unsigned nwords = fs->fs_num / 32;
+	unsigned fw, w;
+	uint32_t bits;
+
+	for (fw = 0; fw * 32 < nwords; fw++) {
+		bits = ~fs->fs_full[fw];
+		if (nwords - fw * 32 < 32) {
+			/* ignore bits past the end of fs_inuse */
+			bits &= ((uint32_t)1 << (nwords - fw * 32)) - 1;
+		}
+		if (bits != 0) {
+			w = fw * 32 + lowbit32(bits);
+			return w * 32 + lowbit32(~fs->fs_inuse[w]);
+		}
+	}
+	return fs->fs_num;
+}
+
+////////////////////////////////////////////////////////////
+//
+// Filetables
+//
+
+/*
+ * Allocate a filetable with no slot array.
+ */
+static
+struct filetable *
+filetable_alloc(void)
+{
+	struct filetable *ft;
+
+	ft = kmalloc(sizeof(struct filetable));
+	if (ft == NULL) {
+		return NULL;
+	}
+	ft->ft_wlock = lock_create("filetable");
+	if (ft->ft_wlock == NULL) {
+		kfree(ft);
+		return NULL;
+	}
+	spinlock_init(&ft->ft_lock);
+	ft->ft_slots = NULL;
+	return ft;
+}
+
+/*
+ * Get a filetable ready to be changed: make sure its slot array is
+ * its own and has at least MINSLOTS slots. This is where the copy in
+ * copy-on-write happens. Must hold ft_wlock.
+ *
+ * The new array is built without ft_lock held (it needs to allocate
+ * memory) and then swapped in; this is safe because only holders of
+ * ft_wlock change the slots, and nobody else can start sharing our
+ * array while we hold ft_wlock (see filetable_copy). If the array
+ * wasn't shared, the open file references move over to the new one;
+ * otherwise we take new references and drop ours on the old array.
+ */
+static
+int
+filetable_prepare(struct filetable *ft, unsigned minslots)
+{
+	struct ftslots *old, *new;
+	unsigned num, i;
+	bool shared;
+
+	KASSERT(lock_do_i_hold(ft->ft_wlock));
+	KASSERT(minslots <= OPEN_MAX);
+
+	old = ft->ft_slots;
+	shared = ftslots_shared(old);
+	if (!shared && old->fs_num >= minslots) {
+		return 0;
+	}
+
+	num = old->fs_num;
+	while (num < minslots) {
+		num *= 2;
+	}
+	if (num > OPEN_MAX) {
+		num = OPEN_MAX;
+	}
+
+	new = ftslots_create(num);
+	if (new == NULL) {
+		return ENOMEM;
+	}
+	for (i=0; i<old->fs_num; i++) {
+		new->fs_files[i] = old->fs_files[i];
+		if (shared && new->fs_files[i] != NULL) {
+			openfile_incref(new->fs_files[i]);
+		}
+	}
+	for (i=0; i<old->fs_num / 32; i++) {
+		new->fs_inuse[i] = old->fs_inuse[i];
+	}
+	for (i=0; i<FT_FULLWORDS; i++) {
+		new->fs_full[i] = old->fs_full[i];
+	}
+
+	spinlock_acquire(&ft->ft_lock);
+	ft->ft_slots = new;
+	spinlock_release(&ft->ft_lock);
+
+	if (shared) {
+		ftslots_decref(old);
+	}
+	else {
+		ftslots_free(old);
+	}
+	return 0;
+}
+
 /*
  * Construct a filetable.
  */
@@ -45,16 +294,19 @@ struct filetable *
 filetable_create(void)
 {
 	struct filetable *ft;
-	int fd;
 
-	ft = kmalloc(sizeof(struct filetable));
+	ft = filetable_alloc();
 	if (ft == NULL) {
 		return NULL;
 	}
 
 	/* the table starts empty */
-	for (fd = 0; fd < OPEN_MAX; fd++) {
-		ft->ft_openfiles[fd] = NULL;
+	ft->ft_slots = ftslots_create(FT_MINSLOTS);
+	if (ft->ft_slots == NULL) {
+		spinlock_cleanup(&ft->ft_lock);
+		lock_destroy(ft->ft_wlock);
+		kfree(ft);
+		return NULL;
 	}
 
 	return ft;
@@ -66,17 +318,14 @@ filetable_create(void)
 void
 filetable_destroy(struct filetable *ft)
 {
-	int fd;
-
 	KASSERT(ft != NULL);
 
-	/* Close any open files. */
-	for (fd = 0; fd < OPEN_MAX; fd++) {
-		if (ft->ft_openfiles[fd] != NULL) {
-			openfile_decref(ft->ft_openfiles[fd]);
-			ft->ft_openfiles[fd] = NULL;
-		}
-	}
+	/* Close any open files, unless someone else is still using them. */
+	ftslots_decref(ft->ft_slots);
+	ft->ft_slots = NULL;
+
+	spinlock_cleanup(&ft->ft_lock);
+	lock_destroy(ft->ft_wlock);
 	kfree(ft);
 }
 
@@ -94,13 +343,16 @@ filetable_destroy(struct filetable *ft)
  *
  * produce the intended output instead of having the second echo
  * command overwrite the first.
+ *
+ * The slot array itself is shared too, until one side changes its
+ * table (see filetable_prepare). The common case of fork followed by
+ * exec thus doesn't need to touch the open files at all.
  */
 int
 filetable_copy(struct filetable *src, struct filetable **dest_ret)
 {
 	struct filetable *dest;
-	struct openfile *file;
-	int fd;
+	struct ftslots *fs;
 
 	/* Copying the nonexistent table avoids special cases elsewhere */
 	if (src == NULL) {
@@ -108,20 +360,20 @@ filetable_copy(struct filetable *src, struct filetable **dest_ret)
 		return 0;
 	}
 
-	dest = filetable_create();
+	dest = filetable_alloc();
 	if (dest == NULL) {
 		return ENOMEM;
 	}
 
-	/* share the entries */
-	for (fd = 0; fd < OPEN_MAX; fd++) {
-		file = src->ft_openfiles[fd];
-		if (file != NULL) {
-			openfile_incref(file);
-		}
-		dest->ft_openfiles[fd] = file;
-	}
+	/* share the slots; hold ft_wlock so nobody's changing them */
+	lock_acquire(src->ft_wlock);
+	fs = src->ft_slots;
+	spinlock_acquire(&fs->fs_reflock);
+	fs->fs_refcount++;
+	spinlock_release(&fs->fs_reflock);
+	lock_release(src->ft_wlock);
 
+	dest->ft_slots = fs;
 	*dest_ret = dest;
 	return 0;
 }
@@ -132,7 +384,7 @@ filetable_copy(struct filetable *src, struct filetable **dest_ret)
 bool
 filetable_okfd(struct filetable *ft, int fd)
 {
-	/* We have a fixed-size table so we don't need to check the size */
+	/* The table grows as needed, so just check against the limit */
 	(void)ft;
 
 	return (fd >= 0 && fd < OPEN_MAX);
@@ -145,17 +397,28 @@ filetable_okfd(struct filetable *ft, int fd)
  * This checks that the file handle is in range and fails rather than
  * returning a null openfile; it only yields files that are actually
  * open.
+ *
+ * The openfile comes with its own reference, so it stays valid even
+ * if another thread closes the file handle before we're done.
  */
 int
 filetable_get(struct filetable *ft, int fd, struct openfile **ret)
 {
+	struct ftslots *fs;
 	struct openfile *file;
 
 	if (!filetable_okfd(ft, fd)) {
 		return EBADF;
 	}
 
-	file = ft->ft_openfiles[fd];
+	spinlock_acquire(&ft->ft_lock);
+	fs = ft->ft_slots;
+	file = (unsigned)fd < fs->fs_num ? fs->fs_files[fd] : NULL;
+	if (file != NULL) {
+		openfile_incref(file);
+	}
+	spinlock_release(&ft->ft_lock);
+
 	if (file == NULL) {
 		return EBADF;
 	}
@@ -165,26 +428,21 @@ filetable_get(struct filetable *ft, int fd, struct openfile **ret)
 }
 
 /*
- * Put a file handle back when done with it. This does not actually do
- * anything (other than crosscheck) but it's always good practice to
- * build things so when you take them out you put them back again
- * rather than dropping them on the floor. Then if you need to do
- * something at cleanup time you can put it in this function instead
- * of having to hunt for all the places to insert the new logic.
- *
- * (For example, if you have multithreaded processes you will need to
- * insert additional lock and/or refcount manipulations here and in
- * filetable_get.)
+ * Put a file handle back when done with it. This drops the reference
+ * filetable_get took; if the file handle was closed in the meantime,
+ * that might be the last reference.
  *
  * The openfile should be the one returned from filetable_get. If you
- * want to manipulate the table so the assertion's no longer true, get
- * your own reference to the openfile (with openfile_incref) and call
- * filetable_put before mucking about.
+ * want to keep it after putting it back, get your own reference to
+ * the openfile (with openfile_incref) first.
  */
 void
 filetable_put(struct filetable *ft, int fd, struct openfile *file)
 {
-	KASSERT(ft->ft_openfiles[fd] == file);
+	(void)ft;
+	(void)fd;
+
+	openfile_decref(file);
 }
 
 /*
@@ -195,22 +453,38 @@ filetable_put(struct filetable *ft, int fd, struct openfile *file)
  * manipulating stdin/stdout/stderr.)
  *
  * Consumes a reference to the openfile object. (That reference is
- * placed in the table.)
+ * placed in the table.) On failure the reference is left to the
+ * caller.
  */
 int
 filetable_place(struct filetable *ft, struct openfile *file, int *fd_ret)
 {
-	int fd;
+	unsigned fd;
+	int result;
 
-	for (fd = 0; fd < OPEN_MAX; fd++) {
-		if (ft->ft_openfiles[fd] == NULL) {
-			ft->ft_openfiles[fd] = file;
-			*fd_ret = fd;
-			return 0;
-		}
+	lock_acquire(ft->ft_wlock);
+
+	fd = ftslots_lowfree(ft->ft_slots);
+	if (fd >= OPEN_MAX) {
+		lock_release(ft->ft_wlock);
+		return EMFILE;
+	}
+
+	/* grow the table if it's full, and unshare it */
+	result = filetable_prepare(ft, fd + 1);
+	if (result) {
+		lock_release(ft->ft_wlock);
+		return result;
 	}
 
-	return EMFILE;
+	spinlock_acquire(&ft->ft_lock);
+	ftslots_set(ft->ft_slots, fd, file);
+	spinlock_release(&ft->ft_lock);
+
+	lock_release(ft->ft_wlock);
+
+	*fd_ret = fd;
+	return 0;
 }
 
 /*
@@ -221,17 +495,45 @@ filetable_place(struct filetable *ft, struct openfile *file, int *fd_ret)
  * reference to the old openfile object (if not NULL); this should
  * generally be decref'd.
  *
- * Doesn't fail.
+ * Can fail with ENOMEM if the table needs to be grown or unshared;
+ * then nothing is consumed or returned. Placing NULL in a slot that's
+ * already empty doesn't need to do either, so never fails.
  *
  * Note that you can use this to place NULL in the filetable, which is
  * potentially handy.
  */
-void
+int
 filetable_placeat(struct filetable *ft, struct openfile *newfile, int fd,
 		  struct openfile **oldfile_ret)
 {
+	struct ftslots *fs;
+	int result;
+
 	KASSERT(filetable_okfd(ft, fd));
 
-	*oldfile_ret = ft->ft_openfiles[fd];
-	ft->ft_openfiles[fd] = newfile;
+	lock_acquire(ft->ft_wlock);
+
+	fs = ft->ft_slots;
+	if (newfile == NULL &&
+	    ((unsigned)fd >= fs->fs_num || fs->fs_files[fd] == NULL)) {
+		/* nothing to do */
+		lock_release(ft->ft_wlock);
+		*oldfile_ret = NULL;
+		return 0;
+	}
+
+	result = filetable_prepare(ft, fd + 1);
+	if (result) {
+		lock_release(ft->ft_wlock);
+		return result;
+	}
+
+	spinlock_acquire(&ft->ft_lock);
+	fs = ft->ft_slots;
+	*oldfile_ret = fs->fs_files[fd];
+	ftslots_set(fs, fd, newfile);
+	spinlock_release(&ft->ft_lock);
+
+	lock_release(ft->ft_wlock);
+	return 0;
 }
@@ -0,0 +1,345 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Futexes.
+ *
+ * A futex is just a word of user memory. User code does all the
+ * uncontended work itself with atomic instructions, and only calls
+ * futex_wait to sleep until the word changes and futex_wake to wake
+ * sleepers after changing it.
+ *
+ * Waiters are identified by a key. For a word in a shared memory
+ * mapping the key is the shm object and the offset in it, so that
+ * processes mapping the object find each other no matter where it
+ * appears in their address spaces. Any other word is private to its
+ * address space, and the key is the address space and the virtual
+ * address. (Not the physical address: copy-on-write after fork, or
+ * paging, can move the word to another frame between the wait and
+ * the wake.) Keys hash into a fixed table of buckets; each bucket has
+ * a spinlock, a wait channel, and a list of the waiters currently
+ * asleep on any key that hashes there. futex_wake wakes just the
+ * threads it picked, not everyone in the bucket.
+ *
+ * Waiter records live on the waiting thread's kernel stack, along
+ * with the timer for a timed wait, which wakes just that waiter.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/time.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <synch.h>
+#include <wchan.h>
+#include <clock.h>
+#include <current.h>
+#include <copyinout.h>
+#include <proc.h>
+#include <addrspace.h>
+#include <futex.h>
+#include <syscall.h>
+
+/* Number of hash buckets; must be a power of 2 */
+#define FUTEX_NBUCKETS	64
+
+/* What a waiter is waiting on; see above. */
+struct futex_key {
+	const void *fk_obj;		/* shm object or address space */
+	vaddr_t fk_offset;		/* offset in object, or vaddr */
+};
+
+struct futex_waiter {
+	struct futex_key fw_key;	/* word waited on */
+	bool fw_woken;			/* set by futex_wake */
+	bool fw_timedout;		/* set by futex_timeout */
+	struct thread *fw_thread;	/* who's waiting */
+	struct futex_bucket *fw_bucket;	/* where */
+	struct futex_waiter *fw_next;	/* next in bucket */
+};
+
+struct futex_bucket {
+	struct spinlock fb_lock;	/* protects the rest */
+	struct wchan *fb_wchan;		/* everyone in the bucket sleeps here */
+	struct futex_waiter *fb_waiters; /* list of waiters */
+};
+
+static struct futex_bucket futex_table[FUTEX_NBUCKETS];
+
+/*
+ * Setup.
+ */
+void
+futex_bootstrap(void)
+{
+	unsigned i;
+
+	for (i=0; i<FUTEX_NBUCKETS; i++) {
+		spinlock_init(&futex_table[i].fb_lock);
+		futex_table[i].fb_wchan = wchan_create("futex");
+		if (futex_table[i].fb_wchan == NULL) {
+			panic("futex_bootstrap: Out of memory\n");
+		}
+		futex_table[i].fb_waiters = NULL;
+	}
+}
+
+/*
+ * Hash a key to its bucket. The low two bits of the offset are
+ * always zero.
+ */
+static
+struct futex_bucket *
+futex_bucket(const struct futex_key *key)
+{
+	uint32_t h;
+
+	h = (uint32_t)(uintptr_t)key->fk_obj ^ (key->fk_offset >> 2);
+	return &futex_table[(h * 2654435761U) >> 26 & (FUTEX_NBUCKETS - 1)];
+}
+
+static
+bool
+futex_samekey(const struct futex_key *a, const struct futex_key *b)
+{
+	return a->fk_obj == b->fk_obj && a->fk_offset == b->fk_offset;
+}
+
+/*
+ * Translate the user address of a futex word to its key. Read the
+ * word first to check the address is mapped, then see if it's in a
+ * shared mapping.
+ */
+static
+int
+futex_getkey(userptr_t uaddr, struct futex_key *key)
+{
+	struct addrspace *as;
+	Shm_Region_t shm;
+	vaddr_t va = (vaddr_t)uaddr;
+	int val, result;
+
+	if (va % sizeof(int) != 0) {
+		return EINVAL;
+	}
+	result = copyin((const_userptr_t)uaddr, &val, sizeof(val));
+	if (result) {
+		return result;
+	}
+
+	as = proc_getas();
+	KASSERT(as != NULL);
+
+	/* the shm list changes under as_lock */
+	lock_acquire(as->as_lock);
+	shm = Lookup_Shm(as, va);
+	if (shm != NULL) {
+		key->fk_obj = shm->obj;
+		key->fk_offset = va - shm->base_addr;
+	}
+	else {
+		key->fk_obj = as;
+		key->fk_offset = va;
+	}
+	lock_release(as->as_lock);
+	return 0;
+}
+
+/*
+ * Timer function for a timed wait.
+ */
+static
+void
+futex_timeout(void *data)
+{
+	struct futex_waiter *fw = data;
+	struct futex_bucket *fb = fw->fw_bucket;
+
+	spinlock_acquire(&fb->fb_lock);
+	fw->fw_timedout = true;
+	wchan_wakethread(fb->fb_wchan, &fb->fb_lock, fw->fw_thread);
+	spinlock_release(&fb->fb_lock);
+}
+
+/*
+ * sys_futex_wait
+ *
+ * Sleep if the word at UADDR still contains VAL, until futex_wake is
+ * called on it or the (relative) TIMEOUT, if given, runs out. Fails
+ * with EAGAIN if the word didn't contain VAL, and ETIMEDOUT on
+ * timeout. Spurious success is allowed; callers recheck the word.
+ *
+ * We go on the waiter list before reading the word. That way, if it
+ * changes and the waker runs after we look, the waker finds us and
+ * sets fw_woken; if before, we see the new value.
+ */
+int
+sys_futex_wait(userptr_t uaddr, int val, const_userptr_t utimeout)
+{
+	struct futex_bucket *fb;
+	struct futex_waiter fw, **fwp;
+	struct timespec timeout;
+	struct timer tm;
+	bool timed;
+	int cur, result;
+
+	timed = utimeout != NULL;
+	if (timed) {
+		result = copyin(utimeout, &timeout, sizeof(timeout));
+		if (result) {
+			return result;
+		}
+		if (timeout.tv_sec < 0 ||
+		    timeout.tv_nsec < 0 || timeout.tv_nsec >= 1000000000) {
+			return EINVAL;
+		}
+	}
+
+	result = futex_getkey(uaddr, &fw.fw_key);
+	if (result) {
+		return result;
+	}
+	fw.fw_woken = false;
+	fw.fw_timedout = false;
+	fw.fw_thread = curthread;
+	fb = futex_bucket(&fw.fw_key);
+	fw.fw_bucket = fb;
+
+	spinlock_acquire(&fb->fb_lock);
+	fw.fw_next = fb->fb_waiters;
+	fb->fb_waiters = &fw;
+	spinlock_release(&fb->fb_lock);
+
+	if (timed) {
+		timer_init(&tm, futex_timeout, &fw);
+		timer_start(&tm, &timeout);
+	}
+
+	result = copyin((const_userptr_t)uaddr, &cur, sizeof(cur));
+
+	spinlock_acquire(&fb->fb_lock);
+	if (result == 0 && cur != val) {
+		result = EAGAIN;
+	}
+	while (result == 0 && !fw.fw_woken) {
+		if (fw.fw_timedout) {
+			result = ETIMEDOUT;
+			break;
+		}
+		if (curproc->p_exiting) {
+			/* see futex_wakeproc */
+			result = EINTR;
+			break;
+		}
+		wchan_sleep(fb->fb_wchan, &fb->fb_lock);
+	}
+	if (fw.fw_woken) {
+		/* we used up a wakeup, so report it */
+		result = 0;
+	}
+
+	for (fwp = &fb->fb_waiters; *fwp != &fw; fwp = &(*fwp)->fw_next) {
+		KASSERT(*fwp != NULL);
+	}
+	*fwp = fw.fw_next;
+	spinlock_release(&fb->fb_lock);
+
+	if (timed) {
+		/* also waits for futex_timeout to be done with FW */
+		timer_stop(&tm);
+	}
+
+	return result;
+}
+
+/*
+ * sys_futex_wake
+ *
+ * Wake up to COUNT threads waiting on the word at UADDR; returns the
+ * number woken. A waiter that hasn't got to sleep yet sees fw_woken
+ * before it does, so wchan_wakethread not finding it is fine.
+ */
+int
+sys_futex_wake(userptr_t uaddr, int count, int *retval)
+{
+	struct futex_bucket *fb;
+	struct futex_waiter *fw;
+	struct futex_key key;
+	int n, result;
+
+	if (count < 0) {
+		return EINVAL;
+	}
+	result = futex_getkey(uaddr, &key);
+	if (result) {
+		return result;
+	}
+	fb = futex_bucket(&key);
+
+	n = 0;
+	spinlock_acquire(&fb->fb_lock);
+	for (fw = fb->fb_waiters; fw != NULL && n < count; fw = fw->fw_next) {
+		if (futex_samekey(&fw->fw_key, &key) && !fw->fw_woken) {
+			fw->fw_woken = true;
+			wchan_wakethread(fb->fb_wchan, &fb->fb_lock,
+					 fw->fw_thread);
+			n++;
+		}
+	}
+	spinlock_release(&fb->fb_lock);
+
+	*retval = n;
+	return 0;
+}
+
+/*
+ * Wake every thread of PROC that's in futex_wait, so it can notice
+ * the process is exiting. PROC's p_exiting is already set, and a
+ * waiter checks it under the bucket lock before sleeping, so each
+ * one either sees it or is asleep by the time we look.
+ */
+void
+futex_wakeproc(struct proc *proc)
+{
+	struct futex_bucket *fb;
+	struct futex_waiter *fw;
+	unsigned i;
+
+	for (i=0; i<FUTEX_NBUCKETS; i++) {
+		fb = &futex_table[i];
+		spinlock_acquire(&fb->fb_lock);
+		for (fw = fb->fb_waiters; fw != NULL; fw = fw->fw_next) {
+			if (fw->fw_thread->t_proc == proc) {
+				wchan_wakethread(fb->fb_wchan, &fb->fb_lock,
+						 fw->fw_thread);
+			}
+		}
+		spinlock_release(&fb->fb_lock);
+	}
+}
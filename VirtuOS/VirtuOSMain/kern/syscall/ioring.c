@@ -0,0 +1,353 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * I/O submission rings.
+ *
+ * The ring is an anonymous shared memory object (see shm.h) mapped
+ * into the process, so user code fills in requests and reaps results
+ * with ordinary loads and stores, and one ioring_enter call does a
+ * whole batch, paying for the trap only once.
+ *
+ * The kernel reaches the ring with copyin/copyout through its user
+ * address, like any other user memory, so if the process unmaps it
+ * or scribbles on it the worst it gets is EFAULT or garbage results.
+ * For the same reason the kernel never trusts anything in the ring
+ * but the two counters the user advances.
+ *
+ * The per-process state is created by the first ioring_setup and
+ * lives as long as the process. Exec just forgets the ring, which
+ * leaves nothing to free out from under another thread's
+ * ioring_enter.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/ioring.h>
+#include <lib.h>
+#include <membar.h>
+#include <synch.h>
+#include <current.h>
+#include <copyinout.h>
+#include <proc.h>
+#include <addrspace.h>
+#include <shm.h>
+#include <ioring.h>
+#include <syscall.h>
+
+struct ioring_ctx {
+	struct lock *ic_lock;		/* one ioring_enter at a time */
+	vaddr_t ic_base;		/* user address of ring, 0 if none */
+	unsigned ic_entries;		/* size of each ring */
+	unsigned ic_sqoff;		/* offset of submission entries */
+	unsigned ic_cqoff;		/* offset of completion entries */
+	unsigned ic_sqhead;		/* our own copies of the counters */
+	unsigned ic_cqtail;		/* we post */
+};
+
+/* Where the counters are */
+#define IC_FIELD(ic, f)	((userptr_t)&((struct ioring *)(ic)->ic_base)->f)
+
+void
+ioring_reset(struct ioring_ctx *ic)
+{
+	lock_acquire(ic->ic_lock);
+	ic->ic_base = 0;
+	lock_release(ic->ic_lock);
+}
+
+void
+ioring_destroy(struct ioring_ctx *ic)
+{
+	lock_destroy(ic->ic_lock);
+	kfree(ic);
+}
+
+/*
+ * Get the current process's ring state, creating it if CREATE is set.
+ */
+static
+struct ioring_ctx *
+ioring_get(bool create)
+{
+	struct proc *p = curproc;
+	struct ioring_ctx *ic, *newic;
+
+	spinlock_acquire(&p->p_lock);
+	ic = p->p_ioring;
+	spinlock_release(&p->p_lock);
+	if (ic != NULL || !create) {
+		return ic;
+	}
+
+	newic = kmalloc(sizeof(*newic));
+	if (newic == NULL) {
+		return NULL;
+	}
+	newic->ic_lock = lock_create("ioring");
+	if (newic->ic_lock == NULL) {
+		kfree(newic);
+		return NULL;
+	}
+	newic->ic_base = 0;
+
+	/* another thread may have beaten us to it */
+	spinlock_acquire(&p->p_lock);
+	ic = p->p_ioring;
+	if (ic == NULL) {
+		p->p_ioring = ic = newic;
+		newic = NULL;
+	}
+	spinlock_release(&p->p_lock);
+
+	if (newic != NULL) {
+		ioring_destroy(newic);
+	}
+	return ic;
+}
+
+/*
+ * Do one request; returns the completion result.
+ */
+static
+int64_t
+ioring_do(const struct ioring_sqe *sqe)
+{
+	int result, ret = 0;
+	off_t pos;
+
+	switch (sqe->sqe_op) {
+	    case IORING_OP_NOP:
+		result = 0;
+		break;
+	    case IORING_OP_READ:
+		if (sqe->sqe_off == -1) {
+			result = sys_read(sqe->sqe_fd, sqe->sqe_buf,
+					  sqe->sqe_len, &ret);
+		}
+		else {
+			result = sys_pread(sqe->sqe_fd, sqe->sqe_buf,
+					   sqe->sqe_len, sqe->sqe_off, &ret);
+		}
+		break;
+	    case IORING_OP_WRITE:
+		if (sqe->sqe_off == -1) {
+			result = sys_write(sqe->sqe_fd, sqe->sqe_buf,
+					   sqe->sqe_len, &ret);
+		}
+		else {
+			result = sys_pwrite(sqe->sqe_fd, sqe->sqe_buf,
+					    sqe->sqe_len, sqe->sqe_off, &ret);
+		}
+		break;
+	    case IORING_OP_OPEN:
+		result = sys_open(sqe->sqe_buf, sqe->sqe_flags,
+				  sqe->sqe_mode, &ret);
+		break;
+	    case IORING_OP_CLOSE:
+		result = sys_close(sqe->sqe_fd);
+		break;
+	    case IORING_OP_FSYNC:
+		result = sys_fsync(sqe->sqe_fd);
+		break;
+	    case IORING_OP_LSEEK:
+		result = sys_lseek(sqe->sqe_fd, sqe->sqe_off, sqe->sqe_flags,
+				   &pos);
+		if (result == 0) {
+			return pos;
+		}
+		break;
+	    default:
+		result = EINVAL;
+		break;
+	}
+
+	if (result) {
+		return -(int64_t)result;
+	}
+	return ret;
+}
+
+/*
+ * sys_ioring_setup
+ *
+ * Map a new ring with at least ENTRIES entries (rounded up to a
+ * power of 2) and return its address. A process has at most one.
+ */
+int
+sys_ioring_setup(unsigned entries, int32_t *retval)
+{
+	struct ioring_ctx *ic;
+	struct ioring hdr;
+	struct shmobj *so;
+	unsigned n, sqoff, cqoff;
+	size_t size;
+	vaddr_t addr;
+	int result;
+
+	if (entries == 0 || entries > IORING_MAXENTRIES) {
+		return EINVAL;
+	}
+	for (n = 1; n < entries; n <<= 1) {
+		/* nothing */
+	}
+	sqoff = ROUNDUP(sizeof(struct ioring), sizeof(uint64_t));
+	cqoff = sqoff + n * sizeof(struct ioring_sqe);
+	size = ROUNDUP(cqoff + n * sizeof(struct ioring_cqe), PAGE_SIZE);
+
+	ic = ioring_get(true);
+	if (ic == NULL) {
+		return ENOMEM;
+	}
+
+	lock_acquire(ic->ic_lock);
+	if (ic->ic_base != 0) {
+		lock_release(ic->ic_lock);
+		return EBUSY;
+	}
+
+	result = shmobj_open(NULL, 0, size, &so);
+	if (result) {
+		lock_release(ic->ic_lock);
+		return result;
+	}
+	result = as_map_shared(proc_getas(), so, size, true, &addr);
+	if (result) {
+		shmobj_decref(so);
+		lock_release(ic->ic_lock);
+		return result;
+	}
+
+	hdr.ir_sqhead = hdr.ir_sqtail = 0;
+	hdr.ir_cqhead = hdr.ir_cqtail = 0;
+	hdr.ir_entries = n;
+	hdr.ir_sqoff = sqoff;
+	hdr.ir_cqoff = cqoff;
+	result = copyout(&hdr, (userptr_t)addr, sizeof(hdr));
+	if (result) {
+		/* someone unmapped it already */
+		lock_release(ic->ic_lock);
+		return result;
+	}
+
+	ic->ic_base = addr;
+	ic->ic_entries = n;
+	ic->ic_sqoff = sqoff;
+	ic->ic_cqoff = cqoff;
+	ic->ic_sqhead = 0;
+	ic->ic_cqtail = 0;
+	lock_release(ic->ic_lock);
+
+	*retval = addr;
+	return 0;
+}
+
+/*
+ * sys_ioring_enter
+ *
+ * Run up to TOSUBMIT submitted requests, posting a completion for
+ * each, and return how many ran. Stops early when the submission
+ * ring runs dry or the completion ring fills up.
+ */
+int
+sys_ioring_enter(unsigned tosubmit, int *retval)
+{
+	struct ioring_ctx *ic;
+	struct ioring_sqe sqe;
+	struct ioring_cqe cqe;
+	uint32_t sqtail, cqhead;
+	unsigned mask, done;
+	int result;
+
+	ic = ioring_get(false);
+	if (ic == NULL) {
+		return EINVAL;
+	}
+
+	lock_acquire(ic->ic_lock);
+	if (ic->ic_base == 0) {
+		lock_release(ic->ic_lock);
+		return EINVAL;
+	}
+	mask = ic->ic_entries - 1;
+
+	result = copyin(IC_FIELD(ic, ir_sqtail), &sqtail, sizeof(sqtail));
+	if (result == 0) {
+		result = copyin(IC_FIELD(ic, ir_cqhead), &cqhead,
+				sizeof(cqhead));
+	}
+	if (result == 0 && sqtail - ic->ic_sqhead > ic->ic_entries) {
+		/* the user's counter is garbage */
+		result = EINVAL;
+	}
+	/* read the entries only after the tail that covers them */
+	membar_load_load();
+
+	done = 0;
+	while (result == 0 && done < tosubmit && ic->ic_sqhead != sqtail) {
+		if (ic->ic_cqtail - cqhead >= ic->ic_entries) {
+			break;
+		}
+
+		result = copyin((userptr_t)(ic->ic_base + ic->ic_sqoff +
+			(ic->ic_sqhead & mask) * sizeof(sqe)),
+			&sqe, sizeof(sqe));
+		if (result) {
+			break;
+		}
+		ic->ic_sqhead++;
+
+		cqe.cqe_data = sqe.sqe_data;
+		cqe.cqe_res = ioring_do(&sqe);
+		result = copyout(&cqe, (userptr_t)(ic->ic_base + ic->ic_cqoff +
+			(ic->ic_cqtail & mask) * sizeof(cqe)),
+			sizeof(cqe));
+		if (result) {
+			break;
+		}
+		ic->ic_cqtail++;
+		done++;
+
+		/* publish the completion after its contents */
+		membar_store_store();
+		result = copyout(&ic->ic_cqtail, IC_FIELD(ic, ir_cqtail),
+				 sizeof(uint32_t));
+	}
+	if (result == 0) {
+		result = copyout(&ic->ic_sqhead, IC_FIELD(ic, ir_sqhead),
+				 sizeof(uint32_t));
+	}
+	lock_release(ic->ic_lock);
+
+	if (result && done == 0) {
+		return result;
+	}
+	*retval = done;
+	return 0;
+}
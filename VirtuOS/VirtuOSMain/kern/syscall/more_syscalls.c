@@ -339,6 +339,62 @@ sys_getdirentry(int fd, userptr_t buf, size_t buflen, int *retval)
 	return 0;
 }
 
+/*
+ * getdirentries - like getdirentry, but call VOP_GETDIRENTRIES to
+ * fill the whole buffer with struct dirent records at once.
+ */
+int
+sys_getdirentries(int fd, userptr_t buf, size_t buflen, int *retval)
+{
+	struct iovec iov;
+	struct uio useruio;
+	struct openfile *file;
+	int err;
+
+	err = filetable_get(curproc->p_filetable, fd, &file);
+	if (err) {
+		return err;
+	}
+
+	/*
+	 * Directories are seekable; the console and pipes aren't, and
+	 * the uio offset means nothing for them. Don't let users
+	 * trip over that.
+	 */
+	if (!VOP_ISSEEKABLE(file->of_vnode)) {
+		filetable_put(curproc->p_filetable, fd, file);
+		return ENOTDIR;
+	}
+
+	lock_acquire(file->of_offsetlock);
+
+	KASSERT((file->of_accmode & O_ACCMODE) == file->of_accmode);
+	if (file->of_accmode == O_WRONLY) {
+		lock_release(file->of_offsetlock);
+		filetable_put(curproc->p_filetable, fd, file);
+		return EBADF;
+	}
+
+	uio_uinit(&iov, &useruio, buf, buflen, file->of_offset, UIO_READ);
+
+	err = VOP_GETDIRENTRIES(file->of_vnode, &useruio);
+	if (err) {
+		lock_release(file->of_offsetlock);
+		filetable_put(curproc->p_filetable, fd, file);
+		return err;
+	}
+
+	file->of_offset = useruio.uio_offset;
+
+	lock_release(file->of_offsetlock);
+	filetable_put(curproc->p_filetable, fd, file);
+
+	/* as with getdirentry, uio_offset isn't a byte count */
+	*retval = buflen - useruio.uio_resid;
+
+	return 0;
+}
+
 /*
  * fstat - call VOP_FSTAT
  */
@@ -369,6 +425,86 @@ sys_fstat(int fd, userptr_t statptr)
 	return copyout(&kbuf, statptr, sizeof(struct stat));
 }
 
+/*
+ * Check if PATH is relative, that is, would be looked up from the
+ * current directory by vfs_lookup. That's the case unless it starts
+ * with a slash or has a device name (a colon before any slash).
+ */
+static
+bool
+path_isrelative(const char *path)
+{
+	size_t i;
+
+	for (i=0; path[i]; i++) {
+		if (path[i] == ':') {
+			return false;
+		}
+		if (path[i] == '/') {
+			return i > 0;
+		}
+	}
+	return true;
+}
+
+/*
+ * fstatat - look up PATH relative to the directory DIRFD (or the
+ * current directory, for AT_FDCWD) and call VOP_STAT on it. There
+ * are no symlinks, so AT_SYMLINK_NOFOLLOW changes nothing.
+ */
+int
+sys_fstatat(int dirfd, const_userptr_t path, userptr_t statptr, int flags)
+{
+	struct stat kbuf;
+	struct openfile *dir;
+	struct vnode *vn;
+	char *kpath;
+	int err;
+
+	if ((flags & AT_SYMLINK_NOFOLLOW) != flags) {
+		return EINVAL;
+	}
+
+	kpath = kmalloc(PATH_MAX);
+	if (kpath == NULL) {
+		return ENOMEM;
+	}
+
+	err = copyinstr(path, kpath, PATH_MAX, NULL);
+	if (err) {
+		kfree(kpath);
+		return err;
+	}
+	if (kpath[0] == 0) {
+		kfree(kpath);
+		return ENOENT;
+	}
+
+	if (dirfd == AT_FDCWD || !path_isrelative(kpath)) {
+		err = vfs_lookup(kpath, &vn);
+	}
+	else {
+		err = filetable_get(curproc->p_filetable, dirfd, &dir);
+		if (err == 0) {
+			/* the openfile holds a reference to the vnode */
+			err = VOP_LOOKUP(dir->of_vnode, kpath, &vn);
+			filetable_put(curproc->p_filetable, dirfd, dir);
+		}
+	}
+	kfree(kpath);
+	if (err) {
+		return err;
+	}
+
+	err = VOP_STAT(vn, &kbuf);
+	VOP_DECREF(vn);
+	if (err) {
+		return err;
+	}
+
+	return copyout(&kbuf, statptr, sizeof(struct stat));
+}
+
 /*
  * fsync - call VOP_FSYNC
  */
@@ -429,6 +565,39 @@ sys_ftruncate(int fd, off_t len)
 	return err;
 }
 
+/*
+ * fallocate - call VOP_FALLOCATE
+ */
+int
+sys_fallocate(int fd, off_t pos, off_t len)
+{
+	struct openfile *file;
+	int err;
+
+	if (pos < 0 || len <= 0) {
+		return EINVAL;
+	}
+
+	err = filetable_get(curproc->p_filetable, fd, &file);
+	if (err) {
+		return err;
+	}
+
+	/* of_accmode should have only the O_ACCMODE bits in it */
+	KASSERT((file->of_accmode & O_ACCMODE) == file->of_accmode);
+
+	if (file->of_accmode == O_RDONLY) {
+		filetable_put(curproc->p_filetable, fd, file);
+		return EBADF;
+	}
+
+	/* As with ftruncate, no need to lock the openfile. */
+
+	err = VOP_FALLOCATE(file->of_vnode, pos, len);
+	filetable_put(curproc->p_filetable, fd, file);
+	return err;
+}
+
 int sys_sbrk(intptr_t amount, int32_t* retval) {
 
 	struct addrspace* as = proc_getas();
@@ -33,6 +33,8 @@
 
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/time.h>
+#include <kern/resource.h>
 #include <kern/wait.h>
 #include <lib.h>
 #include <machine/trapframe.h>
@@ -58,6 +60,83 @@ sys_getpid(pid_t *retval)
 	return 0;
 }
 
+/*
+ * sys_getpriority, sys_setpriority
+ *
+ * Only PRIO_PROCESS on ourselves (WHO is 0 or our own pid) is
+ * supported: there's no way to get from a pid to another process's
+ * threads, and there are no process groups or users. The nice value
+ * lives in each thread, so setpriority sets it in all of ours and
+ * getpriority reads the caller's; see the scheduler in thread.c for
+ * what it does. Like BSD, getpriority can legitimately return -1.
+ */
+static
+int
+prio_checktarget(int which, pid_t who)
+{
+	if (which != PRIO_PROCESS) {
+		return EINVAL;
+	}
+	if (who != 0 && who != curproc->p_pid) {
+		return ESRCH;
+	}
+	return 0;
+}
+
+int
+sys_getpriority(int which, pid_t who, int *retval)
+{
+	int result;
+
+	result = prio_checktarget(which, who);
+	if (result) {
+		return result;
+	}
+	*retval = thread_getnice();
+	return 0;
+}
+
+int
+sys_setpriority(int which, pid_t who, int prio)
+{
+	int result;
+
+	result = prio_checktarget(which, who);
+	if (result) {
+		return result;
+	}
+	proc_setnice(prio);
+	return 0;
+}
+
+/*
+ * sys_sched_setaffinity, sys_sched_getaffinity
+ *
+ * Bit N of the mask allows the process to run on cpu N. As with
+ * setpriority, PID must be 0 or our own pid, and the mask is kept
+ * in each of our threads, so new threads and fork pass it on.
+ */
+int
+sys_sched_setaffinity(pid_t pid, uint32_t mask)
+{
+	if (pid != 0 && pid != curproc->p_pid) {
+		return ESRCH;
+	}
+	return proc_setaffinity(mask);
+}
+
+int
+sys_sched_getaffinity(pid_t pid, userptr_t mask)
+{
+	uint32_t kmask;
+
+	if (pid != 0 && pid != curproc->p_pid) {
+		return ESRCH;
+	}
+	kmask = thread_getaffinity();
+	return copyout(&kmask, mask, sizeof(kmask));
+}
+
 /*
  * sys__exit()
  *
@@ -137,6 +216,117 @@ sys_fork(struct trapframe *tf, pid_t *retval)
 	return 0;
 }
 
+/*
+ * sys___thread_create
+ *
+ * Create a new thread in the current process. It shares the address
+ * space and file table, and starts at ENTRY with ARG as its argument
+ * and its stack pointer at STACKTOP; libc allocates the stack and
+ * supplies an ENTRY that calls the user's function. Returns the new
+ * thread's id.
+ */
+
+struct uthread_start {
+	struct trapframe us_tf;		/* creator's registers */
+	vaddr_t us_entry;		/* where to start */
+	vaddr_t us_arg;			/* argument in a0 */
+	vaddr_t us_stacktop;		/* initial sp */
+};
+
+static
+void
+uthread_newthread(void *vus, unsigned long tid)
+{
+	struct uthread_start *us = vus;
+	struct trapframe mytf;
+	vaddr_t entry, arg, stacktop;
+
+	/* As in fork_newthread, move everything onto our stack. */
+	mytf = us->us_tf;
+	entry = us->us_entry;
+	arg = us->us_arg;
+	stacktop = us->us_stacktop;
+	kfree(us);
+
+	curthread->t_tid = tid;
+	enter_new_thread(&mytf, entry, arg, stacktop);
+}
+
+int
+sys___thread_create(struct trapframe *tf, userptr_t entry, userptr_t arg,
+		    userptr_t stacktop, int *retval)
+{
+	struct uthread_start *us;
+	int tid;
+	int result;
+
+	/* The stack must be doubleword aligned. */
+	if ((vaddr_t)entry % 4 != 0 || (vaddr_t)stacktop % 8 != 0) {
+		return EINVAL;
+	}
+
+	us = kmalloc(sizeof(*us));
+	if (us == NULL) {
+		return ENOMEM;
+	}
+	us->us_tf = *tf;
+	us->us_entry = (vaddr_t)entry;
+	us->us_arg = (vaddr_t)arg;
+	us->us_stacktop = (vaddr_t)stacktop;
+
+	result = proc_newtid(&tid);
+	if (result) {
+		kfree(us);
+		return result;
+	}
+
+	result = thread_fork(curthread->t_name, curproc,
+			     uthread_newthread, us, tid);
+	if (result) {
+		proc_droptid(tid);
+		kfree(us);
+		return result;
+	}
+
+	*retval = tid;
+	return 0;
+}
+
+/*
+ * sys___thread_join
+ *
+ * Wait for thread TID of this process to exit, and hand back the
+ * value it passed to __thread_exit.
+ */
+int
+sys___thread_join(int tid, userptr_t retval)
+{
+	userptr_t val;
+	int result;
+
+	result = proc_jointid(tid, &val);
+	if (result) {
+		return result;
+	}
+	if (retval != NULL) {
+		result = copyout(&val, retval, sizeof(val));
+	}
+	return result;
+}
+
+/*
+ * sys___thread_exit
+ *
+ * Like _exit, but for one thread; the process goes away with the
+ * last one.
+ */
+__DEAD
+void
+sys___thread_exit(userptr_t retval)
+{
+	proc_thread_exit(retval);
+}
+
 /*
  * sys_waitpid
  * just pass off the work to the pid code.
@@ -157,3 +347,52 @@ sys_waitpid(pid_t pid, userptr_t retstatus, int flags, pid_t *retval)
 	}
 	return result;
 }
+
+/*
+ * sys_waitmany
+ * Reap up to N exited children at once. More than WAITMANY_MAX at a
+ * time isn't worth a bigger buffer; the caller can just call again.
+ */
+#define WAITMANY_MAX	64
+
+int
+sys_waitmany(userptr_t retpids, userptr_t retstatuses, int n, int flags,
+	     int *retval)
+{
+	pid_t *pids;
+	int *statuses;
+	unsigned count;
+	int result;
+
+	if (n <= 0) {
+		return EINVAL;
+	}
+	if (n > WAITMANY_MAX) {
+		n = WAITMANY_MAX;
+	}
+
+	pids = kmalloc(n * sizeof(pid_t));
+	statuses = kmalloc(n * sizeof(int));
+	if (pids == NULL || statuses == NULL) {
+		kfree(pids);
+		kfree(statuses);
+		return ENOMEM;
+	}
+
+	result = pid_waitmany(pids, statuses, n, flags, &count);
+	if (result == 0 && count > 0) {
+		result = copyout(pids, retpids, count * sizeof(pid_t));
+		if (result == 0 && retstatuses != NULL) {
+			result = copyout(statuses, retstatuses,
+					 count * sizeof(int));
+		}
+	}
+	kfree(pids);
+	kfree(statuses);
+	if (result) {
+		return result;
+	}
+
+	*retval = count;
+	return 0;
+}
@@ -39,139 +39,93 @@
 #include <limits.h>
 #include <lib.h>
 #include <proc.h>
-#include <current.h>
 #include <synch.h>
+#include <current.h>
 #include <copyinout.h>
 #include <addrspace.h>
 #include <vm.h>
 #include <vfs.h>
 #include <openfile.h>
 #include <filetable.h>
+#include <ioring.h>
 #include <syscall.h>
 #include <test.h>
 
 /*
- * argv buffer.
+ * Argument passing.
  *
- * This is an abstraction that holds an argv while it's being shuffled
- * through the kernel during exec.
- */
-struct argbuf {
-	char *data;
-	size_t len;
-	size_t max;
-	int nargs;
-	bool tooksem;
-};
-
-/*
- * Throttle to limit the number of processes in exec at once. Or,
- * rather, the number trying to use large exec buffers at once. See
- * design notes for the rationale.
- */
-#define EXEC_BIGBUF_THROTTLE	1
-static struct semaphore *execthrottle;
-
-/*
- * Set things up.
- */
-void
-exec_bootstrap(void)
-{
-	execthrottle = sem_create("exec", EXEC_BIGBUF_THROTTLE);
-	if (execthrottle == NULL) {
-		panic("Cannot create exec throttle semaphore\n");
-	}
-}
-
-/*
- * Initialize an argv buffer.
- */
-static
-void
-argbuf_init(struct argbuf *buf)
-{
-	buf->data = NULL;
-	buf->len = 0;
-	buf->max = 0;
-	buf->nargs = 0;
-	buf->tooksem = false;
-}
-
-/*
- * Clean up an argv buffer when done.
+ * The argument strings go straight from where they are (the old
+ * process's memory for execv, a kernel string for runprogram) into
+ * the top page of the new process's stack. The new stack isn't
+ * current yet, so it's written through the kernel addresses of its
+ * pages, which as_stackpage hands out; the old address space stays
+ * current so copyin can read the old argv. There's no kernel buffer
+ * in between and so nothing to throttle. See design/exec.txt.
+ *
+ * ARG_MAX is no more than a page, so the strings all fit in the top
+ * page of the stack, and copyinstr gets the contiguous destination it
+ * needs. The argv array goes below them and may spill onto the pages
+ * underneath, but it's written one aligned pointer at a time.
  */
-static
-void
-argbuf_cleanup(struct argbuf *buf)
-{
-	if (buf->data != NULL) {
-		kfree(buf->data);
-		buf->data = NULL;
-	}
-	buf->len = 0;
-	buf->max = 0;
-	buf->nargs = 0;
-	if (buf->tooksem) {
-		V(execthrottle);
-		buf->tooksem = false;
-	}
-}
 
-/*
- * Allocate the memory for an argv buffer.
- */
-static
-int
-argbuf_allocate(struct argbuf *buf, size_t size)
-{
-	buf->data = kmalloc(size);
-	if (buf->data == NULL) {
-		return ENOMEM;
-	}
-	buf->max = size;
-	return 0;
-}
+/* Where we last looked up a page of the new stack */
+struct stackcursor {
+	vaddr_t upage;		/* user address of the page, or 0 */
+	vaddr_t kpage;		/* kernel address of the same page */
+};
 
 /*
- * Prepare an argv buffer for runprogram, using a kernel pointer.
- *
- * This only accepts a program name (not arbitrary arguments) from the
- * menu, but could easily be extended to support arbitrary arguments.
+ * Store the pointer VAL at user address UADDR in the new stack.
  */
 static
 int
-argbuf_fromkernel(struct argbuf *buf, const char *progname)
+stack_putptr(struct addrspace *as, struct stackcursor *sc, vaddr_t uaddr,
+	     userptr_t val)
 {
-	size_t len;
 	int result;
 
-	len = strlen(progname) + 1;
+	KASSERT((uaddr & (sizeof(userptr_t) - 1)) == 0);
 
-	result = argbuf_allocate(buf, len);
-	if (result) {
-		return result;
+	if ((uaddr & PAGE_FRAME) != sc->upage) {
+		result = as_stackpage(as, uaddr, &sc->kpage);
+		if (result) {
+			return result;
+		}
+		sc->upage = uaddr & PAGE_FRAME;
 	}
-	strcpy(buf->data, progname);
-	buf->len = len;
-	buf->nargs = 1;
-
+	*(userptr_t *)(sc->kpage + (uaddr & ~(vaddr_t)PAGE_FRAME)) = val;
 	return 0;
 }
 
 /*
- * Copy an argv array into kernel space, using an argvdata buffer.
+ * Copy the argument strings into the bottom of the page KPAGE, from
+ * the user argv UARGV or, if KNAME isn't NULL, just that one string.
+ * Hands back the total length and the number of strings.
  */
 static
 int
-argbuf_copyin(struct argbuf *buf, userptr_t uargv)
+args_copyin(char *kpage, userptr_t uargv, const char *kname,
+	    size_t *len_ret, int *nargs_ret)
 {
 	userptr_t thisarg;
-	size_t thisarglen;
+	size_t len, thisarglen;
+	int nargs;
 	int result;
 
+	if (kname != NULL) {
+		len = strlen(kname) + 1;
+		if (len > ARG_MAX) {
+			return E2BIG;
+		}
+		memcpy(kpage, kname, len);
+		*len_ret = len;
+		*nargs_ret = 1;
+		return 0;
+	}
+
 	/* loop through the argv, grabbing each arg string */
-	buf->nargs = 0;
+	len = 0;
+	nargs = 0;
 	while (1) {
 		/*
 		 * First, grab the pointer at argv.
@@ -188,8 +142,8 @@ argbuf_copyin(struct argbuf *buf, userptr_t uargv)
 		}
 
 		/* Use the pointer to fetch the argument string. */
-		result = copyinstr(thisarg, buf->data + buf->len,
-				   buf->max - buf->len, &thisarglen);
+		result = copyinstr(thisarg, kpage + len, ARG_MAX - len,
+				   &thisarglen);
 		if (result == ENAMETOOLONG) {
 			return E2BIG;
 		}
@@ -198,136 +152,111 @@ argbuf_copyin(struct argbuf *buf, userptr_t uargv)
 		}
 
 		/* Move ahead. Note: thisarglen includes the \0. */
-		buf->len += thisarglen;
+		len += thisarglen;
 		uargv += sizeof(userptr_t);
-		buf->nargs++;
+		nargs++;
 	}
 
+	*len_ret = len;
+	*nargs_ret = nargs;
 	return 0;
 }
 
 /*
- * Get an argv from user space.
+ * Set up the arguments on the stack of NEWVM, whose top is *USTACKP.
+ * Hands back the new stack pointer and the user-level argc and argv.
+ *
+ * Note: ustackp is an in/out argument.
  */
 static
 int
-argbuf_fromuser(struct argbuf *buf, userptr_t uargv)
+args_place(struct addrspace *newvm, userptr_t uargv, const char *kname,
+	   vaddr_t *ustackp, int *argc_ret, userptr_t *uargv_ret)
 {
+	struct stackcursor sc;
+	vaddr_t ustack, kstrings;
+	userptr_t ustringbase, uargvbase, thisarg;
+	size_t len, pos;
+	int nargs, i;
 	int result;
 
-	/* try with a small buffer */
-	result = argbuf_allocate(buf, PAGE_SIZE);
+	COMPILE_ASSERT(ARG_MAX <= PAGE_SIZE);
+
+	/* Begin the stack at the passed in top. */
+	ustack = *ustackp;
+	KASSERT((ustack & ~(vaddr_t)PAGE_FRAME) == 0);
+
+	result = as_stackpage(newvm, ustack - PAGE_SIZE, &kstrings);
 	if (result) {
 		return result;
 	}
+	sc.upage = ustack - PAGE_SIZE;
+	sc.kpage = kstrings;
 
-	/* do the copyin */
-	result = argbuf_copyin(buf, uargv);
-	if (result == E2BIG) {
-		/*
-		 * Try again with the full-size buffer. Just start
-		 * over instead of trying to keep the page we already
-		 * did; this is a bit inefficient but it's not that
-		 * important.
-		 */
-		argbuf_cleanup(buf);
-		argbuf_init(buf);
-
-		/* Wait on the semaphore, to throttle this allocation */
-		P(execthrottle);
-		buf->tooksem = true;
-
-		result = argbuf_allocate(buf, ARG_MAX);
-		if (result) {
-			return result;
-		}
-
-		result = argbuf_copyin(buf, uargv);
+	result = args_copyin((char *)kstrings, uargv, kname, &len, &nargs);
+	if (result) {
+		return result;
 	}
-	return result;
-}
-
-/*
- * Copy an argv out of kernel space to user space.
- *
- * Note: ustackp is an in/out argument.
- */
-static
-int
-argbuf_copyout(struct argbuf *buf, vaddr_t *ustackp,
-	       int *argc_ret, userptr_t *uargv_ret)
-{
-	vaddr_t ustack;
-	userptr_t ustringbase, uargvbase, uargv_i;
-	userptr_t thisarg;
-	size_t thisarglen;
-	size_t pos;
-	int result;
-
-	/* Begin the stack at the passed in top. */
-	ustack = *ustackp;
 
 	/*
-	 * Allocate space.
-	 *
-	 * buf->pos is the amount of space used by the strings; put that
-	 * first, then align the stack, then make space for the argv
-	 * pointers. Allow an extra slot for the ending NULL.
+	 * Slide the strings up to the top of the page, so the argv
+	 * array and the rest of the stack can go right under them. This
+	 * stays within the one page.
 	 */
+	memmove((char *)kstrings + PAGE_SIZE - len, (char *)kstrings, len);
+	kstrings += PAGE_SIZE - len;
 
-	ustack -= buf->len;
-	ustack -= (ustack & (sizeof(void *) - 1));
+	/*
+	 * Allocate space: the strings first, then align the stack, then
+	 * make space for the argv pointers. Allow an extra slot for the
+	 * ending NULL.
+	 */
+	ustack -= len;
 	ustringbase = (userptr_t)ustack;
+	ustack -= (ustack & (sizeof(void *) - 1));
 
-	ustack -= (buf->nargs + 1) * sizeof(userptr_t);
+	ustack -= (nargs + 1) * sizeof(userptr_t);
 	uargvbase = (userptr_t)ustack;
 
-	/* Now copy the data out. */
+	/* Now fill in the argv array. */
 	pos = 0;
-	uargv_i = uargvbase;
-	while (pos < buf->len) {
-		/* The user address of the string will be ustringbase + pos. */
+	for (i=0; i<nargs; i++) {
+		/* The user address of the string is ustringbase + pos. */
 		thisarg = ustringbase + pos;
-
-		/* Place it in the argv array. */
-		result = copyout(&thisarg, uargv_i, sizeof(thisarg));
+		result = stack_putptr(newvm, &sc,
+				      (vaddr_t)uargvbase + i * sizeof(thisarg),
+				      thisarg);
 		if (result) {
 			return result;
 		}
-
-		/* Push out the string. */
-		result = copyoutstr(buf->data + pos, thisarg,
-				    buf->len - pos, &thisarglen);
-		if (result) {
-			return result;
-		}
-
-		/* thisarglen includes the \0 */
-		pos += thisarglen;
-		uargv_i += sizeof(thisarg);
+		pos += strlen((char *)kstrings + pos) + 1;
 	}
 	/* Should have come out even... */
-	KASSERT(pos == buf->len);
+	KASSERT(pos == len);
 
 	/* Add the NULL. */
-	thisarg = NULL;
-	result = copyout(&thisarg, uargv_i, sizeof(userptr_t));
+	result = stack_putptr(newvm, &sc,
+			      (vaddr_t)uargvbase + nargs * sizeof(thisarg),
+			      NULL);
 	if (result) {
 		return result;
 	}
 
 	*ustackp = ustack;
-	*argc_ret = buf->nargs;
+	*argc_ret = nargs;
 	*uargv_ret = uargvbase;
 	return 0;
 }
 
 /*
- * Common code for execv and runprogram: loading the executable.
+ * Common code for execv and runprogram: loading the executable and
+ * setting up its arguments, from UARGV or KNAME as for args_place.
  */
 static
 int
-loadexec(char *path, vaddr_t *entrypoint, vaddr_t *stackptr)
+loadexec(char *path, userptr_t uargv, const char *kname,
+	 vaddr_t *entrypoint, vaddr_t *stackptr,
+	 int *argc_ret, userptr_t *uargv_ret)
 {
 	struct addrspace *newvm, *oldvm;
 	struct vnode *v;
@@ -385,6 +314,29 @@ loadexec(char *path, vaddr_t *entrypoint, vaddr_t *stackptr)
 		return result;
         }
 
+	/*
+	 * Put the arguments on the new stack. They're read from the old
+	 * address space, so make it current again while they're copied.
+	 * If this fails the old process is still intact to get the error.
+	 */
+	if (oldvm != NULL) {
+		proc_setas(oldvm);
+		as_activate();
+	}
+	result = args_place(newvm, uargv, kname, stackptr,
+			    argc_ret, uargv_ret);
+	if (result) {
+		proc_setas(oldvm);
+		as_activate();
+		as_destroy(newvm);
+		kfree(newname);
+		return result;
+	}
+	if (oldvm != NULL) {
+		proc_setas(newvm);
+		as_activate();
+	}
+
 	/*
 	 * Wipe out old address space.
 	 *
@@ -395,6 +347,11 @@ loadexec(char *path, vaddr_t *entrypoint, vaddr_t *stackptr)
 		as_destroy(oldvm);
 	}
 
+	/* The I/O ring, if any, was in the old address space. */
+	if (curproc->p_ioring != NULL) {
+		ioring_reset(curproc->p_ioring);
+	}
+
 	/*
 	 * Now that we know we're succeeding, change the current thread's
 	 * name to reflect the new process.
@@ -431,7 +388,11 @@ placed_open(const char *path, int openflags, int fd)
 	}
 
 	/* place the file in the filetable in the right slot */
-	filetable_placeat(curproc->p_filetable, newfile, fd, &oldfile);
+	result = filetable_placeat(curproc->p_filetable, newfile, fd, &oldfile);
+	if (result) {
+		openfile_decref(newfile);
+		return result;
+	}
 
 	/* the table should previously have been empty */
 	KASSERT(oldfile == NULL);
@@ -482,7 +443,7 @@ open_stdfds(const char *inpath, const char *outpath, const char *errpath)
 int
 runprogram(char *progname)
 {
-	struct argbuf kargv;
+	char *argv0;
 	vaddr_t entrypoint, stackptr;
 	int argc;
 	userptr_t uargv;
@@ -508,32 +469,22 @@ runprogram(char *progname)
 	}
 
 	/*
-	 * Cons up argv.
+	 * The program name is the only argument. Keep a copy, because
+	 * vfs_open may destroy progname.
 	 */
-
-	argbuf_init(&kargv);
-	result = argbuf_fromkernel(&kargv, progname);
-	if (result) {
-		argbuf_cleanup(&kargv);
-		return result;
+	argv0 = kstrdup(progname);
+	if (argv0 == NULL) {
+		return ENOMEM;
 	}
 
 	/* Load the executable. Note: must not fail after this succeeds. */
-	result = loadexec(progname, &entrypoint, &stackptr);
+	result = loadexec(progname, NULL, argv0, &entrypoint, &stackptr,
+			  &argc, &uargv);
+	kfree(argv0);
 	if (result) {
-		argbuf_cleanup(&kargv);
 		return result;
 	}
 
-	result = argbuf_copyout(&kargv, &stackptr, &argc, &uargv);
-	if (result) {
-		/* If copyout fails, *we* messed up, so panic */
-		panic("execv: copyout_args failed: %s\n", strerror(result));
-	}
-
-	/* free the space */
-	argbuf_cleanup(&kargv);
-
 	/* Warp to user mode. */
 	enter_new_process(argc, uargv, NULL /*uenv*/, stackptr, entrypoint);
 
@@ -546,20 +497,31 @@ runprogram(char *progname)
  * execv.
  *
  * 1. Copy in the program name.
- * 2. Copy in the argv with copyin_args.
- * 3. Load the executable.
- * 4. Copy the argv out again with copyout_args.
- * 5. Warp to usermode.
+ * 2. Load the executable.
+ * 3. Copy the argv straight onto the new stack with args_place.
+ * 4. Warp to usermode.
  */
 int
 sys_execv(userptr_t prog, userptr_t uargv)
 {
 	char *path;
-	struct argbuf kargv;
 	vaddr_t entrypoint, stackptr;
 	int argc;
+	bool alone;
 	int result;
 
+	/*
+	 * Other threads would go on running in the old address space
+	 * after loadexec destroys it. Only our own threads can make
+	 * new ones, so once we're alone we stay alone.
+	 */
+	lock_acquire(curproc->p_threadslock);
+	alone = threadarray_num(&curproc->p_threads) == 1;
+	lock_release(curproc->p_threadslock);
+	if (!alone) {
+		return EBUSY;
+	}
+
 	path = kmalloc(PATH_MAX);
 	if (!path) {
 		return ENOMEM;
@@ -572,38 +534,17 @@ sys_execv(userptr_t prog, userptr_t uargv)
 		return result;
 	}
 
-	/* get the argv strings. */
-
-	argbuf_init(&kargv);
-
-	result = argbuf_fromuser(&kargv, uargv);
-	if (result) {
-		argbuf_cleanup(&kargv);
-		kfree(path);
-		return result;
-	}
-
-	/* Load the executable. Note: must not fail after this succeeds. */
-	result = loadexec(path, &entrypoint, &stackptr);
-	if (result) {
-		argbuf_cleanup(&kargv);
-		kfree(path);
-		return result;
-	}
-
-	/* don't need this any more */
+	/*
+	 * Load the executable and pass it the argv strings. Note: must
+	 * not fail after this succeeds.
+	 */
+	result = loadexec(path, uargv, NULL, &entrypoint, &stackptr,
+			  &argc, &uargv);
 	kfree(path);
-
-	/* Send the argv strings to the process. */
-	result = argbuf_copyout(&kargv, &stackptr, &argc, &uargv);
 	if (result) {
-		/* if copyout fails, *we* messed up, so panic */
-		panic("execv: copyout_args failed: %s\n", strerror(result));
+		return result;
 	}
 
-	/* free the argv buffer space */
-	argbuf_cleanup(&kargv);
-
 	/* Warp to user mode. */
 	enter_new_process(argc, uargv, NULL /*uenv*/, stackptr, entrypoint);
 
@@ -0,0 +1,378 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * System call statistics and tracing. See <kern/sysstat.h> for what
+ * userland sees and syscallstat.h for the hooks.
+ *
+ * The counters are kept per cpu, so that the common path touches
+ * nothing shared: each cpu gets its own table the first time it runs
+ * a system call, and updates it with interrupts off, which is enough
+ * to keep anyone else on that cpu from getting in the way. Reading
+ * adds up the tables without stopping anybody, so a busy system may
+ * give slightly inconsistent totals, and resetting may lose a few
+ * counts made while it runs.
+ *
+ * The trace ring is shared by every traced process and protected by
+ * a spinlock. It isn't allocated until tracing is first turned on.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/sysstat.h>
+#include <lib.h>
+#include <spl.h>
+#include <clock.h>
+#include <cpu.h>
+#include <current.h>
+#include <copyinout.h>
+#include <proc.h>
+#include <platform/maxcpus.h>
+#include <mips/trapframe.h>
+#include <syscallstat.h>
+#include <syscall.h>
+
+struct syscallstat_entry {
+	uint32_t se_calls;
+	uint32_t se_errors;
+	uint64_t se_totalns;
+	uint32_t se_hist[SYSSTAT_NBUCKETS];
+};
+
+struct syscallstat_cpu {
+	struct syscallstat_entry sc_entries[SYSSTAT_NCALLS];
+};
+
+static struct syscallstat_cpu *syscallstat_cpus[MAXCPUS];
+static struct spinlock syscallstat_lock = SPINLOCK_INITIALIZER;
+
+#define SYSTRACE_NRECORDS	512
+
+static struct sysstat_trace *systrace_ring;
+static unsigned systrace_head;		/* next record to write */
+static unsigned systrace_tail;		/* next record to read */
+static struct spinlock systrace_lock = SPINLOCK_INITIALIZER;
+
+/* How many records systrace_read copies out per trip through the lock */
+#define SYSTRACE_CHUNK		8
+
+static
+uint64_t
+syscallstat_now(void)
+{
+	struct timespec ts;
+
+	gettime(&ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Get the table for cpu NUM, making it if needed. This can sleep, so
+ * by the time it returns we may well be on some other cpu; that
+ * doesn't matter, as the table is only being made, not used.
+ */
+static
+struct syscallstat_cpu *
+syscallstat_gettable(unsigned num)
+{
+	struct syscallstat_cpu *sc;
+
+	sc = syscallstat_cpus[num];
+	if (sc != NULL) {
+		return sc;
+	}
+	sc = kmalloc(sizeof(*sc));
+	if (sc == NULL) {
+		return NULL;
+	}
+	bzero(sc, sizeof(*sc));
+
+	spinlock_acquire(&syscallstat_lock);
+	if (syscallstat_cpus[num] == NULL) {
+		syscallstat_cpus[num] = sc;
+		sc = NULL;
+	}
+	spinlock_release(&syscallstat_lock);
+	if (sc != NULL) {
+		/* another thread got there first */
+		kfree(sc);
+	}
+	return syscallstat_cpus[num];
+}
+
+/*
+ * Histogram bucket for a latency of NS nanoseconds.
+ */
+static
+unsigned
+syscallstat_bucket(uint64_t ns)
+{
+	uint64_t us;
+	unsigned b;
+
+	us = ns / 1000;
+	b = 0;
+	while (us > 1 && b < SYSSTAT_NBUCKETS - 1) {
+		us >>= 1;
+		b++;
+	}
+	return b;
+}
+
+/*
+ * Called on entry to the system call dispatcher. Counts the call and
+ * returns the time to hand to syscallstat_exit.
+ */
+uint64_t
+syscallstat_enter(int callno)
+{
+	struct syscallstat_cpu *sc;
+	int spl;
+
+	if (callno < 0 || callno >= SYSSTAT_NCALLS) {
+		return 0;
+	}
+	if (syscallstat_cpus[curcpu->c_number] == NULL) {
+		/* if this fails we just don't count */
+		syscallstat_gettable(curcpu->c_number);
+	}
+
+	spl = splhigh();
+	sc = syscallstat_cpus[curcpu->c_number];
+	if (sc != NULL) {
+		sc->sc_entries[callno].se_calls++;
+	}
+	splx(spl);
+
+	return syscallstat_now();
+}
+
+/*
+ * Log a finished system call to the trace ring.
+ */
+static
+void
+systrace_log(struct trapframe *tf, int callno, uint64_t start,
+	     uint64_t duration, int err, int32_t retval)
+{
+	struct sysstat_trace *st;
+
+	spinlock_acquire(&systrace_lock);
+	if (systrace_head - systrace_tail == SYSTRACE_NRECORDS) {
+		/* full; drop the oldest */
+		systrace_tail++;
+	}
+	st = &systrace_ring[systrace_head % SYSTRACE_NRECORDS];
+	st->st_start = start;
+	st->st_duration = duration;
+	st->st_seq = systrace_head;
+	st->st_pid = curproc->p_pid;
+	st->st_callno = callno;
+	st->st_args[0] = tf->tf_a0;
+	st->st_args[1] = tf->tf_a1;
+	st->st_args[2] = tf->tf_a2;
+	st->st_args[3] = tf->tf_a3;
+	st->st_retval = err ? -1 : retval;
+	st->st_err = err;
+	systrace_head++;
+	spinlock_release(&systrace_lock);
+}
+
+/*
+ * Called on the way out of the system call dispatcher, before the
+ * results are put in the trapframe, with the time syscallstat_enter
+ * returned. Records the outcome and latency, and logs the call if
+ * the process is being traced.
+ */
+void
+syscallstat_exit(struct trapframe *tf, int callno, uint64_t start,
+		 int err, int32_t retval)
+{
+	struct syscallstat_cpu *sc;
+	struct syscallstat_entry *se;
+	uint64_t duration;
+	int spl;
+
+	if (start == 0) {
+		return;
+	}
+	duration = syscallstat_now() - start;
+
+	spl = splhigh();
+	sc = syscallstat_cpus[curcpu->c_number];
+	if (sc != NULL) {
+		se = &sc->sc_entries[callno];
+		if (err) {
+			se->se_errors++;
+		}
+		se->se_totalns += duration;
+		se->se_hist[syscallstat_bucket(duration)]++;
+	}
+	splx(spl);
+
+	if (curproc->p_systrace && systrace_ring != NULL) {
+		systrace_log(tf, callno, start, duration, err, retval);
+	}
+}
+
+////////////////////////////////////////////////////////////
+//
+// System calls.
+
+/*
+ * sysstat: add up the per-cpu tables for the first NCALLS call
+ * numbers and copy them out.
+ */
+int
+sys_sysstat(userptr_t buf, unsigned ncalls, int *retval)
+{
+	struct sysstat_call total;
+	struct syscallstat_cpu *sc;
+	struct syscallstat_entry *se;
+	unsigned i, cpu, b;
+	int result;
+
+	if (ncalls > SYSSTAT_NCALLS) {
+		ncalls = SYSSTAT_NCALLS;
+	}
+
+	for (i=0; i<ncalls; i++) {
+		bzero(&total, sizeof(total));
+		for (cpu=0; cpu<MAXCPUS; cpu++) {
+			sc = syscallstat_cpus[cpu];
+			if (sc == NULL) {
+				continue;
+			}
+			se = &sc->sc_entries[i];
+			total.sc_calls += se->se_calls;
+			total.sc_errors += se->se_errors;
+			total.sc_totalns += se->se_totalns;
+			for (b=0; b<SYSSTAT_NBUCKETS; b++) {
+				total.sc_hist[b] += se->se_hist[b];
+			}
+		}
+		result = copyout(&total, buf + i * sizeof(total),
+				 sizeof(total));
+		if (result) {
+			return result;
+		}
+	}
+
+	*retval = ncalls;
+	return 0;
+}
+
+/*
+ * sysstat_reset: zero all the counters.
+ */
+int
+sys_sysstat_reset(void)
+{
+	struct syscallstat_cpu *sc;
+	unsigned cpu;
+
+	for (cpu=0; cpu<MAXCPUS; cpu++) {
+		sc = syscallstat_cpus[cpu];
+		if (sc != NULL) {
+			bzero(sc, sizeof(*sc));
+		}
+	}
+	return 0;
+}
+
+/*
+ * systrace: turn tracing of the current process on or off.
+ */
+int
+sys_systrace(int on, int *retval)
+{
+	struct sysstat_trace *ring;
+
+	if (on && systrace_ring == NULL) {
+		ring = kmalloc(SYSTRACE_NRECORDS * sizeof(*ring));
+		if (ring == NULL) {
+			return ENOMEM;
+		}
+		spinlock_acquire(&systrace_lock);
+		if (systrace_ring == NULL) {
+			systrace_ring = ring;
+			ring = NULL;
+		}
+		spinlock_release(&systrace_lock);
+		if (ring != NULL) {
+			kfree(ring);
+		}
+	}
+
+	spinlock_acquire(&curproc->p_lock);
+	*retval = curproc->p_systrace;
+	curproc->p_systrace = (on != 0);
+	spinlock_release(&curproc->p_lock);
+	return 0;
+}
+
+/*
+ * systrace_read: copy out up to N trace records, oldest first.
+ */
+int
+sys_systrace_read(userptr_t buf, unsigned n, int *retval)
+{
+	struct sysstat_trace chunk[SYSTRACE_CHUNK];
+	unsigned done, num, i;
+	int result;
+
+	done = 0;
+	while (done < n) {
+		num = 0;
+		spinlock_acquire(&systrace_lock);
+		while (num < SYSTRACE_CHUNK && done + num < n &&
+		       systrace_tail != systrace_head) {
+			chunk[num++] =
+			    systrace_ring[systrace_tail % SYSTRACE_NRECORDS];
+			systrace_tail++;
+		}
+		spinlock_release(&systrace_lock);
+		if (num == 0) {
+			break;
+		}
+
+		for (i=0; i<num; i++) {
+			result = copyout(&chunk[i],
+					 buf + (done + i) * sizeof(chunk[i]),
+					 sizeof(chunk[i]));
+			if (result) {
+				return result;
+			}
+		}
+		done += num;
+	}
+
+	*retval = done;
+	return 0;
+}
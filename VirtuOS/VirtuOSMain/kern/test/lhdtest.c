@@ -0,0 +1,318 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * lhdtest - disk request queue benchmarks.
+ *
+ * Both keep DEPTH random single-sector reads outstanding on an lhd,
+ * using the asynchronous block I/O interface, until COUNT have been
+ * done. Every run reads the same sequence of sectors. Nothing is
+ * written, so they are safe to run on a mounted disk.
+ *
+ *    lhd1 - runs once in FIFO order and once with the elevator, and
+ *           prints the time taken and the head travel for each.
+ *    lhd2 - runs with the elevator at depth 1 and then at depth 8,
+ *           and prints the throughput of each.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <clock.h>
+#include <spinlock.h>
+#include <synch.h>
+#include <bio.h>
+#include <test.h>
+#include <lamebus/lhd.h>
+
+#define DEFAULT_DEPTH	8
+#define MAX_DEPTH	64
+#define DEFAULT_COUNT	400
+
+struct lhdtest_slot {
+	struct bio ls_bio;
+	char ls_buf[LHD_SECTSIZE];
+};
+
+static struct spinlock lt_lock = SPINLOCK_INITIALIZER;
+static struct semaphore *lt_donesem;
+static struct lhd_softc *lt_lh;
+static unsigned lt_tosubmit;
+static unsigned lt_errors;
+static uint32_t lt_seed;
+
+/*
+ * Next sector to read. A fixed LCG rather than random() so all runs
+ * see the same sequence. Call with lt_lock held.
+ */
+static
+uint32_t
+lhdtest_nextsector(void)
+{
+	lt_seed = lt_seed * 1103515245 + 12345;
+	return (lt_seed >> 8) % lt_lh->lh_dev.d_blocks;
+}
+
+/*
+ * Completion callback: resubmit the slot if there's more to do,
+ * otherwise report that it's finished. Runs in the interrupt handler.
+ */
+static
+void
+lhdtest_done(struct bio *b)
+{
+	bool again = false;
+
+	spinlock_acquire(&lt_lock);
+	if (b->b_error) {
+		lt_errors++;
+	}
+	if (lt_tosubmit > 0) {
+		lt_tosubmit--;
+		b->b_blkno = lhdtest_nextsector();
+		again = true;
+	}
+	spinlock_release(&lt_lock);
+
+	if (again) {
+		bio_submit(b);
+	}
+	else {
+		V(lt_donesem);
+	}
+}
+
+/*
+ * Do one run. Returns the elapsed time in RET.
+ */
+static
+void
+lhdtest_run(struct lhdtest_slot *slots, unsigned depth, unsigned count,
+	    struct timespec *ret)
+{
+	struct timespec t0, t1;
+	struct bio *list = NULL;
+	unsigned i, started;
+
+	spinlock_acquire(&lt_lock);
+	lt_seed = 161;
+	lt_errors = 0;
+	lt_tosubmit = count;
+	spinlock_release(&lt_lock);
+
+	gettime(&t0);
+
+	/* Start the first DEPTH reads as one batch. */
+	started = 0;
+	spinlock_acquire(&lt_lock);
+	for (i=0; i<depth && lt_tosubmit > 0; i++) {
+		lt_tosubmit--;
+		bio_init(&slots[i].ls_bio, &lt_lh->lh_dev,
+			 lhdtest_nextsector(), 1, slots[i].ls_buf, false);
+		slots[i].ls_bio.b_done = lhdtest_done;
+		slots[i].ls_bio.b_next = list;
+		list = &slots[i].ls_bio;
+		started++;
+	}
+	spinlock_release(&lt_lock);
+
+	bio_submitlist(list);
+	for (i=0; i<started; i++) {
+		P(lt_donesem);
+	}
+
+	gettime(&t1);
+	timespec_sub(&t1, &t0, ret);
+}
+
+/*
+ * Common setup: parse arguments and find the disk. Returns the slot
+ * array, or NULL after printing why not.
+ */
+static
+struct lhdtest_slot *
+lhdtest_setup(const char *name, int nargs, char **args,
+	      unsigned *depth, unsigned *count)
+{
+	struct lhdtest_slot *slots;
+	int unit = 0;
+
+	if (nargs > 4) {
+		kprintf("Usage: %s [unit [depth [count]]]\n", name);
+		return NULL;
+	}
+	if (nargs > 1) {
+		unit = atoi(args[1]);
+	}
+	if (nargs > 2) {
+		*depth = atoi(args[2]);
+	}
+	if (nargs > 3) {
+		*count = atoi(args[3]);
+	}
+	if (*depth < 1 || *depth > MAX_DEPTH || *count < 1) {
+		kprintf("%s: depth must be 1-%u and count positive\n",
+			name, MAX_DEPTH);
+		return NULL;
+	}
+
+	lt_lh = lhd_getunit(unit);
+	if (lt_lh == NULL) {
+		kprintf("%s: no lhd%d\n", name, unit);
+		return NULL;
+	}
+
+	if (lt_donesem == NULL) {
+		lt_donesem = sem_create("lhdtest", 0);
+		if (lt_donesem == NULL) {
+			kprintf("%s: Out of memory\n", name);
+			return NULL;
+		}
+	}
+	slots = kmalloc(*depth * sizeof(*slots));
+	if (slots == NULL) {
+		kprintf("%s: Out of memory\n", name);
+		return NULL;
+	}
+
+	kprintf("lhd%d: %u random reads, %u rpm\n",
+		unit, *count, lt_lh->lh_rpm);
+	return slots;
+}
+
+int
+lhdtest(int nargs, char **args)
+{
+	struct lhdtest_slot *slots;
+	struct lhd_stats before, after;
+	struct timespec dur;
+	unsigned depth = DEFAULT_DEPTH, count = DEFAULT_COUNT;
+	bool fifo, oldfifo;
+	int i;
+
+	slots = lhdtest_setup("lhd1", nargs, args, &depth, &count);
+	if (slots == NULL) {
+		return EINVAL;
+	}
+
+	for (i=0; i<2; i++) {
+		fifo = (i == 0);
+		oldfifo = lhd_setfifo(lt_lh, fifo);
+		lhd_getstats(lt_lh, &before);
+		lhdtest_run(slots, depth, count, &dur);
+		lhd_getstats(lt_lh, &after);
+		lhd_setfifo(lt_lh, oldfifo);
+
+		kprintf("%-6s depth %u: %llu.%03lu s, %llu dispatches, "
+			"%llu sectors of travel, %llu ms modeled seek time%s\n",
+			fifo ? "fifo" : "c-look", depth,
+			(unsigned long long)dur.tv_sec,
+			(unsigned long)dur.tv_nsec / 1000000,
+			after.ls_dispatches - before.ls_dispatches,
+			after.ls_seekdist - before.ls_seekdist,
+			(after.ls_seekns - before.ls_seekns) / 1000000,
+			lt_errors ? " (errors!)" : "");
+	}
+
+	kfree(slots);
+	kprintf("lhd1 done.\n");
+	return 0;
+}
+
+int
+lhdtest2(int nargs, char **args)
+{
+	static const unsigned depths[2] = { 1, DEFAULT_DEPTH };
+	struct lhdtest_slot *slots;
+	struct timespec dur;
+	unsigned depth = DEFAULT_DEPTH, count = DEFAULT_COUNT;
+	uint64_t ms;
+	bool oldfifo;
+	int i;
+
+	if (nargs > 2) {
+		kprintf("Usage: lhd2 [unit]\n");
+		return EINVAL;
+	}
+	slots = lhdtest_setup("lhd2", nargs, args, &depth, &count);
+	if (slots == NULL) {
+		return EINVAL;
+	}
+
+	oldfifo = lhd_setfifo(lt_lh, false);
+	for (i=0; i<2; i++) {
+		lhdtest_run(slots, depths[i], count, &dur);
+		ms = (uint64_t)dur.tv_sec * 1000 + dur.tv_nsec / 1000000;
+		if (ms == 0) {
+			ms = 1;
+		}
+		kprintf("depth %u: %llu.%03lu s, %llu reads/s, %llu KB/s%s\n",
+			depths[i], (unsigned long long)dur.tv_sec,
+			(unsigned long)dur.tv_nsec / 1000000,
+			(unsigned long long)count * 1000 / ms,
+			(unsigned long long)count * LHD_SECTSIZE / ms,
+			lt_errors ? " (errors!)" : "");
+	}
+	lhd_setfifo(lt_lh, oldfifo);
+
+	kfree(slots);
+	kprintf("lhd2 done.\n");
+	return 0;
+}
+
+/*
+ * Print disk queue statistics, or set the queue order on all disks.
+ */
+int
+lhdstats(int nargs, char **args)
+{
+	struct lhd_softc *lh;
+	bool fifo;
+	int i;
+
+	if (nargs == 1) {
+		lhd_printstats();
+		return 0;
+	}
+	if (nargs == 2 && !strcmp(args[1], "fifo")) {
+		fifo = true;
+	}
+	else if (nargs == 2 && !strcmp(args[1], "clook")) {
+		fifo = false;
+	}
+	else {
+		kprintf("Usage: lhd [fifo|clook]\n");
+		return EINVAL;
+	}
+
+	for (i=0; (lh = lhd_getunit(i)) != NULL; i++) {
+		lhd_setfifo(lh, fifo);
+	}
+	return 0;
+}
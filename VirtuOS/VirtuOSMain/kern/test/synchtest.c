@@ -43,12 +43,18 @@
 #define NLOCKLOOPS    120
 #define NCVLOOPS      5
 #define NTHREADS      32
+#define NHANDOFFTHREADS 4
+#define NHANDOFFLOOPS 2000
+#define NRWLOOPS      200
+#define NRWREADERS    8
+#define NRWWRITES     20
 
 static volatile unsigned long testval1;
 static volatile unsigned long testval2;
 static volatile unsigned long testval3;
 static struct semaphore *testsem;
 static struct lock *testlock;
+static struct rwlock *testrwlock;
 static struct cv *testcv;
 static struct semaphore *donesem;
 
@@ -68,6 +74,12 @@ inititems(void)
 			panic("synchtest: lock_create failed\n");
 		}
 	}
+	if (testrwlock==NULL) {
+		testrwlock = rwlock_create("testrwlock");
+		if (testrwlock == NULL) {
+			panic("synchtest: rwlock_create failed\n");
+		}
+	}
 	if (testcv==NULL) {
 		testcv = cv_create("testlock");
 		if (testcv == NULL) {
@@ -400,3 +412,269 @@ cvtest2(int nargs, char **args)
 	kprintf("cvtest2 done\n");
 	return 0;
 }
+
+////////////////////////////////////////////////////////////
+
+/*
+ * Lock handoff latency: a few threads take turns on one lock with a
+ * very short critical section, first with lock_acquire always
+ * sleeping and then with adaptive spinning. On a multi-cpu machine
+ * the second run should be noticeably faster; on one cpu they should
+ * be about the same, because the holder is never running while
+ * someone else is trying to get the lock.
+ */
+
+static
+void
+handoffthread(void *junk, unsigned long num)
+{
+	int i;
+	volatile int j;
+
+	(void)junk;
+	(void)num;
+
+	for (i=0; i<NHANDOFFLOOPS; i++) {
+		lock_acquire(testlock);
+		testval1++;
+		for (j=0; j<10; j++);
+		lock_release(testlock);
+
+		/* a little work outside the lock */
+		for (j=0; j<50; j++);
+	}
+	V(donesem);
+}
+
+static
+void
+handoffrun(bool spin)
+{
+	struct timespec ts1, ts2;
+	uint64_t nsecs;
+	unsigned ops;
+	int i, result;
+
+	lock_setspin(spin);
+	testval1 = 0;
+	ops = NHANDOFFTHREADS * NHANDOFFLOOPS;
+
+	gettime(&ts1);
+	for (i=0; i<NHANDOFFTHREADS; i++) {
+		result = thread_fork("handoff", NULL, handoffthread, NULL, i);
+		if (result) {
+			panic("locktest2: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<NHANDOFFTHREADS; i++) {
+		P(donesem);
+	}
+	gettime(&ts2);
+	timespec_sub(&ts2, &ts1, &ts2);
+
+	if (testval1 != ops) {
+		kprintf("Lost updates: %lu of %u\n", testval1, ops);
+		kprintf("Test failed\n");
+	}
+
+	nsecs = ts2.tv_sec * 1000000000ULL + ts2.tv_nsec;
+	kprintf("%s: %u acquires in %llu.%09lu s, %llu ns each\n",
+		spin ? "spin then sleep" : "always sleep", ops,
+		(unsigned long long)ts2.tv_sec,
+		(unsigned long)ts2.tv_nsec, nsecs / ops);
+}
+
+int
+locktest2(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	kprintf("Starting lock handoff test...\n");
+
+	handoffrun(false);
+	handoffrun(true);
+
+	/* leave it on */
+	lock_setspin(true);
+
+	kprintf("Lock handoff test done.\n");
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+
+/*
+ * Reader-writer lock tests.
+ *
+ * rwtest: a mix of readers and writers. Writers update the three
+ * test values so they're consistent with each other only at the end
+ * of the critical section; readers check that they never see them
+ * half-updated, and that no writer is in at the same time. We also
+ * count how many readers were in at once, which should be more than
+ * one if readers are really shared (on one cpu this needs a reader
+ * to get preempted inside, so it may not happen).
+ *
+ * rwtest2: readers hold the lock continuously, overlapping each
+ * other so that it is never free; a writer must still get in. If it
+ * hangs, writers can be starved.
+ */
+
+static struct spinlock rwcountlock = SPINLOCK_INITIALIZER;
+static volatile unsigned rwreaders, rwwriters, rwmaxreaders;
+static volatile bool rwstop;
+
+static
+void
+rwfail(unsigned long num, const char *msg)
+{
+	kprintf("thread %lu: %s\n", num, msg);
+	kprintf("Test failed\n");
+}
+
+static
+void
+rwtestthread(void *junk, unsigned long num)
+{
+	int i;
+	volatile int j;
+
+	(void)junk;
+
+	for (i=0; i<NRWLOOPS; i++) {
+		if (i % NTHREADS == (int)num) {
+			rwlock_acquire_write(testrwlock);
+			spinlock_acquire(&rwcountlock);
+			if (rwreaders != 0 || rwwriters != 0) {
+				rwfail(num, "writer not alone");
+			}
+			rwwriters++;
+			spinlock_release(&rwcountlock);
+
+			testval1 = num;
+			for (j=0; j<100; j++);
+			testval2 = num*num;
+			testval3 = num%3;
+
+			spinlock_acquire(&rwcountlock);
+			rwwriters--;
+			spinlock_release(&rwcountlock);
+			rwlock_release_write(testrwlock);
+		}
+		else {
+			rwlock_acquire_read(testrwlock);
+			spinlock_acquire(&rwcountlock);
+			if (rwwriters != 0) {
+				rwfail(num, "reader with a writer");
+			}
+			rwreaders++;
+			if (rwreaders > rwmaxreaders) {
+				rwmaxreaders = rwreaders;
+			}
+			spinlock_release(&rwcountlock);
+
+			if (testval2 != testval1*testval1 ||
+			    testval3 != testval1%3) {
+				rwfail(num, "inconsistent values");
+			}
+			for (j=0; j<100; j++);
+
+			spinlock_acquire(&rwcountlock);
+			rwreaders--;
+			spinlock_release(&rwcountlock);
+			rwlock_release_read(testrwlock);
+		}
+	}
+	V(donesem);
+}
+
+int
+rwtest(int nargs, char **args)
+{
+	int i, result;
+
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	kprintf("Starting rwlock test...\n");
+
+	testval1 = testval2 = testval3 = 0;
+	rwreaders = rwwriters = rwmaxreaders = 0;
+
+	for (i=0; i<NTHREADS; i++) {
+		result = thread_fork("rwtest", NULL, rwtestthread, NULL, i);
+		if (result) {
+			panic("rwtest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<NTHREADS; i++) {
+		P(donesem);
+	}
+
+	kprintf("At most %u readers at once\n", rwmaxreaders);
+	kprintf("Rwlock test done.\n");
+	return 0;
+}
+
+static
+void
+rwreaderthread(void *junk, unsigned long num)
+{
+	volatile int j;
+
+	(void)junk;
+	(void)num;
+
+	while (!rwstop) {
+		rwlock_acquire_read(testrwlock);
+		for (j=0; j<500; j++);
+		rwlock_release_read(testrwlock);
+	}
+	V(donesem);
+}
+
+int
+rwtest2(int nargs, char **args)
+{
+	int i, result;
+
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	kprintf("Starting rwlock writer starvation test...\n");
+	kprintf("If this hangs, it's broken: ");
+
+	rwstop = false;
+	for (i=0; i<NRWREADERS; i++) {
+		result = thread_fork("rwreader", NULL, rwreaderthread,
+				     NULL, i);
+		if (result) {
+			panic("rwtest2: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+
+	/* let the readers get going */
+	thread_yield();
+
+	for (i=0; i<NRWWRITES; i++) {
+		rwlock_acquire_write(testrwlock);
+		testval1++;
+		rwlock_release_write(testrwlock);
+		thread_yield();
+	}
+	kprintf("ok\n");
+
+	rwstop = true;
+	for (i=0; i<NRWREADERS; i++) {
+		P(donesem);
+	}
+
+	kprintf("Rwlock writer starvation test done.\n");
+	return 0;
+}
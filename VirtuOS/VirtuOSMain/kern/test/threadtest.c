@@ -31,13 +31,19 @@
  * Thread test code.
  */
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
+#include <clock.h>
 #include <thread.h>
 #include <synch.h>
 #include <test.h>
 
 #define NTHREADS  8
 
+/* Default number of forks for the fork benchmark, and forks per round */
+#define NFORKS    10000
+#define FORKBATCH 64
+
 static struct semaphore *tsem = NULL;
 
 static
@@ -144,3 +150,72 @@ threadtest2(int nargs, char **args)
 
 	return 0;
 }
+
+/*
+ * Fork benchmark. Fork short-lived threads in rounds of FORKBATCH,
+ * waiting for each round to exit before starting the next, and report
+ * forks per second. This covers thread_fork, the first switch into
+ * the thread, thread_exit, and cleaning up the zombie, which is the
+ * kernel-side cost of fork in forkbomb and farm. Run "sched" before
+ * and after to see how often the thread cache was hit.
+ */
+static
+void
+nullthread(void *junk, unsigned long num)
+{
+	(void)junk;
+	(void)num;
+
+	V(tsem);
+}
+
+int
+threadtest4(int nargs, char **args)
+{
+	struct timespec ts1, ts2;
+	uint64_t nsecs;
+	unsigned nforks, i, j, batch;
+	int result;
+
+	nforks = NFORKS;
+	if (nargs > 1) {
+		nforks = atoi(args[1]);
+	}
+	if (nforks == 0) {
+		kprintf("Usage: tt4 [forks]\n");
+		return EINVAL;
+	}
+
+	init_sem();
+	kprintf("Starting thread fork benchmark (%u forks)...\n", nforks);
+
+	gettime(&ts1);
+	for (i=0; i<nforks; i+=batch) {
+		batch = nforks - i < FORKBATCH ? nforks - i : FORKBATCH;
+		for (j=0; j<batch; j++) {
+			result = thread_fork("forkbench", NULL, nullthread,
+					     NULL, j);
+			if (result) {
+				panic("threadtest4: thread_fork failed %s\n",
+				      strerror(result));
+			}
+		}
+		for (j=0; j<batch; j++) {
+			P(tsem);
+		}
+	}
+	gettime(&ts2);
+	timespec_sub(&ts2, &ts1, &ts2);
+
+	nsecs = ts2.tv_sec * 1000000000ULL + ts2.tv_nsec;
+	if (nsecs == 0) {
+		nsecs = 1;
+	}
+	kprintf("%u forks in %llu.%09lu s: %llu forks/sec, %llu ns each\n",
+		nforks, (unsigned long long)ts2.tv_sec,
+		(unsigned long)ts2.tv_nsec,
+		nforks * 1000000000ULL / nsecs, nsecs / nforks);
+	kprintf("Thread fork benchmark done.\n");
+
+	return 0;
+}
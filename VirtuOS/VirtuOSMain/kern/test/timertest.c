@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * timertest - timer wheel and tickless idle checks.
+ *
+ *    tm1 - sleeps for a range of durations with clocknanosleep and
+ *          prints how late each wakeup was on average and at worst,
+ *          then sits idle for a few seconds and prints how often the
+ *          cpus woke up per second.
+ *    tm2 - checks that cv_timedwait times out when nobody signals and
+ *          doesn't when someone does.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <clock.h>
+#include <thread.h>
+#include <synch.h>
+#include <test.h>
+
+#define SLEEPS_PER_DURATION	20
+#define IDLE_SECONDS		5
+
+static const unsigned long tm1_durations[] = {
+	100000,		/* 100 us */
+	500000,		/* 500 us */
+	1000000,	/* 1 ms */
+	3000000,	/* 3 ms */
+	10000000,	/* 10 ms */
+	25000000,	/* 25 ms */
+	100000000,	/* 100 ms */
+};
+#define NDURATIONS (sizeof(tm1_durations) / sizeof(tm1_durations[0]))
+
+static
+uint64_t
+timertest_nsecs(const struct timespec *ts)
+{
+	return ts->tv_sec * 1000000000ULL + ts->tv_nsec;
+}
+
+int
+timertest(int nargs, char **args)
+{
+	struct timespec req, before, after;
+	uint64_t late, totlate, maxlate;
+	unsigned i, j, wakeups;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Timer accuracy (%u sleeps each):\n", SLEEPS_PER_DURATION);
+	for (i=0; i<NDURATIONS; i++) {
+		req.tv_sec = 0;
+		req.tv_nsec = tm1_durations[i];
+		totlate = maxlate = 0;
+		for (j=0; j<SLEEPS_PER_DURATION; j++) {
+			gettime(&before);
+			clocknanosleep(&req);
+			gettime(&after);
+			timespec_sub(&after, &before, &after);
+			if (timertest_nsecs(&after) < tm1_durations[i]) {
+				kprintf("tm1: slept %llu ns, asked for %lu\n",
+					timertest_nsecs(&after),
+					tm1_durations[i]);
+				kprintf("tm1: FAILED\n");
+				return 1;
+			}
+			late = timertest_nsecs(&after) - tm1_durations[i];
+			totlate += late;
+			if (late > maxlate) {
+				maxlate = late;
+			}
+		}
+		kprintf("  %9lu ns: %8llu ns late on average, %8llu max\n",
+			tm1_durations[i], totlate / SLEEPS_PER_DURATION,
+			maxlate);
+	}
+
+	kprintf("Idling for %u seconds...\n", IDLE_SECONDS);
+	wakeups = thread_idlewakeups();
+	clocksleep(IDLE_SECONDS);
+	wakeups = thread_idlewakeups() - wakeups;
+	kprintf("Idle wakeups: %u in %u seconds, %u per second "
+		"(all cpus; %u per second per cpu with HZ ticks)\n",
+		wakeups, IDLE_SECONDS, wakeups / IDLE_SECONDS, HZ);
+
+	kprintf("tm1: done\n");
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+
+static struct lock *tm2_lock;
+static struct cv *tm2_cv;
+static volatile bool tm2_flag;
+
+static
+void
+tm2_signaller(void *junk, unsigned long num)
+{
+	struct timespec ts;
+
+	(void)junk;
+	(void)num;
+
+	ts.tv_sec = 0;
+	ts.tv_nsec = 20000000;
+	clocknanosleep(&ts);
+
+	lock_acquire(tm2_lock);
+	tm2_flag = true;
+	cv_signal(tm2_cv, tm2_lock);
+	lock_release(tm2_lock);
+}
+
+int
+timertest2(int nargs, char **args)
+{
+	struct timespec timeout;
+	int result, ok = 1;
+
+	(void)nargs;
+	(void)args;
+
+	tm2_lock = lock_create("tm2");
+	tm2_cv = cv_create("tm2");
+	if (tm2_lock == NULL || tm2_cv == NULL) {
+		panic("tm2: out of memory\n");
+	}
+
+	/* Nobody signals: should time out. */
+	timeout.tv_sec = 0;
+	timeout.tv_nsec = 50000000;
+	lock_acquire(tm2_lock);
+	result = cv_timedwait(tm2_cv, tm2_lock, &timeout);
+	lock_release(tm2_lock);
+	if (result != ETIMEDOUT) {
+		kprintf("tm2: unsignalled wait returned %d\n", result);
+		ok = 0;
+	}
+
+	/* Signalled after 20 ms with a 2 s timeout: should not. */
+	tm2_flag = false;
+	result = thread_fork("tm2", NULL, tm2_signaller, NULL, 0);
+	if (result) {
+		panic("tm2: thread_fork failed: %s\n", strerror(result));
+	}
+	timeout.tv_sec = 2;
+	timeout.tv_nsec = 0;
+	lock_acquire(tm2_lock);
+	result = 0;
+	while (!tm2_flag && result == 0) {
+		result = cv_timedwait(tm2_cv, tm2_lock, &timeout);
+	}
+	lock_release(tm2_lock);
+	if (result != 0) {
+		kprintf("tm2: signalled wait returned %d\n", result);
+		ok = 0;
+	}
+
+	cv_destroy(tm2_cv);
+	lock_destroy(tm2_lock);
+
+	kprintf("tm2: %s\n", ok ? "SUCCESS" : "FAILED");
+	return 0;
+}
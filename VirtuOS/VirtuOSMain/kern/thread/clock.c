@@ -27,20 +27,24 @@
  * SUCH DAMAGE.
  */
 
+
 #include <types.h>
 #include <lib.h>
 #include <cpu.h>
+#include <spl.h>
+#include <spinlock.h>
 #include <wchan.h>
 #include <clock.h>
 #include <thread.h>
 #include <current.h>
+#include <mainbus.h>
 
 /*
  * Time handling.
  *
- * This is pretty primitive. A real kernel will typically have some
- * kind of support for scheduling callbacks to happen at specific
- * points in the future, usually with more resolution than one second.
+ * Scheduling callbacks for points in the future is done with the
+ * timing wheel below; clocksleep and the once-a-second lbolt are
+ * still here for the simple cases.
  *
  * A real kernel also has to maintain the time of day; in OS/161 we
  * skimp on that because we have a known-good hardware clock.
@@ -53,12 +57,76 @@
 #define SCHEDULE_HARDCLOCKS	4	/* Reschedule every 4 hardclocks. */
 #define MIGRATE_HARDCLOCKS	16	/* Migrate every 16 hardclocks. */
 
+/*
+ * Tickless idle. An idle cpu sleeps until its next timer or for
+ * CLOCK_IDLE_NSECS, whichever is first -- unless its last attempt to
+ * steal work found ready threads it couldn't take yet, in which case
+ * it keeps taking hardclocks and retries on each.
+ *
+ * A timer interrupt that arrives up to CLOCK_SLOP_NSECS early still
+ * counts as the hardclock; the on-chip timer and the time-of-day
+ * clock don't quite agree. We never ask for an interrupt sooner than
+ * CLOCK_MIN_NSECS from now.
+ */
+#define NSECS_PER_SEC		1000000000ULL
+#define HARDCLOCK_NSECS		(NSECS_PER_SEC / HZ)
+#define CLOCK_IDLE_NSECS	NSECS_PER_SEC
+#define CLOCK_SLOP_NSECS	(HARDCLOCK_NSECS / 8)
+#define CLOCK_MIN_NSECS		20000
+
 /*
  * Once a second, everything waiting on lbolt is awakened by CPU 0.
  */
 static struct wchan *lbolt;
 static struct spinlock lbolt_lock;
 
+/*
+ * Sleepers in clocknanosleep wait here until their timer goes off.
+ */
+static struct wchan *sleep_wchan;
+static struct spinlock sleep_lock;
+
+/*
+ * Timing wheel.
+ *
+ * Time is measured in wheel ticks of TIMER_TICK_NSECS since the
+ * epoch; tw_now is the tick being processed. Level L has TW_SIZE
+ * slots, each covering TW_SIZE^L ticks, so level 0 holds the timers
+ * due in the next TW_SIZE ticks and each level above covers TW_SIZE
+ * times as far out. When tw_now crosses into a new block of level L,
+ * that block's slot is emptied and its timers are re-filed lower
+ * down ("cascaded"). Timers too far out for the top level go in its
+ * last slot and get re-filed when it comes around.
+ *
+ * tw_pending has bit N set for each level if slot N is not empty, so
+ * finding the next thing to do doesn't mean walking empty slots'
+ * lists.
+ *
+ * The wheel belongs to timer_cpu (cpu 0), which runs the timers from
+ * hardclock. Everything here is protected by timer_lock, except that
+ * the timer functions are called with it released; timer_running is
+ * the one being called, so timer_stop can wait for it.
+ */
+#define TIMER_TICK_NSECS	1000000ULL	/* 1 ms */
+#define TW_BITS			6
+#define TW_SIZE			(1 << TW_BITS)
+#define TW_MASK			(TW_SIZE - 1)
+#define TW_LEVELS		4
+
+static struct spinlock timer_lock;
+static struct timer *tw_slots[TW_LEVELS][TW_SIZE];
+static uint64_t tw_pending[TW_LEVELS];
+static uint64_t tw_now;
+static struct timer *timer_running;
+static struct cpu *timer_cpu;
+static uint64_t timer_wakeat;	/* when timer_cpu's next interrupt is */
+static bool timers_started;
+
+/* Statistics */
+static unsigned timer_fired;	/* timers that went off */
+static unsigned timer_cascaded;	/* timers moved down a level */
+static unsigned timer_kicks;	/* reprograms for a new earlier timer */
+
 /*
  * Setup.
  */
@@ -70,8 +138,319 @@ hardclock_bootstrap(void)
 	if (lbolt == NULL) {
 		panic("Couldn't create lbolt\n");
 	}
+	spinlock_init(&sleep_lock);
+	sleep_wchan = wchan_create("nanosleep");
+	if (sleep_wchan == NULL) {
+		panic("Couldn't create nanosleep wchan\n");
+	}
+	spinlock_init(&timer_lock);
+	SPINLOCK_SETNAME(&timer_lock, "timer_lock");
+}
+
+/*
+ * Current time in nanoseconds.
+ */
+static
+uint64_t
+clock_nsecs(void)
+{
+	struct timespec ts;
+
+	gettime(&ts);
+	return ts.tv_sec * NSECS_PER_SEC + ts.tv_nsec;
+}
+
+/*
+ * Start the timing wheel. Must be called on cpu 0 after the clock
+ * device is attached, since until then we can't tell the time.
+ */
+void
+timer_bootstrap(void)
+{
+	spinlock_acquire(&timer_lock);
+	tw_now = clock_nsecs() / TIMER_TICK_NSECS;
+	timer_wakeat = 0;
+	timer_cpu = curcpu->c_self;
+	timers_started = true;
+	spinlock_release(&timer_lock);
+}
+
+////////////////////////////////////////////////////////////
+// timing wheel
+
+/*
+ * File TM on the wheel according to tm_expires. Timers already due
+ * go in the current slot.
+ */
+static
+void
+timer_insert(struct timer *tm)
+{
+	uint64_t tick, delta;
+	unsigned level, slot;
+
+	KASSERT(spinlock_do_i_hold(&timer_lock));
+	KASSERT(!tm->tm_pending);
+
+	tick = tm->tm_expires / TIMER_TICK_NSECS;
+	if (tick < tw_now) {
+		tick = tw_now;
+	}
+	delta = tick - tw_now;
+	for (level = 0; level < TW_LEVELS - 1; level++) {
+		if (delta < (1ULL << (TW_BITS * (level + 1)))) {
+			break;
+		}
+	}
+	if (delta >= (1ULL << (TW_BITS * TW_LEVELS))) {
+		/* farther out than the wheel reaches; park it */
+		tick = tw_now + (1ULL << (TW_BITS * TW_LEVELS)) - 1;
+	}
+	slot = (tick >> (TW_BITS * level)) & TW_MASK;
+
+	tm->tm_next = tw_slots[level][slot];
+	if (tm->tm_next != NULL) {
+		tm->tm_next->tm_prevp = &tm->tm_next;
+	}
+	tm->tm_prevp = &tw_slots[level][slot];
+	tw_slots[level][slot] = tm;
+	tw_pending[level] |= 1ULL << slot;
+	tm->tm_slot = level * TW_SIZE + slot;
+	tm->tm_pending = true;
 }
 
+/*
+ * Take TM off the wheel.
+ */
+static
+void
+timer_remove(struct timer *tm)
+{
+	unsigned level, slot;
+
+	KASSERT(spinlock_do_i_hold(&timer_lock));
+	KASSERT(tm->tm_pending);
+
+	level = tm->tm_slot / TW_SIZE;
+	slot = tm->tm_slot % TW_SIZE;
+
+	*tm->tm_prevp = tm->tm_next;
+	if (tm->tm_next != NULL) {
+		tm->tm_next->tm_prevp = tm->tm_prevp;
+	}
+	tm->tm_next = NULL;
+	tm->tm_prevp = NULL;
+	tm->tm_pending = false;
+	if (tw_slots[level][slot] == NULL) {
+		tw_pending[level] &= ~(1ULL << slot);
+	}
+}
+
+/*
+ * Empty slot SLOT of level LEVEL and re-file its timers, which will
+ * now land lower down.
+ */
+static
+void
+timer_cascade(unsigned level, unsigned slot)
+{
+	struct timer *tm;
+
+	while ((tm = tw_slots[level][slot]) != NULL) {
+		timer_remove(tm);
+		timer_insert(tm);
+		timer_cascaded++;
+	}
+}
+
+/*
+ * Move tw_now forward one tick, cascading the blocks it enters. Do
+ * the highest level first, so timers coming down from it can land
+ * in a lower slot that is about to be cascaded too.
+ */
+static
+void
+timer_advance(void)
+{
+	unsigned level;
+
+	tw_now++;
+	for (level = TW_LEVELS - 1; level > 0; level--) {
+		if ((tw_now & ((1ULL << (TW_BITS * level)) - 1)) == 0) {
+			timer_cascade(level,
+				      (tw_now >> (TW_BITS * level)) & TW_MASK);
+		}
+	}
+}
+
+/*
+ * Call TM's function. Drops timer_lock while doing so.
+ */
+static
+void
+timer_fire(struct timer *tm)
+{
+	KASSERT(spinlock_do_i_hold(&timer_lock));
+
+	timer_running = tm;
+	timer_fired++;
+	spinlock_release(&timer_lock);
+
+	tm->tm_func(tm->tm_data);
+
+	spinlock_acquire(&timer_lock);
+	timer_running = NULL;
+}
+
+/*
+ * Run everything due by NOW. Ticks before the current one are
+ * finished in full; the current tick's slot may also hold timers due
+ * later in the tick, which are left for next time.
+ */
+static
+void
+timer_run(uint64_t now)
+{
+	struct timer *tm;
+	uint64_t target;
+	unsigned slot;
+
+	target = now / TIMER_TICK_NSECS;
+
+	spinlock_acquire(&timer_lock);
+	while (1) {
+		slot = tw_now & TW_MASK;
+		for (tm = tw_slots[0][slot]; tm != NULL; tm = tm->tm_next) {
+			if (tw_now < target || tm->tm_expires <= now) {
+				break;
+			}
+		}
+		if (tm != NULL) {
+			/* the list may change while it runs; start over */
+			timer_remove(tm);
+			timer_fire(tm);
+			continue;
+		}
+		if (tw_now >= target) {
+			break;
+		}
+		timer_advance();
+	}
+	spinlock_release(&timer_lock);
+}
+
+/*
+ * When the next timer is due: the earliest deadline in the first
+ * nonempty level 0 slot, or the next cascade if only higher levels
+ * have anything. Returns 0 if there are no timers at all.
+ */
+static
+uint64_t
+timer_nextevent(void)
+{
+	struct timer *tm;
+	uint64_t next;
+	unsigned i, slot, level;
+
+	KASSERT(spinlock_do_i_hold(&timer_lock));
+
+	for (i=0; i<TW_SIZE; i++) {
+		slot = (tw_now + i) & TW_MASK;
+		if ((tw_pending[0] & (1ULL << slot)) == 0) {
+			continue;
+		}
+		next = tw_slots[0][slot]->tm_expires;
+		for (tm = tw_slots[0][slot]; tm != NULL; tm = tm->tm_next) {
+			if (tm->tm_expires < next) {
+				next = tm->tm_expires;
+			}
+		}
+		return next;
+	}
+	for (level = 1; level < TW_LEVELS; level++) {
+		if (tw_pending[level] != 0) {
+			return ((tw_now >> TW_BITS) + 1) * TW_SIZE *
+				TIMER_TICK_NSECS;
+		}
+	}
+	return 0;
+}
+
+void
+timer_init(struct timer *tm, void (*func)(void *), void *data)
+{
+	tm->tm_next = NULL;
+	tm->tm_prevp = NULL;
+	tm->tm_expires = 0;
+	tm->tm_slot = 0;
+	tm->tm_pending = false;
+	tm->tm_func = func;
+	tm->tm_data = data;
+}
+
+/*
+ * Arm a timer. If it's due before timer_cpu was planning to wake up,
+ * get timer_cpu to reprogram its timer: directly if that's us,
+ * otherwise with an IPI (sent after dropping timer_lock, because the
+ * IPI handler takes it).
+ */
+void
+timer_start(struct timer *tm, const struct timespec *delay)
+{
+	uint64_t now;
+	bool kick;
+	int spl;
+
+	KASSERT(timers_started);
+	KASSERT(delay->tv_sec >= 0);
+	KASSERT(delay->tv_nsec >= 0 && delay->tv_nsec < 1000000000);
+
+	now = clock_nsecs();
+
+	spinlock_acquire(&timer_lock);
+	tm->tm_expires = now + delay->tv_sec * NSECS_PER_SEC + delay->tv_nsec;
+	timer_insert(tm);
+	kick = tm->tm_expires < timer_wakeat;
+	if (kick) {
+		/* don't kick again for a later one */
+		timer_wakeat = tm->tm_expires;
+		timer_kicks++;
+	}
+	spinlock_release(&timer_lock);
+
+	if (kick) {
+		spl = splhigh();
+		if (curcpu->c_self == timer_cpu) {
+			hardclock_rearm();
+		}
+		else {
+			ipi_send(timer_cpu, IPI_CLOCK);
+		}
+		splx(spl);
+	}
+}
+
+bool
+timer_stop(struct timer *tm)
+{
+	spinlock_acquire(&timer_lock);
+	if (tm->tm_pending) {
+		timer_remove(tm);
+		spinlock_release(&timer_lock);
+		return true;
+	}
+	while (timer_running == tm) {
+		/* it's running on timer_cpu right now; wait for it */
+		spinlock_release(&timer_lock);
+		spinlock_acquire(&timer_lock);
+	}
+	spinlock_release(&timer_lock);
+	return false;
+}
+
+////////////////////////////////////////////////////////////
+// clock interrupts
+
 /*
  * This is called once per second, on one processor, by the timer
  * code.
@@ -86,11 +465,11 @@ timerclock(void)
 }
 
 /*
- * This is called HZ times a second (on each processor) by the timer
- * code.
+ * The scheduler's part of a hardclock.
  */
+static
 void
-hardclock(void)
+hardclock_tick(void)
 {
 	/*
 	 * Collect statistics here as desired.
@@ -103,9 +482,106 @@ hardclock(void)
 	if ((curcpu->c_hardclocks % SCHEDULE_HARDCLOCKS) == 0) {
 		schedule();
 	}
-	thread_yield();
+	thread_timeslice();
+}
+
+/*
+ * Program this cpu's next timer interrupt, as of NOW: the next
+ * hardclock if the cpu is busy or is waiting to steal work,
+ * CLOCK_IDLE_NSECS out if it's otherwise idle, and on timer_cpu,
+ * sooner if a timer is due sooner.
+ */
+static
+void
+hardclock_program(uint64_t now)
+{
+	uint64_t next, event;
+
+	if (curcpu->c_isidle && !curcpu->c_stealretry) {
+		next = now + CLOCK_IDLE_NSECS;
+	}
+	else {
+		next = curcpu->c_nextclock;
+	}
+
+	if (curcpu->c_self == timer_cpu) {
+		spinlock_acquire(&timer_lock);
+		event = timer_nextevent();
+		if (event != 0 && event < next) {
+			next = event;
+		}
+		timer_wakeat = next;
+		spinlock_release(&timer_lock);
+	}
+
+	mainbus_settimer(next > now + CLOCK_MIN_NSECS ?
+			 next - now : CLOCK_MIN_NSECS);
+}
+
+/*
+ * Reprogram the timer interrupt after something changed: the cpu went
+ * idle or stopped being idle, or (on timer_cpu) a new timer is due
+ * sooner than expected. Interrupts must be off.
+ */
+void
+hardclock_rearm(void)
+{
+	KASSERT(curthread->t_curspl > 0);
+
+	if (!timers_started) {
+		/* plain HZ ticks until then */
+		return;
+	}
+	hardclock_program(clock_nsecs());
+}
+
+/*
+ * This is called on each processor on every timer interrupt, which
+ * is HZ times a second while it's busy, and when timers are due or
+ * now and then while it's idle.
+ */
+void
+hardclock(void)
+{
+	uint64_t now, missed;
+
+	if (!timers_started) {
+		hardclock_tick();
+		return;
+	}
+
+	now = clock_nsecs();
+	if (curcpu->c_self == timer_cpu) {
+		timer_run(now);
+	}
+
+	if (curcpu->c_nextclock == 0) {
+		curcpu->c_nextclock = now;
+	}
+	if (now + CLOCK_SLOP_NSECS < curcpu->c_nextclock) {
+		/* woken just for timers */
+		hardclock_program(now);
+		return;
+	}
+
+	/* Account for hardclocks we skipped while idle. */
+	missed = (now + CLOCK_SLOP_NSECS - curcpu->c_nextclock) /
+		HARDCLOCK_NSECS;
+	curcpu->c_hardclocks += missed;
+	curcpu->c_skippedclocks += missed;
+	curcpu->c_nextclock += (missed + 1) * HARDCLOCK_NSECS;
+
+	/*
+	 * Program the next interrupt before hardclock_tick, which may
+	 * switch threads; by the time it returns NOW is stale.
+	 */
+	hardclock_program(now);
+	hardclock_tick();
 }
 
+////////////////////////////////////////////////////////////
+// sleeping
+
 /*
  * Suspend execution for n seconds.
  */
@@ -119,3 +595,79 @@ clocksleep(int num_secs)
 	}
 	spinlock_release(&lbolt_lock);
 }
+
+struct clocksleeper {
+	struct thread *cs_thread;
+	bool cs_done;
+};
+
+/*
+ * Timer function for clocknanosleep.
+ */
+static
+void
+clocknanosleep_wake(void *data)
+{
+	struct clocksleeper *cs = data;
+
+	spinlock_acquire(&sleep_lock);
+	cs->cs_done = true;
+	wchan_wakethread(sleep_wchan, &sleep_lock, cs->cs_thread);
+	spinlock_release(&sleep_lock);
+}
+
+/*
+ * Suspend execution for DURATION.
+ */
+void
+clocknanosleep(const struct timespec *duration)
+{
+	struct clocksleeper cs;
+	struct timer tm;
+
+	if (duration->tv_sec == 0 && duration->tv_nsec == 0) {
+		thread_yield();
+		return;
+	}
+
+	cs.cs_thread = curthread;
+	cs.cs_done = false;
+	timer_init(&tm, clocknanosleep_wake, &cs);
+
+	spinlock_acquire(&sleep_lock);
+	timer_start(&tm, duration);
+	while (!cs.cs_done) {
+		wchan_sleep(sleep_wchan, &sleep_lock);
+	}
+	spinlock_release(&sleep_lock);
+
+	/* Make sure clocknanosleep_wake is done with CS. */
+	timer_stop(&tm);
+}
+
+////////////////////////////////////////////////////////////
+// statistics
+
+void
+clock_printstats(void)
+{
+	unsigned level, n;
+	struct timer *tm;
+
+	spinlock_acquire(&timer_lock);
+	n = 0;
+	for (level = 0; level < TW_LEVELS; level++) {
+		unsigned slot;
+
+		for (slot = 0; slot < TW_SIZE; slot++) {
+			for (tm = tw_slots[level][slot]; tm != NULL;
+			     tm = tm->tm_next) {
+				n++;
+			}
+		}
+	}
+	spinlock_release(&timer_lock);
+
+	kprintf("Timers: %u pending, %u fired, %u cascaded, %u kicks\n",
+		n, timer_fired, timer_cascaded, timer_kicks);
+}
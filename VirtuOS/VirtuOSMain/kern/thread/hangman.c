@@ -180,3 +180,30 @@ hangman_release(struct hangman_actor *a,
 
 	spinlock_release(&hangman_lock);
 }
+
+/*
+ * Note that a has stopped waiting for l without becoming its holder.
+ * This is for shared locks (readers of an rwlock), which can't be
+ * represented by the one-holder model; they wait, so a deadlock
+ * through the holder can be found, but never hold.
+ */
+void
+hangman_unwait(struct hangman_actor *a,
+	       struct hangman_lockable *l)
+{
+	if (l == &hangman_lock.splk_hangman) {
+		/* don't recurse */
+		return;
+	}
+
+	spinlock_acquire(&hangman_lock);
+
+	if (a->a_waiting != l) {
+		spinlock_release(&hangman_lock);
+		panic("hangman_unwait: not waiting for lock %s (%p)\n",
+		      l->l_name, l);
+	}
+	a->a_waiting = NULL;
+
+	spinlock_release(&hangman_lock);
+}
@@ -0,0 +1,322 @@
+/*
+ * Copyright (c) 2015
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Lock contention profiler. See lockstat.h.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spl.h>
+#include <membar.h>
+#include <clock.h>
+#include <spinlock.h>
+#include <lockstat.h>
+
+/*
+ * The classes live in a fixed table so that registering a lock never
+ * allocates memory; locks are made in places that can't sleep or
+ * fail. Classes are never freed; a name that comes back later picks
+ * up where it left off. If the table fills up, new names simply
+ * aren't tracked.
+ */
+#define LOCKSTAT_MAXCLASSES	128
+#define LOCKSTAT_NAMELEN	24
+
+struct lockstat_class {
+	/*
+	 * This is a bare lock word rather than a spinlock, because
+	 * it's used from inside spinlock_acquire and spinlock_release.
+	 */
+	volatile spinlock_data_t ls_lock;
+
+	char ls_kind;
+	char ls_name[LOCKSTAT_NAMELEN];
+
+	uint64_t ls_acquires;		/* Total acquisitions */
+	uint64_t ls_contended;		/* ...that had to wait */
+	uint64_t ls_waittotal;		/* Total wait time (ns) */
+	uint64_t ls_waitmax;		/* Longest wait (ns) */
+	uint64_t ls_holdtotal;		/* Total hold time (ns) */
+};
+
+static struct lockstat_class lockstat_classes[LOCKSTAT_MAXCLASSES];
+static unsigned lockstat_nclasses;
+static unsigned lockstat_dropped;
+static volatile spinlock_data_t lockstat_tablelock = SPINLOCK_DATA_INITIALIZER;
+
+/* Set once the clock can be read. */
+static bool lockstat_ready;
+
+/*
+ * Take and drop one of the bare lock words. Interrupts go off first,
+ * as for a spinlock, so an interrupt handler can't come along and
+ * spin on a word its own cpu holds.
+ */
+static
+int
+lockstat_lockword(volatile spinlock_data_t *word)
+{
+	int spl;
+
+	spl = splhigh();
+	while (spinlock_data_get(word) != 0 ||
+	       spinlock_data_testandset(word) != 0) {
+		/* spin */
+	}
+	membar_store_any();
+	return spl;
+}
+
+static
+void
+lockstat_unlockword(volatile spinlock_data_t *word, int spl)
+{
+	membar_any_store();
+	spinlock_data_set(word, 0);
+	splx(spl);
+}
+
+void
+lockstat_bootstrap(void)
+{
+	lockstat_ready = true;
+}
+
+/*
+ * Point H at the class for KIND and NAME, making the class if needed.
+ */
+void
+lockstat_register(struct lockstat_hook *h, char kind, const char *name)
+{
+	struct lockstat_class *ls;
+	char shortname[LOCKSTAT_NAMELEN];
+	unsigned i;
+	int spl;
+
+	h->lh_class = NULL;
+	h->lh_since = 0;
+
+	/* Long names are cut short; they then share a class. */
+	for (i=0; i<LOCKSTAT_NAMELEN - 1 && name[i] != 0; i++) {
+		shortname[i] = name[i];
+	}
+	shortname[i] = 0;
+
+	spl = lockstat_lockword(&lockstat_tablelock);
+	for (i=0; i<lockstat_nclasses; i++) {
+		ls = &lockstat_classes[i];
+		if (ls->ls_kind == kind &&
+		    !strcmp(ls->ls_name, shortname)) {
+			h->lh_class = ls;
+			break;
+		}
+	}
+	if (h->lh_class == NULL) {
+		if (lockstat_nclasses < LOCKSTAT_MAXCLASSES) {
+			ls = &lockstat_classes[lockstat_nclasses++];
+			/* the table is static, so it starts zeroed */
+			ls->ls_kind = kind;
+			strcpy(ls->ls_name, shortname);
+			h->lh_class = ls;
+		}
+		else {
+			lockstat_dropped++;
+		}
+	}
+	lockstat_unlockword(&lockstat_tablelock, spl);
+}
+
+/*
+ * Current time in nanoseconds, or 0 if H isn't being tracked (or
+ * it's too early to tell), which makes the wait not count.
+ */
+uint64_t
+lockstat_now(struct lockstat_hook *h)
+{
+	struct timespec ts;
+	uint64_t ns;
+
+	if (h->lh_class == NULL || !lockstat_ready) {
+		return 0;
+	}
+	gettime(&ts);
+	ns = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	return ns == 0 ? 1 : ns;
+}
+
+/*
+ * The lock behind H was just acquired. If WAITSTART is nonzero we had
+ * to wait for it, since then.
+ */
+void
+lockstat_acquired(struct lockstat_hook *h, uint64_t waitstart)
+{
+	struct lockstat_class *ls = h->lh_class;
+	uint64_t now, wait;
+	int spl;
+
+	now = lockstat_now(h);
+	if (now == 0) {
+		return;
+	}
+	h->lh_since = now;
+
+	spl = lockstat_lockword(&ls->ls_lock);
+	ls->ls_acquires++;
+	if (waitstart != 0) {
+		wait = now - waitstart;
+		ls->ls_contended++;
+		ls->ls_waittotal += wait;
+		if (wait > ls->ls_waitmax) {
+			ls->ls_waitmax = wait;
+		}
+	}
+	lockstat_unlockword(&ls->ls_lock, spl);
+}
+
+/*
+ * The lock behind H is about to be released.
+ */
+void
+lockstat_released(struct lockstat_hook *h)
+{
+	struct lockstat_class *ls = h->lh_class;
+	uint64_t now, since;
+	int spl;
+
+	since = h->lh_since;
+	if (since == 0) {
+		/* not tracked, or acquired before we were ready */
+		return;
+	}
+	h->lh_since = 0;
+	now = lockstat_now(h);
+
+	spl = lockstat_lockword(&ls->ls_lock);
+	ls->ls_holdtotal += now - since;
+	lockstat_unlockword(&ls->ls_lock, spl);
+}
+
+/*
+ * A CV wait that started at WAITSTART just finished.
+ */
+void
+lockstat_waited(struct lockstat_hook *h, uint64_t waitstart)
+{
+	struct lockstat_class *ls = h->lh_class;
+	uint64_t now, wait;
+	int spl;
+
+	if (waitstart == 0) {
+		return;
+	}
+	now = lockstat_now(h);
+	wait = now - waitstart;
+
+	spl = lockstat_lockword(&ls->ls_lock);
+	ls->ls_acquires++;
+	ls->ls_contended++;
+	ls->ls_waittotal += wait;
+	if (wait > ls->ls_waitmax) {
+		ls->ls_waitmax = wait;
+	}
+	lockstat_unlockword(&ls->ls_lock, spl);
+}
+
+////////////////////////////////////////////////////////////
+//
+// Reporting.
+
+/*
+ * Print the N classes with the most contended acquisitions, most
+ * first. Times are in microseconds. The counters are read without
+ * the class locks, so a busy class may be slightly inconsistent.
+ */
+void
+lockstat_print(unsigned n)
+{
+	struct lockstat_class *top[LOCKSTAT_MAXCLASSES];
+	struct lockstat_class *ls;
+	unsigned i, j, num, ntop;
+
+	num = lockstat_nclasses;
+	ntop = 0;
+	for (i=0; i<num; i++) {
+		ls = &lockstat_classes[i];
+		if (ls->ls_acquires == 0) {
+			continue;
+		}
+		/* insertion sort by contended count */
+		for (j=ntop; j>0 && top[j-1]->ls_contended < ls->ls_contended;
+		     j--) {
+			top[j] = top[j-1];
+		}
+		top[j] = ls;
+		ntop++;
+	}
+	if (n > ntop) {
+		n = ntop;
+	}
+
+	kprintf("lockstat: %u classes, %u untracked names\n",
+		num, lockstat_dropped);
+	kprintf("  %-24s %10s %10s %12s %10s %12s\n", "lock", "acquires",
+		"contended", "wait us", "max us", "hold us");
+	for (i=0; i<n; i++) {
+		ls = top[i];
+		kprintf("%c %-24s %10llu %10llu %12llu %10llu %12llu\n",
+			ls->ls_kind, ls->ls_name, ls->ls_acquires,
+			ls->ls_contended, ls->ls_waittotal / 1000,
+			ls->ls_waitmax / 1000, ls->ls_holdtotal / 1000);
+	}
+}
+
+/*
+ * Zero all the counters.
+ */
+void
+lockstat_reset(void)
+{
+	struct lockstat_class *ls;
+	unsigned i, num;
+	int spl;
+
+	num = lockstat_nclasses;
+	for (i=0; i<num; i++) {
+		ls = &lockstat_classes[i];
+		spl = lockstat_lockword(&ls->ls_lock);
+		ls->ls_acquires = 0;
+		ls->ls_contended = 0;
+		ls->ls_waittotal = 0;
+		ls->ls_waitmax = 0;
+		ls->ls_holdtotal = 0;
+		lockstat_unlockword(&ls->ls_lock, spl);
+	}
+}
@@ -53,6 +53,7 @@ spinlock_init(struct spinlock *splk)
 	spinlock_data_set(&splk->splk_lock, 0);
 	splk->splk_holder = NULL;
 	HANGMAN_LOCKABLEINIT(&splk->splk_hangman, "spinlock");
+	LOCKSTAT_HOOKINIT(&splk->splk_lockstat);
 }
 
 /*
@@ -76,6 +77,7 @@ void
 spinlock_acquire(struct spinlock *splk)
 {
 	struct cpu *mycpu;
+	LOCKSTAT_WAITVAR(waitstart);
 
 	splraise(IPL_NONE, IPL_HIGH);
 
@@ -105,9 +107,11 @@ spinlock_acquire(struct spinlock *splk)
 		 * we don't.
 		 */
 		if (spinlock_data_get(&splk->splk_lock) != 0) {
+			LOCKSTAT_CONTENDED(&splk->splk_lockstat, waitstart);
 			continue;
 		}
 		if (spinlock_data_testandset(&splk->splk_lock) != 0) {
+			LOCKSTAT_CONTENDED(&splk->splk_lockstat, waitstart);
 			continue;
 		}
 		break;
@@ -115,6 +119,7 @@ spinlock_acquire(struct spinlock *splk)
 
 	membar_store_any();
 	splk->splk_holder = mycpu;
+	LOCKSTAT_ACQUIRED(&splk->splk_lockstat, waitstart);
 
 	if (CURCPU_EXISTS()) {
 		HANGMAN_ACQUIRE(&curcpu->c_hangman, &splk->splk_hangman);
@@ -135,6 +140,7 @@ spinlock_release(struct spinlock *splk)
 		HANGMAN_RELEASE(&curcpu->c_hangman, &splk->splk_hangman);
 	}
 
+	LOCKSTAT_RELEASED(&splk->splk_lockstat);
 	splk->splk_holder = NULL;
 	membar_any_store();
 	spinlock_data_set(&splk->splk_lock, 0);
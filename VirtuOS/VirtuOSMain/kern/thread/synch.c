@@ -33,13 +33,26 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
 #include <spinlock.h>
 #include <wchan.h>
+#include <clock.h>
 #include <thread.h>
 #include <current.h>
 #include <synch.h>
 
+/*
+ * How many times lock_acquire polls a lock whose holder is running
+ * on another cpu before giving up and sleeping. Each poll is a few
+ * instructions, so this is on the order of the cost of the two
+ * context switches that sleeping costs.
+ */
+#define LOCK_SPINMAX	500
+
+/* Whether lock_acquire spins at all. */
+static bool lock_spin_enabled = true;
+
 ////////////////////////////////////////////////////////////
 //
 // Semaphore.
@@ -155,6 +168,7 @@ lock_create(const char *name)
 	}
 
 	HANGMAN_LOCKABLEINIT(&lock->lk_hangman, lock->lk_name);
+	LOCKSTAT_REGISTER(&lock->lk_lockstat, LOCKSTAT_LOCK, lock->lk_name);
 
 	lock->lk_wchan = wchan_create(lock->lk_name);
 	if (lock->lk_wchan == NULL) {
@@ -184,6 +198,10 @@ lock_destroy(struct lock *lock)
 void
 lock_acquire(struct lock *lock)
 {
+	struct thread *holder;
+	unsigned spins;
+	LOCKSTAT_WAITVAR(waitstart);
+
 	DEBUGASSERT(lock != NULL);
 	KASSERT(curthread->t_in_interrupt == false);
 
@@ -193,11 +211,34 @@ lock_acquire(struct lock *lock)
 	HANGMAN_WAIT(&curthread->t_hangman, &lock->lk_hangman);
 
 	KASSERT(lock->lk_holder != curthread);
-	while (lock->lk_holder != NULL) {
+	spins = 0;
+	while ((holder = lock->lk_holder) != NULL) {
+		LOCKSTAT_CONTENDED(&lock->lk_lockstat, waitstart);
+
+		/*
+		 * If the holder is running (which means on another
+		 * cpu), it's probably about to let go; spin for a
+		 * bit instead of paying for a sleep and a wakeup.
+		 * The holder can't go away while it holds the lock,
+		 * so look at t_oncpu only with lk_lock held; while
+		 * spinning, only watch lk_holder.
+		 */
+		if (lock_spin_enabled && holder->t_oncpu &&
+		    spins < LOCK_SPINMAX) {
+			spinlock_release(&lock->lk_lock);
+			while (lock->lk_holder == holder &&
+			       spins < LOCK_SPINMAX) {
+				spins++;
+			}
+			spinlock_acquire(&lock->lk_lock);
+			continue;
+		}
+
 		/* As in the semaphore. */
 		wchan_sleep(lock->lk_wchan, &lock->lk_lock);
 	}
 	lock->lk_holder = curthread;
+	LOCKSTAT_ACQUIRED(&lock->lk_lockstat, waitstart);
 
 	/* Call this (atomically) once the lock is acquired */
 	HANGMAN_ACQUIRE(&curthread->t_hangman, &lock->lk_hangman);
@@ -213,6 +254,7 @@ lock_release(struct lock *lock)
 	spinlock_acquire(&lock->lk_lock);
 
 	KASSERT(lock->lk_holder == curthread);
+	LOCKSTAT_RELEASED(&lock->lk_lockstat);
 	lock->lk_holder = NULL;
 	wchan_wakeone(lock->lk_wchan, &lock->lk_lock);
 
@@ -236,6 +278,12 @@ lock_do_i_hold(struct lock *lock)
 	return ret;
 }
 
+void
+lock_setspin(bool enabled)
+{
+	lock_spin_enabled = enabled;
+}
+
 ////////////////////////////////////////////////////////////
 //
 // CV
@@ -265,6 +313,7 @@ cv_create(const char *name)
 	}
 
 	spinlock_init(&cv->cv_wchanlock);
+	LOCKSTAT_REGISTER(&cv->cv_lockstat, LOCKSTAT_CV, cv->cv_name);
 	return cv;
 }
 
@@ -283,6 +332,9 @@ cv_destroy(struct cv *cv)
 void
 cv_wait(struct cv *cv, struct lock *lock)
 {
+	LOCKSTAT_WAITVAR(waitstart);
+
+	LOCKSTAT_WAITSTART(&cv->cv_lockstat, waitstart);
 	spinlock_acquire(&cv->cv_wchanlock);
 	lock_release(lock);
 	wchan_sleep(cv->cv_wchan, &cv->cv_wchanlock);
@@ -295,7 +347,61 @@ cv_wait(struct cv *cv, struct lock *lock)
 	 * logic to make that work cleanly.
 	 */
 	spinlock_release(&cv->cv_wchanlock);
+	LOCKSTAT_WAITED(&cv->cv_lockstat, waitstart);
+	lock_acquire(lock);
+}
+
+/*
+ * For cv_timedwait: the timer knows which thread to wake, so it
+ * doesn't disturb anyone else on the CV. If the thread was already
+ * woken, ct_timedout stays false and the wakeup counts.
+ */
+struct cv_timeout {
+	struct cv *ct_cv;
+	struct thread *ct_thread;
+	bool ct_timedout;
+};
+
+static
+void
+cv_timeout(void *data)
+{
+	struct cv_timeout *ct = data;
+
+	spinlock_acquire(&ct->ct_cv->cv_wchanlock);
+	if (wchan_wakethread(ct->ct_cv->cv_wchan, &ct->ct_cv->cv_wchanlock,
+			     ct->ct_thread)) {
+		ct->ct_timedout = true;
+	}
+	spinlock_release(&ct->ct_cv->cv_wchanlock);
+}
+
+int
+cv_timedwait(struct cv *cv, struct lock *lock, const struct timespec *timeout)
+{
+	struct cv_timeout ct;
+	struct timer tm;
+	LOCKSTAT_WAITVAR(waitstart);
+
+	ct.ct_cv = cv;
+	ct.ct_thread = curthread;
+	ct.ct_timedout = false;
+	timer_init(&tm, cv_timeout, &ct);
+
+	LOCKSTAT_WAITSTART(&cv->cv_lockstat, waitstart);
+	spinlock_acquire(&cv->cv_wchanlock);
+	lock_release(lock);
+	/* can't go off until we're asleep; it needs cv_wchanlock */
+	timer_start(&tm, timeout);
+	wchan_sleep(cv->cv_wchan, &cv->cv_wchanlock);
+	spinlock_release(&cv->cv_wchanlock);
+
+	/* Make sure cv_timeout is done with CT before we return. */
+	timer_stop(&tm);
+	LOCKSTAT_WAITED(&cv->cv_lockstat, waitstart);
+
 	lock_acquire(lock);
+	return ct.ct_timedout ? ETIMEDOUT : 0;
 }
 
 void
@@ -315,3 +421,182 @@ cv_broadcast(struct cv *cv, struct lock *lock)
 	wchan_wakeall(cv->cv_wchan, &cv->cv_wchanlock);
 	spinlock_release(&cv->cv_wchanlock);
 }
+
+////////////////////////////////////////////////////////////
+//
+// Reader-writer lock.
+
+struct rwlock *
+rwlock_create(const char *name)
+{
+	struct rwlock *rwl;
+
+	rwl = kmalloc(sizeof(*rwl));
+	if (rwl == NULL) {
+		return NULL;
+	}
+
+	rwl->rwl_name = kstrdup(name);
+	if (rwl->rwl_name == NULL) {
+		kfree(rwl);
+		return NULL;
+	}
+
+	HANGMAN_LOCKABLEINIT(&rwl->rwl_hangman, rwl->rwl_name);
+
+	rwl->rwl_readwchan = wchan_create(rwl->rwl_name);
+	if (rwl->rwl_readwchan == NULL) {
+		kfree(rwl->rwl_name);
+		kfree(rwl);
+		return NULL;
+	}
+	rwl->rwl_writewchan = wchan_create(rwl->rwl_name);
+	if (rwl->rwl_writewchan == NULL) {
+		wchan_destroy(rwl->rwl_readwchan);
+		kfree(rwl->rwl_name);
+		kfree(rwl);
+		return NULL;
+	}
+
+	spinlock_init(&rwl->rwl_lock);
+	rwl->rwl_readers = 0;
+	rwl->rwl_readwaiting = 0;
+	rwl->rwl_writewaiting = 0;
+	rwl->rwl_readpass = 0;
+	rwl->rwl_writer = NULL;
+
+	return rwl;
+}
+
+void
+rwlock_destroy(struct rwlock *rwl)
+{
+	KASSERT(rwl != NULL);
+
+	KASSERT(rwl->rwl_readers == 0);
+	KASSERT(rwl->rwl_writer == NULL);
+	KASSERT(rwl->rwl_readwaiting == 0);
+	KASSERT(rwl->rwl_writewaiting == 0);
+
+	spinlock_cleanup(&rwl->rwl_lock);
+	wchan_destroy(rwl->rwl_writewchan);
+	wchan_destroy(rwl->rwl_readwchan);
+
+	kfree(rwl->rwl_name);
+	kfree(rwl);
+}
+
+void
+rwlock_acquire_read(struct rwlock *rwl)
+{
+	DEBUGASSERT(rwl != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&rwl->rwl_lock);
+
+	HANGMAN_WAIT(&curthread->t_hangman, &rwl->rwl_hangman);
+
+	KASSERT(rwl->rwl_writer != curthread);
+
+	/*
+	 * Wait while there's a writer, or while writers are waiting
+	 * unless a releasing writer has given us a pass.
+	 */
+	rwl->rwl_readwaiting++;
+	while (rwl->rwl_writer != NULL ||
+	       (rwl->rwl_writewaiting > 0 && rwl->rwl_readpass == 0)) {
+		wchan_sleep(rwl->rwl_readwchan, &rwl->rwl_lock);
+	}
+	rwl->rwl_readwaiting--;
+	if (rwl->rwl_readpass > 0) {
+		rwl->rwl_readpass--;
+	}
+	rwl->rwl_readers++;
+
+	HANGMAN_UNWAIT(&curthread->t_hangman, &rwl->rwl_hangman);
+
+	spinlock_release(&rwl->rwl_lock);
+}
+
+void
+rwlock_release_read(struct rwlock *rwl)
+{
+	DEBUGASSERT(rwl != NULL);
+
+	spinlock_acquire(&rwl->rwl_lock);
+
+	KASSERT(rwl->rwl_readers > 0);
+	rwl->rwl_readers--;
+	if (rwl->rwl_readers == 0 && rwl->rwl_readpass == 0) {
+		wchan_wakeone(rwl->rwl_writewchan, &rwl->rwl_lock);
+	}
+
+	spinlock_release(&rwl->rwl_lock);
+}
+
+void
+rwlock_acquire_write(struct rwlock *rwl)
+{
+	DEBUGASSERT(rwl != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&rwl->rwl_lock);
+
+	HANGMAN_WAIT(&curthread->t_hangman, &rwl->rwl_hangman);
+
+	KASSERT(rwl->rwl_writer != curthread);
+
+	/*
+	 * Wait for the current holders to leave, and for any readers
+	 * who were promised a turn to take it.
+	 */
+	rwl->rwl_writewaiting++;
+	while (rwl->rwl_writer != NULL || rwl->rwl_readers > 0 ||
+	       rwl->rwl_readpass > 0) {
+		wchan_sleep(rwl->rwl_writewchan, &rwl->rwl_lock);
+	}
+	rwl->rwl_writewaiting--;
+	rwl->rwl_writer = curthread;
+
+	HANGMAN_ACQUIRE(&curthread->t_hangman, &rwl->rwl_hangman);
+
+	spinlock_release(&rwl->rwl_lock);
+}
+
+void
+rwlock_release_write(struct rwlock *rwl)
+{
+	DEBUGASSERT(rwl != NULL);
+
+	spinlock_acquire(&rwl->rwl_lock);
+
+	KASSERT(rwl->rwl_writer == curthread);
+	rwl->rwl_writer = NULL;
+
+	if (rwl->rwl_readwaiting > 0) {
+		/* Let everyone waiting now in ahead of the next writer. */
+		rwl->rwl_readpass = rwl->rwl_readwaiting;
+		wchan_wakeall(rwl->rwl_readwchan, &rwl->rwl_lock);
+	}
+	else {
+		wchan_wakeone(rwl->rwl_writewchan, &rwl->rwl_lock);
+	}
+
+	HANGMAN_RELEASE(&curthread->t_hangman, &rwl->rwl_hangman);
+
+	spinlock_release(&rwl->rwl_lock);
+}
+
+bool
+rwlock_do_i_hold_write(struct rwlock *rwl)
+{
+	bool ret;
+
+	DEBUGASSERT(rwl != NULL);
+
+	spinlock_acquire(&rwl->rwl_lock);
+	ret = (rwl->rwl_writer == curthread);
+	spinlock_release(&rwl->rwl_lock);
+
+	return ret;
+}
@@ -35,6 +35,8 @@
 
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/time.h>
+#include <kern/resource.h>
 #include <kern/wait.h>
 #include <limits.h>
 #include <lib.h>
@@ -43,6 +45,7 @@
 #include <spl.h>
 #include <spinlock.h>
 #include <wchan.h>
+#include <clock.h>
 #include <thread.h>
 #include <threadlist.h>
 #include <threadprivate.h>
@@ -58,6 +61,34 @@
 /* Magic number used as a guard value on kernel thread stacks. */
 #define THREAD_STACK_MAGIC 0xbaadf00d
 
+/*
+ * Scheduler tuning. There are SCHED_NLEVELS run levels; a thread at
+ * level L gets a quantum of SCHED_QUANTUM(L) hardclocks before it is
+ * demoted, so CPU-bound threads sink and get longer, rarer slices.
+ * A ready thread that has waited SCHED_AGE_PASSES calls of schedule()
+ * without running is promoted one level.
+ */
+#define SCHED_NLEVELS		8
+#define SCHED_QUANTUM(level)	((level) + 1)
+#define SCHED_AGE_PASSES	8
+
+/*
+ * An idle cpu won't steal a thread that ran within this many
+ * hardclocks; its cache is probably still warm where it was.
+ */
+#define SCHED_CACHEHOT_HARDCLOCKS	2
+
+/* Highest (numerically lowest) level a thread with this nice value gets. */
+#define SCHED_TOPLEVEL(nice) \
+	((unsigned)((nice) - PRIO_MIN) * (SCHED_NLEVELS - 1) / \
+	 (PRIO_MAX - PRIO_MIN))
+
+/*
+ * Exited threads are kept on a per-cpu cache, stack and all, for
+ * thread_fork to reuse. This is the most each cpu keeps.
+ */
+#define THREAD_CACHE_MAX	32
+
 /* Wait channel. A wchan is protected by an associated, passed-in spinlock. */
 struct wchan {
 	const char *wc_name;		/* name for this channel */
@@ -72,6 +103,12 @@ static struct cpuarray allcpus;
 /* Used to wait for secondary CPUs to come online. */
 static struct semaphore *cpu_startup_sem;
 
+/* Whether idle cpus steal work; see thread_steal(). */
+static bool thread_steal_enabled = true;
+
+/* Whether thread T may run on cpu C. */
+#define THREAD_CPUOK(t, c) (((t)->t_affinity & (1U << (c)->c_number)) != 0)
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -111,6 +148,43 @@ thread_checkstack(struct thread *thread)
 	}
 }
 
+/*
+ * Initialize the fields of a new or recycled thread. The name and
+ * the stack are left to the caller.
+ */
+static
+void
+thread_init(struct thread *thread)
+{
+	thread->t_wchan_name = "NEW";
+	thread->t_state = S_READY;
+
+	/* Thread subsystem fields */
+	thread_machdep_init(&thread->t_machdep);
+	threadlistnode_init(&thread->t_listnode, thread);
+	thread->t_context = NULL;
+	thread->t_cpu = NULL;
+	thread->t_proc = NULL;
+	thread->t_tid = 0;
+	HANGMAN_ACTORINIT(&thread->t_hangman, thread->t_name);
+
+	/* Interrupt state fields */
+	thread->t_in_interrupt = false;
+	thread->t_curspl = IPL_HIGH;
+	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
+	thread->t_oncpu = false;
+
+	/* Scheduler fields */
+	thread->t_nice = 0;
+	thread->t_priority = SCHED_TOPLEVEL(0);
+	thread->t_quantum = SCHED_QUANTUM(thread->t_priority);
+	thread->t_age = 0;
+	thread->t_lastrun = 0;
+	thread->t_affinity = THREAD_ALLCPUS;
+
+	/* If you add to struct thread, be sure to initialize here */
+}
+
 /*
  * Create a thread. This is used both to create a first thread
  * for each CPU and to create subsequent forked threads.
@@ -133,24 +207,8 @@ thread_create(const char *name)
 		kfree(thread);
 		return NULL;
 	}
-	thread->t_wchan_name = "NEW";
-	thread->t_state = S_READY;
-
-	/* Thread subsystem fields */
-	thread_machdep_init(&thread->t_machdep);
-	threadlistnode_init(&thread->t_listnode, thread);
 	thread->t_stack = NULL;
-	thread->t_context = NULL;
-	thread->t_cpu = NULL;
-	thread->t_proc = NULL;
-	HANGMAN_ACTORINIT(&thread->t_hangman, thread->t_name);
-
-	/* Interrupt state fields */
-	thread->t_in_interrupt = false;
-	thread->t_curspl = IPL_HIGH;
-	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
-
-	/* If you add to struct thread, be sure to initialize here */
+	thread_init(thread);
 
 	return thread;
 }
@@ -180,15 +238,28 @@ cpu_create(unsigned hardware_number)
 
 	c->c_curthread = NULL;
 	threadlist_init(&c->c_zombies);
+	threadlist_init(&c->c_threadcache);
+	c->c_cachehits = 0;
+	c->c_cachemisses = 0;
+	c->c_moving = NULL;
 	c->c_hardclocks = 0;
+	c->c_nextclock = 0;
+	c->c_idlewakeups = 0;
+	c->c_stealretry = false;
+	c->c_skippedclocks = 0;
 	c->c_spinlocks = 0;
 
 	c->c_isidle = false;
 	threadlist_init(&c->c_runqueue);
 	spinlock_init(&c->c_runqueue_lock);
+	SPINLOCK_SETNAME(&c->c_runqueue_lock, "runqueue");
+	c->c_steals = 0;
+	c->c_stolen = 0;
 
 	c->c_ipi_pending = 0;
 	c->c_numshootdown = 0;
+	c->c_shootdown_posted = 0;
+	c->c_shootdown_done = 0;
 	spinlock_init(&c->c_ipi_lock);
 
 	result = cpuarray_add(&allcpus, c, &c->c_number);
@@ -202,6 +273,7 @@ cpu_create(unsigned hardware_number)
 		panic("cpu_create: thread_create failed\n");
 	}
 	c->c_curthread->t_cpu = c;
+	c->c_curthread->t_oncpu = true;
 
 	if (c->c_number == 0) {
 		/*
@@ -294,7 +366,13 @@ thread_destroy(struct thread *thread)
  * Clean up zombies. (Zombies are threads that have exited but still
  * need to have thread_destroy called on them.)
  *
- * The list of zombies is per-cpu.
+ * The list of zombies is per-cpu. Zombies with a stack go onto this
+ * cpu's thread cache, which is only list surgery, until it holds
+ * THREAD_CACHE_MAX threads; the rest are destroyed. Their stacks were
+ * checked in thread_switch on the way out, so the guard words are
+ * still good for the next user.
+ *
+ * Called with interrupts off.
  */
 static
 void
@@ -305,8 +383,65 @@ exorcise(void)
 	while ((z = threadlist_remhead(&curcpu->c_zombies)) != NULL) {
 		KASSERT(z != curthread);
 		KASSERT(z->t_state == S_ZOMBIE);
-		thread_destroy(z);
+		KASSERT(z->t_proc == NULL);
+		if (z->t_stack != NULL &&
+		    curcpu->c_threadcache.tl_count < THREAD_CACHE_MAX) {
+			thread_machdep_cleanup(&z->t_machdep);
+			z->t_wchan_name = "CACHED";
+			threadlist_addhead(&curcpu->c_threadcache, z);
+		}
+		else {
+			thread_destroy(z);
+		}
+	}
+}
+
+/*
+ * Take a thread from this cpu's cache and set it up to be NAME, as
+ * thread_create would. The name buffer is reused if NAME fits, which
+ * it usually does as a process tends to fork children with its own
+ * name. Returns NULL if the cache is empty; the caller then makes a
+ * thread from scratch.
+ */
+static
+struct thread *
+thread_create_cached(const char *name)
+{
+	struct thread *thread;
+	char *newname;
+	int spl;
+
+	spl = splhigh();
+	thread = threadlist_remhead(&curcpu->c_threadcache);
+	if (thread == NULL) {
+		curcpu->c_cachemisses++;
+	}
+	else {
+		curcpu->c_cachehits++;
+	}
+	splx(spl);
+
+	if (thread == NULL) {
+		return NULL;
+	}
+	KASSERT(thread->t_stack != NULL);
+	thread_checkstack(thread);
+
+	if (strlen(name) <= strlen(thread->t_name)) {
+		strcpy(thread->t_name, name);
+	}
+	else {
+		newname = kstrdup(name);
+		if (newname == NULL) {
+			thread_destroy(thread);
+			return NULL;
+		}
+		kfree(thread->t_name);
+		thread->t_name = newname;
 	}
+	thread_init(thread);
+
+	return thread;
 }
 
 /*
@@ -445,20 +580,90 @@ thread_start_cpus(void)
 	cpu_startup_sem = NULL;
 }
 
+/*
+ * Put a thread on a CPU's run queue. The queue is kept sorted by
+ * priority level, and FIFO within a level, so the head is always the
+ * next thread to run and the tail is the best candidate to migrate.
+ * We search from the tail because most threads are added at the end.
+ *
+ * The run queue lock must be held.
+ */
+static
+void
+thread_enqueue(struct cpu *c, struct thread *t)
+{
+	struct thread *other;
+
+	KASSERT(spinlock_do_i_hold(&c->c_runqueue_lock));
+
+	THREADLIST_FORALL_REV(other, c->c_runqueue) {
+		if (other->t_priority <= t->t_priority) {
+			threadlist_insertafter(&c->c_runqueue, other, t);
+			return;
+		}
+	}
+	threadlist_addhead(&c->c_runqueue, t);
+}
+
+/*
+ * Choose a cpu for a thread whose current one isn't in its affinity
+ * mask: the allowed cpu with the shortest run queue. The counts are
+ * peeked at without locks; this is only a hint.
+ */
+static
+struct cpu *
+thread_pickcpu(struct thread *t)
+{
+	unsigned i, numcpus;
+	struct cpu *c, *best;
+
+	best = NULL;
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, i);
+		if (!THREAD_CPUOK(t, c)) {
+			continue;
+		}
+		if (best == NULL ||
+		    c->c_runqueue.tl_count < best->c_runqueue.tl_count) {
+			best = c;
+		}
+	}
+	/* thread_setaffinity doesn't allow masks with no real cpus */
+	KASSERT(best != NULL);
+	return best;
+}
+
 /*
  * Make a thread runnable.
  *
- * targetcpu might be curcpu; it might not be, too.
+ * targetcpu might be curcpu; it might not be, too. If the thread's
+ * affinity mask doesn't allow its cpu, it is sent to one that's
+ * allowed -- unless it is still that cpu's curthread (see the notes
+ * in thread_consider_migration), in which case it stays put and
+ * moves at its next context switch.
  */
 static
 void
 thread_make_runnable(struct thread *target, bool already_have_lock)
 {
 	struct cpu *targetcpu;
+	bool running;
 
-	/* Lock the run queue of the target thread's cpu. */
 	targetcpu = target->t_cpu;
 
+	if (!already_have_lock && !THREAD_CPUOK(target, targetcpu)) {
+		spinlock_acquire(&targetcpu->c_runqueue_lock);
+		running = (targetcpu->c_curthread == target);
+		spinlock_release(&targetcpu->c_runqueue_lock);
+		if (!running) {
+			targetcpu = thread_pickcpu(target);
+			target->t_cpu = targetcpu;
+		}
+	}
+
+	/* Lock the run queue of the target thread's cpu. */
+
 	if (already_have_lock) {
 		/* The target thread's cpu should be already locked. */
 		KASSERT(spinlock_do_i_hold(&targetcpu->c_runqueue_lock));
@@ -469,7 +674,7 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 
 	/* Target thread is now ready to run; put it on the run queue. */
 	target->t_state = S_READY;
-	threadlist_addtail(&targetcpu->c_runqueue, target);
+	thread_enqueue(targetcpu, target);
 
 	if (targetcpu->c_isidle && targetcpu != curcpu->c_self) {
 		/*
@@ -484,6 +689,26 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 	}
 }
 
+/*
+ * Finish sending a thread that thread_switch took off this cpu
+ * because of its affinity mask. This has to wait until we're off
+ * its stack, so it's called after every switch, like exorcise().
+ */
+static
+void
+thread_finish_move(void)
+{
+	struct thread *t;
+
+	t = curcpu->c_moving;
+	if (t == NULL) {
+		return;
+	}
+	KASSERT(t != curthread);
+	curcpu->c_moving = NULL;
+	thread_make_runnable(t, false);
+}
+
 /*
  * Create a new thread based on an existing one.
  *
@@ -503,18 +728,22 @@ thread_fork(const char *name,
 	struct thread *newthread;
 	int result;
 
-	newthread = thread_create(name);
+	/* Reuse an exited thread and its stack if we can */
+	newthread = thread_create_cached(name);
 	if (newthread == NULL) {
-		return ENOMEM;
-	}
+		newthread = thread_create(name);
+		if (newthread == NULL) {
+			return ENOMEM;
+		}
 
-	/* Allocate a stack */
-	newthread->t_stack = kmalloc(STACK_SIZE);
-	if (newthread->t_stack == NULL) {
-		thread_destroy(newthread);
-		return ENOMEM;
+		/* Allocate a stack */
+		newthread->t_stack = kmalloc(STACK_SIZE);
+		if (newthread->t_stack == NULL) {
+			thread_destroy(newthread);
+			return ENOMEM;
+		}
+		thread_checkstack_init(newthread);
 	}
-	thread_checkstack_init(newthread);
 
 	/*
 	 * Now we clone various fields from the parent thread.
@@ -523,6 +752,12 @@ thread_fork(const char *name,
 	/* Thread subsystem fields */
 	newthread->t_cpu = curthread->t_cpu;
 
+	/* Scheduler fields: keep nice and affinity, but start fresh */
+	newthread->t_nice = curthread->t_nice;
+	newthread->t_affinity = curthread->t_affinity;
+	newthread->t_priority = SCHED_TOPLEVEL(newthread->t_nice);
+	newthread->t_quantum = SCHED_QUANTUM(newthread->t_priority);
+
 	/* Attach the new thread to its process */
 	if (proc == NULL) {
 		proc = curthread->t_proc;
@@ -550,6 +785,104 @@ thread_fork(const char *name,
 	return 0;
 }
 
+/*
+ * Work stealing.
+ *
+ * Called from thread_switch when the current cpu has nothing to run
+ * and is about to idle. Find the cpu with the longest run queue and
+ * take half of its ready threads, starting from the tail (the lowest
+ * priority, which would have waited longest there anyway). Threads
+ * that ran within SCHED_CACHEHOT_HARDCLOCKS are left alone, as is
+ * the other cpu's curthread if it happens to be on its own run queue
+ * (see the notes in thread_consider_migration).
+ *
+ * This complements thread_consider_migration, which pushes work from
+ * busy cpus only every MIGRATE_HARDCLOCKS; here an idle cpu pulls
+ * work as soon as it runs out, and again on every hardclock while
+ * it stays idle.
+ *
+ * If another cpu has ready threads but none could be taken (usually
+ * because they are all cache-hot), set c_stealretry so that this cpu
+ * keeps taking hardclocks while idle instead of sleeping for
+ * CLOCK_IDLE_NSECS; see hardclock_program.
+ *
+ * Returns the number of threads stolen. We hold only one run queue
+ * lock at a time, so two cpus stealing from each other can't
+ * deadlock. The queue lengths and the victim's c_hardclocks are read
+ * without its cooperation; at worst that picks a slightly worse
+ * victim or misjudges how hot a thread is.
+ */
+static
+unsigned
+thread_steal(void)
+{
+	unsigned i, numcpus, count, best, to_take, taken;
+	struct cpu *c, *victim;
+	struct threadlist stolen;
+	struct thread *t, *prev;
+
+	curcpu->c_stealretry = false;
+	if (!thread_steal_enabled) {
+		return 0;
+	}
+
+	victim = NULL;
+	best = 0;
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, i);
+		if (c == curcpu->c_self) {
+			continue;
+		}
+		count = c->c_runqueue.tl_count;
+		if (count > best) {
+			best = count;
+			victim = c;
+		}
+	}
+	if (victim == NULL) {
+		return 0;
+	}
+
+	threadlist_init(&stolen);
+
+	spinlock_acquire(&victim->c_runqueue_lock);
+	to_take = DIVROUNDUP(victim->c_runqueue.tl_count, 2);
+	t = victim->c_runqueue.tl_tail.tln_prev->tln_self;
+	while (t != NULL && to_take > 0) {
+		prev = t->t_listnode.tln_prev->tln_self;
+		if (t != victim->c_curthread &&
+		    THREAD_CPUOK(t, curcpu) &&
+		    victim->c_hardclocks - t->t_lastrun >=
+		    SCHED_CACHEHOT_HARDCLOCKS) {
+			threadlist_remove(&victim->c_runqueue, t);
+			threadlist_addhead(&stolen, t);
+			to_take--;
+		}
+		t = prev;
+	}
+	taken = stolen.tl_count;
+	victim->c_stolen += taken;
+	spinlock_release(&victim->c_runqueue_lock);
+
+	curcpu->c_stealretry = (taken == 0);
+
+	if (taken > 0) {
+		spinlock_acquire(&curcpu->c_runqueue_lock);
+		while ((t = threadlist_remhead(&stolen)) != NULL) {
+			t->t_cpu = curcpu->c_self;
+			thread_enqueue(curcpu, t);
+			DEBUG(DB_THREADS, "Stole thread %s: cpu %u -> %u",
+			      t->t_name, victim->c_number, curcpu->c_number);
+		}
+		curcpu->c_steals += taken;
+		spinlock_release(&curcpu->c_runqueue_lock);
+	}
+
+	threadlist_cleanup(&stolen);
+	return taken;
+}
+
 /*
  * High level, machine-independent context switch code.
  *
@@ -565,6 +898,7 @@ void
 thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 {
 	struct thread *cur, *next;
+	bool idled = false;
 	int spl;
 
 	DEBUGASSERT(curcpu->c_curthread == curthread);
@@ -597,11 +931,29 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 		return;
 	}
 
+	/* Note when it stopped running, for thread_steal. */
+	cur->t_lastrun = curcpu->c_hardclocks;
+
 	/* Put the thread in the right place. */
 	switch (newstate) {
 	    case S_RUN:
 		panic("Illegal S_RUN in thread_switch\n");
 	    case S_READY:
+		if (!THREAD_CPUOK(cur, curcpu)) {
+			/*
+			 * Our affinity mask says we can't stay here.
+			 * We can't go on another cpu's run queue
+			 * while we're still running on our stack, so
+			 * leave ourselves for the next thread to send
+			 * away (thread_finish_move). There must be a
+			 * next thread, because of the check above; if
+			 * the run queue is empty we just keep running
+			 * here until there's something else to do.
+			 */
+			cur->t_state = S_READY;
+			curcpu->c_moving = cur;
+			break;
+		}
 		thread_make_runnable(cur, true /*have lock*/);
 		break;
 	    case S_SLEEP:
@@ -625,7 +977,8 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	cur->t_state = newstate;
 
 	/*
-	 * Get the next thread. While there isn't one, call cpu_idle().
+	 * Get the next thread. While there isn't one, try to steal
+	 * some from another cpu, and if that fails call cpu_idle().
 	 * curcpu->c_isidle must be true when cpu_idle is
 	 * called. Unlock the runqueue while idling too, to make sure
 	 * things can be added to it.
@@ -645,13 +998,26 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	curcpu->c_isidle = true;
 	do {
 		next = threadlist_remhead(&curcpu->c_runqueue);
-		if (next == NULL) {
+		if (next != NULL) {
+			next->t_age = 0;
+		}
+		else {
 			spinlock_release(&curcpu->c_runqueue_lock);
-			cpu_idle();
+			if (thread_steal() == 0) {
+				/* no ticks while idle; see clock.c */
+				hardclock_rearm();
+				cpu_idle();
+				curcpu->c_idlewakeups++;
+				idled = true;
+			}
 			spinlock_acquire(&curcpu->c_runqueue_lock);
 		}
 	} while (next == NULL);
 	curcpu->c_isidle = false;
+	if (idled) {
+		/* back to regular ticks */
+		hardclock_rearm();
+	}
 
 	/*
 	 * Note that curcpu->c_curthread may be the same variable as
@@ -663,6 +1029,10 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	curcpu->c_curthread = next;
 	curthread = next;
 
+	/* Tell lock_acquire which of the two is now running. */
+	cur->t_oncpu = false;
+	next->t_oncpu = true;
+
 	/* do the switch (in assembler in switch.S) */
 	switchframe_switch(&cur->t_context, &next->t_context);
 
@@ -726,6 +1096,9 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	/* Clean up dead threads. */
 	exorcise();
 
+	/* Send off the previous thread if it had to change cpus. */
+	thread_finish_move();
+
 	/* Turn interrupts back on. */
 	splx(spl);
 }
@@ -759,6 +1132,9 @@ thread_startup(void (*entrypoint)(void *data1, unsigned long data2),
 	/* Clean up dead threads. */
 	exorcise();
 
+	/* Send off the previous thread if it had to change cpus. */
+	thread_finish_move();
+
 	/* Enable interrupts. */
 	spl0();
 
@@ -821,17 +1197,200 @@ thread_yield(void)
 /*
  * Scheduler.
  *
- * This is called periodically from hardclock(). It should reshuffle
- * the current CPU's run queue by job priority.
+ * This is a multi-level feedback queue. Each thread has a level
+ * (t_priority, 0 highest) and each CPU's run queue is kept sorted by
+ * level, round-robin within a level, so picking the next thread is
+ * still just taking the head of the queue.
+ *
+ * The rules are:
+ *    - A thread that uses up its quantum is demoted one level, and
+ *      gets the (longer) quantum of the new level. See
+ *      thread_timeslice().
+ *    - A thread woken from a wait channel is promoted one level and
+ *      gets a fresh quantum, so threads that mostly sleep (shells,
+ *      I/O-bound work) rise above threads that compute.
+ *    - A thread that waits too long on a run queue is promoted one
+ *      level, so nothing starves. See schedule().
+ *    - No thread ever rises above the level its nice value allows.
+ *    - A running thread is preempted at the next hardclock if a
+ *      thread at a better level is waiting on its CPU.
  */
 
+/*
+ * Age the current CPU's run queue.
+ *
+ * This is called periodically from hardclock(). Each call, every
+ * waiting thread gets one pass older; a thread that has waited
+ * SCHED_AGE_PASSES passes is promoted. The queue is then re-sorted.
+ */
 void
 schedule(void)
 {
+	struct threadlist list;
+	struct thread *t;
+	unsigned top;
+
+	threadlist_init(&list);
+
+	spinlock_acquire(&curcpu->c_runqueue_lock);
+	while ((t = threadlist_remhead(&curcpu->c_runqueue)) != NULL) {
+		t->t_age++;
+		top = SCHED_TOPLEVEL(t->t_nice);
+		if (t->t_age >= SCHED_AGE_PASSES && t->t_priority > top) {
+			t->t_priority--;
+			t->t_quantum = SCHED_QUANTUM(t->t_priority);
+			t->t_age = 0;
+		}
+		threadlist_addtail(&list, t);
+	}
+	while ((t = threadlist_remhead(&list)) != NULL) {
+		thread_enqueue(curcpu, t);
+	}
+	spinlock_release(&curcpu->c_runqueue_lock);
+
+	threadlist_cleanup(&list);
+}
+
+/*
+ * Quantum accounting.
+ *
+ * This is called from hardclock() on every tick. Charge the current
+ * thread one tick; if its quantum is gone, demote it. Then yield if
+ * the head of the run queue is at a better level, or at the same
+ * level and we've used up our quantum, or if our affinity mask no
+ * longer allows this cpu.
+ */
+void
+thread_timeslice(void)
+{
+	struct thread *cur, *next;
+	bool expired, preempt;
+
+	/* If the timer interrupted the idle loop, nothing is running. */
+	if (curcpu->c_isidle) {
+		return;
+	}
+
+	cur = curthread;
+	expired = false;
+
+	spinlock_acquire(&curcpu->c_runqueue_lock);
+	if (cur->t_quantum > 0) {
+		cur->t_quantum--;
+	}
+	if (cur->t_quantum == 0) {
+		if (cur->t_priority < SCHED_NLEVELS - 1) {
+			cur->t_priority++;
+		}
+		cur->t_quantum = SCHED_QUANTUM(cur->t_priority);
+		expired = true;
+	}
+	next = curcpu->c_runqueue.tl_head.tln_next->tln_self;
+	preempt = next != NULL &&
+		(next->t_priority < cur->t_priority ||
+		 (expired && next->t_priority == cur->t_priority) ||
+		 !THREAD_CPUOK(cur, curcpu));
+	spinlock_release(&curcpu->c_runqueue_lock);
+
+	if (preempt) {
+		thread_yield();
+	}
+}
+
+/*
+ * Get the current thread's affinity mask.
+ */
+uint32_t
+thread_getaffinity(void)
+{
+	return curthread->t_affinity;
+}
+
+/*
+ * Set T's affinity mask. Bits for cpus that don't exist are dropped.
+ * If T is the current thread and this cpu isn't allowed any more,
+ * yield so thread_switch can send us elsewhere; another thread moves
+ * at its next context switch or wakeup.
+ */
+int
+thread_setaffinity(struct thread *t, uint32_t mask)
+{
+	unsigned numcpus;
+
+	numcpus = cpuarray_num(&allcpus);
+	if (numcpus < 32) {
+		mask &= (1U << numcpus) - 1;
+	}
+	if (mask == 0) {
+		return EINVAL;
+	}
+
+	t->t_affinity = mask;
+	if (t == curthread && !THREAD_CPUOK(curthread, curcpu)) {
+		thread_yield();
+	}
+	return 0;
+}
+
+/*
+ * Promote a thread that is being woken up. The caller must have just
+ * taken it off a wait channel, so nobody else is looking at it.
+ */
+static
+void
+thread_wakeboost(struct thread *t)
+{
+	if (t->t_priority > SCHED_TOPLEVEL(t->t_nice)) {
+		t->t_priority--;
+	}
+	t->t_quantum = SCHED_QUANTUM(t->t_priority);
+	t->t_age = 0;
+}
+
+/*
+ * Get the current thread's nice value.
+ */
+int
+thread_getnice(void)
+{
+	return curthread->t_nice;
+}
+
+/*
+ * Set T's nice value. The thread is moved to the top level the new
+ * value allows, so lowering priority takes effect at once rather
+ * than waiting for the thread to be demoted. If T is sitting on a run
+ * queue it isn't re-sorted; it just won't be in priority order until
+ * it next runs.
+ */
+void
+thread_setnice(struct thread *t, int nice)
+{
+	struct cpu *c;
+
+	if (nice < PRIO_MIN) {
+		nice = PRIO_MIN;
+	}
+	if (nice > PRIO_MAX) {
+		nice = PRIO_MAX;
+	}
+
 	/*
-	 * You can write this. If we do nothing, threads will run in
-	 * round-robin fashion.
+	 * The runqueue lock of T's cpu keeps thread_timeslice() out.
+	 * T can move while we wait for it, so check we got the right one.
 	 */
+	while (1) {
+		c = t->t_cpu;
+		spinlock_acquire(&c->c_runqueue_lock);
+		if (t->t_cpu == c) {
+			break;
+		}
+		spinlock_release(&c->c_runqueue_lock);
+	}
+	t->t_nice = nice;
+	t->t_priority = SCHED_TOPLEVEL(nice);
+	t->t_quantum = SCHED_QUANTUM(t->t_priority);
+	spinlock_release(&c->c_runqueue_lock);
 }
 
 /*
@@ -922,8 +1481,18 @@ thread_consider_migration(void)
 				continue;
 			}
 
+			/*
+			 * Likewise skip threads whose affinity mask
+			 * doesn't allow this cpu.
+			 */
+			if (!THREAD_CPUOK(t, c)) {
+				threadlist_addtail(&victims, t);
+				to_send--;
+				continue;
+			}
+
 			t->t_cpu = c;
-			threadlist_addtail(&c->c_runqueue, t);
+			thread_enqueue(c, t);
 			DEBUG(DB_THREADS,
 			      "Migrated thread %s: cpu %u -> %u",
 			      t->t_name, curcpu->c_number, c->c_number);
@@ -947,7 +1516,7 @@ thread_consider_migration(void)
 	if (!threadlist_isempty(&victims)) {
 		spinlock_acquire(&curcpu->c_runqueue_lock);
 		while ((t = threadlist_remhead(&victims)) != NULL) {
-			threadlist_addtail(&curcpu->c_runqueue, t);
+			thread_enqueue(curcpu, t);
 		}
 		spinlock_release(&curcpu->c_runqueue_lock);
 	}
@@ -956,6 +1525,59 @@ thread_consider_migration(void)
 	threadlist_cleanup(&victims);
 }
 
+/*
+ * Turn idle-time work stealing on or off.
+ */
+void
+thread_setsteal(bool enabled)
+{
+	thread_steal_enabled = enabled;
+}
+
+/*
+ * Print per-cpu scheduler statistics.
+ */
+void
+thread_printschedstats(void)
+{
+	unsigned i, numcpus, ready, steals, stolen;
+	struct cpu *c;
+
+	kprintf("Work stealing: %s\n", thread_steal_enabled ? "on" : "off");
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, i);
+		spinlock_acquire(&c->c_runqueue_lock);
+		ready = c->c_runqueue.tl_count;
+		steals = c->c_steals;
+		stolen = c->c_stolen;
+		spinlock_release(&c->c_runqueue_lock);
+		kprintf("cpu%u: %u ready, %u hardclocks, stole %u, "
+			"lost %u\n", c->c_number, ready, c->c_hardclocks,
+			steals, stolen);
+		kprintf("cpu%u: thread cache %u cached, %u hits, "
+			"%u misses\n", c->c_number, c->c_threadcache.tl_count,
+			c->c_cachehits, c->c_cachemisses);
+		kprintf("cpu%u: %u idle wakeups, %u hardclocks skipped "
+			"while idle\n", c->c_number, c->c_idlewakeups,
+			c->c_skippedclocks);
+	}
+}
+
+unsigned
+thread_idlewakeups(void)
+{
+	unsigned i, numcpus, total;
+
+	total = 0;
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus; i++) {
+		/* unlocked; it's just a counter */
+		total += cpuarray_get(&allcpus, i)->c_idlewakeups;
+	}
+	return total;
+}
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -1045,6 +1667,7 @@ wchan_wakeone(struct wchan *wc, struct spinlock *lk)
 	 * in thread_switch.
 	 */
 
+	thread_wakeboost(target);
 	thread_make_runnable(target, false);
 }
 
@@ -1075,12 +1698,36 @@ wchan_wakeall(struct wchan *wc, struct spinlock *lk)
 	 * make each thread runnable.
 	 */
 	while ((target = threadlist_remhead(&list)) != NULL) {
+		thread_wakeboost(target);
 		thread_make_runnable(target, false);
 	}
 
 	threadlist_cleanup(&list);
 }
 
+/*
+ * Wake up thread T if it is sleeping on the channel. Returns false if
+ * it isn't (it was already woken). The associated spinlock should be
+ * locked.
+ */
+bool
+wchan_wakethread(struct wchan *wc, struct spinlock *lk, struct thread *t)
+{
+	struct thread *itervar;
+
+	KASSERT(spinlock_do_i_hold(lk));
+
+	THREADLIST_FORALL(itervar, wc->wc_threads) {
+		if (itervar == t) {
+			threadlist_remove(&wc->wc_threads, t);
+			thread_wakeboost(t);
+			thread_make_runnable(t, false);
+			return true;
+		}
+	}
+	return false;
+}
+
 /*
  * Return nonzero if there are no threads sleeping on the channel.
  * This is meant to be used only for diagnostic purposes.
@@ -1134,37 +1781,96 @@ ipi_broadcast(int code)
 }
 
 /*
- * Send a TLB shootdown IPI to the specified CPU.
+ * Send a TLB shootdown IPI to the specified CPU. Returns the value
+ * target->c_shootdown_done will reach once the request is done.
  */
-void
-ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping)
+static
+unsigned
+ipi_tlbshootdown_post(struct cpu *target, const struct tlbshootdown *mapping)
 {
-	unsigned n;
+	unsigned n, ticket;
 
 	spinlock_acquire(&target->c_ipi_lock);
 
 	n = target->c_numshootdown;
 	if (n == TLBSHOOTDOWN_MAX) {
 		/*
-		 * If you have problems with this panic going off,
-		 * consider: (1) increasing the maximum, (2) putting
-		 * logic here to sleep until space appears (may
-		 * interact awkwardly with VM system locking), (3)
-		 * putting logic here to coalesce requests together,
-		 * and/or (4) improving VM system state tracking to
-		 * reduce the number of unnecessary shootdowns.
+		 * vm_tlbshootdown flushes the whole TLB no matter
+		 * what it's asked for, so the requests already queued
+		 * cover this one too.
 		 */
-		panic("ipi_tlbshootdown: Too many shootdowns queued\n");
 	}
 	else {
 		target->c_shootdown[n] = *mapping;
 		target->c_numshootdown = n+1;
 	}
 
+	ticket = ++target->c_shootdown_posted;
+
 	target->c_ipi_pending |= (uint32_t)1 << IPI_TLBSHOOTDOWN;
 	mainbus_send_ipi(target);
 
 	spinlock_release(&target->c_ipi_lock);
+
+	return ticket;
+}
+
+/*
+ * Send a TLB shootdown IPI to the specified CPU.
+ */
+void
+ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping)
+{
+	(void)ipi_tlbshootdown_post(target, mapping);
+}
+
+/*
+ * Send a TLB shootdown IPI to all CPUs except the current one.
+ */
+void
+ipi_tlbshootdown_broadcast(const struct tlbshootdown *mapping)
+{
+	unsigned i;
+	struct cpu *c;
+
+	for (i=0; i < cpuarray_num(&allcpus); i++) {
+		c = cpuarray_get(&allcpus, i);
+		if (c != curcpu->c_self) {
+			ipi_tlbshootdown(c, mapping);
+		}
+	}
+}
+
+/*
+ * Send a TLB shootdown IPI to all CPUs except the current one, and
+ * wait until each has processed it.
+ *
+ * We spin with interrupts on, so that a CPU doing the same to us at
+ * the same time gets its answer and we don't deadlock.
+ */
+void
+ipi_tlbshootdown_sync(const struct tlbshootdown *mapping)
+{
+	unsigned i, ticket;
+	struct cpu *c;
+	bool done;
+
+	KASSERT(curthread->t_in_interrupt == false);
+	KASSERT(curthread->t_curspl == 0);
+	KASSERT(curcpu->c_spinlocks == 0);
+
+	for (i=0; i < cpuarray_num(&allcpus); i++) {
+		c = cpuarray_get(&allcpus, i);
+		if (c == curcpu->c_self) {
+			continue;
+		}
+		ticket = ipi_tlbshootdown_post(c, mapping);
+		do {
+			spinlock_acquire(&c->c_ipi_lock);
+			done = (int)(c->c_shootdown_done - ticket) >= 0;
+			spinlock_release(&c->c_ipi_lock);
+		} while (!done);
+	}
 }
 
 /*
@@ -1212,8 +1918,19 @@ interprocessor_interrupt(void)
 			vm_tlbshootdown(&curcpu->c_shootdown[i]);
 		}
 		curcpu->c_numshootdown = 0;
+		curcpu->c_shootdown_done = curcpu->c_shootdown_posted;
 	}
 
 	curcpu->c_ipi_pending = 0;
 	spinlock_release(&curcpu->c_ipi_lock);
+
+	if (bits & (1U << IPI_CLOCK)) {
+		/*
+		 * Someone started a timer that's due before our next
+		 * timer interrupt. This takes the timer lock, which
+		 * the sender held while deciding to send it, so wait
+		 * until the IPI lock is released.
+		 */
+		hardclock_rearm();
+	}
 }
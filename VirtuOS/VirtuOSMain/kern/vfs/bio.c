@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Asynchronous block I/O. See bio.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <thread.h>
+#include <current.h>
+#include <synch.h>
+#include <uio.h>
+#include <device.h>
+#include <bio.h>
+
+/*
+ * Threads in bio_wait sleep on the channel of the bucket their bio
+ * hashes to, and record themselves in b_waiter, so bio_done wakes
+ * just the one thread waiting for that bio. The bucket lock is "the
+ * bio lock" for b_flags and b_waiter.
+ */
+
+/* Number of hash buckets; must be a power of 2 */
+#define BIO_NBUCKETS	16
+
+struct bio_bucket {
+	struct spinlock bb_lock;
+	struct wchan *bb_wchan;
+};
+
+static struct bio_bucket bio_table[BIO_NBUCKETS];
+
+void
+bio_bootstrap(void)
+{
+	unsigned i;
+
+	for (i=0; i<BIO_NBUCKETS; i++) {
+		spinlock_init(&bio_table[i].bb_lock);
+		bio_table[i].bb_wchan = wchan_create("bio");
+		if (bio_table[i].bb_wchan == NULL) {
+			panic("bio_bootstrap: Out of memory\n");
+		}
+	}
+}
+
+/*
+ * Hash a bio to its bucket.
+ */
+static
+struct bio_bucket *
+bio_bucket(struct bio *b)
+{
+	uint32_t h;
+
+	h = (uint32_t)(uintptr_t)b >> 2;
+	return &bio_table[(h * 2654435761U) >> 28 & (BIO_NBUCKETS - 1)];
+}
+
+void
+bio_init(struct bio *b, struct device *dev, daddr_t blkno,
+	 uint32_t nblocks, void *data, bool write)
+{
+	b->b_dev = dev;
+	b->b_blkno = blkno;
+	b->b_nblocks = nblocks;
+	b->b_write = write;
+	b->b_data = data;
+	b->b_done = NULL;
+	b->b_sem = NULL;
+	b->b_arg = NULL;
+	b->b_error = 0;
+	b->b_flags = 0;
+	b->b_waiter = NULL;
+	b->b_next = NULL;
+	b->b_chain = NULL;
+	b->b_end = 0;
+}
+
+/*
+ * Do a transfer with DEVOP_IO, for devices without devop_strategy.
+ */
+static
+void
+bio_syncio(struct bio *b)
+{
+	struct device *dev = b->b_dev;
+	struct iovec iov;
+	struct uio ku;
+	int result;
+
+	uio_kinit(&iov, &ku, b->b_data, b->b_nblocks * dev->d_blocksize,
+		  (off_t)b->b_blkno * dev->d_blocksize,
+		  b->b_write ? UIO_WRITE : UIO_READ);
+	result = DEVOP_IO(dev, &ku);
+	bio_done(b, result);
+}
+
+void
+bio_submitlist(struct bio *list)
+{
+	struct device *dev;
+	struct bio *b, *next;
+
+	if (list == NULL) {
+		return;
+	}
+	dev = list->b_dev;
+
+	for (b = list; b != NULL; b = b->b_next) {
+		KASSERT(b->b_dev == dev);
+		b->b_error = 0;
+		b->b_flags = 0;
+	}
+
+	if (dev->d_ops->devop_strategy != NULL) {
+		DEVOP_STRATEGY(dev, list);
+		return;
+	}
+
+	for (b = list; b != NULL; b = next) {
+		next = b->b_next;
+		b->b_next = NULL;
+		bio_syncio(b);
+	}
+}
+
+void
+bio_submit(struct bio *b)
+{
+	b->b_next = NULL;
+	bio_submitlist(b);
+}
+
+int
+bio_wait(struct bio *b)
+{
+	struct bio_bucket *bb = bio_bucket(b);
+
+	KASSERT(b->b_done == NULL && b->b_sem == NULL);
+
+	spinlock_acquire(&bb->bb_lock);
+	while ((b->b_flags & B_DONE) == 0) {
+		b->b_waiter = curthread;
+		wchan_sleep(bb->bb_wchan, &bb->bb_lock);
+	}
+	b->b_waiter = NULL;
+	spinlock_release(&bb->bb_lock);
+	return b->b_error;
+}
+
+int
+bio_waitall(struct bio *bios, unsigned n)
+{
+	unsigned i;
+	int result = 0;
+
+	for (i=0; i<n; i++) {
+		if (bio_wait(&bios[i]) && result == 0) {
+			result = bios[i].b_error;
+		}
+	}
+	return result;
+}
+
+/*
+ * Finish a transfer. Once b_done is called or b_sem is upped, the
+ * bio may be reused or freed, so don't touch it afterwards.
+ */
+void
+bio_done(struct bio *b, int error)
+{
+	struct semaphore *sem;
+	struct bio_bucket *bb;
+
+	b->b_error = error;
+
+	if (b->b_done != NULL) {
+		b->b_done(b);
+		return;
+	}
+
+	sem = b->b_sem;
+	if (sem != NULL) {
+		V(sem);
+		return;
+	}
+
+	bb = bio_bucket(b);
+	spinlock_acquire(&bb->bb_lock);
+	b->b_flags |= B_DONE;
+	if (b->b_waiter != NULL) {
+		wchan_wakethread(bb->bb_wchan, &bb->bb_lock, b->b_waiter);
+	}
+	spinlock_release(&bb->bb_lock);
+}
@@ -330,6 +330,7 @@ static const struct vnode_ops dev_vnode_ops = {
 	.vop_read = dev_read,
 	.vop_readlink = vopfail_uio_inval,
 	.vop_getdirentry = vopfail_uio_notdir,
+	.vop_getdirentries = vopfail_uio_notdir,
 	.vop_write = dev_write,
 	.vop_ioctl = dev_ioctl,
 	.vop_stat = dev_stat,
@@ -338,6 +339,7 @@ static const struct vnode_ops dev_vnode_ops = {
 	.vop_fsync = null_fsync,
 	.vop_mmap = dev_mmap,
 	.vop_truncate = dev_truncate,
+	.vop_fallocate = vopfail_fallocate_nosys,
 	.vop_namefile = dev_namefile,
 	.vop_creat = vopfail_creat_notdir,
 	.vop_symlink = vopfail_symlink_notdir,
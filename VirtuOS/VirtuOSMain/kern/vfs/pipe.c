@@ -0,0 +1,554 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Anonymous pipes.
+ *
+ * The data lives in a ring buffer whose size is a power of 2.
+ * p_head counts every byte ever written and p_tail every byte ever
+ * read; both wrap around freely, and head - tail is the number of
+ * bytes in the buffer. Only the writer changes p_head and only the
+ * reader changes p_tail.
+ *
+ * Readers take turns with p_rlock and writers with p_wlock, so at any
+ * moment there is at most one of each in the buffer, and that's all
+ * a single-producer single-consumer ring needs: the two sides don't
+ * share a lock while data is flowing. The writer fills in bytes and
+ * then publishes them by advancing p_head; the reader copies bytes
+ * out and then frees the space by advancing p_tail. The memory
+ * barriers make sure each side sees the other's bytes before the
+ * counter that covers them. When there is exactly one reader and one
+ * writer (the usual case) p_rlock and p_wlock are never contended.
+ *
+ * Only when one side has to wait (empty or full buffer) does it take
+ * p_lock and sleep on its cv, after setting a flag saying so. The
+ * other side checks the flag after moving its counter and only then
+ * takes p_lock to wake it up. Setting the flag and checking the
+ * counter are separated by a full barrier on both sides, so one of
+ * the two always sees the other.
+ *
+ * Each end has its own vnode, and an openfile for that end holds a
+ * reference to it. When the last openfile for an end goes away, its
+ * vnode is reclaimed and the end is marked closed, which wakes up
+ * the other side: readers see EOF once the buffer is drained, and
+ * writers get EPIPE. When both ends are gone the pipe is freed.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <limits.h>
+#include <stat.h>
+#include <lib.h>
+#include <membar.h>
+#include <synch.h>
+#include <uio.h>
+#include <vnode.h>
+#include <pipe.h>
+
+struct pipe {
+	struct vnode p_readvn;		/* read end */
+	struct vnode p_writevn;		/* write end */
+
+	char *p_buf;			/* the ring buffer */
+	unsigned p_size;		/* its size (power of 2) */
+	volatile unsigned p_head;	/* bytes written (writer only) */
+	volatile unsigned p_tail;	/* bytes read (reader only) */
+
+	struct lock *p_rlock;		/* one reader at a time */
+	struct lock *p_wlock;		/* one writer at a time */
+	bool p_rnonblock;		/* O_NONBLOCK on the read end */
+	bool p_wnonblock;		/* O_NONBLOCK on the write end */
+
+	struct lock *p_lock;		/* for sleeping and closing */
+	struct cv *p_readcv;		/* reader waits for data */
+	struct cv *p_writecv;		/* writer waits for space */
+	volatile bool p_readwaiting;	/* reader is (about to be) asleep */
+	volatile bool p_writewaiting;	/* writer is (about to be) asleep */
+	volatile bool p_readclosed;	/* read end is gone */
+	volatile bool p_writeclosed;	/* write end is gone */
+};
+
+////////////////////////////////////////////////////////////
+//
+// Ring buffer
+//
+
+/*
+ * Bytes in the buffer, and free space.
+ */
+static
+unsigned
+pipe_used(struct pipe *p)
+{
+	return p->p_head - p->p_tail;
+}
+
+static
+unsigned
+pipe_space(struct pipe *p)
+{
+	return p->p_size - (p->p_head - p->p_tail);
+}
+
+/*
+ * Move LEN bytes between the uio and the buffer, starting at
+ * position POS (a head or tail count), in up to two pieces if it
+ * wraps around. Returns the number of bytes moved, which is less than
+ * LEN only if uiomove failed.
+ */
+static
+unsigned
+pipe_xfer(struct pipe *p, unsigned pos, unsigned len, struct uio *uio,
+	  int *err)
+{
+	unsigned off, first;
+	size_t before;
+
+	before = uio->uio_resid;
+	off = pos & (p->p_size - 1);
+	first = len;
+	if (first > p->p_size - off) {
+		first = p->p_size - off;
+	}
+	*err = uiomove(p->p_buf + off, first, uio);
+	if (*err == 0 && len > first) {
+		*err = uiomove(p->p_buf, len - first, uio);
+	}
+	return before - uio->uio_resid;
+}
+
+/*
+ * Wake the other side if it's asleep. The barrier orders our counter
+ * update before the check of the flag; see the comment at the top.
+ */
+static
+void
+pipe_wake(struct pipe *p, volatile bool *waiting, struct cv *cv)
+{
+	membar_any_any();
+	if (*waiting) {
+		lock_acquire(p->p_lock);
+		cv_signal(cv, p->p_lock);
+		lock_release(p->p_lock);
+	}
+}
+
+////////////////////////////////////////////////////////////
+//
+// Vnode operations
+//
+
+/*
+ * Read: wait until there's data (or the write end is gone) and then
+ * return as much as there is, up to the size of the request.
+ */
+static
+int
+pipe_read(struct vnode *vn, struct uio *uio)
+{
+	struct pipe *p = vn->vn_data;
+	unsigned len, moved;
+	int result = 0;
+
+	if (vn != &p->p_readvn) {
+		return EBADF;
+	}
+	if (uio->uio_resid == 0) {
+		return 0;
+	}
+
+	lock_acquire(p->p_rlock);
+
+	while (pipe_used(p) == 0) {
+		if (p->p_writeclosed) {
+			/* recheck; the last write comes before the close */
+			membar_load_load();
+			if (pipe_used(p) == 0) {
+				/* EOF */
+				lock_release(p->p_rlock);
+				return 0;
+			}
+			break;
+		}
+		if (p->p_rnonblock) {
+			lock_release(p->p_rlock);
+			return EAGAIN;
+		}
+
+		lock_acquire(p->p_lock);
+		p->p_readwaiting = true;
+		membar_any_any();
+		while (pipe_used(p) == 0 && !p->p_writeclosed) {
+			cv_wait(p->p_readcv, p->p_lock);
+		}
+		p->p_readwaiting = false;
+		lock_release(p->p_lock);
+	}
+
+	/* don't look at the bytes until we've seen p_head cover them */
+	membar_load_load();
+
+	len = pipe_used(p);
+	if (len > uio->uio_resid) {
+		len = uio->uio_resid;
+	}
+	moved = pipe_xfer(p, p->p_tail, len, uio, &result);
+
+	/* done with the bytes; now give the space back */
+	membar_any_store();
+	p->p_tail += moved;
+	pipe_wake(p, &p->p_writewaiting, p->p_writecv);
+
+	lock_release(p->p_rlock);
+	return result;
+}
+
+/*
+ * Write: copy in as much as fits, waiting for space as needed, until
+ * it's all written. Writes of up to PIPE_BUF bytes go in all at once.
+ * If the read end is gone, fail with EPIPE; in nonblocking mode, fail
+ * with EAGAIN instead of waiting. Either way, if some of the data was
+ * already written, succeed with a short count instead.
+ */
+static
+int
+pipe_write(struct vnode *vn, struct uio *uio)
+{
+	struct pipe *p = vn->vn_data;
+	unsigned len, need, moved;
+	size_t total;
+	int result = 0;
+
+	if (vn != &p->p_writevn) {
+		return EBADF;
+	}
+
+	lock_acquire(p->p_wlock);
+
+	total = uio->uio_resid;
+	while (uio->uio_resid > 0) {
+		if (p->p_readclosed) {
+			result = EPIPE;
+			break;
+		}
+
+		need = (total <= PIPE_BUF) ? uio->uio_resid : 1;
+		if (pipe_space(p) < need) {
+			if (p->p_wnonblock) {
+				result = EAGAIN;
+				break;
+			}
+
+			lock_acquire(p->p_lock);
+			p->p_writewaiting = true;
+			membar_any_any();
+			while (pipe_space(p) < need && !p->p_readclosed) {
+				cv_wait(p->p_writecv, p->p_lock);
+			}
+			p->p_writewaiting = false;
+			lock_release(p->p_lock);
+			continue;
+		}
+
+		/* the reader is done with this space once p_tail moves */
+		membar_load_load();
+
+		len = pipe_space(p);
+		if (len > uio->uio_resid) {
+			len = uio->uio_resid;
+		}
+		moved = pipe_xfer(p, p->p_head, len, uio, &result);
+
+		/* publish the bytes */
+		membar_store_store();
+		p->p_head += moved;
+		pipe_wake(p, &p->p_readwaiting, p->p_readcv);
+
+		if (result) {
+			break;
+		}
+	}
+
+	lock_release(p->p_wlock);
+
+	if (uio->uio_resid < total && (result == EPIPE || result == EAGAIN)) {
+		/* short write */
+		result = 0;
+	}
+	return result;
+}
+
+/*
+ * Destroy a pipe once both ends are gone.
+ */
+static
+void
+pipe_destroy(struct pipe *p)
+{
+	cv_destroy(p->p_writecv);
+	cv_destroy(p->p_readcv);
+	lock_destroy(p->p_lock);
+	lock_destroy(p->p_wlock);
+	lock_destroy(p->p_rlock);
+	kfree(p->p_buf);
+	kfree(p);
+}
+
+/*
+ * Reclaim: the last reference to one end went away. Mark that end
+ * closed and wake whoever is waiting on the other end.
+ *
+ * The two ends can be reclaimed at once on different cpus, so the
+ * vnode is cleaned up under p_lock and only the one that sees both
+ * ends closed destroys the pipe. It cycles p_lock first so the other
+ * one is all the way out of lock_release.
+ */
+static
+int
+pipe_reclaim(struct vnode *vn)
+{
+	struct pipe *p = vn->vn_data;
+	bool done;
+
+	lock_acquire(p->p_lock);
+	if (vn == &p->p_readvn) {
+		p->p_readclosed = true;
+		cv_broadcast(p->p_writecv, p->p_lock);
+	}
+	else {
+		KASSERT(vn == &p->p_writevn);
+		p->p_writeclosed = true;
+		cv_broadcast(p->p_readcv, p->p_lock);
+	}
+	vnode_cleanup(vn);
+	done = p->p_readclosed && p->p_writeclosed;
+	lock_release(p->p_lock);
+
+	if (done) {
+		lock_acquire(p->p_lock);
+		lock_release(p->p_lock);
+		pipe_destroy(p);
+	}
+	return 0;
+}
+
+static
+int
+pipe_eachopen(struct vnode *vn, int openflags)
+{
+	/* pipes have no names, so nothing can open them */
+	(void)vn;
+	(void)openflags;
+	return EINVAL;
+}
+
+static
+int
+pipe_ioctl(struct vnode *vn, int op, userptr_t data)
+{
+	(void)vn;
+	(void)op;
+	(void)data;
+	return EINVAL;
+}
+
+static
+int
+pipe_stat(struct vnode *vn, struct stat *buf)
+{
+	struct pipe *p = vn->vn_data;
+
+	bzero(buf, sizeof(*buf));
+	buf->st_mode = S_IFIFO | 0600;
+	buf->st_size = pipe_used(p);
+	buf->st_nlink = 0;
+	buf->st_blocks = 0;
+	buf->st_dev = 0;
+	buf->st_ino = 0;
+	return 0;
+}
+
+static
+int
+pipe_gettype(struct vnode *vn, mode_t *ret)
+{
+	(void)vn;
+	*ret = S_IFIFO;
+	return 0;
+}
+
+static
+bool
+pipe_isseekable(struct vnode *vn)
+{
+	(void)vn;
+	return false;
+}
+
+static
+int
+pipe_fsync(struct vnode *vn)
+{
+	(void)vn;
+	return EINVAL;
+}
+
+static
+int
+pipe_truncate(struct vnode *vn, off_t len)
+{
+	(void)vn;
+	(void)len;
+	return EINVAL;
+}
+
+/*
+ * Vnode ops table for both ends of a pipe.
+ */
+static const struct vnode_ops pipe_vnode_ops = {
+	.vop_magic = VOP_MAGIC,
+
+	.vop_eachopen = pipe_eachopen,
+	.vop_reclaim = pipe_reclaim,
+
+	.vop_read = pipe_read,
+	.vop_readlink = vopfail_uio_inval,
+	.vop_getdirentry = vopfail_uio_notdir,
+	.vop_getdirentries = vopfail_uio_notdir,
+	.vop_write = pipe_write,
+	.vop_ioctl = pipe_ioctl,
+	.vop_stat = pipe_stat,
+	.vop_gettype = pipe_gettype,
+	.vop_isseekable = pipe_isseekable,
+	.vop_fsync = pipe_fsync,
+	.vop_mmap = vopfail_mmap_perm,
+	.vop_truncate = pipe_truncate,
+	.vop_fallocate = vopfail_fallocate_nosys,
+	.vop_namefile = vopfail_uio_notdir,
+
+	.vop_creat = vopfail_creat_notdir,
+	.vop_symlink = vopfail_symlink_notdir,
+	.vop_mkdir = vopfail_mkdir_notdir,
+	.vop_link = vopfail_link_notdir,
+	.vop_remove = vopfail_string_notdir,
+	.vop_rmdir = vopfail_string_notdir,
+	.vop_rename = vopfail_rename_notdir,
+	.vop_lookup = vopfail_lookup_notdir,
+	.vop_lookparent = vopfail_lookparent_notdir,
+};
+
+////////////////////////////////////////////////////////////
+//
+// Constructor
+//
+
+/*
+ * Create a pipe.
+ */
+int
+pipe_create(size_t size, int flags,
+	    struct vnode **readend, struct vnode **writeend)
+{
+	struct pipe *p;
+	int result;
+
+	KASSERT((flags & ~O_NONBLOCK) == 0);
+
+	if (size > PIPE_MAXSIZE) {
+		return EINVAL;
+	}
+	if (size < PIPE_DEFSIZE) {
+		size = PIPE_DEFSIZE;
+	}
+
+	p = kmalloc(sizeof(*p));
+	if (p == NULL) {
+		return ENOMEM;
+	}
+
+	p->p_size = PIPE_DEFSIZE;
+	while (p->p_size < size) {
+		p->p_size *= 2;
+	}
+	p->p_buf = kmalloc(p->p_size);
+	if (p->p_buf == NULL) {
+		goto fail_pipe;
+	}
+	p->p_head = p->p_tail = 0;
+
+	p->p_rlock = lock_create("pipe-read");
+	if (p->p_rlock == NULL) {
+		goto fail_buf;
+	}
+	p->p_wlock = lock_create("pipe-write");
+	if (p->p_wlock == NULL) {
+		goto fail_rlock;
+	}
+	p->p_lock = lock_create("pipe");
+	if (p->p_lock == NULL) {
+		goto fail_wlock;
+	}
+	p->p_readcv = cv_create("pipe-read");
+	if (p->p_readcv == NULL) {
+		goto fail_lock;
+	}
+	p->p_writecv = cv_create("pipe-write");
+	if (p->p_writecv == NULL) {
+		goto fail_readcv;
+	}
+
+	p->p_rnonblock = p->p_wnonblock = (flags & O_NONBLOCK) != 0;
+	p->p_readwaiting = p->p_writewaiting = false;
+	p->p_readclosed = p->p_writeclosed = false;
+
+	/* vnode_init doesn't actually fail */
+	result = vnode_init(&p->p_readvn, &pipe_vnode_ops, NULL, p);
+	KASSERT(result == 0);
+	result = vnode_init(&p->p_writevn, &pipe_vnode_ops, NULL, p);
+	KASSERT(result == 0);
+
+	*readend = &p->p_readvn;
+	*writeend = &p->p_writevn;
+	return 0;
+
+ fail_readcv:
+	cv_destroy(p->p_readcv);
+ fail_lock:
+	lock_destroy(p->p_lock);
+ fail_wlock:
+	lock_destroy(p->p_wlock);
+ fail_rlock:
+	lock_destroy(p->p_rlock);
+ fail_buf:
+	kfree(p->p_buf);
+ fail_pipe:
+	kfree(p);
+	return ENOMEM;
+}
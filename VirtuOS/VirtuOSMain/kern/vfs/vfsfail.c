@@ -114,6 +114,27 @@ vopfail_truncate_isdir(struct vnode *vn, off_t pos)
 	return EISDIR;
 }
 
+////////////////////////////////////////////////////////////
+// fallocate
+
+int
+vopfail_fallocate_isdir(struct vnode *vn, off_t pos, off_t len)
+{
+	(void)vn;
+	(void)pos;
+	(void)len;
+	return EISDIR;
+}
+
+int
+vopfail_fallocate_nosys(struct vnode *vn, off_t pos, off_t len)
+{
+	(void)vn;
+	(void)pos;
+	(void)len;
+	return ENOSYS;
+}
+
 ////////////////////////////////////////////////////////////
 // creat
 
@@ -234,16 +234,91 @@ getdevice(char *path, char **subpath, struct vnode **startvn)
 	return 0;
 }
 
+/*
+ * Look up a single component NAME in DIR, going through the name
+ * cache. Misses are passed to the filesystem and the result (found
+ * or not found) is entered in the cache.
+ */
+static
+int
+lookup_component(struct vnode *dir, char *name, struct vnode **ret)
+{
+	int result;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	if (vfs_ncache_lookup(dir, name, ret)) {
+		return (*ret == NULL) ? ENOENT : 0;
+	}
+
+	result = VOP_LOOKUP(dir, name, ret);
+	if (result == 0) {
+		vfs_ncache_enter(dir, name, *ret);
+	}
+	else if (result == ENOENT) {
+		vfs_ncache_enter(dir, name, NULL);
+	}
+	return result;
+}
+
+/*
+ * Walk PATH starting from STARTVN, one component at a time. Empty
+ * components (from doubled or trailing slashes) are skipped. Returns
+ * a new reference in RET; the caller keeps its reference to STARTVN.
+ */
+static
+int
+lookup_path(struct vnode *startvn, char *path, struct vnode **ret)
+{
+	struct vnode *dir, *next;
+	char *name, *s;
+	int result;
+
+	VOP_INCREF(startvn);
+	dir = startvn;
+
+	for (name = path; name != NULL; name = s) {
+		while (*name == '/') {
+			name++;
+		}
+		if (*name == 0) {
+			break;
+		}
+		s = strchr(name, '/');
+		if (s != NULL) {
+			*s = 0;
+			s++;
+		}
+
+		result = lookup_component(dir, name, &next);
+		VOP_DECREF(dir);
+		if (result) {
+			return result;
+		}
+		dir = next;
+	}
+
+	*ret = dir;
+	return 0;
+}
+
 /*
  * Name-to-vnode translation.
  * (In BSD, both of these are subsumed by namei().)
+ *
+ * Rather than handing the whole path to the filesystem, we walk it
+ * component by component so each step can be served from the name
+ * cache. The last component of lookparent is still given to
+ * VOP_LOOKPARENT so the filesystem can check the parent.
  */
 
 int
 vfs_lookparent(char *path, struct vnode **retval,
 	       char *buf, size_t buflen)
 {
-	struct vnode *startvn;
+	struct vnode *startvn, *dir;
+	char *name;
+	size_t len;
 	int result;
 
 	vfs_biglock_acquire();
@@ -254,18 +329,43 @@ vfs_lookparent(char *path, struct vnode **retval,
 		return result;
 	}
 
-	if (strlen(path)==0) {
+	/* strip trailing slashes */
+	len = strlen(path);
+	while (len > 0 && path[len-1] == '/') {
+		path[--len] = 0;
+	}
+
+	if (len==0) {
 		/*
 		 * It does not make sense to use just a device name in
 		 * a context where "lookparent" is the desired
 		 * operation.
 		 */
-		result = EINVAL;
+		VOP_DECREF(startvn);
+		vfs_biglock_release();
+		return EINVAL;
+	}
+
+	name = strrchr(path, '/');
+	if (name == NULL) {
+		name = path;
+		VOP_INCREF(startvn);
+		dir = startvn;
 	}
 	else {
-		result = VOP_LOOKPARENT(startvn, path, retval, buf, buflen);
+		*name = 0;
+		name++;
+		result = lookup_path(startvn, path, &dir);
+		if (result) {
+			VOP_DECREF(startvn);
+			vfs_biglock_release();
+			return result;
+		}
 	}
 
+	result = VOP_LOOKPARENT(dir, name, retval, buf, buflen);
+
+	VOP_DECREF(dir);
 	VOP_DECREF(startvn);
 
 	vfs_biglock_release();
@@ -292,7 +392,7 @@ vfs_lookup(char *path, struct vnode **retval)
 		return 0;
 	}
 
-	result = VOP_LOOKUP(startvn, path, retval);
+	result = lookup_path(startvn, path, retval);
 
 	VOP_DECREF(startvn);
 	vfs_biglock_release();
@@ -0,0 +1,503 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * VFS name cache.
+ *
+ * Maps (directory vnode, component name) to the vnode that name
+ * refers to, so that repeated path translation (open, stat, chdir,
+ * and especially exec walking $PATH) doesn't have to go down into
+ * the filesystem for every component every time.
+ *
+ * Entries whose vnode is NULL are negative entries: they record that
+ * the name was looked up and did not exist. This matters for execvp,
+ * which probes several directories before finding the program.
+ *
+ * Positive entries hold a reference to both the directory and the
+ * target vnode; negative entries hold a reference to the directory
+ * only. Holding the directory reference keeps its address from being
+ * reused for some other vnode while entries keyed on it exist.
+ *
+ * The cache is a fixed pool of entries on a hash table, recycled in
+ * LRU order. It is protected by the vfs_biglock; every caller already
+ * holds it during path translation, and taking a separate lock here
+ * would deadlock against VOP_RECLAIM, which also takes the biglock.
+ *
+ * "." and ".." are never cached, nor are names longer than
+ * NCACHE_NAMELEN, nor lookups in vnodes that don't belong to a
+ * filesystem (devices).
+ *
+ * Note that emufs passes lookups to the host, and nothing tells us if
+ * files appear or vanish on the host side. Changes made through
+ * OS/161 itself are invalidated properly; changes made behind its
+ * back may be masked by a stale negative entry until it is recycled
+ * or the cache is flushed.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <vfs.h>
+#include <vnode.h>
+
+#define NCACHE_SIZE	256	/* number of entries */
+#define NCACHE_HASHSIZE	64	/* number of hash chains; power of 2 */
+#define NCACHE_NAMELEN	31	/* longest name we'll cache */
+
+struct ncentry {
+	/* hash chain; nc_dir == NULL means the entry is free */
+	struct ncentry *nc_hashnext;
+	struct ncentry **nc_hashprevp;
+
+	/* LRU list; the head is most recently used */
+	struct ncentry *nc_lrunext;
+	struct ncentry *nc_lruprev;
+
+	struct vnode *nc_dir;		/* directory (holds a reference) */
+	struct vnode *nc_vn;		/* target, or NULL if negative */
+	unsigned nc_hash;
+	size_t nc_namelen;
+	char nc_name[NCACHE_NAMELEN+1];
+};
+
+static struct ncentry ncache_entries[NCACHE_SIZE];
+static struct ncentry *ncache_hash[NCACHE_HASHSIZE];
+static struct ncentry *ncache_lruhead;
+static struct ncentry *ncache_lrutail;
+static bool ncache_enabled;
+
+/* statistics */
+static unsigned ncache_hits;
+static unsigned ncache_neghits;
+static unsigned ncache_misses;
+static unsigned ncache_enters;
+static unsigned ncache_recycles;
+static unsigned ncache_purges;
+
+////////////////////////////////////////////////////////////
+// internal helpers
+
+/*
+ * Hash (dir, name). FNV-1a over the name, mixed with the vnode
+ * address.
+ */
+static
+unsigned
+ncache_hashname(struct vnode *dir, const char *name, size_t len)
+{
+	unsigned h = 2166136261U;
+	size_t i;
+
+	for (i=0; i<len; i++) {
+		h ^= (unsigned char)name[i];
+		h *= 16777619U;
+	}
+	h ^= (unsigned)(uintptr_t)dir >> 4;
+	return h;
+}
+
+/*
+ * LRU list manipulation.
+ */
+static
+void
+ncache_lru_remove(struct ncentry *nc)
+{
+	if (nc->nc_lruprev != NULL) {
+		nc->nc_lruprev->nc_lrunext = nc->nc_lrunext;
+	}
+	else {
+		ncache_lruhead = nc->nc_lrunext;
+	}
+	if (nc->nc_lrunext != NULL) {
+		nc->nc_lrunext->nc_lruprev = nc->nc_lruprev;
+	}
+	else {
+		ncache_lrutail = nc->nc_lruprev;
+	}
+	nc->nc_lrunext = nc->nc_lruprev = NULL;
+}
+
+static
+void
+ncache_lru_addhead(struct ncentry *nc)
+{
+	nc->nc_lruprev = NULL;
+	nc->nc_lrunext = ncache_lruhead;
+	if (ncache_lruhead != NULL) {
+		ncache_lruhead->nc_lruprev = nc;
+	}
+	else {
+		ncache_lrutail = nc;
+	}
+	ncache_lruhead = nc;
+}
+
+static
+void
+ncache_lru_addtail(struct ncentry *nc)
+{
+	nc->nc_lrunext = NULL;
+	nc->nc_lruprev = ncache_lrutail;
+	if (ncache_lrutail != NULL) {
+		ncache_lrutail->nc_lrunext = nc;
+	}
+	else {
+		ncache_lruhead = nc;
+	}
+	ncache_lrutail = nc;
+}
+
+/*
+ * Find the entry for (dir, name), or NULL.
+ */
+static
+struct ncentry *
+ncache_find(struct vnode *dir, const char *name, size_t len, unsigned hash)
+{
+	struct ncentry *nc;
+
+	for (nc = ncache_hash[hash & (NCACHE_HASHSIZE-1)]; nc != NULL;
+	     nc = nc->nc_hashnext) {
+		if (nc->nc_hash == hash && nc->nc_dir == dir &&
+		    nc->nc_namelen == len &&
+		    !strcmp(nc->nc_name, name)) {
+			return nc;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Take an entry off its hash chain, drop its references, and put it
+ * at the tail of the LRU list so it's the next one reused.
+ *
+ * Dropping the references may reclaim vnodes, which may call back
+ * into the filesystem; the entry is fully detached first so that
+ * doesn't find it half-removed.
+ */
+static
+void
+ncache_release(struct ncentry *nc)
+{
+	struct vnode *dir, *vn;
+
+	KASSERT(nc->nc_dir != NULL);
+
+	*nc->nc_hashprevp = nc->nc_hashnext;
+	if (nc->nc_hashnext != NULL) {
+		nc->nc_hashnext->nc_hashprevp = nc->nc_hashprevp;
+	}
+	nc->nc_hashnext = NULL;
+	nc->nc_hashprevp = NULL;
+
+	dir = nc->nc_dir;
+	vn = nc->nc_vn;
+	nc->nc_dir = NULL;
+	nc->nc_vn = NULL;
+
+	ncache_lru_remove(nc);
+	ncache_lru_addtail(nc);
+
+	if (vn != NULL) {
+		VOP_DECREF(vn);
+	}
+	VOP_DECREF(dir);
+}
+
+/*
+ * Check if a name is one we're willing to cache.
+ */
+static
+bool
+ncache_cacheable(struct vnode *dir, const char *name, size_t len)
+{
+	if (!ncache_enabled) {
+		return false;
+	}
+	if (dir->vn_fs == NULL) {
+		return false;
+	}
+	if (len == 0 || len > NCACHE_NAMELEN) {
+		return false;
+	}
+	if (!strcmp(name, ".") || !strcmp(name, "..")) {
+		return false;
+	}
+	return true;
+}
+
+////////////////////////////////////////////////////////////
+// interface
+
+/*
+ * Set up the cache. Called from vfs_bootstrap.
+ */
+void
+vfs_ncache_bootstrap(void)
+{
+	unsigned i;
+
+	ncache_lruhead = ncache_lrutail = NULL;
+	for (i=0; i<NCACHE_HASHSIZE; i++) {
+		ncache_hash[i] = NULL;
+	}
+	for (i=0; i<NCACHE_SIZE; i++) {
+		ncache_entries[i].nc_hashnext = NULL;
+		ncache_entries[i].nc_hashprevp = NULL;
+		ncache_entries[i].nc_dir = NULL;
+		ncache_entries[i].nc_vn = NULL;
+		ncache_lru_addtail(&ncache_entries[i]);
+	}
+	ncache_enabled = true;
+}
+
+/*
+ * Look up NAME in DIR. Returns true if the cache knows the answer;
+ * then *RET is either a new reference to the vnode, or NULL if the
+ * name is known not to exist. Returns false on a miss.
+ */
+bool
+vfs_ncache_lookup(struct vnode *dir, const char *name, struct vnode **ret)
+{
+	struct ncentry *nc;
+	size_t len;
+	unsigned hash;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	len = strlen(name);
+	if (!ncache_cacheable(dir, name, len)) {
+		return false;
+	}
+
+	hash = ncache_hashname(dir, name, len);
+	nc = ncache_find(dir, name, len, hash);
+	if (nc == NULL) {
+		ncache_misses++;
+		return false;
+	}
+
+	ncache_lru_remove(nc);
+	ncache_lru_addhead(nc);
+
+	if (nc->nc_vn == NULL) {
+		ncache_neghits++;
+		*ret = NULL;
+	}
+	else {
+		ncache_hits++;
+		VOP_INCREF(nc->nc_vn);
+		*ret = nc->nc_vn;
+	}
+	return true;
+}
+
+/*
+ * Record the result of looking up NAME in DIR: VN, or NULL for a
+ * negative entry. Takes its own references; the caller keeps theirs.
+ */
+void
+vfs_ncache_enter(struct vnode *dir, const char *name, struct vnode *vn)
+{
+	struct ncentry *nc;
+	struct ncentry **chain;
+	size_t len;
+	unsigned hash;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	len = strlen(name);
+	if (!ncache_cacheable(dir, name, len)) {
+		return;
+	}
+
+	hash = ncache_hashname(dir, name, len);
+	nc = ncache_find(dir, name, len, hash);
+	if (nc != NULL) {
+		/* replace the existing entry */
+		ncache_release(nc);
+	}
+
+	/* recycle the least recently used entry */
+	nc = ncache_lrutail;
+	KASSERT(nc != NULL);
+	if (nc->nc_dir != NULL) {
+		ncache_recycles++;
+		ncache_release(nc);
+		nc = ncache_lrutail;
+	}
+
+	VOP_INCREF(dir);
+	if (vn != NULL) {
+		VOP_INCREF(vn);
+	}
+	nc->nc_dir = dir;
+	nc->nc_vn = vn;
+	nc->nc_hash = hash;
+	nc->nc_namelen = len;
+	memcpy(nc->nc_name, name, len);
+	nc->nc_name[len] = 0;
+
+	chain = &ncache_hash[hash & (NCACHE_HASHSIZE-1)];
+	nc->nc_hashnext = *chain;
+	nc->nc_hashprevp = chain;
+	if (*chain != NULL) {
+		(*chain)->nc_hashprevp = &nc->nc_hashnext;
+	}
+	*chain = nc;
+
+	ncache_lru_remove(nc);
+	ncache_lru_addhead(nc);
+
+	ncache_enters++;
+}
+
+/*
+ * Forget NAME in DIR. Call this after anything that creates, removes,
+ * or renames a name. If the name referred to a directory, also forget
+ * everything cached under that directory, since it may have been
+ * removed.
+ */
+void
+vfs_ncache_purge(struct vnode *dir, const char *name)
+{
+	struct ncentry *nc;
+	struct vnode *vn;
+	size_t len;
+
+	vfs_biglock_acquire();
+
+	len = strlen(name);
+	nc = ncache_find(dir, name, len, ncache_hashname(dir, name, len));
+	if (nc != NULL) {
+		vn = nc->nc_vn;
+		if (vn != NULL) {
+			/* keep vn valid while we purge under it */
+			VOP_INCREF(vn);
+		}
+		ncache_purges++;
+		ncache_release(nc);
+		if (vn != NULL) {
+			vfs_ncache_purgedir(vn);
+			VOP_DECREF(vn);
+		}
+	}
+
+	vfs_biglock_release();
+}
+
+/*
+ * Forget everything cached under DIR.
+ */
+void
+vfs_ncache_purgedir(struct vnode *dir)
+{
+	unsigned i;
+
+	vfs_biglock_acquire();
+	for (i=0; i<NCACHE_SIZE; i++) {
+		if (ncache_entries[i].nc_dir == dir) {
+			ncache_purges++;
+			ncache_release(&ncache_entries[i]);
+		}
+	}
+	vfs_biglock_release();
+}
+
+/*
+ * Forget everything belonging to FS, or everything at all if FS is
+ * NULL. Must be done before unmounting, since the cache holds vnode
+ * references that would otherwise keep the filesystem busy.
+ */
+void
+vfs_ncache_purgefs(struct fs *fs)
+{
+	struct ncentry *nc;
+	unsigned i;
+
+	vfs_biglock_acquire();
+	for (i=0; i<NCACHE_SIZE; i++) {
+		nc = &ncache_entries[i];
+		if (nc->nc_dir != NULL &&
+		    (fs == NULL || nc->nc_dir->vn_fs == fs)) {
+			ncache_purges++;
+			ncache_release(nc);
+		}
+	}
+	vfs_biglock_release();
+}
+
+/*
+ * Turn the cache on or off (for measurement). Turning it off flushes
+ * it.
+ */
+void
+vfs_ncache_setenabled(bool enabled)
+{
+	vfs_biglock_acquire();
+	if (!enabled) {
+		vfs_ncache_purgefs(NULL);
+	}
+	ncache_enabled = enabled;
+	vfs_biglock_release();
+}
+
+/*
+ * Print statistics.
+ */
+void
+vfs_ncache_printstats(void)
+{
+	unsigned i, used = 0, negative = 0, lookups;
+
+	vfs_biglock_acquire();
+	for (i=0; i<NCACHE_SIZE; i++) {
+		if (ncache_entries[i].nc_dir != NULL) {
+			used++;
+			if (ncache_entries[i].nc_vn == NULL) {
+				negative++;
+			}
+		}
+	}
+	lookups = ncache_hits + ncache_neghits + ncache_misses;
+
+	kprintf("vfs name cache: %s, %u/%u entries in use (%u negative)\n",
+		ncache_enabled ? "enabled" : "disabled",
+		used, NCACHE_SIZE, negative);
+	kprintf("    %u lookups: %u hits, %u negative hits, %u misses",
+		lookups, ncache_hits, ncache_neghits, ncache_misses);
+	if (lookups > 0) {
+		kprintf(" (%u%% hit rate)",
+			(ncache_hits + ncache_neghits) * 100 / lookups);
+	}
+	kprintf("\n");
+	kprintf("    %u entered, %u recycled, %u purged\n",
+		ncache_enters, ncache_recycles, ncache_purges);
+	vfs_biglock_release();
+}
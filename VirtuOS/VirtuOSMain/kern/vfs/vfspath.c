@@ -73,7 +73,13 @@ vfs_open(char *path, int openflags, mode_t mode, struct vnode **ret)
 			return result;
 		}
 
+		vfs_biglock_acquire();
 		result = VOP_CREAT(dir, name, excl, mode, &vn);
+		if (result == 0) {
+			/* drop any negative entry */
+			vfs_ncache_purge(dir, name);
+		}
+		vfs_biglock_release();
 
 		VOP_DECREF(dir);
 	}
@@ -145,7 +151,12 @@ vfs_remove(char *path)
 		return result;
 	}
 
+	vfs_biglock_acquire();
 	result = VOP_REMOVE(dir, name);
+	if (result == 0) {
+		vfs_ncache_purge(dir, name);
+	}
+	vfs_biglock_release();
 	VOP_DECREF(dir);
 
 	return result;
@@ -178,7 +189,13 @@ vfs_rename(char *oldpath, char *newpath)
 		return EXDEV;
 	}
 
+	vfs_biglock_acquire();
 	result = VOP_RENAME(olddir, oldname, newdir, newname);
+	if (result == 0) {
+		vfs_ncache_purge(olddir, oldname);
+		vfs_ncache_purge(newdir, newname);
+	}
+	vfs_biglock_release();
 
 	VOP_DECREF(newdir);
 	VOP_DECREF(olddir);
@@ -212,7 +229,12 @@ vfs_link(char *oldpath, char *newpath)
 		return EXDEV;
 	}
 
+	vfs_biglock_acquire();
 	result = VOP_LINK(newdir, newname, oldfile);
+	if (result == 0) {
+		vfs_ncache_purge(newdir, newname);
+	}
+	vfs_biglock_release();
 
 	VOP_DECREF(newdir);
 	VOP_DECREF(oldfile);
@@ -239,7 +261,12 @@ vfs_symlink(const char *contents, char *path)
 		return result;
 	}
 
+	vfs_biglock_acquire();
 	result = VOP_SYMLINK(newdir, newname, contents);
+	if (result == 0) {
+		vfs_ncache_purge(newdir, newname);
+	}
+	vfs_biglock_release();
 	VOP_DECREF(newdir);
 
 	return result;
@@ -285,7 +312,12 @@ vfs_mkdir(char *path, mode_t mode)
 		return result;
 	}
 
+	vfs_biglock_acquire();
 	result = VOP_MKDIR(parent, name, mode);
+	if (result == 0) {
+		vfs_ncache_purge(parent, name);
+	}
+	vfs_biglock_release();
 
 	VOP_DECREF(parent);
 
@@ -307,7 +339,13 @@ vfs_rmdir(char *path)
 		return result;
 	}
 
+	vfs_biglock_acquire();
 	result = VOP_RMDIR(parent, name);
+	if (result == 0) {
+		/* also drops whatever was cached under the directory */
+		vfs_ncache_purge(parent, name);
+	}
+	vfs_biglock_release();
 
 	VOP_DECREF(parent);
 
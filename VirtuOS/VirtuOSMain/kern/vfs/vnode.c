@@ -32,7 +32,9 @@
  */
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/dirent.h>
 #include <lib.h>
+#include <uio.h>
 #include <synch.h>
 #include <vfs.h>
 #include <vnode.h>
@@ -122,6 +124,58 @@ vnode_decref(struct vnode *vn)
 	}
 }
 
+/*
+ * Generic getdirentries: read names one at a time with
+ * VOP_GETDIRENTRY and pack them into the caller's uio. Nothing here
+ * knows the file types or inode numbers, so they're left unknown.
+ */
+int
+vnode_getdirentries(struct vnode *dir, struct uio *uio)
+{
+	struct dirent de;
+	struct iovec iov;
+	struct uio kuio;
+	size_t namelen, reclen;
+	bool any = false;
+	int result;
+
+	while (1) {
+		uio_kinit(&iov, &kuio, de.d_name, sizeof(de.d_name) - 1,
+			  uio->uio_offset, UIO_READ);
+		result = VOP_GETDIRENTRY(dir, &kuio);
+		if (result) {
+			/* Hand back what we have; the error will recur. */
+			return any ? 0 : result;
+		}
+		namelen = sizeof(de.d_name) - 1 - kuio.uio_resid;
+		if (namelen == 0) {
+			/* end of directory */
+			break;
+		}
+
+		reclen = _DIRENT_RECLEN(namelen);
+		if (reclen > uio->uio_resid) {
+			/* uio_offset still names this entry */
+			return any ? 0 : EINVAL;
+		}
+
+		de.d_ino = 0;
+		de.d_reclen = reclen;
+		de.d_type = DT_UNKNOWN;
+		de.d_namlen = namelen;
+		bzero(de.d_name + namelen, reclen - 8 - namelen);
+
+		result = uiomove(&de, reclen, uio);
+		if (result) {
+			return result;
+		}
+		/* uiomove advanced the offset by bytes; use the fs's */
+		uio->uio_offset = kuio.uio_offset;
+		any = true;
+	}
+	return 0;
+}
+
 /*
  * Check for various things being valid.
  * Called before all VOP_* calls.
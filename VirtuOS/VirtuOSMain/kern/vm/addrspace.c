@@ -39,6 +39,7 @@
 #include <vm.h>
 #include <proc.h>
 #include <elf.h>
+#include <shm.h>
 #include <../arch/mips/include/vm.h>
 
 /*
@@ -90,6 +91,17 @@ struct addrspace * as_create(void) {
 	as->Proc_heap->Heap_lock =  lock_create("Heap Lock created for forking and atomicity");
 	as->File_region_base = 	NULL;
 	as->File_region_end = NULL;
+	as->Shm_region_base = NULL;
+
+	// Serializes faults (and copies) from threads sharing the space
+	as->as_lock = lock_create("addrspace");
+	if (as->as_lock == NULL) {
+		Page_table_free(as->PageTable);
+		lock_destroy(as->Proc_heap->Heap_lock);
+		kfree(as->Proc_heap);
+		kfree(as);
+		return NULL;
+	}
 	return as;
 }
 
@@ -125,8 +137,28 @@ int as_copy(struct addrspace *old, struct addrspace **ret) {
 	newas->Proc_heap->cur_heap_break = old->Proc_heap->cur_heap_break;
 	
 
-	/* Copy the pagetable from old to new */
+	/* Copy the shared mappings and the pagetable from old to new;
+	 * other threads of the old process may be faulting pages in or
+	 * mapping things while we do */
+	lock_acquire(old->as_lock);
+	int err_shm_copy = Shm_region_copy(old, newas);
+
+	if (err_shm_copy) {
+		lock_release(old->as_lock);
+		as_destroy(newas);
+		return err_shm_copy;
+	}
+
 	int copy_pt = Page_table_copy(old->PageTable, newas->PageTable);
+
+	/* Page_table_copy made the parent's pages read-only, but the
+	 * TLBs, ours and those of cpus running our other threads, may
+	 * still hold writable entries for them. Flush before anyone can
+	 * store into a frame now shared with the child. The flush covers
+	 * the whole TLB, so the address doesn't matter. */
+	as_activate();
+	vm_shootdown_others(0);
+	lock_release(old->as_lock);
 	
 	if (copy_pt) {
 		as_destroy(newas);
@@ -163,6 +195,19 @@ void as_destroy(struct addrspace *as) {
 	
 	// Free page table entries
 	Page_table_free(as->PageTable);
+
+	// Drop the shared mappings; the page table has already let go
+	// of their frames.
+	Shm_Region_t shm_curr = as->Shm_region_base;
+	
+	while (shm_curr != NULL) {
+		Shm_Region_t shm_destroy = shm_curr;
+		shm_curr = shm_curr->next;
+		shmobj_decref(shm_destroy->obj);
+		kfree(shm_destroy);
+	}
+
+	lock_destroy(as->as_lock);
 	kfree(as->Proc_heap);
 	kfree(as);
 
@@ -368,6 +413,56 @@ int as_define_stack(struct addrspace *as, vaddr_t *stackptr) {
 	return SUCCESS;
 }
 
+// Hand back the kernel address of the page holding VADDR in the stack
+// of AS, giving it a zeroed frame first if it has none. This lets exec
+// write the arguments straight into the new stack while the old
+// address space is still the current one.
+int as_stackpage(struct addrspace *as, vaddr_t vaddr, vaddr_t *kvaddr) {
+
+	vaddr &= PAGE_FRAME;
+
+	lock_acquire(as->as_lock);
+
+	Region_t Valid_Region = Lookup_Region(as, vaddr);
+
+	if (Valid_Region == NULL || vaddr < USERSTACK - STACK_LIMIT) {
+		lock_release(as->as_lock);
+		return EFAULT;
+	}
+
+	paddr_t entry = Page_table_lookup(as, vaddr);
+
+	if (entry == 0) {
+
+		vaddr_t allocated_addr = alloc_kpages(1);
+
+		if (allocated_addr == 0) {
+			lock_release(as->as_lock);
+			return ENOMEM;
+		}
+
+		as_zero_region(allocated_addr, 1);
+
+		// The stack is read-write, so the entry is valid and dirty
+		entry = (KVADDR_TO_PADDR(allocated_addr) & PAGE_FRAME) | TLBLO_DIRTY | TLBLO_VALID;
+
+		int err_insert = Page_table_Insert(as, (vaddr >> 24) & 0xFF, 
+			(vaddr >> 18) & 0x3F, (vaddr >> 12) & 0x3F, entry);
+
+		if (err_insert) {
+			free_kpages(allocated_addr);
+			lock_release(as->as_lock);
+			return err_insert;
+		}
+	}
+
+	lock_release(as->as_lock);
+
+	*kvaddr = PADDR_TO_KVADDR(entry & PAGE_FRAME);
+
+	return SUCCESS;
+}
+
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
 /////////////// HELPER FUNCTIONS AND ERROR HANDLING FOR ADDRESS SPACE FUNCTIONS////////////////
@@ -625,11 +720,15 @@ vaddr_t as_set_process_break(struct addrspace* as, intptr_t amount, int* err_sbr
 		vaddr_t new_break = as->Proc_heap->cur_heap_break + (vaddr_t) amount;
 		
 		if (new_break < as->Proc_heap->base_heap_addr) {
+			lock_release(as->Proc_heap->Heap_lock);
 			*err_sbrk = EINVAL;
 			return (vaddr_t) NULL;
 		}
 
-		if (new_break >= USERSTACK - STACK_LIMIT) {
+		// The heap can grow up to the lowest shared mapping, or to
+		// the stack if there are none.
+		if (new_break >= Shm_region_floor(as)) {
+			lock_release(as->Proc_heap->Heap_lock);
 			*err_sbrk = ENOMEM;
 			return (vaddr_t) NULL;
 		}
@@ -717,9 +816,143 @@ vaddr_t as_mmap_file(struct addrspace* as, size_t length, int prot, int fd, off_
 
 }
 
+///////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////// SHARED MEMORY REGIONS ///////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+// Shared mappings go between the heap and the stack, handed out from
+// the top down, first fit; the list is kept sorted highest first. Both
+// the heap lock and the addrspace lock are held to change the list, so
+// that sbrk (which holds the first) and vm_fault (the second) can each
+// look at it safely.
+
+int as_map_shared(struct addrspace *as, struct shmobj *so, size_t length,
+		bool writeable, vaddr_t *ret) {
+
+	KASSERT(length > 0 && length % PAGE_SIZE == 0);
+
+	Shm_Region_t new_shm = kmalloc(sizeof(struct Shm_Region));
+
+	if (new_shm == NULL) {
+		return ENOMEM;
+	}
+
+	lock_acquire(as->Proc_heap->Heap_lock);
+	lock_acquire(as->as_lock);
+
+	// Lowest address we can use: the heap break, or the end of the
+	// data segment if there's no heap yet.
+	vaddr_t bottom = as->Proc_heap->cur_heap_break;
+
+	if (bottom == (vaddr_t) NULL && as->addr_region_end != NULL) {
+		bottom = as->addr_region_end->end_addr + 1;
+	}
+	bottom = ROUNDUP(bottom, PAGE_SIZE);
+
+	// Walk down from the stack looking for a gap big enough.
+	vaddr_t top = USERSTACK - STACK_LIMIT;
+	Shm_Region_t *link = &as->Shm_region_base;
+
+	while (*link != NULL && top - (*link)->end_addr < length) {
+		top = (*link)->base_addr;
+		link = &(*link)->next;
+	}
+
+	if (top < bottom || top - bottom < length) {
+		lock_release(as->as_lock);
+		lock_release(as->Proc_heap->Heap_lock);
+		kfree(new_shm);
+		return ENOMEM;
+	}
+
+	new_shm->base_addr = top - length;
+	new_shm->end_addr = top;
+	new_shm->writeable = writeable;
+	new_shm->obj = so;
+	new_shm->next = *link;
+	*link = new_shm;
+
+	lock_release(as->as_lock);
+	lock_release(as->Proc_heap->Heap_lock);
+
+	*ret = new_shm->base_addr;
+	return SUCCESS;
+}
+
+int as_unmap_shared(struct addrspace *as, vaddr_t vaddr) {
+
+	lock_acquire(as->Proc_heap->Heap_lock);
+	lock_acquire(as->as_lock);
+
+	Shm_Region_t *link = &as->Shm_region_base;
+
+	while (*link != NULL && (*link)->base_addr != vaddr) {
+		link = &(*link)->next;
+	}
+
+	if (*link == NULL) {
+		lock_release(as->as_lock);
+		lock_release(as->Proc_heap->Heap_lock);
+		return EINVAL;
+	}
+
+	Shm_Region_t old_shm = *link;
+	*link = old_shm->next;
+
+	// Drop the pages this space had touched, here and in the TLBs.
+	// This waits for the other cpus to flush, so once it returns
+	// the object's frames can be freed.
+	Page_table_unmap(as, old_shm->base_addr, old_shm->end_addr);
+
+	lock_release(as->as_lock);
+	lock_release(as->Proc_heap->Heap_lock);
+
+	shmobj_decref(old_shm->obj);
+	kfree(old_shm);
+	return SUCCESS;
+}
+
+// Copies the shared mappings for as_copy, in the same order, taking a
+// reference to each object. The page table entries are copied along
+// with the rest of the page table. On error the caller destroys newas,
+// which cleans up whatever got copied.
+int Shm_region_copy (struct addrspace* old, struct addrspace* newas) {
 
+	Shm_Region_t *tail = &newas->Shm_region_base;
 
+	for (Shm_Region_t old_shm = old->Shm_region_base;
+		old_shm != NULL; old_shm = old_shm->next) {
 
+		Shm_Region_t temp = kmalloc(sizeof(struct Shm_Region));
 
+		if (temp == NULL) {
+			return ENOMEM;
+		}
+
+		temp->base_addr = old_shm->base_addr;
+		temp->end_addr = old_shm->end_addr;
+		temp->writeable = old_shm->writeable;
+		temp->obj = old_shm->obj;
+		temp->next = NULL;
+		shmobj_incref(temp->obj);
+
+		*tail = temp;
+		tail = &temp->next;
+	}
 
+	return SUCCESS;
+}
 
+// Returns the bottom of the lowest shared mapping, or of the stack if
+// there are none; the heap must stay below it. Call with either the
+// heap lock or the addrspace lock held.
+vaddr_t Shm_region_floor (struct addrspace* as) {
+
+	vaddr_t floor = USERSTACK - STACK_LIMIT;
+
+	for (Shm_Region_t shm = as->Shm_region_base; shm != NULL; shm = shm->next) {
+		floor = shm->base_addr;
+	}
+
+	return floor;
+}
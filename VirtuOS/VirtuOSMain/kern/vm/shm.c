@@ -0,0 +1,427 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Shared memory objects.
+ *
+ * An object is just an array of frames, filled in as the pages are
+ * first touched, and a reference count: one reference per mapping
+ * (see as_map_shared) and one for the name, if it has one. Page table
+ * entries for the frames hold frame references of their own, so the
+ * frames stay put until the last mapping's page table lets go of them
+ * even if the object is gone by then.
+ *
+ * Named objects live on a list protected by shm_lock. An object on
+ * the list always holds its name reference, so lookups can take a
+ * reference without worrying about the object going away.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <limits.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <synch.h>
+#include <copyinout.h>
+#include <proc.h>
+#include <addrspace.h>
+#include <vm.h>
+#include <shm.h>
+#include <syscall.h>
+
+struct shmobj {
+	char *so_name;			/* name, or NULL if anonymous */
+	unsigned so_npages;		/* size in pages */
+	paddr_t *so_pages;		/* frames, or 0 if not touched yet */
+	struct spinlock so_lock;	/* protects so_pages and refcount */
+	unsigned so_refcount;		/* mappings, plus one for the name */
+	struct shmobj *so_next;		/* next on the named list */
+};
+
+static struct lock *shm_lock;
+static struct shmobj *shm_named;
+
+/*
+ * Setup.
+ */
+void
+shm_bootstrap(void)
+{
+	shm_lock = lock_create("shm");
+	if (shm_lock == NULL) {
+		panic("shm_bootstrap: Out of memory\n");
+	}
+	shm_named = NULL;
+}
+
+////////////////////////////////////////////////////////////
+//
+// Objects
+//
+
+static
+struct shmobj *
+shmobj_create(const char *name, size_t size)
+{
+	struct shmobj *so;
+	unsigned i;
+
+	so = kmalloc(sizeof(*so));
+	if (so == NULL) {
+		return NULL;
+	}
+	if (name != NULL) {
+		so->so_name = kstrdup(name);
+		if (so->so_name == NULL) {
+			kfree(so);
+			return NULL;
+		}
+	}
+	else {
+		so->so_name = NULL;
+	}
+	so->so_npages = DIVROUNDUP(size, PAGE_SIZE);
+	so->so_pages = kmalloc(so->so_npages * sizeof(paddr_t));
+	if (so->so_pages == NULL) {
+		kfree(so->so_name);
+		kfree(so);
+		return NULL;
+	}
+	for (i=0; i<so->so_npages; i++) {
+		so->so_pages[i] = 0;
+	}
+	spinlock_init(&so->so_lock);
+	so->so_refcount = 1;
+	so->so_next = NULL;
+	return so;
+}
+
+static
+void
+shmobj_destroy(struct shmobj *so)
+{
+	unsigned i;
+
+	for (i=0; i<so->so_npages; i++) {
+		if (so->so_pages[i] != 0) {
+			free_kpages(PADDR_TO_KVADDR(so->so_pages[i]));
+		}
+	}
+	spinlock_cleanup(&so->so_lock);
+	kfree(so->so_pages);
+	kfree(so->so_name);
+	kfree(so);
+}
+
+/*
+ * Find a named object. Call with shm_lock held. If PREVP is not
+ * NULL, it gets the link pointing at the object, for unlinking.
+ */
+static
+struct shmobj *
+shmobj_find(const char *name, struct shmobj ***prevp)
+{
+	struct shmobj **sop;
+
+	KASSERT(lock_do_i_hold(shm_lock));
+
+	for (sop = &shm_named; *sop != NULL; sop = &(*sop)->so_next) {
+		if (!strcmp((*sop)->so_name, name)) {
+			if (prevp != NULL) {
+				*prevp = sop;
+			}
+			return *sop;
+		}
+	}
+	return NULL;
+}
+
+int
+shmobj_open(const char *name, int flags, size_t size, struct shmobj **ret)
+{
+	struct shmobj *so;
+
+	if (size > SHM_MAXSIZE) {
+		return EINVAL;
+	}
+
+	if (name == NULL) {
+		if (size == 0) {
+			return EINVAL;
+		}
+		so = shmobj_create(NULL, size);
+		if (so == NULL) {
+			return ENOMEM;
+		}
+		*ret = so;
+		return 0;
+	}
+
+	lock_acquire(shm_lock);
+	so = shmobj_find(name, NULL);
+	if (so != NULL) {
+		if ((flags & O_CREAT) && (flags & O_EXCL)) {
+			lock_release(shm_lock);
+			return EEXIST;
+		}
+		if (size > shmobj_size(so)) {
+			lock_release(shm_lock);
+			return EINVAL;
+		}
+		shmobj_incref(so);
+		lock_release(shm_lock);
+		*ret = so;
+		return 0;
+	}
+
+	if (!(flags & O_CREAT)) {
+		lock_release(shm_lock);
+		return ENOENT;
+	}
+	if (size == 0) {
+		lock_release(shm_lock);
+		return EINVAL;
+	}
+	so = shmobj_create(name, size);
+	if (so == NULL) {
+		lock_release(shm_lock);
+		return ENOMEM;
+	}
+	/* one reference for the name, one for the caller */
+	so->so_refcount = 2;
+	so->so_next = shm_named;
+	shm_named = so;
+	lock_release(shm_lock);
+
+	*ret = so;
+	return 0;
+}
+
+int
+shmobj_unlink(const char *name)
+{
+	struct shmobj *so, **prev;
+
+	lock_acquire(shm_lock);
+	so = shmobj_find(name, &prev);
+	if (so == NULL) {
+		lock_release(shm_lock);
+		return ENOENT;
+	}
+	*prev = so->so_next;
+	so->so_next = NULL;
+	lock_release(shm_lock);
+
+	/* drop the name's reference */
+	shmobj_decref(so);
+	return 0;
+}
+
+void
+shmobj_incref(struct shmobj *so)
+{
+	spinlock_acquire(&so->so_lock);
+	KASSERT(so->so_refcount > 0);
+	so->so_refcount++;
+	spinlock_release(&so->so_lock);
+}
+
+void
+shmobj_decref(struct shmobj *so)
+{
+	bool destroy;
+
+	spinlock_acquire(&so->so_lock);
+	KASSERT(so->so_refcount > 0);
+	so->so_refcount--;
+	destroy = so->so_refcount == 0;
+	spinlock_release(&so->so_lock);
+
+	if (destroy) {
+		shmobj_destroy(so);
+	}
+}
+
+size_t
+shmobj_size(struct shmobj *so)
+{
+	/* constant, so no lock needed */
+	return (size_t)so->so_npages * PAGE_SIZE;
+}
+
+/*
+ * Two processes can fault on the same new page at once; allocate
+ * outside the lock and let the loser free its frame.
+ */
+int
+shmobj_getpage(struct shmobj *so, unsigned index, paddr_t *ret)
+{
+	vaddr_t kva;
+	paddr_t pa;
+
+	KASSERT(index < so->so_npages);
+
+	spinlock_acquire(&so->so_lock);
+	pa = so->so_pages[index];
+	spinlock_release(&so->so_lock);
+	if (pa != 0) {
+		*ret = pa;
+		return 0;
+	}
+
+	kva = alloc_kpages(1);
+	if (kva == 0) {
+		return ENOMEM;
+	}
+	bzero((void *)kva, PAGE_SIZE);
+
+	spinlock_acquire(&so->so_lock);
+	pa = so->so_pages[index];
+	if (pa == 0) {
+		pa = KVADDR_TO_PADDR(kva);
+		so->so_pages[index] = pa;
+		kva = 0;
+	}
+	spinlock_release(&so->so_lock);
+
+	if (kva != 0) {
+		free_kpages(kva);
+	}
+	*ret = pa;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+//
+// System calls
+//
+
+/*
+ * Get a name from userspace.
+ */
+static
+int
+shm_copyinname(const_userptr_t uname, char *buf, size_t len)
+{
+	int result;
+
+	result = copyinstr(uname, buf, len, NULL);
+	if (result) {
+		return result;
+	}
+	if (buf[0] == '\0') {
+		return EINVAL;
+	}
+	return 0;
+}
+
+/*
+ * sys_shm_map
+ *
+ * Map the object called NAME, or a new anonymous object if NAME is
+ * NULL, and return the address it landed at. FLAGS is O_RDONLY or
+ * O_RDWR, plus O_CREAT and O_EXCL as for open. SIZE is the size to
+ * create a new object with, or the amount of an existing one to map
+ * (0 means all of it). Mappings are inherited across fork and are
+ * shared, not copied.
+ */
+int
+sys_shm_map(const_userptr_t uname, int flags, size_t size, int32_t *retval)
+{
+	char name[NAME_MAX+1];
+	struct addrspace *as;
+	struct shmobj *so;
+	vaddr_t addr;
+	int result;
+
+	if ((flags & ~(O_ACCMODE | O_CREAT | O_EXCL)) != 0) {
+		return EINVAL;
+	}
+	if ((flags & O_ACCMODE) == O_WRONLY) {
+		/* no such thing as a write-only page */
+		return EINVAL;
+	}
+
+	if (uname != NULL) {
+		result = shm_copyinname(uname, name, sizeof(name));
+		if (result) {
+			return result;
+		}
+	}
+
+	result = shmobj_open(uname != NULL ? name : NULL, flags, size, &so);
+	if (result) {
+		return result;
+	}
+	if (size == 0) {
+		size = shmobj_size(so);
+	}
+
+	as = proc_getas();
+	result = as_map_shared(as, so, ROUNDUP(size, PAGE_SIZE),
+			       (flags & O_ACCMODE) == O_RDWR, &addr);
+	if (result) {
+		shmobj_decref(so);
+		return result;
+	}
+
+	*retval = addr;
+	return 0;
+}
+
+/*
+ * sys_shm_unmap
+ *
+ * Remove the mapping that starts at ADDR.
+ */
+int
+sys_shm_unmap(userptr_t addr)
+{
+	return as_unmap_shared(proc_getas(), (vaddr_t)addr);
+}
+
+/*
+ * sys_shm_unlink
+ *
+ * Remove NAME from the namespace. Existing mappings are unaffected;
+ * the object goes away when the last of them does.
+ */
+int
+sys_shm_unlink(const_userptr_t uname)
+{
+	char name[NAME_MAX+1];
+	int result;
+
+	result = shm_copyinname(uname, name, sizeof(name));
+	if (result) {
+		return result;
+	}
+	return shmobj_unlink(name);
+}
@@ -5,10 +5,12 @@
 #include <addrspace.h>
 #include <vm.h>
 #include <current.h>
+#include <cpu.h>
 #include <machine/tlb.h>
 #include <synch.h>
 #include <proc.h>
 #include <spl.h>
+#include <shm.h>
 #include <../../userland/include/unistd.h>
 
 /////////////////////////////////////////////////////////////////////////////////////////
@@ -35,16 +37,32 @@ int vm_fault(int faulttype, vaddr_t faultaddress) {
 		return EFAULT;
 	}
 
+    // Threads sharing the address space can fault at the same time;
+    // hold the lock across the lookups and the page table update.
+    lock_acquire(as->as_lock);
+
     Region_t Valid_Region = Lookup_Region(as, faultaddress);
     
     HeapRegion_t Valid_Heap = Lookup_Heap(as, faultaddress);
 
     Mmap_Region_t Valid_File = Lookup_Mmap(as, faultaddress);
 
-    if (Valid_Region == NULL && Valid_Heap == NULL && Valid_File == NULL) {
+    Shm_Region_t Valid_Shm = Lookup_Shm(as, faultaddress);
+
+    if (Valid_Region == NULL && Valid_Heap == NULL && Valid_File == NULL 
+        && Valid_Shm == NULL) {
+        lock_release(as->as_lock);
         return EFAULT;
     }
 
+    // Shared pages are never copied on write, so they get their own
+    // handler.
+    if (Valid_Shm != NULL) {
+        int err_shm = Shm_fault(faulttype, faultaddress, as, Valid_Shm);
+        lock_release(as->as_lock);
+        return err_shm;
+    }
+
     int miss_tlb = SUCCESS;
 
     // If we get VM_FAULT_READONLY retrun EFUALT otherwise deal with the
@@ -54,6 +72,7 @@ int vm_fault(int faulttype, vaddr_t faultaddress) {
         case VM_FAULT_READONLY:
                 
                 if (Valid_Region->is_readonly == true) {
+                    lock_release(as->as_lock);
                     return EFAULT; 
                 }
                 
@@ -61,8 +80,10 @@ int vm_fault(int faulttype, vaddr_t faultaddress) {
                     int err_copy_on_write = copy_on_write(as, faultaddress);
 
                     if (err_copy_on_write) {
+                        lock_release(as->as_lock);
                         return err_copy_on_write;
                     }
+                    vm_shootdown_others(faultaddress);
                 }
             
             
@@ -77,7 +98,8 @@ int vm_fault(int faulttype, vaddr_t faultaddress) {
     }
 
     miss_tlb = tlb_miss_handler(faultaddress, as, Valid_Region, Valid_Heap, Valid_File);
-    
+
+    lock_release(as->as_lock);
     return miss_tlb;
 
 }
@@ -86,11 +108,37 @@ int vm_fault(int faulttype, vaddr_t faultaddress) {
  * SMP-specific functions.  Unused in our UNSW configuration.
  */
 
+// Other threads of a process can have a stale read-only mapping of
+// a page whose copy-on-write we just broke. There are no ASIDs, so
+// just drop the whole TLB; that also makes it safe for
+// ipi_tlbshootdown to coalesce requests.
 void vm_tlbshootdown(const struct tlbshootdown *ts) {
-	
+
     (void)ts;
-	panic("vm tried to do tlb shootdown?!\n");
 
+    int spl = splhigh();
+
+    for (int i=0; i<NUM_TLB; i++) {
+        tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
+    }
+
+    splx(spl);
+}
+
+// Shoot down the mapping of VADDR on the other cpus, if other
+// threads of this process might be using it, and wait until they
+// have all flushed. (A thread being created concurrently starts with
+// a flushed TLB anyway, so the unlocked look at p_threads is fine.)
+void vm_shootdown_others(vaddr_t vaddr) {
+
+    struct tlbshootdown ts;
+
+    if (threadarray_num(&curproc->p_threads) < 2) {
+        return;
+    }
+
+    ts.ts_vaddr = vaddr & PAGE_FRAME;
+    ipi_tlbshootdown_sync(&ts);
 }
 
 void vm_bootstrap(void) {
@@ -291,6 +339,81 @@ Mmap_Region_t Lookup_Mmap(struct addrspace *as, vaddr_t faultaddress) {
     return NULL;
 }
 
+Shm_Region_t Lookup_Shm(struct addrspace *as, vaddr_t faultaddress) {
+
+    Shm_Region_t Shm_addr_proc = as->Shm_region_base;
+
+    while (Shm_addr_proc != NULL) {
+        if (faultaddress >= Shm_addr_proc->base_addr && 
+            faultaddress < Shm_addr_proc->end_addr) {
+            return Shm_addr_proc;
+        }
+        Shm_addr_proc = Shm_addr_proc->next;
+    }
+
+    return NULL;
+}
+
+// Handles every fault on a shared memory region. On a miss the page
+// comes from the shared object, so all the spaces mapping it end up
+// with the same frame; the page table entry holds a frame reference of
+// its own. A write to a read-only entry just means fork cleared the
+// dirty bit (it does that to every page it copies), so put it back
+// instead of copying.
+int Shm_fault(int faulttype, vaddr_t faultaddress, struct addrspace* as, Shm_Region_t Valid_Shm) {
+
+    if (faulttype != VM_FAULT_READ && !Valid_Shm->writeable) {
+        return EFAULT;
+    }
+
+    paddr_t entry_lo = Page_table_lookup(as, faultaddress);
+
+    // Same index split as Page_table_lookup
+    vaddr_t page_number = faultaddress & TLBHI_VPAGE;
+    uint32_t TLI = (page_number >> 12) & 0x3F;
+    uint32_t SLI = (page_number >> 18) & 0x3F;
+    uint32_t FLI = (page_number >> 24) & 0xFF;
+
+    if (entry_lo == 0) {
+
+        paddr_t frame_no;
+        unsigned index = (page_number - Valid_Shm->base_addr) / PAGE_SIZE;
+
+        int err_page = shmobj_getpage(Valid_Shm->obj, index, &frame_no);
+
+        if (err_page) {
+            return err_page;
+        }
+
+        entry_lo = frame_no | TLBLO_VALID;
+        
+        if (Valid_Shm->writeable) {
+            entry_lo |= TLBLO_DIRTY;
+        }
+
+        int err_insert = Page_table_Insert(as, FLI, SLI, TLI, entry_lo);
+
+        if (err_insert) {
+            return err_insert;
+        }
+        frame_ref_increase(frame_no);
+    }
+
+    else if (faulttype == VM_FAULT_READONLY) {
+
+        // Flush our stale read-only entry so the reload below can't
+        // duplicate it. Other cpus that still have one will fault on
+        // their next write, find the dirty bit set, and reload.
+        entry_lo |= TLBLO_DIRTY;
+        as->PageTable->Pages[FLI][SLI][TLI] = entry_lo;
+        as_activate();
+    }
+
+    Load_TLB((uint32_t) page_number, (uint32_t) entry_lo);
+
+    return SUCCESS;
+}
+
 // Allocates teh frame for the new entry and add the page table entry for the same, and 
 // then LOAD the TLB entry for it.
 int Alloc_Frame_Insert_PTE(vaddr_t faultaddress, struct addrspace* as, Region_t as_req, HeapRegion_t as_hreq, Mmap_Region_t as_Freq) {
@@ -701,6 +824,40 @@ int Page_table_Add (vaddr_t faultaddress, paddr_t frame_no, Region_t as_reg, Hea
 
 }
 
+////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////// PAGE_TABLE_UNMAP AND ASSOCIATED HELPER FUNCS. //////////////////
+////////////////////////////////////////////////////////////////////////////////////////
+
+// Flushes the translations for [base_addr, end_addr) out of the TLBs,
+// this cpu's and any other running a thread of this process, then
+// clears the entries and drops their frame references. The caller
+// holds as_lock, so nobody can reload a translation in between, and
+// once we return no cpu can still reach the frames.
+void Page_table_unmap(struct addrspace *as, vaddr_t base_addr, vaddr_t end_addr) {
+
+    as_activate();
+    vm_shootdown_others(base_addr);
+
+    for (vaddr_t vaddr = base_addr; vaddr < end_addr; vaddr += PAGE_SIZE) {
+
+        uint32_t TLI = (vaddr >> 12) & 0x3F;
+        uint32_t SLI = (vaddr >> 18) & 0x3F;
+        uint32_t FLI = (vaddr >> 24) & 0xFF;
+
+        if (as->PageTable->Pages[FLI] == NULL || 
+            as->PageTable->Pages[FLI][SLI] == NULL) {
+            continue;
+        }
+
+        paddr_t entry = as->PageTable->Pages[FLI][SLI][TLI];
+
+        if (entry != 0) {
+            as->PageTable->Pages[FLI][SLI][TLI] = 0;
+            free_kpages(PADDR_TO_KVADDR(entry & PAGE_FRAME));
+        }
+    }
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////
 /////////////////////// PAGE_TABLE_FREE AND ASSOCIATED HELPER FUNCS. ///////////////////
 ////////////////////////////////////////////////////////////////////////////////////////
@@ -31,6 +31,7 @@
 #include <sys/stat.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <dirent.h>
 #include <string.h>
 #include <errno.h>
 #include <err.h>
@@ -52,6 +53,15 @@ static int lopt=0;
 static int Ropt=0;
 static int sopt=0;
 
+/*
+ * Buffer for getdirentries. The union keeps it aligned for the
+ * records; each one is a multiple of 4 bytes long, so they all are.
+ */
+union dirbuf {
+	struct dirent de;
+	char bytes[1024];
+};
+
 /* Process an option character. */
 static
 void
@@ -86,24 +96,17 @@ basename(const char *path)
 
 /*
  * Utility function to check if a name refers to a directory.
+ * NAME is looked up in DIRFD; PATH is its full name, for errors.
  */
 static
 int
-isdir(const char *path)
+isdir(int dirfd, const char *name, const char *path)
 {
 	struct stat buf;
-	int fd;
 
-	/* Assume stat() may not be implemented; use fstat */
-	fd = open(path, O_RDONLY);
-	if (fd<0) {
+	if (fstatat(dirfd, name, &buf, 0)<0) {
 		err(1, "%s", path);
 	}
-	if (fstat(fd, &buf)<0) {
-		err(1, "%s: fstat", path);
-	}
-	close(fd);
-
 	return S_ISDIR(buf.st_mode);
 }
 
@@ -127,31 +130,24 @@ printheader(const char *file)
 }
 
 /*
- * Show a single file.
+ * Show a single file, NAME in the directory DIRFD (full name PATH).
  * We don't do the neat multicolumn listing that Unix ls does.
  */
 static
 void
-print(const char *path)
+print(int dirfd, const char *name, const char *path)
 {
 	struct stat statbuf;
 	const char *file;
 	int typech;
 
 	if (lopt || sopt) {
-		int fd;
-
-		fd = open(path, O_RDONLY);
-		if (fd<0) {
+		if (fstatat(dirfd, name, &statbuf, 0)<0) {
 			err(1, "%s", path);
 		}
-		if (fstat(fd, &statbuf)<0) {
-			err(1, "%s: fstat", path);
-		}
-		close(fd);
 	}
 
-	file = basename(path);
+	file = basename(name);
 
 	if (sopt) {
 		printf("%3d ", statbuf.st_blocks);
@@ -193,9 +189,10 @@ void
 listdir(const char *path, int showheader)
 {
 	int fd;
-	char buf[1024];
+	union dirbuf buf;
+	struct dirent *de;
 	char newpath[1024];
-	ssize_t len;
+	ssize_t len, pos;
 
 	if (showheader) {
 		printheader(path);
@@ -212,19 +209,24 @@ listdir(const char *path, int showheader)
 	/*
 	 * List the directory.
 	 */
-	while ((len = getdirentry(fd, buf, sizeof(buf)-1)) > 0) {
-		buf[len] = 0;
+	while ((len = getdirentries(fd, &buf, sizeof(buf))) > 0) {
+		for (pos = 0; pos < len; pos += de->d_reclen) {
+			de = (struct dirent *)(buf.bytes + pos);
 
-		/* Assemble the full name of the new item */
-		snprintf(newpath, sizeof(newpath), "%s/%s", path, buf);
+			if (!aopt && de->d_name[0]=='.') {
+				continue;
+			}
+
+			/* Assemble the full name of the new item */
+			snprintf(newpath, sizeof(newpath), "%s/%s",
+				 path, de->d_name);
 
-		if (aopt || buf[0]!='.') {
 			/* Print it */
-			print(newpath);
+			print(fd, de->d_name, newpath);
 		}
 	}
 	if (len<0) {
-		err(1, "%s: getdirentry", path);
+		err(1, "%s: getdirentries", path);
 	}
 
 	/* Done */
@@ -236,9 +238,10 @@ void
 recursedir(const char *path)
 {
 	int fd;
-	char buf[1024];
+	union dirbuf buf;
+	struct dirent *de;
 	char newpath[1024];
-	int len;
+	ssize_t len, pos;
 
 	/*
 	 * Open it.
@@ -251,29 +254,39 @@ recursedir(const char *path)
 	/*
 	 * List the directory.
 	 */
-	while ((len = getdirentry(fd, buf, sizeof(buf)-1)) > 0) {
-		buf[len] = 0;
+	while ((len = getdirentries(fd, &buf, sizeof(buf))) > 0) {
+		for (pos = 0; pos < len; pos += de->d_reclen) {
+			de = (struct dirent *)(buf.bytes + pos);
 
-		/* Assemble the full name of the new item */
-		snprintf(newpath, sizeof(newpath), "%s/%s", path, buf);
+			if (!aopt && de->d_name[0]=='.') {
+				/* skip this one */
+				continue;
+			}
 
-		if (!aopt && buf[0]=='.') {
-			/* skip this one */
-			continue;
-		}
+			if (!strcmp(de->d_name, ".") ||
+			    !strcmp(de->d_name, "..")) {
+				/* always skip these */
+				continue;
+			}
 
-		if (!strcmp(buf, ".") || !strcmp(buf, "..")) {
-			/* always skip these */
-			continue;
-		}
+			/* Assemble the full name of the new item */
+			snprintf(newpath, sizeof(newpath), "%s/%s",
+				 path, de->d_name);
 
-		if (!isdir(newpath)) {
-			continue;
-		}
+			/* Only stat it if the filesystem didn't say */
+			if (de->d_type == DT_UNKNOWN) {
+				if (!isdir(fd, de->d_name, newpath)) {
+					continue;
+				}
+			}
+			else if (de->d_type != DT_DIR) {
+				continue;
+			}
 
-		listdir(newpath, 1 /*showheader*/);
-		if (Ropt) {
-			recursedir(newpath);
+			listdir(newpath, 1 /*showheader*/);
+			if (Ropt) {
+				recursedir(newpath);
+			}
 		}
 	}
 	if (len<0) {
@@ -287,14 +300,14 @@ static
 void
 listitem(const char *path, int showheader)
 {
-	if (!dopt && isdir(path)) {
+	if (!dopt && isdir(AT_FDCWD, path, path)) {
 		listdir(path, showheader || Ropt);
 		if (Ropt) {
 			recursedir(path);
 		}
 	}
 	else {
-		print(path);
+		print(AT_FDCWD, path, path);
 	}
 }
 
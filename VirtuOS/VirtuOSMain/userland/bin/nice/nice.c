@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+
+/*
+ * nice - run a program at a different scheduling priority.
+ * Usage: nice [-n increment] program [args...]
+ *
+ * Adds INCREMENT (default 10) to our nice value and execs the
+ * program, which inherits it. Positive increments make the program
+ * yield to everything else; negative ones do the opposite.
+ */
+
+static
+void
+usage(void)
+{
+	errx(1, "Usage: nice [-n increment] program [args...]");
+}
+
+int
+main(int argc, char *argv[])
+{
+	int incr = 10;
+	int i = 1;
+
+	if (argc > 1 && !strcmp(argv[1], "-n")) {
+		if (argc < 3) {
+			usage();
+		}
+		incr = atoi(argv[2]);
+		i = 3;
+	}
+	if (i >= argc) {
+		usage();
+	}
+
+	errno = 0;
+	if (nice(incr) == -1 && errno != 0) {
+		err(1, "nice");
+	}
+
+	execvp(argv[i], &argv[i]);
+	err(1, "%s", argv[i]);
+}
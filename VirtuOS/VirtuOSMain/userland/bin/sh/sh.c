@@ -73,18 +73,21 @@ static int timing = 0;
 #define MAXBG 128
 static pid_t bgpids[MAXBG];
 
+/* most commands in one pipeline */
+#define MAXPIPE 16
+
 /*
  * can_bg
- * just checks for an open slot.
+ * just checks for enough open slots.
  */
 static
 int
-can_bg(void)
+can_bg(int njobs)
 {
 	int i;
 
 	for (i = 0; i < MAXBG; i++) {
-		if (bgpids[i] == 0) {
+		if (bgpids[i] == 0 && --njobs == 0) {
 			return 1;
 		}
 	}
@@ -340,6 +343,48 @@ cmd_exit(int ac, char *av[], struct exitinfo *ei)
 	exit(code);
 }
 
+/*
+ * spawn
+ * forks and runs one command of a pipeline. in the child, INFD and
+ * OUTFD (if not -1) become stdin and stdout, and CLOSEFD (the other
+ * end of the output pipe) is closed. returns the pid, or -1.
+ */
+static
+pid_t
+spawn(char **args, int infd, int outfd, int closefd)
+{
+	pid_t pid;
+
+	pid = fork();
+	if (pid != 0) {
+		/* error or parent */
+		return pid;
+	}
+
+	/* child */
+	if (infd >= 0) {
+		dup2(infd, STDIN_FILENO);
+		close(infd);
+	}
+	if (outfd >= 0) {
+		dup2(outfd, STDOUT_FILENO);
+		close(outfd);
+	}
+	if (closefd >= 0) {
+		close(closefd);
+	}
+	execvp(args[0], args);
+	warn("%s", args[0]);
+	/*
+	 * Use _exit() instead of exit() in the child
+	 * process to avoid calling atexit() functions,
+	 * which would cause hostcompat (if present) to
+	 * reset the tty state and mess up our input
+	 * handling.
+	 */
+	_exit(1);
+}
+
 /*
  * a struct of the builtins associates the builtin name with the function that
  * executes it.  they must all take an argc and argv.
@@ -359,17 +404,20 @@ static struct {
  * docommand
  * tokenizes the command line using strtok.  if there aren't any commands,
  * simply returns.  checks to see if it's a builtin, running it if it is.
- * otherwise, it's a standard command.  check for the '&', try to background
- * the job if possible, otherwise just run it and wait on it.
+ * otherwise, it's a standard command, or several joined with '|' into a
+ * pipeline.  check for the '&', try to background the job if possible,
+ * otherwise just run it and wait on it.
  */
 static
 void
 docommand(char *buf, struct exitinfo *ei)
 {
 	char *args[NARG_MAX + 1];
-	int nargs, i;
+	char **cmds[MAXPIPE];
+	pid_t pids[MAXPIPE];
+	int nargs, ncmds, started, i;
+	int fds[2], infd;
 	char *s;
-	pid_t pid;
 	int status;
 	int bg=0;
 	time_t startsecs, endsecs;
@@ -405,60 +453,97 @@ docommand(char *buf, struct exitinfo *ei)
 
 	if (nargs > 0 && !strcmp(args[nargs-1], "&")) {
 		/* background */
-		if (!can_bg()) {
-			printf("%s: Too many background jobs; wait for "
-			       "some to finish before starting more\n",
-			       args[0]);
-			exitinfo_exit(ei, 1);
-			return;
-		}
 		nargs--;
 		args[nargs] = NULL;
 		bg = 1;
 	}
 
+	/* split into a pipeline at each "|" */
+	ncmds = 0;
+	cmds[ncmds++] = args;
+	for (i=0; i<nargs; i++) {
+		if (!strcmp(args[i], "|")) {
+			if (ncmds >= MAXPIPE) {
+				printf("%s: Too many commands in pipeline\n",
+				       args[0]);
+				exitinfo_exit(ei, 1);
+				return;
+			}
+			args[i] = NULL;
+			cmds[ncmds++] = &args[i+1];
+		}
+	}
+	for (i=0; i<ncmds; i++) {
+		if (cmds[i][0] == NULL) {
+			printf("Missing command in pipeline\n");
+			exitinfo_exit(ei, 1);
+			return;
+		}
+	}
+
+	if (bg && !can_bg(ncmds)) {
+		printf("%s: Too many background jobs; wait for "
+		       "some to finish before starting more\n",
+		       args[0]);
+		exitinfo_exit(ei, 1);
+		return;
+	}
+
 	if (timing) {
 		__time(&startsecs, &startnsecs);
 	}
 
-	pid = fork();
-	switch (pid) {
-		case -1:
-			/* error */
+	/*
+	 * Start each command with its stdin hooked to the previous
+	 * one's pipe. The parent closes its copies of the pipe ends as
+	 * it goes, so each reader sees EOF when its writer exits.
+	 */
+	infd = -1;
+	for (started=0; started<ncmds; started++) {
+		fds[0] = fds[1] = -1;
+		if (started < ncmds-1 && pipe(fds) < 0) {
+			warn("pipe");
+			break;
+		}
+		pids[started] = spawn(cmds[started], infd, fds[1], fds[0]);
+		if (infd >= 0) {
+			close(infd);
+		}
+		if (fds[1] >= 0) {
+			close(fds[1]);
+		}
+		infd = fds[0];
+		if (pids[started] < 0) {
 			warn("fork");
-			exitinfo_exit(ei, 255);
-			return;
-		case 0:
-			/* child */
-			execvp(args[0], args);
-			warn("%s", args[0]);
-			/*
-			 * Use _exit() instead of exit() in the child
-			 * process to avoid calling atexit() functions,
-			 * which would cause hostcompat (if present) to
-			 * reset the tty state and mess up our input
-			 * handling.
-			 */
-			_exit(1);
-		default:
 			break;
+		}
+	}
+	if (started < ncmds && infd >= 0) {
+		close(infd);
 	}
 
 	/* parent */
 	if (bg) {
-		/* background this command */
-		remember_bg(pid);
-		printf("[%d] %s ... &\n", pid, args[0]);
-		exitinfo_exit(ei, 0);
+		/* background the commands that got started */
+		for (i=0; i<started; i++) {
+			remember_bg(pids[i]);
+		}
+		if (started > 0) {
+			printf("[%d] %s ... &\n", pids[started-1], args[0]);
+		}
+		exitinfo_exit(ei, started < ncmds ? 255 : 0);
 		return;
 	}
 
-	if (waitpid(pid, &status, 0) < 0) {
-		warn("waitpid");
-		exitinfo_exit(ei, 255);
-	}
-	else {
-		readstatus(status, ei);
+	/* the status of a pipeline is that of its last command */
+	exitinfo_exit(ei, 255);
+	for (i=0; i<started; i++) {
+		if (waitpid(pids[i], &status, 0) < 0) {
+			warn("waitpid");
+		}
+		else if (i == ncmds-1) {
+			readstatus(status, ei);
+		}
 	}
 
 	if (timing) {
@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <err.h>
+
+/*
+ * taskset - run a program on a restricted set of cpus.
+ * Usage: taskset mask program [args...]
+ *        taskset
+ *
+ * MASK is a number (0x prefix for hex) with bit N set for each cpu N
+ * the program may run on. The mask is inherited across fork, so
+ * everything the program starts is restricted too. With no
+ * arguments, print our own mask.
+ */
+
+/*
+ * Parse a decimal or 0x-prefixed hex number; 0 means garbage. (libc
+ * doesn't have strtoul.)
+ */
+static
+unsigned
+parsemask(const char *s)
+{
+	unsigned val = 0, base = 10, digit;
+
+	if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+		base = 16;
+		s += 2;
+	}
+	if (*s == 0) {
+		return 0;
+	}
+	for (; *s; s++) {
+		if (*s >= '0' && *s <= '9') {
+			digit = *s - '0';
+		}
+		else if (*s >= 'a' && *s <= 'f') {
+			digit = *s - 'a' + 10;
+		}
+		else if (*s >= 'A' && *s <= 'F') {
+			digit = *s - 'A' + 10;
+		}
+		else {
+			return 0;
+		}
+		if (digit >= base) {
+			return 0;
+		}
+		val = val * base + digit;
+	}
+	return val;
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned mask;
+
+	if (argc == 1) {
+		if (sched_getaffinity(0, &mask) < 0) {
+			err(1, "sched_getaffinity");
+		}
+		printf("0x%x\n", mask);
+		return 0;
+	}
+	if (argc < 3) {
+		errx(1, "Usage: taskset [mask program [args...]]");
+	}
+
+	mask = parsemask(argv[1]);
+	if (mask == 0) {
+		errx(1, "%s: invalid cpu mask", argv[1]);
+	}
+	if (sched_setaffinity(0, mask) < 0) {
+		err(1, "sched_setaffinity");
+	}
+
+	execvp(argv[2], &argv[2]);
+	err(1, "%s", argv[2]);
+}
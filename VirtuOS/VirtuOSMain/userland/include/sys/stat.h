@@ -72,6 +72,13 @@ int fstat(int filehandle, struct stat *buf);
 int stat(const char *path, struct stat *buf);
 int lstat(const char *path, struct stat *buf);
 
+/*
+ * fstatat is stat, but with relative paths looked up from the
+ * directory open on DIRFD, or from the current directory if DIRFD
+ * is AT_FDCWD (see fcntl.h). FLAGS may be 0 or AT_SYMLINK_NOFOLLOW.
+ */
+int fstatat(int dirfd, const char *path, struct stat *buf, int flags);
+
 /*
  * The second argument to mkdir is the mode for the new directory.
  * Unless you're implementing security and permissions, you can
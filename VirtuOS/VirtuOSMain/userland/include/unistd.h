@@ -40,9 +40,13 @@
  */
 #include <kern/fcntl.h>
 #include <kern/ioctl.h>
+#include <kern/iovec.h>
+#include <kern/ioring.h>
 #include <kern/reboot.h>
 #include <kern/seek.h>
+#include <kern/sysstat.h>
 #include <kern/time.h>
+#include <kern/resource.h>	/* needs kern/time.h */
 #include <kern/unistd.h>
 #include <kern/wait.h>
 
@@ -56,6 +60,8 @@
  *     stat:     sys/stat.h
  *     fstat:    sys/stat.h
  *     lstat:    sys/stat.h
+ *     fstatat:  sys/stat.h
+ *     getdirentries: dirent.h
  *     mkdir:    sys/stat.h
  *
  * If this were standard Unix, more prototypes would go in other
@@ -113,6 +119,7 @@ __DEAD void _exit(int code);
 int execv(const char *prog, char *const *args);
 pid_t fork(void);
 pid_t waitpid(pid_t pid, int *returncode, int flags);
+int waitmany(pid_t *pids, int *returncodes, int n, int flags);
 /*
  * Open actually takes either two or three args: the optional third
  * arg is the file mode used for creation. Unless you're implementing
@@ -146,8 +153,33 @@ int symlink(const char *target, const char *linkname);
 ssize_t readlink(const char *path, char *buf, size_t buflen);
 int dup2(int filehandle, int newhandle);
 int pipe(int filehandles[2]);
+int pipe2(int filehandles[2], int flags, size_t size); /* size 0: default */
 int __time(time_t *seconds, unsigned long *nanoseconds);
+int nanosleep(const struct timespec *req, struct timespec *rem);
 ssize_t __getcwd(char *buf, size_t buflen);
+int fallocate(int filehandle, off_t pos, off_t len);
+ssize_t pread(int filehandle, void *buf, size_t size, off_t pos);
+ssize_t pwrite(int filehandle, const void *buf, size_t size, off_t pos);
+ssize_t readv(int filehandle, const struct iovec *iov, int iovcnt);
+ssize_t writev(int filehandle, const struct iovec *iov, int iovcnt);
+int getpriority(int which, pid_t who);
+int setpriority(int which, pid_t who, int prio);
+int sched_setaffinity(pid_t pid, unsigned mask);
+int sched_getaffinity(pid_t pid, unsigned *mask);
+int futex_wait(volatile int *addr, int val, const struct timespec *timeout);
+int futex_wake(volatile int *addr, int count);
+void *shm_map(const char *name, int flags, size_t size); /* name NULL: anon */
+int shm_unmap(void *addr);
+int shm_unlink(const char *name);
+void *ioring_setup(unsigned entries);
+int ioring_enter(unsigned tosubmit);
+int sysstat(struct sysstat_call *buf, unsigned ncalls);
+int sysstat_reset(void);
+int systrace(int on);
+int systrace_read(struct sysstat_trace *buf, unsigned n);
+int __thread_create(void (*entry)(void *), void *arg, void *stacktop);
+int __thread_join(int tid, void **retval);
+__DEAD void __thread_exit(void *retval);
 /* stat - see sys/stat.h */
 /* lstat - see sys/stat.h */
 
@@ -158,6 +190,9 @@ ssize_t __getcwd(char *buf, size_t buflen);
 int execvp(const char *prog, char *const *args); /* calls execv */
 char *getcwd(char *buf, size_t buflen);		/* calls __getcwd */
 time_t time(time_t *seconds);			/* calls __time */
+int nice(int incr);				/* calls [gs]etpriority */
+int thread_create(void *(*func)(void *), void *arg); /* __thread_create */
+int thread_join(int tid, void **retval);	/* calls __thread_join */
 
 /* UNSW versions of mmap() and munmap()
  * This are simplified compared to the standard version on UNIX
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _USYNC_H_
+#define _USYNC_H_
+
+/*
+ * User-level mutexes and semaphores built on futex_wait/futex_wake.
+ *
+ * Both are a single word (or two) of ordinary memory, so they work
+ * between threads of one process and, if placed in memory the
+ * processes really share, between processes. Uncontended operations
+ * are done entirely in userland with atomic instructions; the kernel
+ * is only entered to sleep or to wake a sleeper.
+ *
+ * Initialize with the _init functions or the static initializers.
+ * There is nothing to destroy.
+ */
+
+struct umutex {
+	volatile int um_state;		/* 0 free, 1 held, 2 held w/ waiters */
+};
+
+struct usema {
+	volatile int us_count;		/* current value */
+	volatile int us_waiters;	/* threads in or entering futex_wait */
+};
+
+#define UMUTEX_INITIALIZER	{ 0 }
+#define USEMA_INITIALIZER(n)	{ (n), 0 }
+
+void umutex_init(struct umutex *m);
+void umutex_lock(struct umutex *m);
+int umutex_trylock(struct umutex *m);		/* 0 on success, else -1 */
+void umutex_unlock(struct umutex *m);
+
+void usema_init(struct usema *s, unsigned count);
+void usema_P(struct usema *s);
+int usema_tryP(struct usema *s);		/* 0 on success, else -1 */
+void usema_V(struct usema *s);
+void usema_Vn(struct usema *s, unsigned count);
+
+
+#endif /* _USYNC_H_ */
@@ -41,6 +41,7 @@
 #include <unistd.h>
 #include <err.h>
 #include <assert.h>
+#include <usync.h>
 
 #undef MALLOCDEBUG
 
@@ -348,8 +349,9 @@ __malloc_split(struct mheader *mh, size_t size)
 /*
  * malloc itself.
  */
+static
 void *
-malloc(size_t size)
+__malloc(size_t size)
 {
 	struct mheader *mh;
 	uintptr_t i;
@@ -530,8 +532,9 @@ __malloc_trymerge(struct mheader *mh, struct mheader *mhnext)
 /*
  * The actual free() implementation.
  */
+static
 void
-free(void *x)
+__free(void *x)
 {
 	struct mheader *mh, *mhnext, *mhprev;
 
@@ -589,3 +592,31 @@ free(void *x)
 	__malloc_dump();
 #endif
 }
+
+////////////////////////////////////////////////////////////
+
+/*
+ * Threads of one process share the heap, so take a lock around it.
+ * When there's only one thread this never enters the kernel.
+ */
+static struct umutex __malloc_lock = UMUTEX_INITIALIZER;
+
+void *
+malloc(size_t size)
+{
+	void *p;
+
+	umutex_lock(&__malloc_lock);
+	p = __malloc(size);
+	umutex_unlock(&__malloc_lock);
+	return p;
+}
+
+void
+free(void *x)
+{
+	umutex_lock(&__malloc_lock);
+	__free(x);
+	umutex_unlock(&__malloc_lock);
+}
+
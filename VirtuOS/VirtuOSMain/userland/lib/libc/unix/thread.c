@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2015
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <usync.h>
+
+/*
+ * User-level side of thread_create/thread_join.
+ *
+ * The kernel starts a new thread at whatever entry point and stack
+ * we give it. We malloc the stack, put the user's function and
+ * argument at the top of it, and start the thread in thread_start,
+ * which calls the function and passes its result to __thread_exit.
+ * The stack can't be freed by the thread running on it, so we keep
+ * track of it and thread_join frees it.
+ */
+
+#define THREAD_STACKSIZE	(64*1024)
+
+/* Start-up record, at the top of the new stack */
+struct threadstart {
+	void *(*ts_func)(void *);
+	void *ts_arg;
+};
+
+/* A stack to free when the thread is joined */
+struct threadstack {
+	int tk_tid;
+	void *tk_mem;
+	struct threadstack *tk_next;
+};
+
+static struct umutex stacks_lock = UMUTEX_INITIALIZER;
+static struct threadstack *stacks;
+
+static
+void
+thread_start(void *p)
+{
+	struct threadstart *ts = p;
+
+	__thread_exit(ts->ts_func(ts->ts_arg));
+}
+
+int
+thread_create(void *(*func)(void *), void *arg)
+{
+	struct threadstack *tk;
+	struct threadstart *ts;
+	char *top;
+	int tid;
+
+	tk = malloc(sizeof(*tk));
+	if (tk == NULL) {
+		return -1;
+	}
+	tk->tk_mem = malloc(THREAD_STACKSIZE);
+	if (tk->tk_mem == NULL) {
+		free(tk);
+		return -1;
+	}
+
+	/*
+	 * The start record goes at the very top. Below it leave the
+	 * 16 bytes the calling convention lets thread_start store its
+	 * argument registers in.
+	 */
+	top = (char *)tk->tk_mem + THREAD_STACKSIZE;
+	ts = (struct threadstart *)(top - sizeof(*ts));
+	ts->ts_func = func;
+	ts->ts_arg = arg;
+	top = (char *)ts - 16;
+
+	tid = __thread_create(thread_start, ts, top);
+	if (tid < 0) {
+		free(tk->tk_mem);
+		free(tk);
+		return -1;
+	}
+
+	tk->tk_tid = tid;
+	umutex_lock(&stacks_lock);
+	tk->tk_next = stacks;
+	stacks = tk;
+	umutex_unlock(&stacks_lock);
+
+	return tid;
+}
+
+int
+thread_join(int tid, void **retval)
+{
+	struct threadstack **tkp, *tk;
+
+	if (__thread_join(tid, retval) < 0) {
+		return -1;
+	}
+
+	umutex_lock(&stacks_lock);
+	for (tkp = &stacks; *tkp != NULL; tkp = &(*tkp)->tk_next) {
+		if ((*tkp)->tk_tid == tid) {
+			break;
+		}
+	}
+	tk = *tkp;
+	if (tk != NULL) {
+		*tkp = tk->tk_next;
+	}
+	umutex_unlock(&stacks_lock);
+
+	if (tk != NULL) {
+		free(tk->tk_mem);
+		free(tk);
+	}
+	return 0;
+}
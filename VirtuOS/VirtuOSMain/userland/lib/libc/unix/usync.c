@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2015
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <unistd.h>
+#include <usync.h>
+
+/*
+ * Mutexes and semaphores on top of futexes. See usync.h.
+ *
+ * The atomic operations use LL/SC like the kernel's spinlocks do;
+ * each returns the old value of the word.
+ */
+
+static
+int
+atomic_cas(volatile int *p, int old, int new)
+{
+	int prev, tmp;
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		".set volatile;"	/* avoid unwanted optimization */
+		"1: ll %0, 0(%2);"	/*   prev = *p */
+		"bne %0, %3, 2f;"	/*   if (prev != old) fail */
+		"move %1, %4;"		/*   tmp = new */
+		"sc %1, 0(%2);"		/*   *p = tmp; tmp = success? */
+		"beqz %1, 1b;"		/*   retry if the store failed */
+		"2:"
+		".set pop"		/* restore assembler mode */
+		: "=&r" (prev), "=&r" (tmp)
+		: "r" (p), "r" (old), "r" (new)
+		: "memory");
+	return prev;
+}
+
+static
+int
+atomic_swap(volatile int *p, int new)
+{
+	int prev, tmp;
+
+	__asm volatile(
+		".set push;"
+		".set mips32;"
+		".set volatile;"
+		"1: ll %0, 0(%2);"	/*   prev = *p */
+		"move %1, %3;"		/*   tmp = new */
+		"sc %1, 0(%2);"		/*   *p = tmp; tmp = success? */
+		"beqz %1, 1b;"		/*   retry if the store failed */
+		".set pop"
+		: "=&r" (prev), "=&r" (tmp)
+		: "r" (p), "r" (new)
+		: "memory");
+	return prev;
+}
+
+static
+int
+atomic_add(volatile int *p, int delta)
+{
+	int prev, tmp;
+
+	__asm volatile(
+		".set push;"
+		".set mips32;"
+		".set volatile;"
+		"1: ll %0, 0(%2);"	/*   prev = *p */
+		"addu %1, %0, %3;"	/*   tmp = prev + delta */
+		"sc %1, 0(%2);"		/*   *p = tmp; tmp = success? */
+		"beqz %1, 1b;"		/*   retry if the store failed */
+		".set pop"
+		: "=&r" (prev), "=&r" (tmp)
+		: "r" (p), "r" (delta)
+		: "memory");
+	return prev;
+}
+
+////////////////////////////////////////////////////////////
+// mutexes
+
+/*
+ * The state is 0 when free, 1 when held, and 2 when held and someone
+ * may be sleeping on it. Only unlock from state 2 calls futex_wake.
+ * A thread that wakes up takes the lock in state 2, since it can't
+ * tell whether anyone else is still asleep.
+ */
+
+void
+umutex_init(struct umutex *m)
+{
+	m->um_state = 0;
+}
+
+void
+umutex_lock(struct umutex *m)
+{
+	int c;
+
+	c = atomic_cas(&m->um_state, 0, 1);
+	if (c == 0) {
+		return;
+	}
+	if (c != 2) {
+		c = atomic_swap(&m->um_state, 2);
+	}
+	while (c != 0) {
+		(void)futex_wait(&m->um_state, 2, NULL);
+		c = atomic_swap(&m->um_state, 2);
+	}
+}
+
+int
+umutex_trylock(struct umutex *m)
+{
+	return atomic_cas(&m->um_state, 0, 1) == 0 ? 0 : -1;
+}
+
+void
+umutex_unlock(struct umutex *m)
+{
+	if (atomic_add(&m->um_state, -1) != 1) {
+		m->um_state = 0;
+		(void)futex_wake(&m->um_state, 1);
+	}
+}
+
+////////////////////////////////////////////////////////////
+// semaphores
+
+/*
+ * A sleeper counts itself in us_waiters before calling futex_wait,
+ * which only sleeps if the count is still 0. So either V sees the
+ * waiter and wakes it, or the waiter sees V's increment and doesn't
+ * sleep.
+ */
+
+void
+usema_init(struct usema *s, unsigned count)
+{
+	s->us_count = count;
+	s->us_waiters = 0;
+}
+
+int
+usema_tryP(struct usema *s)
+{
+	int c;
+
+	while (1) {
+		c = s->us_count;
+		if (c <= 0) {
+			return -1;
+		}
+		if (atomic_cas(&s->us_count, c, c - 1) == c) {
+			return 0;
+		}
+	}
+}
+
+void
+usema_P(struct usema *s)
+{
+	while (usema_tryP(s) < 0) {
+		atomic_add(&s->us_waiters, 1);
+		(void)futex_wait(&s->us_count, 0, NULL);
+		atomic_add(&s->us_waiters, -1);
+	}
+}
+
+void
+usema_Vn(struct usema *s, unsigned count)
+{
+	atomic_add(&s->us_count, count);
+	if (s->us_waiters > 0) {
+		(void)futex_wake(&s->us_count, count);
+	}
+}
+
+void
+usema_V(struct usema *s)
+{
+	usema_Vn(s, 1);
+}
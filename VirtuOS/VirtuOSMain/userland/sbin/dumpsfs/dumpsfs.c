@@ -498,6 +498,117 @@ dumpinode(uint32_t ino, const char *name)
 	}
 }
 
+////////////////////////////////////////////////////////////
+// fragmentation
+
+/*
+ * An extent is a run of file blocks that are also consecutive on
+ * disk. The average extent length says how many blocks a sequential
+ * read gets per seek.
+ */
+
+static uint32_t frag_lastblock;
+static unsigned frag_fileblocks, frag_fileextents;
+static unsigned frag_files, frag_totalblocks, frag_totalextents;
+
+static void fraginode(uint32_t ino, const char *name);
+
+static
+void
+fragblock(uint32_t fileblock, uint32_t diskblock)
+{
+	(void)fileblock;
+	if (diskblock == 0) {
+		/* sparse */
+		return;
+	}
+	if (frag_fileblocks == 0 || diskblock != frag_lastblock + 1) {
+		frag_fileextents++;
+	}
+	frag_fileblocks++;
+	frag_lastblock = diskblock;
+}
+
+static
+void
+fragdirblock(uint32_t fileblock, uint32_t diskblock)
+{
+	struct sfs_direntry sds[SFS_BLOCKSIZE/sizeof(struct sfs_direntry)];
+	int nsds = SFS_BLOCKSIZE/sizeof(struct sfs_direntry);
+	int i;
+
+	(void)fileblock;
+	if (diskblock == 0) {
+		return;
+	}
+	diskread(&sds, diskblock);
+
+	for (i=0; i<nsds; i++) {
+		uint32_t ino = SWAP32(sds[i].sfd_ino);
+		if (ino==SFS_NOINO) {
+			continue;
+		}
+		sds[i].sfd_name[SFS_NAMELEN-1] = 0; /* just in case */
+		if (!strcmp(sds[i].sfd_name, ".") ||
+		    !strcmp(sds[i].sfd_name, "..")) {
+			continue;
+		}
+		fraginode(ino, sds[i].sfd_name);
+	}
+}
+
+static
+void
+fraginode(uint32_t ino, const char *name)
+{
+	struct sfs_dinode sfi;
+
+	diskread(&sfi, ino);
+
+	switch (SWAP16(sfi.sfi_type)) {
+	    case SFS_TYPE_FILE:
+		frag_fileblocks = frag_fileextents = 0;
+		traverse(&sfi, fragblock);
+		if (frag_fileblocks > 0) {
+			printf("    %-24s %6u blocks in %5u extents\n",
+			       name, frag_fileblocks, frag_fileextents);
+		}
+		frag_files++;
+		frag_totalblocks += frag_fileblocks;
+		frag_totalextents += frag_fileextents;
+		break;
+	    case SFS_TYPE_DIR:
+		traverse(&sfi, fragdirblock);
+		break;
+	    default:
+		warnx("Inode %u (%s) has invalid type", ino, name);
+		break;
+	}
+}
+
+static
+void
+dumpfrag(void)
+{
+	unsigned avg100;
+
+	printf("Fragmentation\n");
+	printf("-------------\n");
+	fraginode(SFS_ROOTDIR_INO, "/");
+
+	if (frag_totalextents == 0) {
+		printf("    %u files, no data blocks\n", frag_files);
+	}
+	else {
+		avg100 = frag_totalblocks * 100 / frag_totalextents;
+		printf("    %u files, %u blocks in %u extents; "
+		       "average extent length %u.%02u blocks\n",
+		       frag_files, frag_totalblocks, frag_totalextents,
+		       avg100 / 100, avg100 % 100);
+	}
+	printf("\n");
+}
+
 ////////////////////////////////////////////////////////////
 // main
 
@@ -513,6 +624,7 @@ usage(void)
 	warnx("   -f: dump file contents");
 	warnx("   -d: dump directory contents");
 	warnx("   -r: recurse into directory contents");
+	warnx("   -F: report fragmentation (average extent length)");
 	warnx("   -a: equivalent to -sbdfr -i 1");
 	errx(1, "   Default is -i 1");
 }
@@ -522,6 +634,7 @@ main(int argc, char **argv)
 {
 	bool dosb = false;
 	bool dofreemap = false;
+	bool dofrag = false;
 	uint32_t dumpino = 0;
 	const char *dumpdisk = NULL;
 
@@ -554,6 +667,7 @@ main(int argc, char **argv)
 				    case 'f': dofiles = true; break;
 				    case 'd': dodirs = true; break;
 				    case 'r': recurse = true; break;
+				    case 'F': dofrag = true; break;
 				    case 'a':
 					dosb = true;
 					dofreemap = true;
@@ -584,7 +698,7 @@ main(int argc, char **argv)
 		usage();
 	}
 
-	if (!dosb && !dofreemap && dumpino == 0) {
+	if (!dosb && !dofreemap && !dofrag && dumpino == 0) {
 		dumpino = SFS_ROOTDIR_INO;
 	}
 
@@ -597,6 +711,9 @@ main(int argc, char **argv)
 	if (dofreemap) {
 		dumpfreemap(nblocks);
 	}
+	if (dofrag) {
+		dumpfrag();
+	}
 	if (dumpino != 0) {
 		dumpinode(dumpino, NULL);
 	}
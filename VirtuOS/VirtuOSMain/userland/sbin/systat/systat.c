@@ -0,0 +1,434 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * systat - show system call statistics, or trace a command.
+ * usage: systat [-h] [-r]
+ *        systat [-h] command [args...]
+ *        systat -t command [args...]
+ *
+ * With no command, prints how many times each system call has been
+ * made since boot (or the last reset), how many failed, and the
+ * average latency; -h adds a latency histogram for each call, and -r
+ * resets the counters afterwards. With a command, runs it and prints
+ * the same for the calls made (by everyone) while it ran.
+ *
+ * With -t, runs the command with tracing on and prints each system
+ * call it and its children make, with the arguments, result, and
+ * time taken, much like strace.
+ *
+ * Needs a kernel built with "options syscallstat".
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <kern/syscall.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+
+#define NAME(sym)	[SYS_##sym] = #sym
+
+static const char *const callnames[SYSSTAT_NCALLS] = {
+	NAME(fork),
+	NAME(vfork),
+	NAME(execv),
+	NAME(_exit),
+	NAME(waitpid),
+	NAME(getpid),
+	NAME(getppid),
+	NAME(sbrk),
+	NAME(mmap),
+	NAME(munmap),
+	NAME(mprotect),
+	NAME(umask),
+	NAME(issetugid),
+	NAME(getresuid),
+	NAME(setresuid),
+	NAME(getresgid),
+	NAME(setresgid),
+	NAME(getgroups),
+	NAME(setgroups),
+	NAME(__getlogin),
+	NAME(__setlogin),
+	NAME(kill),
+	NAME(sigaction),
+	NAME(sigpending),
+	NAME(sigprocmask),
+	NAME(sigsuspend),
+	NAME(sigreturn),
+	NAME(getpriority),
+	NAME(setpriority),
+	NAME(open),
+	NAME(pipe),
+	NAME(dup),
+	NAME(dup2),
+	NAME(close),
+	NAME(read),
+	NAME(pread),
+	NAME(readv),
+	NAME(getdirentry),
+	NAME(write),
+	NAME(pwrite),
+	NAME(writev),
+	NAME(lseek),
+	NAME(flock),
+	NAME(ftruncate),
+	NAME(fsync),
+	NAME(fcntl),
+	NAME(ioctl),
+	NAME(select),
+	NAME(poll),
+	NAME(link),
+	NAME(remove),
+	NAME(mkdir),
+	NAME(rmdir),
+	NAME(mkfifo),
+	NAME(rename),
+	NAME(access),
+	NAME(chdir),
+	NAME(fchdir),
+	NAME(__getcwd),
+	NAME(symlink),
+	NAME(readlink),
+	NAME(mount),
+	NAME(unmount),
+	NAME(stat),
+	NAME(fstat),
+	NAME(lstat),
+	NAME(utimes),
+	NAME(futimes),
+	NAME(lutimes),
+	NAME(chmod),
+	NAME(chown),
+	NAME(fchmod),
+	NAME(fchown),
+	NAME(lchmod),
+	NAME(lchown),
+	NAME(socket),
+	NAME(bind),
+	NAME(connect),
+	NAME(listen),
+	NAME(accept),
+	NAME(shutdown),
+	NAME(getsockname),
+	NAME(getpeername),
+	NAME(getsockopt),
+	NAME(setsockopt),
+	NAME(__time),
+	NAME(__settime),
+	NAME(nanosleep),
+	NAME(sync),
+	NAME(reboot),
+	NAME(fallocate),
+	NAME(sched_setaffinity),
+	NAME(sched_getaffinity),
+	NAME(futex_wait),
+	NAME(futex_wake),
+	NAME(__thread_create),
+	NAME(__thread_join),
+	NAME(__thread_exit),
+	NAME(waitmany),
+	NAME(pipe2),
+	NAME(shm_map),
+	NAME(shm_unmap),
+	NAME(shm_unlink),
+	NAME(ioring_setup),
+	NAME(ioring_enter),
+	NAME(sysstat),
+	NAME(sysstat_reset),
+	NAME(systrace),
+	NAME(systrace_read),
+};
+
+static struct sysstat_call before[SYSSTAT_NCALLS];
+static struct sysstat_call after[SYSSTAT_NCALLS];
+
+/* Trace records read at a time */
+#define TRACEBATCH	64
+
+/* Sequence number of the next trace record we expect */
+static unsigned nextseq;
+static int seqknown;
+
+static
+const char *
+callname(int callno, char *buf, size_t len)
+{
+	if (callno >= 0 && callno < SYSSTAT_NCALLS &&
+	    callnames[callno] != NULL) {
+		return callnames[callno];
+	}
+	snprintf(buf, len, "syscall%d", callno);
+	return buf;
+}
+
+static
+void
+getstats(struct sysstat_call *buf)
+{
+	int n;
+
+	n = sysstat(buf, SYSSTAT_NCALLS);
+	if (n < 0) {
+		if (errno == ENOSYS) {
+			errx(1, "kernel not built with options syscallstat");
+		}
+		err(1, "sysstat");
+	}
+	if (n < SYSSTAT_NCALLS) {
+		memset(buf + n, 0, (SYSSTAT_NCALLS - n) * sizeof(*buf));
+	}
+}
+
+////////////////////////////////////////////////////////////
+
+/*
+ * Print AFTER minus BEFORE, for the calls that were made.
+ */
+static
+void
+printstats(int showhist)
+{
+	struct sysstat_call *a, *b;
+	unsigned long long calls, errors, timed, ns;
+	unsigned i, k;
+	unsigned long count;
+	char namebuf[16];
+
+	printf("%-20s %10s %10s %10s\n", "call", "calls", "errors", "avg us");
+	for (i=0; i<SYSSTAT_NCALLS; i++) {
+		a = &after[i];
+		b = &before[i];
+		calls = a->sc_calls - b->sc_calls;
+		if (calls == 0) {
+			continue;
+		}
+		errors = a->sc_errors - b->sc_errors;
+		ns = a->sc_totalns - b->sc_totalns;
+		timed = 0;
+		for (k=0; k<SYSSTAT_NBUCKETS; k++) {
+			timed += a->sc_hist[k] - b->sc_hist[k];
+		}
+		printf("%-20s %10llu %10llu %10llu\n",
+		       callname(i, namebuf, sizeof(namebuf)), calls, errors,
+		       timed == 0 ? 0ULL : ns / timed / 1000);
+
+		if (!showhist) {
+			continue;
+		}
+		for (k=0; k<SYSSTAT_NBUCKETS; k++) {
+			count = a->sc_hist[k] - b->sc_hist[k];
+			if (count == 0) {
+				continue;
+			}
+			printf("    %s%8lu us %10lu\n",
+			       k == SYSSTAT_NBUCKETS - 1 ? ">=" : "  ",
+			       k == 0 ? 0UL : 1UL << k, count);
+		}
+	}
+}
+
+static
+void
+printtrace(const struct sysstat_trace *st)
+{
+	char namebuf[16];
+
+	printf("[%d] %s(%#x, %#x, %#x, %#x)", st->st_pid,
+	       callname(st->st_callno, namebuf, sizeof(namebuf)),
+	       st->st_args[0], st->st_args[1], st->st_args[2],
+	       st->st_args[3]);
+	if (st->st_err) {
+		printf(" = -1 %s", strerror(st->st_err));
+	}
+	else {
+		printf(" = %d", st->st_retval);
+	}
+	printf(" <%llu us>\n", (unsigned long long)st->st_duration / 1000);
+}
+
+/*
+ * Print whatever is in the trace ring. Returns the number of records.
+ */
+static
+int
+drain(void)
+{
+	struct sysstat_trace buf[TRACEBATCH];
+	int i, n, total;
+
+	total = 0;
+	do {
+		n = systrace_read(buf, TRACEBATCH);
+		if (n < 0) {
+			err(1, "systrace_read");
+		}
+		for (i=0; i<n; i++) {
+			if (seqknown && buf[i].st_seq != nextseq) {
+				printf("... %u records lost\n",
+				       buf[i].st_seq - nextseq);
+			}
+			nextseq = buf[i].st_seq + 1;
+			seqknown = 1;
+			printtrace(&buf[i]);
+		}
+		total += n;
+	} while (n == TRACEBATCH);
+	return total;
+}
+
+////////////////////////////////////////////////////////////
+
+/*
+ * Run ARGS, with tracing turned on in the child if TRACE is set.
+ * Returns the child's pid.
+ */
+static
+pid_t
+spawn(char **args, int trace)
+{
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		if (trace && systrace(1) < 0) {
+			err(1, "systrace");
+		}
+		execvp(args[0], args);
+		err(1, "%s", args[0]);
+	}
+	return pid;
+}
+
+static
+void
+trace(char **args)
+{
+	struct sysstat_trace junk[TRACEBATCH];
+	struct timespec pause;
+	pid_t pid, r;
+	int n, status;
+
+	/* Make sure we can, and toss anything left over from before */
+	if (systrace(0) < 0) {
+		if (errno == ENOSYS) {
+			errx(1, "kernel not built with options syscallstat");
+		}
+		err(1, "systrace");
+	}
+	while ((n = systrace_read(junk, TRACEBATCH)) > 0) {
+		nextseq = junk[n-1].st_seq + 1;
+		seqknown = 1;
+	}
+
+	pid = spawn(args, 1);
+	pause.tv_sec = 0;
+	pause.tv_nsec = 10000000;
+	while (1) {
+		if (drain() > 0) {
+			continue;
+		}
+		r = waitpid(pid, &status, WNOHANG);
+		if (r < 0) {
+			err(1, "waitpid");
+		}
+		if (r == pid) {
+			break;
+		}
+		nanosleep(&pause, NULL);
+	}
+	/* Children it didn't wait for may still be going; that's life. */
+	drain();
+}
+
+static
+void
+usage(void)
+{
+	errx(1, "usage: systat [-h] [-r] | [-h] command... | -t command...");
+}
+
+int
+main(int argc, char *argv[])
+{
+	int showhist = 0, reset = 0, dotrace = 0;
+	int i, status;
+	pid_t pid;
+
+	for (i=1; i<argc && argv[i][0] == '-'; i++) {
+		if (!strcmp(argv[i], "-h")) {
+			showhist = 1;
+		}
+		else if (!strcmp(argv[i], "-r")) {
+			reset = 1;
+		}
+		else if (!strcmp(argv[i], "-t")) {
+			dotrace = 1;
+		}
+		else {
+			usage();
+		}
+	}
+
+	if (i == argc) {
+		if (dotrace) {
+			usage();
+		}
+		getstats(after);
+		printstats(showhist);
+		if (reset && sysstat_reset() < 0) {
+			err(1, "sysstat_reset");
+		}
+		return 0;
+	}
+	if (reset) {
+		usage();
+	}
+
+	if (dotrace) {
+		trace(&argv[i]);
+		return 0;
+	}
+
+	getstats(before);
+	pid = spawn(&argv[i], 0);
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	getstats(after);
+	printstats(showhist);
+	return 0;
+}
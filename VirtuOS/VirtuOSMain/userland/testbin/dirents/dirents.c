@@ -0,0 +1,254 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * dirents.c
+ *
+ *      Tests getdirentries and fstatat.
+ *
+ *      Makes a bunch of files in the current directory and lists the
+ *      directory through a buffer that only holds a few records, so
+ *      most calls pick up in the middle of what the filesystem reads
+ *      at a time. Checks that every file comes back exactly once,
+ *      with a sane type, and that fstatat relative to the directory
+ *      agrees. Also checks the error cases.
+ *
+ *      Should run on SFS and on emufs.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <err.h>
+
+#define NFILES		40
+#define PREFIX		"dirents."
+
+/* Small on purpose; holds three records with our names. */
+#define SMALLBUF	64
+
+static int seen[NFILES];
+
+static
+void
+filename(char *buf, size_t len, int n)
+{
+	snprintf(buf, len, "%s%02d", PREFIX, n);
+}
+
+static
+void
+setup(void)
+{
+	char name[32];
+	int i, fd;
+
+	printf("Making %d files...\n", NFILES);
+	for (i=0; i<NFILES; i++) {
+		filename(name, sizeof(name), i);
+		fd = open(name, O_WRONLY|O_CREAT|O_EXCL, 0664);
+		if (fd<0) {
+			err(1, "%s: create", name);
+		}
+		if (write(fd, name, i)<0) {
+			err(1, "%s: write", name);
+		}
+		close(fd);
+	}
+}
+
+static
+void
+cleanup(void)
+{
+	char name[32];
+	int i;
+
+	printf("Cleaning up...\n");
+	for (i=0; i<NFILES; i++) {
+		filename(name, sizeof(name), i);
+		if (remove(name)<0) {
+			err(1, "%s: remove", name);
+		}
+	}
+}
+
+/*
+ * Check one record from getdirentries.
+ */
+static
+void
+checkentry(int dirfd, const struct dirent *de)
+{
+	struct stat st;
+	int n;
+
+	if (de->d_namlen != strlen(de->d_name)) {
+		errx(1, "%s: d_namlen is %u", de->d_name,
+		     (unsigned)de->d_namlen);
+	}
+	if (de->d_reclen != _DIRENT_RECLEN(de->d_namlen)) {
+		errx(1, "%s: d_reclen is %u", de->d_name,
+		     (unsigned)de->d_reclen);
+	}
+	if (de->d_namlen < strlen(PREFIX) ||
+	    memcmp(de->d_name, PREFIX, strlen(PREFIX)) != 0) {
+		/* someone else's file */
+		return;
+	}
+
+	n = atoi(de->d_name + strlen(PREFIX));
+	if (n < 0 || n >= NFILES) {
+		errx(1, "%s: unexpected name", de->d_name);
+	}
+	if (seen[n]) {
+		errx(1, "%s: returned a second time", de->d_name);
+	}
+	seen[n] = 1;
+
+	if (de->d_type != DT_REG && de->d_type != DT_UNKNOWN) {
+		errx(1, "%s: d_type is %u", de->d_name,
+		     (unsigned)de->d_type);
+	}
+
+	if (fstatat(dirfd, de->d_name, &st, 0)<0) {
+		err(1, "%s: fstatat", de->d_name);
+	}
+	if (!S_ISREG(st.st_mode)) {
+		errx(1, "%s: fstatat says not a regular file", de->d_name);
+	}
+	if (st.st_size != n) {
+		errx(1, "%s: fstatat says size %lld", de->d_name,
+		     (long long)st.st_size);
+	}
+}
+
+static
+void
+listit(void)
+{
+	union {
+		struct dirent de;
+		char bytes[SMALLBUF];
+	} buf;
+	const struct dirent *de;
+	ssize_t len, pos;
+	int dirfd, i, calls;
+
+	printf("Listing through a %d-byte buffer...\n", SMALLBUF);
+
+	for (i=0; i<NFILES; i++) {
+		seen[i] = 0;
+	}
+
+	dirfd = open(".", O_RDONLY);
+	if (dirfd<0) {
+		err(1, ".: open");
+	}
+
+	calls = 0;
+	while ((len = getdirentries(dirfd, &buf, sizeof(buf))) > 0) {
+		if (len > (ssize_t)sizeof(buf)) {
+			errx(1, ".: getdirentries returned %ld", (long)len);
+		}
+		for (pos = 0; pos < len; pos += de->d_reclen) {
+			de = (const struct dirent *)(buf.bytes + pos);
+			checkentry(dirfd, de);
+		}
+		calls++;
+	}
+	if (len<0) {
+		err(1, ".: getdirentries");
+	}
+	close(dirfd);
+
+	for (i=0; i<NFILES; i++) {
+		if (!seen[i]) {
+			errx(1, "%s%02d: not returned", PREFIX, i);
+		}
+	}
+	printf("Got all %d files in %d calls\n", NFILES, calls);
+}
+
+static
+void
+errors(void)
+{
+	char tiny[8];
+	struct stat st;
+	int dirfd, fds[2];
+
+	printf("Checking errors...\n");
+
+	dirfd = open(".", O_RDONLY);
+	if (dirfd<0) {
+		err(1, ".: open");
+	}
+	if (getdirentries(dirfd, tiny, sizeof(tiny)) != -1 || errno != EINVAL) {
+		errx(1, "getdirentries with a tiny buffer didn't fail "
+		     "with EINVAL");
+	}
+	if (fstatat(dirfd, PREFIX "nonexistent", &st, 0) != -1 ||
+	    errno != ENOENT) {
+		errx(1, "fstatat of a missing file didn't fail with ENOENT");
+	}
+	close(dirfd);
+
+	if (getdirentries(STDIN_FILENO, tiny, sizeof(tiny)) != -1 ||
+	    errno != ENOTDIR) {
+		errx(1, "getdirentries on the console didn't fail "
+		     "with ENOTDIR");
+	}
+
+	if (pipe(fds)<0) {
+		err(1, "pipe");
+	}
+	if (getdirentries(fds[0], tiny, sizeof(tiny)) != -1 ||
+	    errno != ENOTDIR) {
+		errx(1, "getdirentries on a pipe didn't fail with ENOTDIR");
+	}
+	close(fds[0]);
+	close(fds[1]);
+}
+
+int
+main(void)
+{
+	setup();
+	listit();
+	errors();
+	cleanup();
+	printf("dirents: passed\n");
+	return 0;
+}
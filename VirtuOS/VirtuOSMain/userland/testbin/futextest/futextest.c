@@ -0,0 +1,235 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * futextest.c
+ *
+ *      Tests futex_wait and futex_wake:
+ *
+ *      - futex_wake wakes only as many waiters as asked;
+ *      - a wakeup isn't lost when the waker's store to the word
+ *        breaks copy-on-write after fork and moves the word to a new
+ *        page (this used to hang).
+ *
+ *      The waiters have to be asleep before the wake for the counts
+ *      to mean anything, so the test waits a bit for them; on a very
+ *      slow system it may need to wait longer (-d).
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+
+#define NWAITERS	3
+
+static unsigned delayms = 200;
+
+/* One flag per waiter, so nobody needs atomic increments. */
+static volatile int gate;
+static volatile int arrived[NWAITERS];
+static volatile int woken[NWAITERS];
+
+/* A word on a page of its own, so nothing else breaks copy-on-write. */
+static struct {
+	volatile int word;
+	char pad[4096 - sizeof(int)];
+} cow __attribute__((aligned(4096)));
+
+/*
+ * Busy-wait for DELAYMS so that waiters get to sleep.
+ */
+static
+void
+delay(void)
+{
+	time_t s0, s;
+	unsigned long ns0, ns;
+	unsigned long long elapsed;
+
+	__time(&s0, &ns0);
+	do {
+		__time(&s, &ns);
+		elapsed = (unsigned long long)(s - s0) * 1000000000ULL
+			+ ns - ns0;
+	} while (elapsed < (unsigned long long)delayms * 1000000ULL);
+}
+
+static
+int
+count(volatile int *flags)
+{
+	int i, n = 0;
+
+	for (i=0; i<NWAITERS; i++) {
+		n += flags[i];
+	}
+	return n;
+}
+
+static
+void *
+waiter(void *arg)
+{
+	int me = (int)arg;
+
+	arrived[me] = 1;
+	futex_wait(&gate, 0, NULL);
+	woken[me] = 1;
+	return NULL;
+}
+
+/*
+ * Three waiters; wake one, then the rest.
+ */
+static
+void
+wakecount(void)
+{
+	int tids[NWAITERS];
+	int i, n;
+
+	for (i=0; i<NWAITERS; i++) {
+		tids[i] = thread_create(waiter, (void *)i);
+		if (tids[i] < 0) {
+			err(1, "thread_create");
+		}
+	}
+	while (count(arrived) < NWAITERS) {
+		/* spin */
+	}
+	delay();
+
+	n = futex_wake(&gate, 1);
+	if (n != 1) {
+		errx(1, "futex_wake(1) with %d waiters woke %d", NWAITERS, n);
+	}
+	delay();
+	if (count(woken) != 1) {
+		errx(1, "futex_wake(1) let %d threads go", count(woken));
+	}
+
+	gate = 1;
+	n = futex_wake(&gate, NWAITERS);
+	if (n != NWAITERS - 1) {
+		errx(1, "futex_wake woke %d of the remaining %d", n,
+		     NWAITERS - 1);
+	}
+	for (i=0; i<NWAITERS; i++) {
+		if (thread_join(tids[i], NULL) < 0) {
+			err(1, "thread_join");
+		}
+	}
+	printf("wake count: passed\n");
+}
+
+static
+void *
+cowwaiter(void *arg)
+{
+	(void)arg;
+	arrived[0] = 1;
+	while (cow.word == 0) {
+		futex_wait(&cow.word, 0, NULL);
+	}
+	return NULL;
+}
+
+/*
+ * In a child, while the page holding cow.word is still shared with
+ * the parent, one thread waits on it and the other stores to it and
+ * wakes.
+ */
+static
+void
+cowchild(void)
+{
+	int tid, n;
+
+	arrived[0] = 0;
+	tid = thread_create(cowwaiter, NULL);
+	if (tid < 0) {
+		_exit(2);
+	}
+	while (arrived[0] == 0) {
+		/* spin */
+	}
+	delay();
+
+	cow.word = 1;
+	n = futex_wake(&cow.word, 1);
+	if (n != 1) {
+		_exit(3);
+	}
+	thread_join(tid, NULL);
+	_exit(0);
+}
+
+static
+void
+cowwake(void)
+{
+	pid_t pid;
+	int status;
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		cowchild();
+	}
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		errx(1, "wake after copy-on-write: child status 0x%x",
+		     status);
+	}
+	printf("wake after copy-on-write: passed\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+	if (argc == 3 && !strcmp(argv[1], "-d")) {
+		delayms = atoi(argv[2]);
+	}
+	else if (argc != 1) {
+		errx(1, "usage: futextest [-d delay-ms]");
+	}
+
+	wakecount();
+	cowwake();
+	printf("futextest: passed\n");
+	return 0;
+}
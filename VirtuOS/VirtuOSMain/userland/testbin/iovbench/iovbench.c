@@ -0,0 +1,425 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * iovbench - compare plain read/write with readv/writev and pread.
+ * usage: iovbench [-n records] [-t threads] [file]
+ *
+ * First writes a file of records, each made of a header, a body, and
+ * a trailer, once with one write() per fragment and once with one
+ * writev() per record, and reads it back the same two ways. Then
+ * reads random records with lseek+read and with pread, and finally
+ * with pread from several threads at once, which don't need to take
+ * turns with the seek position. Every read is checked.
+ *
+ * For each run it prints the number of system calls made and the
+ * time taken.
+ */
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <err.h>
+
+#define DEFAULT_RECORDS	256
+#define DEFAULT_THREADS	4
+#define MAXTHREADS	16
+
+#define HDRSIZE		16
+#define BODYSIZE	96
+#define TRLSIZE		16
+#define RECSIZE		(HDRSIZE + BODYSIZE + TRLSIZE)
+
+struct record {
+	char hdr[HDRSIZE];
+	char body[BODYSIZE];
+	char trl[TRLSIZE];
+};
+
+static const char *filename = "iovbench.dat";
+static unsigned nrecords = DEFAULT_RECORDS;
+
+static time_t startsecs;
+static unsigned long startnsecs;
+
+static
+void
+starttimer(void)
+{
+	__time(&startsecs, &startnsecs);
+}
+
+/*
+ * Print the elapsed time since starttimer() and the syscall count.
+ */
+static
+void
+stoptimer(const char *what, unsigned nsyscalls)
+{
+	time_t secs;
+	unsigned long nsecs;
+	unsigned long long total;
+
+	__time(&secs, &nsecs);
+	if (nsecs < startnsecs) {
+		nsecs += 1000000000;
+		secs--;
+	}
+	secs -= startsecs;
+	nsecs -= startnsecs;
+
+	total = (unsigned long long)secs * 1000000000ULL + nsecs;
+	printf("%-24s %6u syscalls in %lu.%09lu s, %llu KB/s\n", what,
+	       nsyscalls, (unsigned long)secs, nsecs,
+	       total == 0 ? 0ULL :
+	       (unsigned long long)nrecords * RECSIZE * 1000000ULL / total);
+}
+
+////////////////////////////////////////////////////////////
+
+/*
+ * Fill in record N. Every byte depends on N and its position, so a
+ * record read from the wrong place or in the wrong order shows up.
+ */
+static
+void
+fillrecord(struct record *r, unsigned n)
+{
+	unsigned i;
+
+	for (i=0; i<HDRSIZE; i++) {
+		r->hdr[i] = 'H' + n + i;
+	}
+	for (i=0; i<BODYSIZE; i++) {
+		r->body[i] = n * 7 + i;
+	}
+	for (i=0; i<TRLSIZE; i++) {
+		r->trl[i] = 'T' + n - i;
+	}
+}
+
+static
+void
+checkrecord(const struct record *r, unsigned n, const char *what)
+{
+	struct record good;
+
+	fillrecord(&good, n);
+	if (memcmp(r, &good, sizeof(good)) != 0) {
+		errx(1, "%s: record %u is wrong", what, n);
+	}
+}
+
+static
+void
+checkio(ssize_t got, size_t want, const char *what)
+{
+	if (got < 0) {
+		err(1, "%s", what);
+	}
+	if ((size_t)got != want) {
+		errx(1, "%s: short transfer (%ld of %lu)", what,
+		     (long)got, (unsigned long)want);
+	}
+}
+
+/*
+ * Set up the three iovecs for a record.
+ */
+static
+void
+recordiov(struct iovec *iov, struct record *r)
+{
+	iov[0].iov_base = r->hdr;
+	iov[0].iov_len = HDRSIZE;
+	iov[1].iov_base = r->body;
+	iov[1].iov_len = BODYSIZE;
+	iov[2].iov_base = r->trl;
+	iov[2].iov_len = TRLSIZE;
+}
+
+static
+int
+openfile(int flags)
+{
+	int fd;
+
+	fd = open(filename, flags, 0664);
+	if (fd < 0) {
+		err(1, "%s", filename);
+	}
+	return fd;
+}
+
+////////////////////////////////////////////////////////////
+
+/*
+ * Sequential writes and reads, one fragment per call.
+ */
+static
+void
+seq_plain(void)
+{
+	struct record r;
+	unsigned n, calls;
+	int fd;
+
+	fd = openfile(O_WRONLY|O_CREAT|O_TRUNC);
+	calls = 0;
+	starttimer();
+	for (n=0; n<nrecords; n++) {
+		fillrecord(&r, n);
+		checkio(write(fd, r.hdr, HDRSIZE), HDRSIZE, "write");
+		checkio(write(fd, r.body, BODYSIZE), BODYSIZE, "write");
+		checkio(write(fd, r.trl, TRLSIZE), TRLSIZE, "write");
+		calls += 3;
+	}
+	stoptimer("write x3", calls);
+	close(fd);
+
+	fd = openfile(O_RDONLY);
+	calls = 0;
+	starttimer();
+	for (n=0; n<nrecords; n++) {
+		checkio(read(fd, r.hdr, HDRSIZE), HDRSIZE, "read");
+		checkio(read(fd, r.body, BODYSIZE), BODYSIZE, "read");
+		checkio(read(fd, r.trl, TRLSIZE), TRLSIZE, "read");
+		calls += 3;
+		checkrecord(&r, n, "read x3");
+	}
+	stoptimer("read x3", calls);
+	close(fd);
+}
+
+/*
+ * Sequential writes and reads, one record per call.
+ */
+static
+void
+seq_vector(void)
+{
+	struct record r;
+	struct iovec iov[3];
+	unsigned n, calls;
+	int fd;
+
+	recordiov(iov, &r);
+
+	fd = openfile(O_WRONLY|O_CREAT|O_TRUNC);
+	calls = 0;
+	starttimer();
+	for (n=0; n<nrecords; n++) {
+		fillrecord(&r, n);
+		checkio(writev(fd, iov, 3), RECSIZE, "writev");
+		calls++;
+	}
+	stoptimer("writev", calls);
+	close(fd);
+
+	fd = openfile(O_RDONLY);
+	calls = 0;
+	starttimer();
+	for (n=0; n<nrecords; n++) {
+		memset(&r, 0, sizeof(r));
+		checkio(readv(fd, iov, 3), RECSIZE, "readv");
+		calls++;
+		checkrecord(&r, n, "readv");
+	}
+	stoptimer("readv", calls);
+	close(fd);
+}
+
+////////////////////////////////////////////////////////////
+
+/*
+ * Record number for the Ith random read. (Stepping by a large odd
+ * stride is plenty; the point is to seek around.)
+ */
+static
+unsigned
+randrecord(unsigned seed, unsigned i)
+{
+	return (seed * 1103515245U + i * 12345U + 1) % nrecords;
+}
+
+/*
+ * Random reads with lseek+read.
+ */
+static
+void
+rand_seek(void)
+{
+	struct record r;
+	unsigned i, n, calls;
+	int fd;
+
+	fd = openfile(O_RDONLY);
+	calls = 0;
+	starttimer();
+	for (i=0; i<nrecords; i++) {
+		n = randrecord(0, i);
+		if (lseek(fd, (off_t)n * RECSIZE, SEEK_SET) < 0) {
+			err(1, "lseek");
+		}
+		checkio(read(fd, &r, RECSIZE), RECSIZE, "read");
+		calls += 2;
+		checkrecord(&r, n, "lseek+read");
+	}
+	stoptimer("lseek+read", calls);
+	close(fd);
+}
+
+/*
+ * Random reads with pread, from one thread. This also checks that
+ * pread leaves the seek position alone.
+ */
+static
+void
+rand_pread(void)
+{
+	struct record r;
+	unsigned i, n, calls;
+	int fd;
+
+	fd = openfile(O_RDONLY);
+	calls = 0;
+	starttimer();
+	for (i=0; i<nrecords; i++) {
+		n = randrecord(0, i);
+		checkio(pread(fd, &r, RECSIZE, (off_t)n * RECSIZE), RECSIZE,
+			"pread");
+		calls++;
+		checkrecord(&r, n, "pread");
+	}
+	stoptimer("pread", calls);
+	if (lseek(fd, 0, SEEK_CUR) != 0) {
+		errx(1, "pread moved the seek position");
+	}
+	close(fd);
+}
+
+/*
+ * Random reads with pread from several threads sharing one fd.
+ */
+static int sharedfd;
+
+static
+void *
+preadthread(void *arg)
+{
+	struct record r;
+	unsigned seed = (unsigned)(uintptr_t)arg;
+	unsigned i, n;
+
+	for (i=0; i<nrecords; i++) {
+		n = randrecord(seed, i);
+		checkio(pread(sharedfd, &r, RECSIZE, (off_t)n * RECSIZE),
+			RECSIZE, "pread");
+		checkrecord(&r, n, "threaded pread");
+	}
+	return NULL;
+}
+
+static
+void
+rand_pread_threads(unsigned nthreads)
+{
+	int tids[MAXTHREADS];
+	char what[32];
+	unsigned t;
+
+	sharedfd = openfile(O_RDONLY);
+	starttimer();
+	for (t=0; t<nthreads; t++) {
+		tids[t] = thread_create(preadthread, (void *)(uintptr_t)(t+1));
+		if (tids[t] < 0) {
+			err(1, "thread_create");
+		}
+	}
+	for (t=0; t<nthreads; t++) {
+		if (thread_join(tids[t], NULL) < 0) {
+			err(1, "thread_join");
+		}
+	}
+	snprintf(what, sizeof(what), "pread, %u threads", nthreads);
+	stoptimer(what, nthreads * nrecords);
+	close(sharedfd);
+}
+
+////////////////////////////////////////////////////////////
+
+static
+void
+usage(void)
+{
+	errx(1, "usage: iovbench [-n records] [-t threads] [file]");
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned nthreads = DEFAULT_THREADS;
+	int i;
+
+	for (i=1; i<argc; i++) {
+		if (!strcmp(argv[i], "-n") && i+1 < argc) {
+			nrecords = atoi(argv[++i]);
+			if (nrecords == 0) {
+				usage();
+			}
+		}
+		else if (!strcmp(argv[i], "-t") && i+1 < argc) {
+			nthreads = atoi(argv[++i]);
+			if (nthreads == 0 || nthreads > MAXTHREADS) {
+				usage();
+			}
+		}
+		else if (argv[i][0] != '-') {
+			filename = argv[i];
+		}
+		else {
+			usage();
+		}
+	}
+
+	seq_plain();
+	seq_vector();
+	rand_seek();
+	rand_pread();
+	rand_pread_threads(nthreads);
+
+	remove(filename);
+	printf("iovbench: passed\n");
+	return 0;
+}
@@ -0,0 +1,206 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * lookupbench - time path name translation.
+ * usage: lookupbench [-n count] [path...]
+ *
+ * Times open()+close() on each path given (by default, this program
+ * itself and a name that doesn't exist), and then fork+execvp of a
+ * program that lives at the end of $PATH, so that execvp has to fail
+ * in each of the earlier directories first.
+ *
+ * To see what the kernel's name cache buys, run this once normally
+ * and once after "ncache off" at the kernel menu. Use deep paths
+ * (a/b/c/d/...) to make the difference bigger.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+
+#define DEFAULT_COUNT	200
+#define EXEC_COUNT	20
+
+static const char *const defaultpaths[] = {
+	"/testbin/lookupbench",
+	"/testbin/nonexistent",
+	NULL
+};
+
+static time_t startsecs;
+static unsigned long startnsecs;
+
+static
+void
+starttimer(void)
+{
+	__time(&startsecs, &startnsecs);
+}
+
+/*
+ * Print the elapsed time since starttimer(), per operation.
+ */
+static
+void
+stoptimer(const char *what, unsigned count)
+{
+	time_t secs;
+	unsigned long nsecs;
+	unsigned long long total;
+
+	__time(&secs, &nsecs);
+	if (nsecs < startnsecs) {
+		nsecs += 1000000000;
+		secs--;
+	}
+	secs -= startsecs;
+	nsecs -= startnsecs;
+
+	total = (unsigned long long)secs * 1000000000ULL + nsecs;
+	printf("%s: %u ops in %lu.%09lu s, %llu us/op\n", what, count,
+	       (unsigned long)secs, nsecs, total / count / 1000);
+}
+
+/*
+ * Open and close PATH COUNT times. Failure to open is fine (that's
+ * the negative lookup case), as long as it's consistent.
+ */
+static
+void
+benchopen(const char *path, unsigned count)
+{
+	char buf[128];
+	unsigned i;
+	int fd, firsterr = 0;
+
+	/* warm up */
+	fd = open(path, O_RDONLY);
+	if (fd >= 0) {
+		close(fd);
+	}
+	else {
+		firsterr = errno;
+	}
+
+	starttimer();
+	for (i=0; i<count; i++) {
+		fd = open(path, O_RDONLY);
+		if (fd >= 0) {
+			close(fd);
+		}
+		else if (errno != firsterr) {
+			err(1, "%s", path);
+		}
+	}
+	snprintf(buf, sizeof(buf), "open %s (%s)", path,
+		 firsterr ? strerror(firsterr) : "exists");
+	stoptimer(buf, count);
+}
+
+/*
+ * Fork and execvp ourselves COUNT times with -x, which exits at once.
+ * Since we live in /testbin, which is last in the default $PATH,
+ * every exec probes /bin and /sbin first.
+ */
+static
+void
+benchexecvp(unsigned count)
+{
+	char *args[3];
+	unsigned i;
+	pid_t pid;
+	int status;
+
+	args[0] = (char *)"lookupbench";
+	args[1] = (char *)"-x";
+	args[2] = NULL;
+
+	starttimer();
+	for (i=0; i<count; i++) {
+		pid = fork();
+		if (pid < 0) {
+			err(1, "fork");
+		}
+		if (pid == 0) {
+			execvp(args[0], args);
+			warn("execvp: %s", args[0]);
+			_exit(1);
+		}
+		if (waitpid(pid, &status, 0) < 0) {
+			err(1, "waitpid");
+		}
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			errx(1, "child failed");
+		}
+	}
+	stoptimer("fork+execvp via $PATH", count);
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned count = DEFAULT_COUNT;
+	int i;
+
+	if (argc == 2 && !strcmp(argv[1], "-x")) {
+		/* we are the exec target */
+		return 0;
+	}
+
+	i = 1;
+	if (argc > 2 && !strcmp(argv[1], "-n")) {
+		count = atoi(argv[2]);
+		if (count == 0) {
+			errx(1, "usage: lookupbench [-n count] [path...]");
+		}
+		i = 3;
+	}
+
+	if (i < argc) {
+		for (; i < argc; i++) {
+			benchopen(argv[i], count);
+		}
+	}
+	else {
+		for (i=0; defaultpaths[i] != NULL; i++) {
+			benchopen(defaultpaths[i], count);
+		}
+	}
+
+	benchexecvp(EXEC_COUNT);
+
+	return 0;
+}
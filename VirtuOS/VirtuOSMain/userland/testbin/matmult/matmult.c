@@ -39,8 +39,22 @@
  *    able to survive this.
  */
 
-#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <err.h>
+
+/*
+ * With no arguments this runs as it always has. With -t N it splits
+ * the work by rows among N threads; with -f N, among N forked
+ * processes, which hand back their part of the answer through a
+ * file since they share no memory. Either way it also prints how
+ * long the computation took, so the two can be compared.
+ */
 
 #define Dim 	72	/* sum total of the arrays doesn't fit in
 			 * physical memory
@@ -48,38 +62,193 @@
 
 #define RIGHT  8772192		/* correct answer */
 
+#define MAXWORKERS 16
+#define PARTFILE "matmult.parts"
+
 int A[Dim][Dim];
 int B[Dim][Dim];
 int C[Dim][Dim];
 int T[Dim][Dim][Dim];
 
+static int nworkers = 1;
+
+/*
+ * Compute rows [lo, hi) of C and return the sum of their diagonal
+ * entries.
+ */
+static
 int
-main(void)
+dorows(int lo, int hi)
 {
     int i, j, k, r;
 
-    for (i = 0; i < Dim; i++)		/* first initialize the matrices */
-	for (j = 0; j < Dim; j++) {
-	     A[i][j] = i;
-	     B[i][j] = j;
-	     C[i][j] = 0;
-	}
-
-    for (i = 0; i < Dim; i++)		/* then multiply them together */
+    for (i = lo; i < hi; i++)		/* multiply */
 	for (j = 0; j < Dim; j++)
             for (k = 0; k < Dim; k++)
 		T[i][j][k] = A[i][k] * B[k][j];
 
-    for (i = 0; i < Dim; i++)
+    for (i = lo; i < hi; i++)
 	for (j = 0; j < Dim; j++)
             for (k = 0; k < Dim; k++)
 		C[i][j] += T[i][j][k];
 
     r = 0;
-    for (i = 0; i < Dim; i++)
+    for (i = lo; i < hi; i++)
 	    r += C[i][i];
+    return r;
+}
+
+static
+int
+worker_lo(int n)
+{
+    return n * Dim / nworkers;
+}
+
+static
+void *
+thread_worker(void *arg)
+{
+    int n = (int)arg;
+    int *ret;
+
+    ret = malloc(sizeof(int));
+    if (ret == NULL) {
+	errx(1, "worker %d: out of memory", n);
+    }
+    *ret = dorows(worker_lo(n), worker_lo(n + 1));
+    return ret;
+}
+
+static
+int
+run_threads(void)
+{
+    int tids[MAXWORKERS];
+    void *ret;
+    int n, r;
+
+    for (n = 0; n < nworkers; n++) {
+	tids[n] = thread_create(thread_worker, (void *)n);
+	if (tids[n] < 0) {
+	    err(1, "thread_create");
+	}
+    }
+    r = 0;
+    for (n = 0; n < nworkers; n++) {
+	if (thread_join(tids[n], &ret) < 0) {
+	    err(1, "thread_join");
+	}
+	if (ret == NULL) {
+	    errx(1, "worker %d failed", n);
+	}
+	r += *(int *)ret;
+	free(ret);
+    }
+    return r;
+}
+
+static
+int
+run_forks(void)
+{
+    pid_t pids[MAXWORKERS];
+    int fd, n, r, part, status;
+
+    fd = open(PARTFILE, O_RDWR|O_CREAT|O_TRUNC, 0664);
+    if (fd < 0) {
+	err(1, "%s", PARTFILE);
+    }
+    for (n = 0; n < nworkers; n++) {
+	pids[n] = fork();
+	if (pids[n] < 0) {
+	    err(1, "fork");
+	}
+	if (pids[n] == 0) {
+	    part = dorows(worker_lo(n), worker_lo(n + 1));
+	    if (lseek(fd, n * sizeof(int), SEEK_SET) < 0 ||
+		write(fd, &part, sizeof(part)) != sizeof(part)) {
+		err(1, "%s: write", PARTFILE);
+	    }
+	    _exit(0);
+	}
+    }
+    for (n = 0; n < nworkers; n++) {
+	if (waitpid(pids[n], &status, 0) < 0) {
+	    err(1, "waitpid");
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+	    errx(1, "worker %d failed", n);
+	}
+    }
+    r = 0;
+    for (n = 0; n < nworkers; n++) {
+	if (lseek(fd, n * sizeof(int), SEEK_SET) < 0 ||
+	    read(fd, &part, sizeof(part)) != sizeof(part)) {
+	    err(1, "%s: read", PARTFILE);
+	}
+	r += part;
+    }
+    close(fd);
+    remove(PARTFILE);
+    return r;
+}
+
+int
+main(int argc, char *argv[])
+{
+    int i, j, r;
+    int usethreads = 0, useforks = 0;
+    time_t startsecs, endsecs;
+    unsigned long startnsecs, endnsecs, msecs;
+
+    if (argc == 3 && !strcmp(argv[1], "-t")) {
+	usethreads = 1;
+    }
+    else if (argc == 3 && !strcmp(argv[1], "-f")) {
+	useforks = 1;
+    }
+    else if (argc != 1) {
+	errx(1, "Usage: matmult [-t nthreads | -f nprocs]");
+    }
+    if (usethreads || useforks) {
+	nworkers = atoi(argv[2]);
+	if (nworkers < 1 || nworkers > MAXWORKERS) {
+	    errx(1, "Worker count must be 1-%d", MAXWORKERS);
+	}
+    }
+
+    for (i = 0; i < Dim; i++)		/* first initialize the matrices */
+	for (j = 0; j < Dim; j++) {
+	     A[i][j] = i;
+	     B[i][j] = j;
+	     C[i][j] = 0;
+	}
+
+    __time(&startsecs, &startnsecs);
+    if (usethreads) {
+	r = run_threads();
+    }
+    else if (useforks) {
+	r = run_forks();
+    }
+    else {
+	r = dorows(0, Dim);		/* then multiply them together */
+    }
+    __time(&endsecs, &endnsecs);
+
+    if (endnsecs < startnsecs) {
+	endnsecs += 1000000000;
+	endsecs--;
+    }
+    msecs = (endsecs - startsecs) * 1000 + (endnsecs - startnsecs) / 1000000;
 
     printf("matmult finished.\n");
+    if (usethreads || useforks) {
+	printf("%d %s: %lu.%03lu seconds\n", nworkers,
+	       usethreads ? "threads" : "processes",
+	       msecs / 1000, msecs % 1000);
+    }
     printf("answer is: %d (should be %d)\n", r, RIGHT);
     if (r != RIGHT) {
 	    printf("FAILED\n");
@@ -0,0 +1,219 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * pidfarm - churn through lots of short-lived processes.
+ * usage: pidfarm [-m] [-n total] [-w width]
+ *
+ * Forks TOTAL children in all, keeping up to WIDTH of them alive at
+ * once, and reaps them in the order they were made. With -m, reaps
+ * whichever have exited, a batch at a time, with waitmany instead.
+ * Each child exits right away with a status derived from its pid,
+ * which the parent checks, so a mixed-up pid table shows up as a
+ * wrong status. WIDTH defaults to more than the kernel's process
+ * limit used to be.
+ *
+ * If fork runs out of memory or processes, that's reported and the
+ * farm just runs narrower for a while.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+
+#define DEFAULT_TOTAL	4000
+#define DEFAULT_WIDTH	256
+#define MAXWIDTH	4096
+#define BATCH		32
+
+static pid_t pids[MAXWIDTH];
+
+static
+void
+usage(void)
+{
+	errx(1, "usage: pidfarm [-m] [-n total] [-w width]");
+}
+
+/*
+ * Check the exit status of child PID.
+ */
+static
+void
+check(pid_t pid, int status)
+{
+	if (!WIFEXITED(status)) {
+		errx(1, "pid %d: did not exit normally", pid);
+	}
+	if (WEXITSTATUS(status) != (pid & 0xff)) {
+		errx(1, "pid %d: exit %d, should be %d", pid,
+		     WEXITSTATUS(status), pid & 0xff);
+	}
+}
+
+/*
+ * Reap the child in slot I.
+ */
+static
+void
+reapone(unsigned i)
+{
+	int status;
+
+	if (waitpid(pids[i], &status, 0) < 0) {
+		err(1, "waitpid %d", pids[i]);
+	}
+	check(pids[i], status);
+}
+
+/*
+ * Reap whatever children have exited, at least one; return how many.
+ */
+static
+unsigned
+reapmany(void)
+{
+	pid_t batch[BATCH];
+	int statuses[BATCH];
+	int i, n;
+
+	n = waitmany(batch, statuses, BATCH, 0);
+	if (n < 0) {
+		err(1, "waitmany");
+	}
+	if (n == 0) {
+		errx(1, "waitmany returned nothing");
+	}
+	for (i=0; i<n; i++) {
+		check(batch[i], statuses[i]);
+	}
+	return n;
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned total = DEFAULT_TOTAL, width = DEFAULT_WIDTH;
+	unsigned made, head, tail, alive, maxalive, shortfalls, n;
+	bool many = false;
+	time_t startsecs, secs;
+	unsigned long startnsecs, nsecs;
+	unsigned long long ms;
+	pid_t pid;
+	int i;
+
+	for (i=1; i<argc; i++) {
+		if (!strcmp(argv[i], "-m")) {
+			many = true;
+		}
+		else if (!strcmp(argv[i], "-n") && i+1 < argc) {
+			total = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-w") && i+1 < argc) {
+			width = atoi(argv[++i]);
+		}
+		else {
+			usage();
+		}
+	}
+	if (total == 0 || width == 0 || width > MAXWIDTH) {
+		usage();
+	}
+
+	/* Without -m, pids[] is a ring of live children, oldest at TAIL. */
+	made = head = tail = alive = maxalive = shortfalls = 0;
+
+	__time(&startsecs, &startnsecs);
+	while (made < total || alive > 0) {
+		if (made < total && alive < width) {
+			pid = fork();
+			if (pid < 0) {
+				if ((errno != ENOMEM && errno != EAGAIN) ||
+				    alive == 0) {
+					err(1, "fork");
+				}
+				/* Out of something; make room and retry. */
+				shortfalls++;
+			}
+			else if (pid == 0) {
+				_exit(getpid() & 0xff);
+			}
+			else {
+				pids[head] = pid;
+				head = (head + 1) % MAXWIDTH;
+				made++;
+				alive++;
+				if (alive > maxalive) {
+					maxalive = alive;
+				}
+				continue;
+			}
+		}
+		if (many) {
+			n = reapmany();
+			if (n > alive) {
+				errx(1, "waitmany reaped %u of %u children",
+				     n, alive);
+			}
+			alive -= n;
+		}
+		else {
+			reapone(tail);
+			tail = (tail + 1) % MAXWIDTH;
+			alive--;
+		}
+	}
+	__time(&secs, &nsecs);
+
+	if (nsecs < startnsecs) {
+		nsecs += 1000000000;
+		secs--;
+	}
+	secs -= startsecs;
+	nsecs -= startnsecs;
+	ms = (unsigned long long)secs * 1000 + nsecs / 1000000;
+
+	if (waitpid(-1, NULL, WNOHANG) >= 0 || errno != ECHILD) {
+		errx(1, "children left over after reaping them all");
+	}
+
+	printf("pidfarm: %u children, up to %u at once, in %lu.%03lu s "
+	       "(%llu forks/s)\n", total, maxalive, (unsigned long)secs,
+	       nsecs / 1000000, ms ? total * 1000ULL / ms : 0ULL);
+	if (shortfalls > 0) {
+		printf("pidfarm: fork ran short %u times\n", shortfalls);
+	}
+	return 0;
+}
@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * pipebench - measure pipe throughput.
+ * usage: pipebench [-m megabytes] [-b chunksize] [-p pipesize]
+ *
+ * Forks a child that writes MEGABYTES (default 64) of data into a
+ * pipe in CHUNKSIZE (default 4096) writes, while the parent reads it
+ * back out in the same size reads, checks every byte, and prints the
+ * throughput. PIPESIZE sets the pipe's buffer size (see pipe2); the
+ * default is the kernel's.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+
+#define DEFAULT_MB	64
+#define DEFAULT_CHUNK	4096
+#define MAXCHUNK	65536
+
+static char buf[MAXCHUNK];
+
+/*
+ * The byte at position POS in the stream. The period is prime so a
+ * chunk that lands in the wrong place doesn't match by accident.
+ */
+static
+unsigned char
+pattern(unsigned long long pos)
+{
+	return pos % 251;
+}
+
+static
+void
+writer(int fd, unsigned long long total, size_t chunk)
+{
+	unsigned long long pos = 0;
+	size_t len, i;
+	ssize_t r;
+
+	while (pos < total) {
+		len = chunk;
+		if (len > total - pos) {
+			len = total - pos;
+		}
+		for (i=0; i<len; i++) {
+			buf[i] = pattern(pos + i);
+		}
+		r = write(fd, buf, len);
+		if (r < 0) {
+			err(1, "write");
+		}
+		if ((size_t)r != len) {
+			errx(1, "short write (%ld of %lu)", (long)r,
+			     (unsigned long)len);
+		}
+		pos += len;
+	}
+}
+
+/*
+ * Read until EOF, checking each byte. Returns the number of reads.
+ */
+static
+unsigned long
+reader(int fd, unsigned long long total, size_t chunk)
+{
+	unsigned long long pos = 0;
+	unsigned long nreads = 0;
+	ssize_t r, i;
+
+	while (1) {
+		r = read(fd, buf, chunk);
+		if (r < 0) {
+			err(1, "read");
+		}
+		if (r == 0) {
+			break;
+		}
+		nreads++;
+		for (i=0; i<r; i++) {
+			if ((unsigned char)buf[i] != pattern(pos + i)) {
+				errx(1, "wrong byte at position %llu",
+				     pos + i);
+			}
+		}
+		pos += r;
+	}
+	if (pos != total) {
+		errx(1, "read %llu bytes, expected %llu", pos, total);
+	}
+	return nreads;
+}
+
+static
+void
+usage(void)
+{
+	errx(1, "usage: pipebench [-m megabytes] [-b chunksize] "
+	     "[-p pipesize]");
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned long long total, usecs;
+	unsigned long mb = DEFAULT_MB, nreads;
+	size_t chunk = DEFAULT_CHUNK, pipesize = 0;
+	time_t startsecs, secs;
+	unsigned long startnsecs, nsecs;
+	int fds[2], status, i;
+	pid_t pid;
+
+	for (i=1; i<argc; i++) {
+		if (i+1 >= argc) {
+			usage();
+		}
+		if (!strcmp(argv[i], "-m")) {
+			mb = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-b")) {
+			chunk = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-p")) {
+			pipesize = atoi(argv[++i]);
+		}
+		else {
+			usage();
+		}
+	}
+	if (mb == 0 || chunk == 0 || chunk > MAXCHUNK) {
+		usage();
+	}
+	total = (unsigned long long)mb * 1024 * 1024;
+
+	if (pipe2(fds, 0, pipesize) < 0) {
+		err(1, "pipe2");
+	}
+
+	__time(&startsecs, &startnsecs);
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		close(fds[0]);
+		writer(fds[1], total, chunk);
+		_exit(0);
+	}
+
+	close(fds[1]);
+	nreads = reader(fds[0], total, chunk);
+	close(fds[0]);
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		errx(1, "writer failed");
+	}
+
+	__time(&secs, &nsecs);
+	if (nsecs < startnsecs) {
+		nsecs += 1000000000;
+		secs--;
+	}
+	secs -= startsecs;
+	nsecs -= startnsecs;
+	usecs = (unsigned long long)secs * 1000000ULL + nsecs / 1000;
+
+	printf("pipebench: %lu MB in %lu.%09lu s (%llu KB/s), "
+	       "%lu writes, %lu reads\n", mb, (unsigned long)secs, nsecs,
+	       usecs == 0 ? 0ULL : total * 1000000ULL / 1024 / usecs,
+	       (unsigned long)((total + chunk - 1) / chunk), nreads);
+	return 0;
+}
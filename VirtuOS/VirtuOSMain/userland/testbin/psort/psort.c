@@ -47,6 +47,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <usync.h>
 
 #ifndef RANDOM_MAX
 /* Note: this is correct for OS/161 but not for some Unix C libraries */
@@ -103,6 +104,13 @@
  * FUTURE: maybe make a build option to malloc the work space instead
  * of using a static buffer, which would allow choosing WORKNUM on the
  * command line too, at the cost of depending on malloc working.
+ *
+ * With -t the workers are threads in this process instead of forked
+ * children. They can't share the static buffer, so each one gets a
+ * WORKNUM-sized slice of a malloc'd block, and the final assembly
+ * copies the merged bins itself instead of running /bin/cat. This is
+ * for comparing the cost of fork/exit/wait against thread_create and
+ * thread_join on the same workload.
  */
 
 /* Set the workload size. */
@@ -110,8 +118,9 @@
 static int numprocs = 4;
 static int numkeys = 128*1024;
 
-/* Per-process work buffer */
+/* Per-process work buffer; per-thread work buffers with -t */
 static int workspace[WORKNUM];
+static int *threadworkspace;
 
 /* Random seed for generating the data */
 static long randomseed = 15432753;
@@ -123,6 +132,12 @@ static unsigned long checksum;
 #define NOBODY (-1)
 static int me = NOBODY;
 
+/* Use threads instead of processes (-t) */
+static int usethreads;
+
+/* random() isn't thread-safe */
+static struct umutex randomlock = UMUTEX_INITIALIZER;
+
 static const char *progname;
 
 ////////////////////////////////////////////////////////////
@@ -485,13 +500,76 @@ dowait(int guy, pid_t pid)
 	return 0;
 }
 
+/*
+ * Thread mode: run one worker. Returning rather than exiting is how
+ * the joiner tells success from a worker that called exit().
+ */
+struct workerargs {
+	void (*wa_func)(int);
+	int wa_who;
+};
+
+static
+void *
+dothread(void *data)
+{
+	struct workerargs *wa = data;
+
+	wa->wa_func(wa->wa_who);
+	return wa;
+}
+
+static
+void
+dothreadall(const char *phasename, void (*func)(int))
+{
+	int i, bad = 0;
+	int tids[numprocs];
+	struct workerargs args[numprocs];
+	void *ret;
+
+	for (i=0; i<numprocs; i++) {
+		args[i].wa_func = func;
+		args[i].wa_who = i;
+		tids[i] = thread_create(dothread, &args[i]);
+		if (tids[i] < 0) {
+			complain("thread_create");
+			bad = 1;
+		}
+	}
+
+	for (i=0; i<numprocs; i++) {
+		if (tids[i] < 0) {
+			continue;
+		}
+		if (thread_join(tids[i], &ret) < 0) {
+			complain("thread_join");
+			bad = 1;
+		}
+		else if (ret != &args[i]) {
+			complainx("thread %d: exited", i);
+			bad = 1;
+		}
+	}
+
+	if (bad) {
+		complainx("%s failed.", phasename);
+		exit(1);
+	}
+}
+
 static
 void
-doforkall(const char *phasename, void (*func)(void))
+doforkall(const char *phasename, void (*func)(int))
 {
 	int i, bad = 0;
 	pid_t pids[numprocs];
 
+	if (usethreads) {
+		dothreadall(phasename, func);
+		return;
+	}
+
 	for (i=0; i<numprocs; i++) {
 		pids[i] = dofork();
 		if (pids[i] < 0) {
@@ -500,7 +578,7 @@ doforkall(const char *phasename, void (*func)(void))
 		else if (pids[i] == 0) {
 			/* child */
 			me = i;
-			func();
+			func(i);
 			exit(0);
 		}
 	}
@@ -519,13 +597,13 @@ doforkall(const char *phasename, void (*func)(void))
 
 static
 void
-seekmyplace(const char *name, int fd)
+seekmyplace(int who, const char *name, int fd)
 {
 	int keys_per, myfirst;
 	off_t offset;
 
 	keys_per = numkeys / numprocs;
-	myfirst = me*keys_per;
+	myfirst = who*keys_per;
 	offset = myfirst * sizeof(int);
 
 	dolseek(name, fd, offset, SEEK_SET);
@@ -533,17 +611,27 @@ seekmyplace(const char *name, int fd)
 
 static
 int
-getmykeys(void)
+getmykeys(int who)
 {
 	int keys_per, myfirst, mykeys;
 
 	keys_per = numkeys / numprocs;
-	myfirst = me*keys_per;
-	mykeys = (me < numprocs-1) ? keys_per : numkeys - myfirst;
+	myfirst = who*keys_per;
+	mykeys = (who < numprocs-1) ? keys_per : numkeys - myfirst;
 
 	return mykeys;
 }
 
+static
+int *
+getworkspace(int who)
+{
+	if (usethreads) {
+		return threadworkspace + who*WORKNUM;
+	}
+	return workspace;
+}
+
 ////////////////////////////////////////////////////////////
 
 static
@@ -574,16 +662,25 @@ static long *seeds;
 
 static
 void
-genkeys_sub(void)
+genkeys_sub(int who)
 {
 	int fd, i, mykeys, keys_done, keys_to_do, value;
+	int *workspace = getworkspace(who);
 
 	fd = doopen(PATH_KEYS, O_WRONLY, 0);
 
-	mykeys = getmykeys();
-	seekmyplace(PATH_KEYS, fd);
+	mykeys = getmykeys(who);
+	seekmyplace(who, PATH_KEYS, fd);
 
-	srandom(seeds[me]);
+	/*
+	 * The random() state is shared by all threads, so in thread
+	 * mode hold the lock for the whole run; otherwise the keys
+	 * would depend on how the threads interleave.
+	 */
+	if (usethreads) {
+		umutex_lock(&randomlock);
+	}
+	srandom(seeds[who]);
 	keys_done = 0;
 	while (keys_done < mykeys) {
 		keys_to_do = mykeys - keys_done;
@@ -609,6 +706,9 @@ genkeys_sub(void)
 		dowrite(PATH_KEYS, fd, workspace, keys_to_do*sizeof(int));
 		keys_done += keys_to_do;
 	}
+	if (usethreads) {
+		umutex_unlock(&randomlock);
+	}
 
 	doclose(PATH_KEYS, fd);
 }
@@ -649,40 +749,42 @@ genkeys(void)
 
 ////////////////////////////////////////////////////////////
 
+/* Buffer for binname, mergedname, and validname */
+#define NAMESIZE 32
+
 static
 const char *
-binname(int a, int b)
+binname(char *rv, int a, int b)
 {
-	static char rv[32];
-	snprintf(rv, sizeof(rv), "bin-%d-%d", a, b);
+	snprintf(rv, NAMESIZE, "bin-%d-%d", a, b);
 	return rv;
 }
 
 static
 const char *
-mergedname(int a)
+mergedname(char *rv, int a)
 {
-	static char rv[32];
-	snprintf(rv, sizeof(rv), "merged-%d", a);
+	snprintf(rv, NAMESIZE, "merged-%d", a);
 	return rv;
 }
 
 static
 void
-bin(void)
+bin(int who)
 {
 	int infd, outfds[numprocs];
-	const char *name;
+	char name[NAMESIZE];
 	int i, mykeys, keys_done, keys_to_do;
 	int key, pivot, binnum;
+	int *workspace = getworkspace(who);
 
 	infd = doopen(PATH_KEYS, O_RDONLY, 0);
 
-	mykeys = getmykeys();
-	seekmyplace(PATH_KEYS, infd);
+	mykeys = getmykeys(who);
+	seekmyplace(who, PATH_KEYS, infd);
 
 	for (i=0; i<numprocs; i++) {
-		name = binname(me, i);
+		binname(name, who, i);
 		outfds[i] = doopen(name, O_WRONLY|O_CREAT|O_TRUNC, 0664);
 	}
 
@@ -703,7 +805,7 @@ bin(void)
 
 			binnum = key / pivot;
 			if (key <= 0) {
-				complainx("proc %d: garbage key %d", me, key);
+				complainx("proc %d: garbage key %d", who, key);
 				key = 0;
 			}
 			assert(binnum >= 0);
@@ -716,28 +818,29 @@ bin(void)
 	doclose(PATH_KEYS, infd);
 
 	for (i=0; i<numprocs; i++) {
-		doclose(binname(me, i), outfds[i]);
+		doclose(binname(name, who, i), outfds[i]);
 	}
 }
 
 static
 void
-sortbins(void)
+sortbins(int who)
 {
-	const char *name;
+	char name[NAMESIZE];
 	int i, fd;
 	off_t binsize;
+	int *workspace = getworkspace(who);
 
 	for (i=0; i<numprocs; i++) {
-		name = binname(me, i);
+		binname(name, who, i);
 		binsize = getsize(name);
 		if (binsize % sizeof(int) != 0) {
 			complainx("%s: bin size %ld no good", name,
 				  (long) binsize);
 			exit(1);
 		}
-		if (binsize > (off_t) sizeof(workspace)) {
-			complainx("proc %d: %s: bin too large", me, name);
+		if (binsize > (off_t) (WORKNUM * sizeof(int))) {
+			complainx("proc %d: %s: bin too large", who, name);
 			exit(1);
 		}
 
@@ -754,19 +857,20 @@ sortbins(void)
 
 static
 void
-mergebins(void)
+mergebins(int who)
 {
 	int infds[numprocs], outfd;
 	int values[numprocs], ready[numprocs];
-	const char *name, *outname;
+	char name[NAMESIZE], outname[NAMESIZE];
 	int i, result;
 	int numready, place, val, worknum;
+	int *workspace = getworkspace(who);
 
-	outname = mergedname(me);
+	mergedname(outname, who);
 	outfd = doopen(outname, O_WRONLY|O_CREAT|O_TRUNC, 0664);
 
 	for (i=0; i<numprocs; i++) {
-		name = binname(i, me);
+		binname(name, i, who);
 		infds[i] = doopen(name, O_RDONLY, 0);
 		values[i] = 0;
 		ready[i] = 0;
@@ -791,7 +895,7 @@ mergebins(void)
 				}
 				if ((size_t) result != sizeof(int)) {
 					complainx("%s: read: short count",
-						  binname(i, me));
+						  binname(name, i, who));
 					exit(1);
 				}
 				values[i] = val;
@@ -836,20 +940,40 @@ mergebins(void)
 
 static
 void
-assemble(void)
+assemble(int who)
 {
+	char name[NAMESIZE];
 	off_t mypos;
-	int i, fd;
+	int i, fd, infd;
 	const char *args[3];
+	int *workspace;
+	size_t len;
 
 	mypos = 0;
-	for (i=0; i<me; i++) {
-		mypos += getsize(mergedname(i));
+	for (i=0; i<who; i++) {
+		mypos += getsize(mergedname(name, i));
 	}
 
 	fd = doopen(PATH_SORTED, O_WRONLY, 0);
 	dolseek(PATH_SORTED, fd, mypos, SEEK_SET);
 
+	if (usethreads) {
+		/*
+		 * Threads share stdout and can't exec, so do what cat
+		 * would have done.
+		 */
+		workspace = getworkspace(who);
+		mergedname(name, who);
+		infd = doopen(name, O_RDONLY, 0);
+		while ((len = doread(name, infd, workspace,
+				     WORKNUM * sizeof(int))) > 0) {
+			dowrite(PATH_SORTED, fd, workspace, len);
+		}
+		doclose(name, infd);
+		doclose(PATH_SORTED, fd);
+		return;
+	}
+
 	if (dup2(fd, STDOUT_FILENO) < 0) {
 		complain("dup2");
 		exit(1);
@@ -858,7 +982,7 @@ assemble(void)
 	doclose(PATH_SORTED, fd);
 
 	args[0] = "cat";
-	args[1] = mergedname(me);
+	args[1] = mergedname(name, who);
 	args[2] = NULL;
 	execv("/bin/cat", (char **) args);
 	complain("/bin/cat: exec");
@@ -869,13 +993,14 @@ static
 void
 checksize_bins(void)
 {
+	char name[NAMESIZE];
 	off_t totsize;
 	int i, j;
 
 	totsize = 0;
 	for (i=0; i<numprocs; i++) {
 		for (j=0; j<numprocs; j++) {
-			totsize += getsize(binname(i, j));
+			totsize += getsize(binname(name, i, j));
 		}
 	}
 	if (totsize != correctsize) {
@@ -889,12 +1014,13 @@ static
 void
 checksize_merge(void)
 {
+	char name[NAMESIZE];
 	off_t totsize;
 	int i;
 
 	totsize = 0;
 	for (i=0; i<numprocs; i++) {
-		totsize += getsize(mergedname(i));
+		totsize += getsize(mergedname(name, i));
 	}
 	if (totsize != correctsize) {
 		complain("Sum of merged sizes is wrong (%ld, should be %ld)",
@@ -907,6 +1033,7 @@ static
 void
 sort(void)
 {
+	char name[NAMESIZE];
 	unsigned long sortedsum;
 	int i, j;
 
@@ -934,7 +1061,7 @@ sort(void)
 	/* Step 3a: delete the bins */
 	for (i=0; i<numprocs; i++) {
 		for (j=0; j<numprocs; j++) {
-			doremove(binname(i, j));
+			doremove(binname(name, i, j));
 		}
 	}
 
@@ -949,7 +1076,7 @@ sort(void)
 
 	/* Step 4a: delete the merged bins */
 	for (i=0; i<numprocs; i++) {
-		doremove(mergedname(i));
+		doremove(mergedname(name, i));
 	}
 
 	/* Step 5: Checksum the result. */
@@ -967,10 +1094,9 @@ sort(void)
 
 static
 const char *
-validname(int a)
+validname(char *rv, int a)
 {
-	static char rv[32];
-	snprintf(rv, sizeof(rv), "valid-%d", a);
+	snprintf(rv, NAMESIZE, "valid-%d", a);
 	return rv;
 }
 
@@ -978,6 +1104,7 @@ static
 void
 checksize_valid(void)
 {
+	char name[NAMESIZE];
 	off_t totvsize, correctvsize;
 	int i;
 
@@ -985,7 +1112,7 @@ checksize_valid(void)
 
 	totvsize = 0;
 	for (i=0; i<numprocs; i++) {
-		totvsize += getsize(validname(i));
+		totvsize += getsize(validname(name, i));
 	}
 	if (totvsize != correctvsize) {
 		complainx("Sum of validation sizes is wrong "
@@ -997,17 +1124,19 @@ checksize_valid(void)
 
 static
 void
-dovalidate(void)
+dovalidate(int who)
 {
+	char vname[NAMESIZE];
 	const char *name;
 	int fd, i, mykeys, keys_done, keys_to_do;
 	int key, smallest, largest;
+	int *workspace = getworkspace(who);
 
 	name = PATH_SORTED;
 	fd = doopen(name, O_RDONLY, 0);
 
-	mykeys = getmykeys();
-	seekmyplace(name, fd);
+	mykeys = getmykeys(who);
+	seekmyplace(who, name, fd);
 
 	smallest = RANDOM_MAX;
 	largest = 0;
@@ -1049,7 +1178,7 @@ dovalidate(void)
 	}
 	doclose(name, fd);
 
-	name = validname(me);
+	name = validname(vname, who);
 	fd = doopen(name, O_WRONLY|O_CREAT|O_TRUNC, 0664);
 	dowrite(name, fd, &smallest, sizeof(smallest));
 	dowrite(name, fd, &largest, sizeof(largest));
@@ -1062,7 +1191,7 @@ validate(void)
 {
 	int smallest, largest, prev_largest;
 	int i, fd;
-	const char *name;
+	char name[NAMESIZE];
 
 	complainx("Validating the sorted data using %d procs", numprocs);
 	doforkall("Validation", dovalidate);
@@ -1071,7 +1200,7 @@ validate(void)
 	prev_largest = 1;
 
 	for (i=0; i<numprocs; i++) {
-		name = validname(i);
+		validname(name, i);
 		fd = doopen(name, O_RDONLY, 0);
 
 		doexactread(name, fd, &smallest, sizeof(int));
@@ -1103,7 +1232,7 @@ validate(void)
 
 
 	for (i=0; i<numprocs; i++) {
-		doremove(validname(i));
+		doremove(validname(name, i));
 	}
 }
 
@@ -1152,7 +1281,8 @@ static
 void
 usage(void)
 {
-	complain("Usage: %s [-p procs] [-k keys] [-s seed] [-r]", progname);
+	complain("Usage: %s [-p procs] [-k keys] [-s seed] [-r] [-t]",
+		 progname);
 	exit(1);
 }
 
@@ -1173,6 +1303,7 @@ doargs(int argc, char *argv[])
 		    case 'k': arg = 1; break;
 		    case 's': arg = 1; break;
 		    case 'r': arg = 0; break;
+		    case 't': arg = 0; break;
 		    default: usage(); return;
 		}
 		if (arg) {
@@ -1198,6 +1329,7 @@ doargs(int argc, char *argv[])
 		else {
 			switch (ch) {
 			    case 'r': randomize(); break;
+			    case 't': usethreads = 1; break;
 			    default: assert(0); break;
 			}
 		}
@@ -1212,6 +1344,14 @@ main(int argc, char *argv[])
 	doargs(argc, argv);
 	correctsize = (off_t) (numkeys*sizeof(int));
 
+	if (usethreads) {
+		threadworkspace = malloc(numprocs * WORKNUM * sizeof(int));
+		if (threadworkspace == NULL) {
+			complainx("Out of memory for %d workspaces", numprocs);
+			exit(1);
+		}
+	}
+
 	setdir();
 
 	genkeys();
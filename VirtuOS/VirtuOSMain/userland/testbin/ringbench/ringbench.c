@@ -0,0 +1,381 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * ringbench - compare small writes made one system call at a time
+ * with the same writes batched through an I/O submission ring.
+ * usage: ringbench [-n records] [-b recordsize] [-q ringsize] [file]
+ *
+ * Writes RECORDS (default 100000) records of RECORDSIZE (default 32)
+ * bytes, once with one write() each and once by queueing them on a
+ * ring of RINGSIZE (default 256) entries and calling ioring_enter()
+ * once per ringful. The ring run also does its open, fsync, and
+ * close through the ring. The file is read back and checked after
+ * each run.
+ *
+ * For each run it prints the number of system calls made and the
+ * time taken.
+ */
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+
+#define DEFAULT_RECORDS	100000
+#define DEFAULT_RECSIZE	32
+#define DEFAULT_RING	256
+#define MAXRECSIZE	512
+
+static const char *filename = "ringbench.dat";
+static unsigned nrecords = DEFAULT_RECORDS;
+static unsigned recsize = DEFAULT_RECSIZE;
+static unsigned ringsize = DEFAULT_RING;
+
+static time_t startsecs;
+static unsigned long startnsecs;
+
+static
+void
+starttimer(void)
+{
+	__time(&startsecs, &startnsecs);
+}
+
+/*
+ * Print the elapsed time since starttimer() and the syscall count.
+ */
+static
+void
+stoptimer(const char *what, unsigned nsyscalls)
+{
+	time_t secs;
+	unsigned long nsecs;
+	unsigned long long total;
+
+	__time(&secs, &nsecs);
+	if (nsecs < startnsecs) {
+		nsecs += 1000000000;
+		secs--;
+	}
+	secs -= startsecs;
+	nsecs -= startnsecs;
+
+	total = (unsigned long long)secs * 1000000000ULL + nsecs;
+	printf("%-12s %7u syscalls in %lu.%09lu s, %llu writes/s\n", what,
+	       nsyscalls, (unsigned long)secs, nsecs,
+	       total == 0 ? 0ULL :
+	       (unsigned long long)nrecords * 1000000000ULL / total);
+}
+
+////////////////////////////////////////////////////////////
+
+/*
+ * The byte at position POS in the file. The period is prime so a
+ * record that lands in the wrong place doesn't match by accident.
+ */
+static
+unsigned char
+pattern(unsigned long long pos)
+{
+	return pos % 251;
+}
+
+static
+void
+fillrecord(char *buf, unsigned n)
+{
+	unsigned long long pos = (unsigned long long)n * recsize;
+	unsigned i;
+
+	for (i=0; i<recsize; i++) {
+		buf[i] = pattern(pos + i);
+	}
+}
+
+/*
+ * Read the file back and check every byte.
+ */
+static
+void
+checkfile(const char *what)
+{
+	char buf[4096];
+	unsigned long long pos, total;
+	ssize_t r, i;
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s", filename);
+	}
+	total = (unsigned long long)nrecords * recsize;
+	pos = 0;
+	while ((r = read(fd, buf, sizeof(buf))) > 0) {
+		for (i=0; i<r; i++) {
+			if ((unsigned char)buf[i] != pattern(pos + i)) {
+				errx(1, "%s: wrong byte at position %llu",
+				     what, pos + i);
+			}
+		}
+		pos += r;
+	}
+	if (r < 0) {
+		err(1, "%s: read", filename);
+	}
+	if (pos != total) {
+		errx(1, "%s: file has %llu bytes, expected %llu", what,
+		     pos, total);
+	}
+	close(fd);
+}
+
+////////////////////////////////////////////////////////////
+
+static
+void
+direct_run(void)
+{
+	char buf[MAXRECSIZE];
+	unsigned n, calls;
+	ssize_t r;
+	int fd;
+
+	starttimer();
+	fd = open(filename, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s", filename);
+	}
+	calls = 1;
+	for (n=0; n<nrecords; n++) {
+		fillrecord(buf, n);
+		r = write(fd, buf, recsize);
+		if (r < 0) {
+			err(1, "write");
+		}
+		if ((size_t)r != recsize) {
+			errx(1, "short write");
+		}
+		calls++;
+	}
+	if (fsync(fd) < 0) {
+		err(1, "fsync");
+	}
+	close(fd);
+	calls += 2;
+	stoptimer("direct", calls);
+	checkfile("direct");
+}
+
+////////////////////////////////////////////////////////////
+
+static struct ioring *ring;
+static struct ioring_sqe *sqes;
+static struct ioring_cqe *cqes;
+static char (*bufs)[MAXRECSIZE];	/* one per ring slot */
+static unsigned ringcalls;
+
+/*
+ * Get the next free submission entry.
+ */
+static
+struct ioring_sqe *
+getsqe(void)
+{
+	struct ioring_sqe *sqe;
+
+	if (ring->ir_sqtail - ring->ir_sqhead >= ring->ir_entries) {
+		errx(1, "ring overflow");
+	}
+	sqe = &sqes[ring->ir_sqtail & (ring->ir_entries - 1)];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->sqe_off = -1;
+	return sqe;
+}
+
+/*
+ * Submit everything queued and reap the completions. Each request's
+ * sqe_data is the result it should get; returns the result of the
+ * last one.
+ */
+static
+long long
+submit(const char *what)
+{
+	struct ioring_cqe *cqe;
+	unsigned queued;
+	long long res = 0;
+	int r;
+
+	queued = ring->ir_sqtail - ring->ir_sqhead;
+	while (queued > 0) {
+		r = ioring_enter(queued);
+		ringcalls++;
+		if (r < 0) {
+			err(1, "ioring_enter");
+		}
+		if (r == 0) {
+			errx(1, "ioring_enter made no progress");
+		}
+		queued -= r;
+
+		while (ring->ir_cqhead != ring->ir_cqtail) {
+			cqe = &cqes[ring->ir_cqhead & (ring->ir_entries - 1)];
+			res = cqe->cqe_res;
+			if (res < 0) {
+				errno = -res;
+				err(1, "%s", what);
+			}
+			if (cqe->cqe_data != (uint64_t)-1 &&
+			    (uint64_t)res != cqe->cqe_data) {
+				errx(1, "%s: got %lld, expected %llu", what,
+				     res, cqe->cqe_data);
+			}
+			ring->ir_cqhead++;
+		}
+	}
+	return res;
+}
+
+static
+void
+ring_run(void)
+{
+	struct ioring_sqe *sqe;
+	unsigned n, slot;
+	int fd;
+
+	ring = ioring_setup(ringsize);
+	if (ring == (void *)-1) {
+		err(1, "ioring_setup");
+	}
+	sqes = (struct ioring_sqe *)((char *)ring + ring->ir_sqoff);
+	cqes = (struct ioring_cqe *)((char *)ring + ring->ir_cqoff);
+	bufs = malloc(ring->ir_entries * sizeof(*bufs));
+	if (bufs == NULL) {
+		err(1, "malloc");
+	}
+	ringcalls = 1;
+
+	starttimer();
+
+	sqe = getsqe();
+	sqe->sqe_op = IORING_OP_OPEN;
+	sqe->sqe_buf = (void *)filename;
+	sqe->sqe_flags = O_WRONLY|O_CREAT|O_TRUNC;
+	sqe->sqe_mode = 0664;
+	sqe->sqe_data = (uint64_t)-1;		/* any fd */
+	ring->ir_sqtail++;
+	fd = submit("open");
+
+	for (n=0; n<nrecords; n++) {
+		if (ring->ir_sqtail - ring->ir_sqhead == ring->ir_entries) {
+			submit("write");
+		}
+		slot = ring->ir_sqtail & (ring->ir_entries - 1);
+		fillrecord(bufs[slot], n);
+		sqe = getsqe();
+		sqe->sqe_op = IORING_OP_WRITE;
+		sqe->sqe_fd = fd;
+		sqe->sqe_buf = bufs[slot];
+		sqe->sqe_len = recsize;
+		sqe->sqe_data = recsize;
+		ring->ir_sqtail++;
+	}
+	submit("write");
+
+	/* fsync and close in one go */
+	sqe = getsqe();
+	sqe->sqe_op = IORING_OP_FSYNC;
+	sqe->sqe_fd = fd;
+	ring->ir_sqtail++;
+	sqe = getsqe();
+	sqe->sqe_op = IORING_OP_CLOSE;
+	sqe->sqe_fd = fd;
+	ring->ir_sqtail++;
+	submit("fsync/close");
+
+	stoptimer("ring", ringcalls);
+	checkfile("ring");
+
+	free(bufs);
+	if (shm_unmap(ring) < 0) {
+		err(1, "shm_unmap");
+	}
+}
+
+////////////////////////////////////////////////////////////
+
+static
+void
+usage(void)
+{
+	errx(1, "usage: ringbench [-n records] [-b recordsize] "
+	     "[-q ringsize] [file]");
+}
+
+int
+main(int argc, char *argv[])
+{
+	int i;
+
+	for (i=1; i<argc; i++) {
+		if (!strcmp(argv[i], "-n") && i+1 < argc) {
+			nrecords = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-b") && i+1 < argc) {
+			recsize = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-q") && i+1 < argc) {
+			ringsize = atoi(argv[++i]);
+		}
+		else if (argv[i][0] != '-') {
+			filename = argv[i];
+		}
+		else {
+			usage();
+		}
+	}
+	if (nrecords == 0 || recsize == 0 || recsize > MAXRECSIZE ||
+	    ringsize == 0 || ringsize > IORING_MAXENTRIES) {
+		usage();
+	}
+
+	direct_run();
+	ring_run();
+
+	remove(filename);
+	printf("ringbench: passed\n");
+	return 0;
+}
@@ -45,6 +45,12 @@
 
 struct usem startsem;
 
+/* Nice value for the CPU-bound (thinker and grinder) task groups. */
+static int cpunice;
+
+/* Use semfs semaphores instead of futex ones in shared memory (-S). */
+static int usesemfs;
+
 /*
  * Task hook function that does nothing.
  */
@@ -56,6 +62,22 @@ nop(unsigned groupid, unsigned count)
 	(void)count;
 }
 
+/*
+ * Task hook function for the CPU-bound groups: apply the -n nice
+ * value in the group director so all the tasks inherit it.
+ */
+static
+void
+cpuprep(unsigned groupid, unsigned count)
+{
+	(void)groupid;
+	(void)count;
+
+	if (cpunice != 0 && setpriority(PRIO_PROCESS, 0, cpunice) < 0) {
+		err(1, "setpriority");
+	}
+}
+
 /*
  * Wrapper for wait.
  */
@@ -232,11 +254,17 @@ runit(unsigned numthinkers, unsigned numgrinders,
 	printf("Running with %u thinkers, %u grinders, and %u pong groups "
 	       "of size %u each.\n", numthinkers, numgrinders, numponggroups,
 	       ponggroupsize);
+	if (usesemfs) {
+		printf("Using semfs semaphores.\n");
+	}
 
+	if (!usesemfs) {
+		usem_mapshared();
+	}
 	usem_init(&startsem, STARTSEM);
 	createresultsfile();
-	forkem(numthinkers, nop, think, nop, 0, &pids[0]);
-	forkem(numgrinders, nop, grind, nop, 1, &pids[1]);
+	forkem(numthinkers, cpuprep, think, nop, 0, &pids[0]);
+	forkem(numgrinders, cpuprep, grind, nop, 1, &pids[1]);
 	for (i=0; i<numponggroups; i++) {
 		forkem(ponggroupsize, pong_prep, pong, pong_cleanup, i+2,
 		       &pids[i+2]);
@@ -281,6 +309,8 @@ usage(const char *av0)
 	warnx("  [-g grinders]         set number of grinders (default 0)");
 	warnx("  [-p ponggroups]       set number of pong groups (default 1)");
 	warnx("  [-s ponggroupsize]    set pong group size (default 6)");
+	warnx("  [-n nice]             nice value for thinkers and grinders");
+	warnx("  [-S]                  use semfs semaphores, not futexes");
 	warnx("Thinkers are CPU bound; grinders are memory-bound;");
 	warnx("pong groups are I/O bound.");
 	exit(1);
@@ -309,6 +339,12 @@ main(int argc, char *argv[])
 		else if (!strcmp(argv[i], "-s")) {
 			ponggroupsize = atoi(argv[++i]);
 		}
+		else if (!strcmp(argv[i], "-n")) {
+			cpunice = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-S")) {
+			usesemfs = 1;
+		}
 		else {
 			usage(argv[0]);
 		}
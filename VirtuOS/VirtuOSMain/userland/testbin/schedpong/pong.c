@@ -63,6 +63,8 @@ pong_prep(unsigned groupid, unsigned count)
 	if (count > MAXCOUNT) {
 		err(1, "pong: too many pongers -- recompile pong.c");
 	}
+	/* our own page; the one startsem is in came from the parent */
+	usem_mapshared();
 	for (i=0; i<count; i++) {
 		usem_init(&sems[i], "sem:pong-%u-%u", groupid, i);
 	}
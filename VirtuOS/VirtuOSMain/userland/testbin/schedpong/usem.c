@@ -38,9 +38,41 @@
 #include <string.h>
 #include <unistd.h>
 #include <err.h>
+#include <usync.h>
 
 #include "usem.h"
 
+/* Size of the shared memory usem_mapshared gets */
+#define USEM_SHAREDSIZE 4096
+
+/* Shared memory to put futex semaphores in, if any */
+static char *usem_shared;
+static size_t usem_sharedleft;
+
+void
+usem_setshared(void *mem, size_t size)
+{
+	usem_shared = mem;
+	usem_sharedleft = size;
+}
+
+/*
+ * Map an anonymous shared page for the semaphores made after this.
+ * If the kernel won't, fall back to semfs.
+ */
+void
+usem_mapshared(void)
+{
+	void *mem;
+
+	mem = shm_map(NULL, O_RDWR, USEM_SHAREDSIZE);
+	if (mem == (void *)-1) {
+		warn("shm_map; using semfs semaphores");
+		return;
+	}
+	usem_setshared(mem, USEM_SHAREDSIZE);
+}
+
 void
 usem_init(struct usem *sem, const char *namefmt, ...)
 {
@@ -50,6 +82,16 @@ usem_init(struct usem *sem, const char *namefmt, ...)
 	vsnprintf(sem->name, sizeof(sem->name), namefmt, ap);
 	va_end(ap);
 
+	if (usem_sharedleft >= sizeof(struct usema)) {
+		sem->fast = (struct usema *)usem_shared;
+		usem_shared += sizeof(struct usema);
+		usem_sharedleft -= sizeof(struct usema);
+		usema_init(sem->fast, 0);
+		sem->fd = -1;
+		return;
+	}
+	sem->fast = NULL;
+
 	sem->fd = open(sem->name, O_RDWR|O_CREAT|O_TRUNC, 0664);
 	if (sem->fd < 0) {
 		err(1, "%s: create", sem->name);
@@ -61,6 +103,9 @@ usem_init(struct usem *sem, const char *namefmt, ...)
 void
 usem_open(struct usem *sem)
 {
+	if (sem->fast != NULL) {
+		return;
+	}
 	sem->fd = open(sem->name, O_RDWR);
 	if (sem->fd < 0) {
 		err(1, "%s: open", sem->name);
@@ -70,6 +115,9 @@ usem_open(struct usem *sem)
 void
 usem_close(struct usem *sem)
 {
+	if (sem->fast != NULL) {
+		return;
+	}
 	if (close(sem->fd) == -1) {
 		warn("%s: close", sem->name);
 	}
@@ -78,6 +126,9 @@ usem_close(struct usem *sem)
 void
 usem_cleanup(struct usem *sem)
 {
+	if (sem->fast != NULL) {
+		return;
+	}
 	(void)remove(sem->name);
 }
 
@@ -87,6 +138,13 @@ Pn(struct usem *sem, unsigned count)
 	ssize_t r;
 	char c[count];
 
+	if (sem->fast != NULL) {
+		while (count-- > 0) {
+			usema_P(sem->fast);
+		}
+		return;
+	}
+
 	r = read(sem->fd, c, count);
 	if (r < 0) {
 		err(1, "%s: read", sem->name);
@@ -108,6 +166,11 @@ Vn(struct usem *sem, unsigned count)
 	ssize_t r;
 	char c[count];
 
+	if (sem->fast != NULL) {
+		usema_Vn(sem->fast, count);
+		return;
+	}
+
 	/* semfs does not use these values, but be conservative */
 	memset(c, 0, count);
 
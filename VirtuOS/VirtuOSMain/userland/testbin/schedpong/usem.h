@@ -30,10 +30,17 @@
 
 /*
  * Semaphore structure.
+ *
+ * If usem_setshared() has been given memory that the task processes
+ * really share, semaphores are allocated from it and use futexes
+ * (FAST is set); otherwise they are semfs files opened by name.
+ * usem_mapshared() gets such memory from shm_map, for processes
+ * forked after it's called.
  */
 struct usem {
 	char name[32];
 	int fd;
+	struct usema *fast;
 };
 
 /* XXX this should be in sys/cdefs.h */
@@ -43,6 +50,8 @@ struct usem {
 #define __PF(a, b)
 #endif
 
+void usem_setshared(void *mem, size_t size);
+void usem_mapshared(void);
 __PF(2, 3) void usem_init(struct usem *sem, const char *namefmt, ...);
 void usem_open(struct usem *sem);
 void usem_close(struct usem *sem);
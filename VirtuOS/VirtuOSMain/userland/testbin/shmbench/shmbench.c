@@ -0,0 +1,395 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * shmbench - compare moving data between processes through a shared
+ * memory segment with moving it through a file.
+ * usage: shmbench [-m megabytes] [-b chunksize] [-s slots] [-N]
+ *
+ * A forked producer generates MEGABYTES (default 16) of data in
+ * CHUNKSIZE (default 4096) pieces and a consumer, the parent, checks
+ * every byte.
+ *
+ * The file run is the way to do it without shared memory: the
+ * producer writes the data to a file and the consumer reads it back
+ * after the producer exits.
+ *
+ * The shared memory run uses a ring of SLOTS (default 8) chunks in an
+ * anonymous segment, with a pair of futex semaphores in the segment
+ * to count free and full slots. The producer builds each chunk in
+ * place and the consumer checks it in place, so nothing is copied
+ * and there are no system calls except to sleep and wake up. With
+ * -N the segment is named instead, and the producer maps it again by
+ * name, so the two sides see the same pages at different addresses.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <err.h>
+#include <usync.h>
+
+#define DEFAULT_MB	16
+#define DEFAULT_CHUNK	4096
+#define DEFAULT_SLOTS	8
+#define MAXCHUNK	65536
+#define MAXSEGMENT	(4*1024*1024)	/* SHM_MAXSIZE in the kernel */
+
+#define FILENAME	"shmbench.dat"
+#define SHMNAME		"shmbench"
+
+/* The shared ring; the slots follow the header. */
+struct ring {
+	struct usema r_free;		/* empty slots */
+	struct usema r_full;		/* slots ready to consume */
+	char r_data[];
+};
+
+static char buf[MAXCHUNK];
+
+static unsigned long long total;
+static size_t chunk = DEFAULT_CHUNK;
+static unsigned nslots = DEFAULT_SLOTS;
+
+static time_t startsecs;
+static unsigned long startnsecs;
+
+static
+void
+starttimer(void)
+{
+	__time(&startsecs, &startnsecs);
+}
+
+/*
+ * Print the elapsed time since starttimer() and the throughput.
+ */
+static
+void
+stoptimer(const char *what)
+{
+	unsigned long long usecs;
+	time_t secs;
+	unsigned long nsecs;
+
+	__time(&secs, &nsecs);
+	if (nsecs < startnsecs) {
+		nsecs += 1000000000;
+		secs--;
+	}
+	secs -= startsecs;
+	nsecs -= startnsecs;
+	usecs = (unsigned long long)secs * 1000000ULL + nsecs / 1000;
+
+	printf("%-12s %llu MB in %lu.%09lu s (%llu KB/s)\n", what,
+	       total / 1024 / 1024, (unsigned long)secs, nsecs,
+	       usecs == 0 ? 0ULL : total * 1000000ULL / 1024 / usecs);
+}
+
+////////////////////////////////////////////////////////////
+
+/*
+ * The byte at position POS in the stream. The period is prime so a
+ * chunk that lands in the wrong place doesn't match by accident.
+ */
+static
+unsigned char
+pattern(unsigned long long pos)
+{
+	return pos % 251;
+}
+
+static
+void
+fill(char *p, unsigned long long pos, size_t len)
+{
+	size_t i;
+
+	for (i=0; i<len; i++) {
+		p[i] = pattern(pos + i);
+	}
+}
+
+static
+void
+check(const char *p, unsigned long long pos, size_t len)
+{
+	size_t i;
+
+	for (i=0; i<len; i++) {
+		if ((unsigned char)p[i] != pattern(pos + i)) {
+			errx(1, "wrong byte at position %llu", pos + i);
+		}
+	}
+}
+
+/*
+ * Length of the chunk at POS.
+ */
+static
+size_t
+chunklen(unsigned long long pos)
+{
+	return total - pos < chunk ? total - pos : chunk;
+}
+
+static
+void
+waitchild(pid_t pid)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		errx(1, "producer failed");
+	}
+}
+
+////////////////////////////////////////////////////////////
+
+static
+void
+file_producer(void)
+{
+	unsigned long long pos;
+	size_t len;
+	ssize_t r;
+	int fd;
+
+	fd = open(FILENAME, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s", FILENAME);
+	}
+	for (pos = 0; pos < total; pos += len) {
+		len = chunklen(pos);
+		fill(buf, pos, len);
+		r = write(fd, buf, len);
+		if (r < 0) {
+			err(1, "%s: write", FILENAME);
+		}
+		if ((size_t)r != len) {
+			errx(1, "%s: short write", FILENAME);
+		}
+	}
+	close(fd);
+}
+
+static
+void
+file_consumer(void)
+{
+	unsigned long long pos;
+	size_t len;
+	ssize_t r;
+	int fd;
+
+	fd = open(FILENAME, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s", FILENAME);
+	}
+	for (pos = 0; pos < total; pos += len) {
+		len = chunklen(pos);
+		r = read(fd, buf, len);
+		if (r < 0) {
+			err(1, "%s: read", FILENAME);
+		}
+		if ((size_t)r != len) {
+			errx(1, "%s: short read", FILENAME);
+		}
+		check(buf, pos, len);
+	}
+	close(fd);
+}
+
+static
+void
+file_run(void)
+{
+	pid_t pid;
+
+	starttimer();
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		file_producer();
+		_exit(0);
+	}
+	waitchild(pid);
+	file_consumer();
+	stoptimer("file");
+	remove(FILENAME);
+}
+
+////////////////////////////////////////////////////////////
+
+static
+void
+shm_producer(struct ring *r)
+{
+	unsigned long long pos;
+	unsigned slot = 0;
+	size_t len;
+
+	for (pos = 0; pos < total; pos += len) {
+		len = chunklen(pos);
+		usema_P(&r->r_free);
+		fill(r->r_data + slot * chunk, pos, len);
+		usema_V(&r->r_full);
+		slot = (slot + 1) % nslots;
+	}
+}
+
+static
+void
+shm_consumer(struct ring *r)
+{
+	unsigned long long pos;
+	unsigned slot = 0;
+	size_t len;
+
+	for (pos = 0; pos < total; pos += len) {
+		len = chunklen(pos);
+		usema_P(&r->r_full);
+		check(r->r_data + slot * chunk, pos, len);
+		usema_V(&r->r_free);
+		slot = (slot + 1) % nslots;
+	}
+}
+
+static
+void
+shm_run(int named)
+{
+	struct ring *r;
+	size_t size;
+	pid_t pid;
+
+	size = sizeof(struct ring) + nslots * chunk;
+	if (size > MAXSEGMENT) {
+		errx(1, "ring too big (%lu bytes)", (unsigned long)size);
+	}
+
+	if (named) {
+		/* clear out any leftover from a crashed run */
+		(void)shm_unlink(SHMNAME);
+		r = shm_map(SHMNAME, O_RDWR|O_CREAT|O_EXCL, size);
+	}
+	else {
+		r = shm_map(NULL, O_RDWR, size);
+	}
+	if (r == (void *)-1) {
+		err(1, "shm_map");
+	}
+	usema_init(&r->r_free, nslots);
+	usema_init(&r->r_full, 0);
+
+	starttimer();
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		if (named) {
+			r = shm_map(SHMNAME, O_RDWR, 0);
+			if (r == (void *)-1) {
+				err(1, "shm_map %s", SHMNAME);
+			}
+		}
+		shm_producer(r);
+		_exit(0);
+	}
+	shm_consumer(r);
+	waitchild(pid);
+	stoptimer(named ? "named shm" : "shm");
+
+	if (shm_unmap(r) < 0) {
+		err(1, "shm_unmap");
+	}
+	if (named && shm_unlink(SHMNAME) < 0) {
+		err(1, "shm_unlink");
+	}
+}
+
+////////////////////////////////////////////////////////////
+
+static
+void
+usage(void)
+{
+	errx(1, "usage: shmbench [-m megabytes] [-b chunksize] [-s slots] "
+	     "[-N]");
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned long mb = DEFAULT_MB;
+	int named = 0;
+	int i;
+
+	for (i=1; i<argc; i++) {
+		if (!strcmp(argv[i], "-N")) {
+			named = 1;
+		}
+		else if (i+1 >= argc) {
+			usage();
+		}
+		else if (!strcmp(argv[i], "-m")) {
+			mb = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-b")) {
+			chunk = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-s")) {
+			nslots = atoi(argv[++i]);
+		}
+		else {
+			usage();
+		}
+	}
+	if (mb == 0 || chunk == 0 || chunk > MAXCHUNK || nslots == 0) {
+		usage();
+	}
+	total = (unsigned long long)mb * 1024 * 1024;
+
+	file_run();
+	shm_run(named);
+
+	printf("shmbench: passed\n");
+	return 0;
+}
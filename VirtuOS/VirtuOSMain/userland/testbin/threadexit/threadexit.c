@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * threadexit.c
+ *
+ *      Tests exit and exec in a process with several threads:
+ *
+ *      - execv fails with EBUSY while another thread exists;
+ *      - _exit from a second thread ends the process even though the
+ *        main thread is asleep in thread_join or futex_wait;
+ *      - _exit from the main thread ends a second thread that's
+ *        spinning in user mode.
+ *
+ *      The last two run in child processes; if the exit doesn't end
+ *      the whole process, waitpid never returns and the test hangs.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <errno.h>
+#include <err.h>
+
+static volatile int stop;
+static volatile int never;
+
+static
+void *
+spinner(void *arg)
+{
+	(void)arg;
+	while (!stop) {
+		/* nothing */
+	}
+	return NULL;
+}
+
+static
+void *
+exiter(void *arg)
+{
+	volatile int i;
+
+	/* give the main thread time to go to sleep */
+	for (i=0; i<100000; i++) {
+		/* nothing */
+	}
+	_exit((int)arg);
+}
+
+/*
+ * Run FUNC in a child process and check that it exits with STATUS.
+ */
+static
+void
+inchild(void (*func)(void), int status, const char *what)
+{
+	pid_t pid;
+	int ret;
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		func();
+		errx(1, "%s: child kept going", what);
+	}
+	if (waitpid(pid, &ret, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (!WIFEXITED(ret) || WEXITSTATUS(ret) != status) {
+		errx(1, "%s: child status 0x%x, wanted exit %d", what,
+		     ret, status);
+	}
+	printf("%s: passed\n", what);
+}
+
+static
+void
+exec_busy(void)
+{
+	char *args[2] = { (char *)"true", NULL };
+	int tid;
+
+	stop = 0;
+	tid = thread_create(spinner, NULL);
+	if (tid < 0) {
+		err(1, "thread_create");
+	}
+	if (execv("/bin/true", args) != -1 || errno != EBUSY) {
+		errx(1, "execv with two threads didn't fail with EBUSY");
+	}
+	stop = 1;
+	if (thread_join(tid, NULL) < 0) {
+		err(1, "thread_join");
+	}
+	printf("exec with threads: passed\n");
+}
+
+static
+void
+exit_while_joining(void)
+{
+	int tid;
+
+	tid = thread_create(exiter, (void *)3);
+	if (tid < 0) {
+		err(1, "thread_create");
+	}
+	thread_join(tid, NULL);
+}
+
+static
+void
+exit_while_waiting(void)
+{
+	if (thread_create(exiter, (void *)4) < 0) {
+		err(1, "thread_create");
+	}
+	while (1) {
+		futex_wait(&never, 0, NULL);
+	}
+}
+
+static
+void
+exit_while_spinning(void)
+{
+	stop = 0;
+	if (thread_create(spinner, NULL) < 0) {
+		err(1, "thread_create");
+	}
+	_exit(5);
+}
+
+int
+main(void)
+{
+	exec_busy();
+	inchild(exit_while_joining, 3, "exit during thread_join");
+	inchild(exit_while_waiting, 4, "exit during futex_wait");
+	inchild(exit_while_spinning, 5, "exit with a thread running");
+	printf("threadexit: passed\n");
+	return 0;
+}
@@ -28,7 +28,9 @@
  */
 
 /*
- * Simple test for the user-level semaphores provided by semfs, aka
+ * Simple test for user-level semaphores: by default the futex-based
+ * ones from <usync.h>, placed in a shm_map page the processes share;
+ * with -s (or if shm_map fails), the ones provided by semfs, aka
  * "sem:".
  *
  * This should mostly run once you've implemented open, read, write,
@@ -43,7 +45,11 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <string.h>
 #include <err.h>
+#ifndef HOST
+#include <usync.h>
+#endif
 
 #define ONCELOOPS   3
 #define TWICELOOPS  2
@@ -111,18 +117,63 @@ dowait(pid_t pid, unsigned num)
 // semaphore access
 
 /*
- * Semaphore structure.
+ * Semaphore structure. FAST is set if the semaphore lives in shared
+ * memory and uses futexes; otherwise it's a semfs file.
  */
 struct usem {
 	char name[32];
 	int fd;
+#ifndef HOST
+	struct usema *fast;
+#endif
 };
 
+#ifndef HOST
+/* Size of the shared memory usem_mapshared gets */
+#define USEM_SHAREDSIZE 4096
+
+/* Shared memory to put futex semaphores in, if any */
+static char *usem_shared;
+static size_t usem_sharedleft;
+#endif
+
+/*
+ * Map an anonymous shared page for the semaphores made after this.
+ * If the kernel won't, fall back to semfs.
+ */
+static
+void
+usem_mapshared(void)
+{
+#ifndef HOST
+	void *mem;
+
+	mem = shm_map(NULL, O_RDWR, USEM_SHAREDSIZE);
+	if (mem == (void *)-1) {
+		warn("shm_map; using semfs semaphores");
+		return;
+	}
+	usem_shared = mem;
+	usem_sharedleft = USEM_SHAREDSIZE;
+#endif
+}
+
 static
 void
 usem_init(struct usem *sem, const char *tag, unsigned num)
 {
 	snprintf(sem->name, sizeof(sem->name), "sem:usemtest.%s%u", tag, num);
+#ifndef HOST
+	if (usem_sharedleft >= sizeof(struct usema)) {
+		sem->fast = (struct usema *)usem_shared;
+		usem_shared += sizeof(struct usema);
+		usem_sharedleft -= sizeof(struct usema);
+		usema_init(sem->fast, 0);
+		sem->fd = -1;
+		return;
+	}
+	sem->fast = NULL;
+#endif
 	sem->fd = open(sem->name, O_RDWR|O_CREAT|O_TRUNC, 0664);
 	if (sem->fd < 0) {
 		err(1, "%s: create", sem->name);
@@ -135,6 +186,11 @@ static
 void
 usem_open(struct usem *sem)
 {
+#ifndef HOST
+	if (sem->fast != NULL) {
+		return;
+	}
+#endif
 	sem->fd = open(sem->name, O_RDWR);
 	if (sem->fd < 0) {
 		err(1, "%s: open", sem->name);
@@ -145,6 +201,11 @@ static
 void
 usem_close(struct usem *sem)
 {
+#ifndef HOST
+	if (sem->fast != NULL) {
+		return;
+	}
+#endif
 	if (close(sem->fd) == -1) {
 		warn("%s: close", sem->name);
 	}
@@ -154,6 +215,11 @@ static
 void
 usem_cleanup(struct usem *sem)
 {
+#ifndef HOST
+	if (sem->fast != NULL) {
+		return;
+	}
+#endif
 	(void)remove(sem->name);
 }
 
@@ -164,6 +230,12 @@ P(struct usem *sem)
 	ssize_t r;
 	char c;
 
+#ifndef HOST
+	if (sem->fast != NULL) {
+		usema_P(sem->fast);
+		return;
+	}
+#endif
 	r = read(sem->fd, &c, 1);
 	if (r < 0) {
 		err(1, "%s: read", sem->name);
@@ -180,6 +252,12 @@ V(struct usem *sem)
 	ssize_t r;
 	char c;
 
+#ifndef HOST
+	if (sem->fast != NULL) {
+		usema_V(sem->fast);
+		return;
+	}
+#endif
 	r = write(sem->fd, &c, 1);
 	if (r < 0) {
 		err(1, "%s: write", sem->name);
@@ -380,8 +458,18 @@ conctest(void)
 // concurrent use test
 
 int
-main(void)
+main(int argc, char *argv[])
 {
+	if (argc == 2 && !strcmp(argv[1], "-s")) {
+		/* semfs only */
+	}
+	else if (argc == 1) {
+		usem_mapshared();
+	}
+	else {
+		errx(1, "Usage: usemtest [-s]");
+	}
+
 	basetest();
 	conctest();
 	say("Passed.\n");
@@ -37,10 +37,11 @@
  *
  * It also makes various assumptions about the thread API. In
  * particular, it believes (1) that you create a thread by calling
- * "threadfork()" and passing the address for execution of the new
- * thread to begin at, (2) that if the parent thread exits any child
- * threads will keep running, and (3) child threads will exit if they
- * return from the function they started in. If any or all of these
+ * "thread_create()" and passing the address for execution of the new
+ * thread to begin at, (2) that the parent thread has to wait for the
+ * child threads with thread_join, since exiting the process ends
+ * them, and (3) child threads will exit if they return from the
+ * function they started in. If any or all of these
  * assumptions are not met by your user-level threads, you will need
  * to patch this test accordingly.
  *
@@ -64,19 +65,45 @@ volatile int count = 0;
 void ThreadRunner(void);
 void BladeRunner(void);
 
+/* thread_create entry points for them */
+static
+void *
+ThreadRunnerStart(void *arg)
+{
+    (void)arg;
+    ThreadRunner();
+    return NULL;
+}
+
+static
+void *
+BladeRunnerStart(void *arg)
+{
+    (void)arg;
+    BladeRunner();
+    return NULL;
+}
+
 int
 main(int argc, char *argv[])
 {
     int i;
+    int tids[NTHREADS];
 
     (void)argc;
     (void)argv;
 
     for (i=0; i<NTHREADS; i++) {
 	if (i)
-	    threadfork(ThreadRunner);
+	    tids[i] = thread_create(ThreadRunnerStart, NULL);
         else
-	    threadfork(BladeRunner);
+	    tids[i] = thread_create(BladeRunnerStart, NULL);
+    }
+
+    printf("Parent is waiting.\n");
+    for (i=0; i<NTHREADS; i++) {
+	if (tids[i] >= 0)
+	    thread_join(tids[i], NULL);
     }
 
     printf("Parent has left.\n");